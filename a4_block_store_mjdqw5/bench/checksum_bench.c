@@ -0,0 +1,88 @@
+// Measures what block checksums cost on the read path.
+//  usage: checksum_bench [reads]
+//  Reads every block in use over and over, first with checksums off, then on, then on with the scrubber running,
+//  and prints the time per read of each and the raw CRC32C throughput.
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "block_store.h"
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// ns per block_store_read, over the blocks in ids
+static double time_reads(const block_store_t *bs, const size_t *ids, size_t count, size_t reads)
+{
+    uint8_t buffer[BLOCK_SIZE_BYTES];
+    size_t sink = 0;
+    double start = now_ns();
+    for (size_t i = 0; i < reads; i++)
+    {
+        sink += block_store_read(bs, ids[i % count], buffer);
+        sink += buffer[i % BLOCK_SIZE_BYTES];
+    }
+    double took = now_ns() - start;
+    if (sink == 0)
+    {
+        fprintf(stderr, "reads failed\n");
+    }
+    return took / reads;
+}
+
+int main(int argc, char **argv)
+{
+    size_t reads = argc > 1 ? strtoul(argv[1], NULL, 10) : 10000000;
+    if (reads == 0)
+    {
+        fprintf(stderr, "usage: %s [reads]\n", argv[0]);
+        return 1;
+    }
+    block_store_t *bs = block_store_create();
+    if (bs == NULL)
+    {
+        return 1;
+    }
+    size_t ids[BLOCK_STORE_NUM_BLOCKS], count = 0;
+    uint8_t block[BLOCK_SIZE_BYTES];
+    for (size_t block_id; (block_id = block_store_allocate(bs)) != SIZE_MAX;)
+    {
+        for (size_t i = 0; i < BLOCK_SIZE_BYTES; i++)
+        {
+            block[i] = (uint8_t)(block_id * 31 + i);
+        }
+        block_store_write(bs, block_id, block);
+        ids[count++] = block_id;
+    }
+
+    double off = time_reads(bs, ids, count, reads);
+    block_store_checksums(bs, true);
+    double on = time_reads(bs, ids, count, reads);
+    block_store_scrub_start(bs, 100000);
+    double scrubbing = time_reads(bs, ids, count, reads);
+    block_store_scrub_stop(bs);
+
+    uint8_t data[1 << 16];
+    memset(data, 0x5A, sizeof(data));
+    uint32_t crc = 0;
+    size_t rounds = 2000;
+    double start = now_ns();
+    for (size_t i = 0; i < rounds; i++)
+    {
+        crc = block_store_crc32c(crc, data, sizeof(data));
+    }
+    double crc_ns = now_ns() - start;
+
+    block_store_checksum_stats_t stats;
+    block_store_checksum_stats(bs, &stats);
+    printf("%-22s %8.1f ns/read\n", "checksums off", off);
+    printf("%-22s %8.1f ns/read  (+%.0f%%)\n", "checksums on", on, 100 * (on - off) / off);
+    printf("%-22s %8.1f ns/read  (+%.0f%%, %zu blocks scrubbed)\n", "on, scrubber running", scrubbing,
+           100 * (scrubbing - off) / off, stats.scrubbed);
+    printf("%-22s %8.2f GB/s  (crc %08x)\n", "crc32c", rounds * sizeof(data) / crc_ns, crc);
+    block_store_destroy(bs);
+    return stats.mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,106 @@
+// Measures how throughput changes with the block size.
+//  usage: geometry_bench [MiB] [backend]
+//    MiB      device size, the same for every block size (default 64)
+//    backend  heap, ram, file or mmap (default heap); file and mmap use geometry_bench.img in the working directory
+//  For each block size from 512 B to 64 KiB, writes and then reads every block in order, then reads and writes
+//  as many blocks at random ids, and prints MB/s and operations per second of each.
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "block_store.h"
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// xorshift64, the ids only have to be spread out
+static uint64_t next_random(uint64_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+static block_store_backend_t make_backend(const char *name)
+{
+    if (strcmp(name, "ram") == 0)
+    {
+        return block_store_backend_memory(BLOCK_STORE_BACKEND_RAM, BLOCK_STORE_HUGE_PAGES, -1);
+    }
+    if (strcmp(name, "file") == 0 || strcmp(name, "mmap") == 0)
+    {
+        unlink("geometry_bench.img");
+        return name[0] == 'f' ? block_store_backend_file("geometry_bench.img") : block_store_backend_mmap("geometry_bench.img");
+    }
+    return block_store_backend_memory(BLOCK_STORE_BACKEND_HEAP, 0, -1);
+}
+
+// ns for one pass of block_store_read or block_store_write over ids (in order when ids is NULL)
+static double time_pass(block_store_t *bs, bool write, const size_t *ids, size_t count, size_t first, uint8_t *buffer)
+{
+    size_t sink = 0;
+    double start = now_ns();
+    for (size_t i = 0; i < count; i++)
+    {
+        size_t block_id = ids ? ids[i] : first + i;
+        sink += write ? block_store_write(bs, block_id, buffer) : block_store_read(bs, block_id, buffer);
+    }
+    double took = now_ns() - start;
+    if (sink == 0)
+    {
+        fprintf(stderr, "%s failed\n", write ? "writes" : "reads");
+    }
+    return took;
+}
+
+int main(int argc, char **argv)
+{
+    size_t mib = argc > 1 ? strtoul(argv[1], NULL, 10) : 64;
+    const char *backend = argc > 2 ? argv[2] : "heap";
+    if (mib == 0)
+    {
+        fprintf(stderr, "usage: %s [MiB] [heap|ram|file|mmap]\n", argv[0]);
+        return 1;
+    }
+    printf("%s backend, %zu MiB device\n", backend, mib);
+    printf("%-8s %10s %10s %10s %10s %12s %12s\n", "block", "seq write", "seq read", "rand read", "rand write", "rand read", "rand write");
+    printf("%-8s %10s %10s %10s %10s %12s %12s\n", "", "MB/s", "MB/s", "MB/s", "MB/s", "ops/s", "ops/s");
+    for (size_t block_size = 512; block_size <= BLOCK_STORE_MAX_BLOCK_SIZE; block_size *= 2)
+    {
+        // the map goes up front so the blocks after it run in order
+        block_store_geometry_t geometry = {block_size, (mib << 20) / block_size, 0};
+        block_store_t *bs = block_store_create_geometry(&geometry, make_backend(backend));
+        uint8_t *buffer = (uint8_t *)malloc(block_size);
+        if (bs == NULL || buffer == NULL)
+        {
+            fprintf(stderr, "could not make a %zu MiB device of %zu B blocks\n", mib, block_size);
+            return 1;
+        }
+        memset(buffer, 0xA5, block_size);
+        size_t first = block_store_allocate(bs), count = geometry.block_count - first;
+        size_t *ids = (size_t *)malloc(count * sizeof(size_t));
+        uint64_t state = 0x9E3779B97F4A7C15ull;
+        for (size_t i = 0; i < count; i++)
+        {
+            ids[i] = first + next_random(&state) % count;
+        }
+
+        double bytes = (double)count * block_size;
+        double seq_write = time_pass(bs, true, NULL, count, first, buffer);
+        double seq_read = time_pass(bs, false, NULL, count, first, buffer);
+        double rand_read = time_pass(bs, false, ids, count, first, buffer);
+        double rand_write = time_pass(bs, true, ids, count, first, buffer);
+        printf("%-8zu %10.0f %10.0f %10.0f %10.0f %12.0f %12.0f\n", block_size, bytes * 1e3 / seq_write, bytes * 1e3 / seq_read,
+               bytes * 1e3 / rand_read, bytes * 1e3 / rand_write, count * 1e9 / rand_read, count * 1e9 / rand_write);
+        free(ids);
+        free(buffer);
+        block_store_destroy(bs);
+    }
+    unlink("geometry_bench.img");
+    return 0;
+}
@@ -0,0 +1,191 @@
+// Replays a trace made by block_store_backend_record against a backend and reports throughput and latency.
+//  Record one by making the device with block_store_create_on(block_store_backend_record(backend, file)), or an FS
+//  workload with fs_trace of the a5 file system.
+//  usage: trace_replay trace [backend] [speed]
+//    backend  heap, ram, file or mmap (default heap); file and mmap use trace_replay.img in the working directory
+//    speed    0 to make the calls back to back (default), 1 to keep the recorded gaps between them, 2 for half the gaps, ...
+//  Writes carry a fixed pattern, the trace does not keep what was written. Calls that come out differently from
+//  the recording (a read of a block the backend does not have, say) are counted as mismatches.
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "block_store.h"
+
+static const char *op_names[] = {"", "open", "read", "write", "allocate", "release", "flush", "close"};
+#define OP_COUNT (sizeof(op_names) / sizeof(op_names[0]))
+
+// latencies of one kind of call, replayed and recorded
+typedef struct {
+    uint64_t *nanos;
+    size_t count, capacity;
+    uint64_t recorded_nanos;
+} op_times_t;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static block_store_backend_t make_backend(const char *name)
+{
+    if (strcmp(name, "ram") == 0)
+    {
+        return block_store_backend_memory(BLOCK_STORE_BACKEND_RAM, BLOCK_STORE_HUGE_PAGES, -1);
+    }
+    if (strcmp(name, "file") == 0 || strcmp(name, "mmap") == 0)
+    {
+        unlink("trace_replay.img");
+        return name[0] == 'f' ? block_store_backend_file("trace_replay.img") : block_store_backend_mmap("trace_replay.img");
+    }
+    return block_store_backend_memory(BLOCK_STORE_BACKEND_HEAP, 0, -1);
+}
+
+static int compare_nanos(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+// the latency no more than percent of the calls took longer than, times must be sorted
+static uint64_t percentile(const op_times_t *times, double percent)
+{
+    size_t rank = (size_t)(percent / 100 * times->count);
+    return times->nanos[rank < times->count ? rank : times->count - 1];
+}
+
+// sleeps until the call recorded at start_ns is due
+static void wait_for(uint64_t replay_start, uint64_t start_ns, double speed)
+{
+    uint64_t due = replay_start + (uint64_t)(start_ns / speed), now = now_ns();
+    if (due > now)
+    {
+        struct timespec gap = {(time_t)((due - now) / 1000000000u), (long)((due - now) % 1000000000u)};
+        nanosleep(&gap, NULL);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    FILE *in = argc > 1 ? fopen(argv[1], "rb") : NULL;
+    const char *backend_name = argc > 2 ? argv[2] : "heap";
+    double speed = argc > 3 ? strtod(argv[3], NULL) : 0;
+    if (in == NULL || speed < 0)
+    {
+        fprintf(stderr, "usage: %s trace [heap|ram|file|mmap] [speed]\n", argv[0]);
+        return 1;
+    }
+
+    block_store_backend_t backend = make_backend(backend_name);
+    if (backend.ops == NULL)
+    {
+        fprintf(stderr, "could not set up the %s backend\n", backend_name);
+        return 1;
+    }
+    op_times_t times[OP_COUNT];
+    memset(times, 0, sizeof(times));
+    block_store_trace_record_t record;
+    memset(&record, 0, sizeof(record));
+    uint8_t *buffer = NULL;
+    size_t block_size = 0, mismatches = 0, calls = 0;
+    uint64_t bytes = 0, recorded_span = 0, replay_start = now_ns();
+    bool opened = false, closed = false;
+    int got = 0;
+    while (!closed && (got = block_store_trace_read(in, &record)) == 1)
+    {
+        if (speed > 0)
+        {
+            wait_for(replay_start, record.start_ns, speed);
+        }
+        if (!opened && record.op != BLOCK_STORE_TRACE_OPEN)
+        {
+            fprintf(stderr, "%s: the trace does not start with an open\n", argv[1]);
+            return 1;
+        }
+        bool ok = true;
+        uint64_t start = now_ns();
+        switch (record.op)
+        {
+        case BLOCK_STORE_TRACE_OPEN:
+            block_size = record.block_size;
+            buffer = (uint8_t *)malloc(block_size);
+            if (opened || buffer == NULL || !(ok = backend.ops->open(backend.state, block_size, record.block_count)))
+            {
+                fprintf(stderr, "could not open a %s backend of %zu blocks of %zu B\n", backend_name, (size_t)record.block_count, block_size);
+                return 1;
+            }
+            memset(buffer, 0xA5, block_size);
+            opened = true;
+            break;
+        case BLOCK_STORE_TRACE_READ:
+            ok = backend.ops->read(backend.state, record.block_id, buffer) == block_size;
+            bytes += ok ? block_size : 0;
+            break;
+        case BLOCK_STORE_TRACE_WRITE:
+            ok = backend.ops->write(backend.state, record.block_id, buffer) == block_size;
+            bytes += ok ? block_size : 0;
+            break;
+        case BLOCK_STORE_TRACE_ALLOCATE:
+            ok = backend.ops->allocate(backend.state, record.block_id);
+            break;
+        case BLOCK_STORE_TRACE_RELEASE:
+            backend.ops->release(backend.state, record.block_id);
+            break;
+        case BLOCK_STORE_TRACE_FLUSH:
+            ok = backend.ops->flush(backend.state);
+            break;
+        default: // close, the backend is closed once the report is out
+            closed = true;
+            continue;
+        }
+        uint64_t took = now_ns() - start;
+        op_times_t *op = &times[record.op];
+        if (op->count == op->capacity)
+        {
+            op->capacity = op->capacity ? op->capacity * 2 : 1024;
+            op->nanos = (uint64_t *)realloc(op->nanos, op->capacity * sizeof(uint64_t));
+        }
+        op->nanos[op->count++] = took;
+        op->recorded_nanos += record.nanos;
+        mismatches += ok != record.ok;
+        recorded_span = record.start_ns + record.nanos;
+        calls++;
+    }
+    uint64_t elapsed = now_ns() - replay_start;
+    fclose(in);
+    if (!closed && got < 0)
+    {
+        fprintf(stderr, "%s: not a trace, or cut short after %zu calls\n", argv[1], calls);
+        backend.ops->close(backend.state);
+        return 1;
+    }
+
+    printf("%s: %zu calls replayed on %s in %.3f ms (recorded over %.3f ms), %zu mismatches\n", argv[1], calls, backend_name,
+           elapsed / 1e6, recorded_span / 1e6, mismatches);
+    printf("%.0f calls/s, %.1f MB/s\n", calls * 1e9 / elapsed, bytes * 1e3 / elapsed);
+    printf("%-9s %10s %12s %10s %10s %10s %12s\n", "call", "count", "mean ns", "p50 ns", "p99 ns", "max ns", "recorded ns");
+    for (size_t op = BLOCK_STORE_TRACE_OPEN; op < OP_COUNT; op++)
+    {
+        op_times_t *t = &times[op];
+        if (t->count == 0)
+        {
+            continue;
+        }
+        uint64_t total = 0;
+        for (size_t i = 0; i < t->count; i++)
+        {
+            total += t->nanos[i];
+        }
+        qsort(t->nanos, t->count, sizeof(uint64_t), compare_nanos);
+        printf("%-9s %10zu %12.0f %10llu %10llu %10llu %12.0f\n", op_names[op], t->count, (double)total / t->count,
+               (unsigned long long)percentile(t, 50), (unsigned long long)percentile(t, 99),
+               (unsigned long long)t->nanos[t->count - 1], (double)t->recorded_nanos / t->count);
+        free(t->nanos);
+    }
+    backend.ops->close(backend.state);
+    free(buffer);
+    unlink("trace_replay.img");
+    return 0;
+}
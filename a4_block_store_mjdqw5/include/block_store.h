@@ -6,8 +6,10 @@ extern "C"
 {
 #endif
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 // Constants
 #define BLOCK_SIZE_BYTES 32         // 2^5 BYTES per block
@@ -31,6 +33,175 @@ extern "C"
 	///
 	block_store_t *block_store_create();
 
+	typedef struct {
+		const char *backend; // the backend's name: "heap", "ram", "file", "mmap", "trace", ...
+		const char *pages;   // what backs the blocks: "normal", "transparent" (huge pages asked for with madvise), "hugetlb" or "file"
+		size_t mapped_bytes; // memory set aside for the blocks, 0 for the file backend
+		int numa_node;       // the node they are bound to, -1 for none
+	} block_store_backend_info_t;
+
+	// A backend keeps the blocks of a device, the device above it does the free block map, checksums and locking
+	//  It is set up with its own options, then open sizes it for the device it ends up under
+	//  Every other call moves or concerns one whole block, block ids it does not have fail
+	//  Backends stack: one can keep its own backend in its state and pass the calls on, as the tracing one does
+	typedef struct {
+		const char *name;
+		bool (*open)(void *const state, const size_t block_size, const size_t block_count); // called once, by the device being made
+		size_t (*read)(void *const state, const size_t block_id, void *buffer);        // bytes read, 0 on error
+		size_t (*write)(void *const state, const size_t block_id, const void *buffer); // bytes written, 0 on error
+		bool (*allocate)(void *const state, const size_t block_id); // the device took the block into use, false to refuse it
+		void (*release)(void *const state, const size_t block_id);  // the device gave the block back
+		bool (*flush)(void *const state);  // makes every write so far durable
+		void (*close)(void *const state);  // frees the state
+		void (*info)(void *const state, block_store_backend_info_t *const info); // fills in all but the name
+	} block_store_ops_t;
+
+	typedef struct {
+		const block_store_ops_t *ops; // NULL for a backend that could not be set up
+		void *state;
+	} block_store_backend_t;
+
+	///
+	/// Creates a new BS device on the given backend, with the default geometry
+	///   A backend that holds a device already (its map blocks are not all zeros) brings it back as it was
+	/// \param backend The backend, the device owns it from here on and closes it when destroyed (or on error)
+	/// \return Pointer to a new block storage device, NULL on error
+	///
+	block_store_t *block_store_create_on(const block_store_backend_t backend);
+
+	// how a device is laid out, see block_store_create_geometry
+	typedef struct {
+		size_t block_size;   // bytes per block, a power of two from BLOCK_STORE_MIN_BLOCK_SIZE to BLOCK_STORE_MAX_BLOCK_SIZE; 0 for BLOCK_SIZE_BYTES
+		size_t block_count;  // up to BLOCK_STORE_MAX_BLOCKS; 0 for BLOCK_STORE_NUM_BLOCKS
+		size_t bitmap_start; // first of the blocks holding the free block map (a bit per block), BLOCK_STORE_BITMAP_DEFAULT for a quarter of the way in less one
+	} block_store_geometry_t;
+
+	#define BLOCK_STORE_MIN_BLOCK_SIZE BLOCK_SIZE_BYTES
+	#define BLOCK_STORE_MAX_BLOCK_SIZE 65536
+	#define BLOCK_STORE_MAX_BLOCKS ((size_t)1 << 32)
+	#define BLOCK_STORE_BITMAP_DEFAULT SIZE_MAX
+	#define BLOCK_STORE_DEFAULT_GEOMETRY {BLOCK_SIZE_BYTES, BLOCK_STORE_NUM_BLOCKS, BITMAP_START_BLOCK}
+
+	///
+	/// Creates a new BS device of the given geometry on the given backend
+	///   The block buffers given to block_store_read and block_store_write hold block_size bytes
+	///   A backend that holds a device already has to be given the geometry that device was made with
+	/// \param geometry The geometry, NULL for BLOCK_STORE_DEFAULT_GEOMETRY
+	/// \param backend The backend, the device owns it from here on and closes it when destroyed (or on error)
+	/// \return Pointer to a new block storage device, NULL on error or for a geometry that does not work
+	///
+	block_store_t *block_store_create_geometry(const block_store_geometry_t *const geometry, const block_store_backend_t backend);
+
+	///
+	/// Reports the geometry a device was made with
+	/// \param bs BS device
+	/// \param geometry Where to put it, with the defaults filled in
+	/// \return true on success
+	///
+	bool block_store_get_geometry(const block_store_t *const bs, block_store_geometry_t *const geometry);
+
+	// where block_store_backend_memory keeps the blocks
+	typedef enum {
+		BLOCK_STORE_BACKEND_HEAP, // calloc'd, what block_store_create uses
+		BLOCK_STORE_BACKEND_RAM,  // an anonymous mapping of its own, for scratch devices that want huge pages or a NUMA node
+	} block_store_backend_type_t;
+
+	// block_store_backend_memory flags, RAM backend only
+	#define BLOCK_STORE_HUGE_PAGES 0x01 // reserved huge pages (MAP_HUGETLB) if there are any, else transparent ones (MADV_HUGEPAGE); rounds the mapping up to whole huge pages
+	#define BLOCK_STORE_NUMA_BIND 0x02  // bind the blocks to numa_node
+
+	///
+	/// Sets up a backend that keeps the blocks in memory
+	/// \param type BLOCK_STORE_BACKEND_HEAP or BLOCK_STORE_BACKEND_RAM
+	/// \param flags BLOCK_STORE_HUGE_PAGES, BLOCK_STORE_NUMA_BIND or 0
+	/// \param numa_node The node to bind to, ignored without BLOCK_STORE_NUMA_BIND
+	/// \return The backend, its ops are NULL on error (including a node that cannot be bound to)
+	///
+	block_store_backend_t block_store_backend_memory(const block_store_backend_type_t type, const int flags, const int numa_node);
+
+	///
+	/// Same as block_store_create_on(block_store_backend_memory(type, flags, numa_node))
+	///
+	block_store_t *block_store_create_backend(const block_store_backend_type_t type, const int flags, const int numa_node);
+
+	///
+	/// Sets up a backend that keeps the blocks in a file the size of the device, read and written a block at a time with pread/pwrite
+	///   The file is laid out like a block_store_serialize image, an existing one is used as is
+	/// \param filename The file, created if it does not exist
+	/// \return The backend, its ops are NULL on error
+	///
+	block_store_backend_t block_store_backend_file(const char *const filename);
+
+	///
+	/// Sets up a backend that keeps the blocks in a file like block_store_backend_file, but mapped shared
+	/// \param filename The file, created if it does not exist
+	/// \return The backend, its ops are NULL on error
+	///
+	block_store_backend_t block_store_backend_mmap(const char *const filename);
+
+	///
+	/// Wraps a backend so each call to it is logged as a line of text: the call, the block id and what it returned
+	/// \param inner The backend to trace, closed along with this one
+	/// \param log Where the lines go, left open
+	/// \return The backend, its ops are NULL on error (inner is closed then too)
+	///
+	block_store_backend_t block_store_backend_trace(const block_store_backend_t inner, FILE *const log);
+
+	// the calls block_store_backend_record logs
+	typedef enum {
+		BLOCK_STORE_TRACE_NONE, // in a zeroed record, before the first call is read
+		BLOCK_STORE_TRACE_OPEN,
+		BLOCK_STORE_TRACE_READ,
+		BLOCK_STORE_TRACE_WRITE,
+		BLOCK_STORE_TRACE_ALLOCATE,
+		BLOCK_STORE_TRACE_RELEASE,
+		BLOCK_STORE_TRACE_FLUSH,
+		BLOCK_STORE_TRACE_CLOSE
+	} block_store_trace_op_t;
+
+	// one call out of a trace, see block_store_trace_read
+	typedef struct {
+		block_store_trace_op_t op;
+		bool ok;              // it succeeded: the block moved or taken, the open or flush done; release and close always do
+		uint64_t start_ns;    // when it was made, in ns since the backend was set up
+		uint64_t nanos;       // how long it took
+		uint64_t block_id;    // the block, for read, write, allocate and release
+		uint64_t block_size;  // open only
+		uint64_t block_count; // open only
+	} block_store_trace_record_t;
+
+	///
+	/// Wraps a backend so each call to it is logged in a compact binary trace, with when it was made and how long it took
+	///   Block contents are not kept; replay a trace with block_store_trace_read and the ops of any backend
+	/// \param inner The backend to record, closed along with this one
+	/// \param out Where the trace goes, left open
+	/// \return The backend, its ops are NULL on error (inner is closed then too)
+	///
+	block_store_backend_t block_store_backend_record(const block_store_backend_t inner, FILE *const out);
+
+	///
+	/// Reads the next call from a trace made by block_store_backend_record
+	/// \param in The trace
+	/// \param record The call read; zero it before the first call, after that it must hold the previous one
+	/// \return 1 for a call, 0 at the end of the trace, -1 if it is not a trace or is cut short
+	///
+	int block_store_trace_read(FILE *const in, block_store_trace_record_t *const record);
+
+	///
+	/// Reports where a device keeps its blocks
+	/// \param bs BS device
+	/// \param info Where to put it
+	/// \return true on success
+	///
+	bool block_store_backend_info(const block_store_t *const bs, block_store_backend_info_t *const info);
+
+	///
+	/// Makes every write to the device so far durable in its backend
+	/// \param bs BS device
+	/// \return true on success
+	///
+	bool block_store_flush(block_store_t *const bs);
+
 	///
 	/// Destroys the provided block storage device
 	/// This is an idempotent operation, so there is no return value
@@ -77,6 +248,7 @@ extern "C"
 	///
 	/// Returns the total number of user-addressable blocks
 	///  (since this is constant, you don't even need the bs object)
+	///  This is for the default geometry, see block_store_get_geometry for the others
 	/// \return Total blocks
 	///
 	size_t block_store_get_total_blocks();
@@ -101,6 +273,7 @@ extern "C"
 
 	///
 	/// Imports BS device from the given file - for grads/bonus
+	///   The file holds no geometry, the device gets the default one
 	/// \param filename The file to load
 	/// \return Pointer to new BS device, NULL on error
 	///
@@ -114,6 +287,81 @@ extern "C"
 	///
 	size_t block_store_serialize(const block_store_t *const bs, const char *const filename);
 
+	// block_store_export flags
+	#define BLOCK_STORE_EXPORT_RLE 0x01 // run-length encode the blocks that get smaller from it
+
+	///
+	/// Writes only the blocks in use to file, in a compact format read back by block_store_import
+	///   The file holds the geometry and the free block map, then each block in use (optionally run-length encoded), then an index of their lengths
+	///   Blocks are streamed out one at a time, the whole image is never put together in memory
+	///   With checksums on, the index also carries each block's CRC32C, and a block that fails its check fails the export
+	/// \param bs BS device
+	/// \param filename The file to write to, overwritten if it exists
+	/// \param flags BLOCK_STORE_EXPORT_RLE or 0
+	/// \return Number of bytes written, 0 on error
+	///
+	size_t block_store_export(const block_store_t *const bs, const char *const filename, const int flags);
+
+	///
+	/// Imports a BS device written by block_store_export
+	///   Only the free block map and the index are read right away, each block is read in the first time it is used
+	///   The file has to stay in place until the device is destroyed
+	/// \param filename The file to load
+	/// \return Pointer to new BS device, NULL on error
+	///
+	block_store_t *block_store_import(const char *const filename);
+
+	///
+	/// Computes the CRC32C (Castagnoli) of a buffer, with the SSE4.2 crc32 instruction when the CPU has it
+	/// \param crc The CRC32C of the data before this buffer, 0 to start
+	/// \param data The buffer
+	/// \param length Number of bytes in data
+	/// \return The CRC32C of everything so far
+	///
+	uint32_t block_store_crc32c(uint32_t crc, const void *const data, const size_t length);
+
+	///
+	/// Turns per-block CRC32C checksums on or off
+	///   While on, every write updates the block's checksum and every read checks it, a block that no longer matches fails to read
+	///   The checksums are kept in memory beside the blocks; block_store_export stores them with each block and block_store_import takes them back
+	/// \param bs BS device
+	/// \param enable true to turn them on, this computes the checksum of every block
+	/// \return true on success
+	///
+	bool block_store_checksums(block_store_t *const bs, const bool enable);
+
+	typedef struct {
+		size_t verified;   // blocks checked against their checksum, by reads and by the scrubber
+		size_t mismatches; // of those, the ones that did not match
+		size_t scrubbed;   // blocks checked by the scrubber
+		size_t passes;     // times the scrubber went over every block in use
+	} block_store_checksum_stats_t;
+
+	///
+	/// Copies out the checksum counters
+	/// \param bs BS device
+	/// \param stats Where to put them
+	/// \return true on success
+	///
+	bool block_store_checksum_stats(const block_store_t *const bs, block_store_checksum_stats_t *const stats);
+
+	///
+	/// Starts a background thread that keeps checking the blocks in use against their checksums
+	///   It checks one block at a time and pauses between blocks, so it never uses more than blocks_per_second
+	///   Mismatches are only counted, see block_store_checksum_stats
+	/// \param bs BS device, with checksums on
+	/// \param blocks_per_second Rate limit
+	/// \return true if the scrubber was started, false if checksums are off or it is already running
+	///
+	bool block_store_scrub_start(block_store_t *const bs, const size_t blocks_per_second);
+
+	///
+	/// Stops the scrubber and waits for it to finish, if it is running
+	///   block_store_destroy and turning checksums off stop it too
+	/// \param bs BS device
+	///
+	void block_store_scrub_stop(block_store_t *const bs);
+
 #ifdef __cplusplus
 }
 #endif
@@ -104,10 +104,14 @@ size_t bitmap_ffz(const bitmap_t *const bitmap)
     if (bitmap) 
     {
         size_t result = 0;
+        // Full bytes hold no zero, skip them whole so a big, mostly used map is not walked a bit at a time
+        for (; result / 8 < bitmap->byte_count && bitmap->data[result / 8] == 0xFF; result += 8) 
+        {
+        }
         for (; result < bitmap->bit_count && bitmap_test(bitmap, result); ++result) 
         {
         }
-        return (result == bitmap->bit_count ? SIZE_MAX : result);
+        return (result >= bitmap->bit_count ? SIZE_MAX : result);
     }
     return SIZE_MAX;
 }
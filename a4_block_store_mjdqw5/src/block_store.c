@@ -1,254 +1,973 @@
-#include <stdio.h>
-#include <stdint.h>
-#include "bitmap.h"
-#include "block_store.h"
-// include more if you need
-#include <string.h>
-#include <fcntl.h>
-#include <unistd.h>
-
-// You might find this handy.  I put it around unused parameters, but you should
-// remove it before you submit. Just allows things to compile initially.
-#define UNUSED(x) (void)(x)
-
-/** GIVEN CONSTANTS 
-    #define BLOCK_STORE_NUM_BLOCKS 512  
-    #define BLOCK_SIZE_BYTES 32         // 2^5 BYTES per block
-    #define BITMAP_SIZE_BITS BLOCK_STORE_NUM_BLOCKS
-    #define BITMAP_SIZE_BYTES (BITMAP_SIZE_BITS / 8)
-    #define BLOCK_STORE_NUM_BYTES (BLOCK_STORE_NUM_BLOCKS * BLOCK_SIZE_BYTES)
-    #define BITMAP_START_BLOCK 127
-    #define BITMAP_NUM_BLOCKS (BITMAP_SIZE_BYTES/BLOCK_SIZE_BYTES)
-*/
-
-// create a new struct that holds an array of bytes
-// using this struct along with block_store struct allows us to treat data like a 2D array
-typedef struct block{
-    uint8_t block_bytes[BLOCK_SIZE_BYTES];
-}block_t; 
-
-typedef struct block_store{
-    bitmap_t*fbm; // keeps track of block in use 
-    block_t num_blocks[BLOCK_STORE_NUM_BLOCKS];
-}block_store_t; 
-
-
-
-block_store_t *block_store_create(){
-    block_store_t*bs = (block_store_t*)calloc(1, sizeof(block_store_t)); // allocate memory block for block store
-    if (!bs){ // alloc check 
-        return NULL;
-    }
-    // bs->fbm = bitmap_create(BLOCK_STORE_NUM_BLOCKS); // create bitmap space with size of available bs blocks 
-    // create a bitmap with 512 bits, each representing a block, and set starting point at 127
-    bs->fbm = bitmap_overlay(BITMAP_SIZE_BITS, &(bs->num_blocks[BITMAP_START_BLOCK]));
-    if (bs->fbm == NULL){ // check for failed bitmap create
-        return NULL;
-    }
-    // store fbm starting in block 127/128
-    bitmap_set(bs->fbm, 127);
-    bitmap_set(bs->fbm, 128);
-    // size_t i = 0; 
-    // while (i < BITMAP_SIZE_BYTES){ 
-    //     if ((i >= BITMAP_START_BLOCK + BITMAP_NUM_BLOCKS) || (int)i < BITMAP_START_BLOCK){ 
-    //         bitmap_reset(bs->fbm, i); 
-    //     }
-    //     i++;
-    // }
-    return bs; // return block store object 
-}
-
-void block_store_destroy(block_store_t *const bs){
-    if (!bs){ // param check
-        return; 
-    }
-    // destory bitmap object and free the block store device
-    bitmap_destroy(bs->fbm); 
-    free(bs);
-}
-
-size_t block_store_allocate(block_store_t *const bs){
-    if (bs && bs->num_blocks){ // param check
-        size_t ffz = bitmap_ffz(bs->fbm); // find first zero bit in free-block-map
-        if (ffz >= SIZE_MAX || ffz > BLOCK_STORE_NUM_BLOCKS){ // error check size of returned block 
-            return SIZE_MAX; 
-        }    
-        bitmap_set(bs->fbm, ffz); // else set ffz bit in fbm
-        return ffz; 
-    }
-    return SIZE_MAX; // else return SIZE_MAX on error 
-}
-
-/** Attempts to allocate the requested block id
-	\param bs the block store object
-	\param block_id the requested block identifier
-	\return boolean indicating succes of operation
-*/
-bool block_store_request(block_store_t *const bs, const size_t block_id){
-    
-    if (bs && block_id > 0 && block_id < BLOCK_STORE_NUM_BLOCKS){ // check params  
-        if (bitmap_test(bs->fbm, block_id) == 1){ // check if bit is already set
-            return false; 
-        } // if bit is not set
-        bitmap_set(bs->fbm, block_id); // set block bit at block_id
-        if (bitmap_test(bs->fbm, block_id) == 0){ // check bit again after setting to ensure it was set correctly 
-            return false; // if the current block wasn't set, return false
-        } 
-        return true;
-    }
-    return false;
-}
-
-/* Frees the specified block */
-void block_store_release(block_store_t *const bs, const size_t block_id){ 
-    if (bs && block_id < BLOCK_STORE_NUM_BLOCKS){ // param check 
-        if (bitmap_test(bs->fbm, block_id) == 0){ // check if block that block_id is at is free
-            return;
-        }
-        bitmap_reset(bs->fbm, block_id); // if block isn't free, reset block value (1 -> 0)
-        return;
-    }
-    return; 
-}
-
-size_t block_store_get_used_blocks(const block_store_t *const bs){
-    if (bs){ // param check
-        size_t blocks_set = bitmap_total_set(bs->fbm); // count total # of bits in fbm
-        return blocks_set; // return total # of bits
-    } // else if theres no block storage device
-    return SIZE_MAX; // return SIZE_MAX 
-}
-
-size_t block_store_get_free_blocks(const block_store_t *const bs){
-    if (bs){ // param check
-        bitmap_invert(bs->fbm); // flip all bits 
-        // get the total # of set bits now that all bits are flipped 
-        // bitmap_total_set() can only get SET blocks, thus temporarily flip bits so that bit = 1 means its free
-        size_t blocks_free = bitmap_total_set(bs->fbm);
-        bitmap_invert(bs->fbm); // flip bits back to correct values 
-        return blocks_free; // return counted bits
-    } // else if theres no block store device
-    return SIZE_MAX; // return SIZE_MAX 
-}
-
-size_t block_store_get_total_blocks(){
-    return BLOCK_STORE_NUM_BLOCKS; // return total blocks
-}
-
-/** Reads data from the specified block and writes it to the designated buffer
- \param bs BS device
- \param block_id Source block id
- \param buffer Data buffer to write to
- \return Number of bytes read, 0 on error
-*/
-size_t block_store_read(const block_store_t *const bs, const size_t block_id, void *buffer){
-    if (bs && block_id <= BLOCK_STORE_NUM_BYTES && buffer){ // param check
-        // copy data from specified (from block_id) in block-store device into buffer | copy 32 bytes into buffer at a time
-        int*copy_data = memcpy(buffer, bs->num_blocks[block_id].block_bytes, BLOCK_SIZE_BYTES); 
-        if (!copy_data){
-            return 0; // return 0 if copy fails
-        }
-        return BLOCK_SIZE_BYTES; // return the # of bytes read
-    }
-    return 0; 
-}
-
-/** Reads data from the specified buffer and writes it to the designated block
- \param bs BS device
- \param block_id Destination block id
- \param buffer Data buffer to read from
- \return Number of bytes written, 0 on error
-*/
-size_t block_store_write(block_store_t *const bs, const size_t block_id, const void *buffer){
-    if (bs && block_id < BLOCK_STORE_NUM_BYTES && buffer){ // check params
-        // write data from buffer into block-store device at specified block_id location
-        int*copy_data = memcpy(bs->num_blocks[block_id].block_bytes, buffer, BLOCK_SIZE_BYTES);
-        if(!copy_data){
-            return 0; // if copy failed return 0
-        }
-        return BLOCK_SIZE_BYTES; // else return the # of bytes written
-    }
-    return 0; 
-}
-
-/* ---- EXTRA CREDIT ---- */
-
-/** Imports BS device from the given file - for grads/bonus
-    \param filename The file to load
-    \return Pointer to new BS device, NULL on error
-*/
-block_store_t *block_store_deserialize(const char *const filename){
-    if (filename){
-        // block_store_t*bs = block_store_create();
-        block_store_t*bs = (block_store_t*)malloc(sizeof(block_store_t));
-        if (bs == NULL){
-            return NULL;
-        }
-    
-        int fd = open(filename, O_RDONLY);
-        if (fd < 0){
-            return NULL;
-        }
-
-        // ssize_t buff = sizeof(block_t)*BLOCK_STORE_NUM_BLOCKS;
-        // read up to 512 bytes from file, into the block store device
-        ssize_t read_bytes = read(fd, bs, BLOCK_STORE_NUM_BYTES);
-        if (read_bytes < 0){ // check if read failed
-                close(fd);
-                return NULL;
-            }
-        
-        // allocate memory for data to be stored ;
-        // **bs->num_blocks = (char*)malloc((BLOCK_STORE_NUM_BLOCKS - 1) * BLOCK_STORE_NUM_BLOCKS * sizeof(char));
-        // read(fd, **bs->data, (BLOCK_STORE_NUM_BLOCKS - 1) * BLOCK_STORE_NUM_BLOCKS);
-        
-        // copy block data from bitmap, stored at the bitmap_start_block
-        bs->fbm = bitmap_import(BITMAP_SIZE_BITS, &(bs->num_blocks[BITMAP_START_BLOCK])); 
-        if (bs->fbm == NULL){ // check if data copied successfully
-            return NULL;    // if failed, return NULL
-        }
-        
-        int is_closed = close(fd); // close file 
-        if (is_closed < 0){ // check if file closed successfully 
-            return NULL;
-        }
-        return bs; // return block store device 
-    }
-    return NULL;
-}
-
-/** Writes the entirety of the BS device to file, overwriting it if it exists - for grads/bonus
- \param bs BS device
- \param filename The file to write to
- \return Number of bytes written, 0 on error
-*/ 
-size_t block_store_serialize(const block_store_t *const bs, const char *const filename){
-    if (bs && filename){
-        /* references: 
-            http://www.ss64.com/bash/chmod.html
-            https://stackoverflow.com/questions/15798450/open-with-o-creat-was-it-opened-or-created 
-            https://stackoverflow.com/questions/18415904/what-does-mode-t-0644-mean
-            
-            0x644:
-            * (owning) User: read & write
-            * Group: read
-            * Other: read               */
-
-        // open file in write only mode
-        // O_CREAT | O_TRUNC to return an error if the file already exists
-        int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644); // open file 
-        if (fd < 0){ // check if file opened succesfully 
-            return 0;
-        }
-        ssize_t write_bytes = write(fd, bs, BLOCK_STORE_NUM_BYTES); // 
-        if (write_bytes < 0){ // check write 
-            return 0;
-        }
-        int is_closed = close(fd); // close file
-        if (is_closed < 0){ // check if file closed successfully
-            return 0;
-        }
-        return write_bytes; // return written bytes 
-    }
-    return 0;
-}
\ No newline at end of file
+#include <stdio.h>
+#include <stdint.h>
+#include "bitmap.h"
+#include "block_store.h"
+// include more if you need
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <nmmintrin.h>
+#define BLOCK_CRC32C_HW 1 // the SSE4.2 crc32 instruction can be used, if the CPU has it
+#endif
+
+// You might find this handy.  I put it around unused parameters, but you should
+// remove it before you submit. Just allows things to compile initially.
+#define UNUSED(x) (void)(x)
+
+/** GIVEN CONSTANTS 
+    #define BLOCK_STORE_NUM_BLOCKS 512  
+    #define BLOCK_SIZE_BYTES 32         // 2^5 BYTES per block
+    #define BITMAP_SIZE_BITS BLOCK_STORE_NUM_BLOCKS
+    #define BITMAP_SIZE_BYTES (BITMAP_SIZE_BITS / 8)
+    #define BLOCK_STORE_NUM_BYTES (BLOCK_STORE_NUM_BLOCKS * BLOCK_SIZE_BYTES)
+    #define BITMAP_START_BLOCK 127
+    #define BITMAP_NUM_BLOCKS (BITMAP_SIZE_BYTES/BLOCK_SIZE_BYTES)
+*/
+
+typedef struct block_store{
+    bitmap_t*fbm; // keeps track of block in use, overlaid on map_blocks
+    // the geometry, fixed when the device is made, see block_store_create_geometry
+    size_t block_size; // bytes per block
+    size_t block_count;
+    size_t bitmap_start; // first of the blocks holding the map
+    size_t bitmap_blocks; // how many of them there are
+    uint8_t *map_blocks; // the blocks holding the map, kept here and written through to the backend
+    uint8_t *scratch; // three blocks to work in: a record read from an imported file, the block decoded from it, a block being checked
+    block_store_backend_t backend; // where the blocks live, see block_store_create_on
+    // a device made by block_store_import reads its blocks in from the file one at a time, as they are used
+    int image_fd; // the file they are read from, -1 once every block is in (or for any other device)
+    bitmap_t*image_pending; // blocks still only in the file
+    size_t image_left; // how many of them, the file is closed when this reaches 0
+    uint64_t *image_offset; // where each block starts in the file
+    uint32_t *image_length; // bytes it takes up there, block_size if it is stored as is
+    // optional CRC32C of every block, see block_store_checksums
+    bool checksums; // on: writes update checksum[], reads check it
+    uint32_t *checksum; // the checksum region, one per block, set up the first time checksums are turned on
+    block_store_checksum_stats_t stats;
+    // while checksums are on, the lock is held around every use of a block and of the map, so the scrubber can run alongside
+    pthread_mutex_t lock;
+    pthread_cond_t scrub_wake; // signalled to stop the scrubber early
+    pthread_t scrubber;
+    bool scrubbing; // the scrubber thread is running
+    bool scrub_stop; // it has been told to stop, under lock
+    struct timespec scrub_pause; // between two blocks it checks
+}block_store_t; 
+
+/* compact image written by block_store_export:
+    header  "BSX1", block size and block count (uint16 each)
+    the free block map, one bit per block
+    every block in use but the ones holding the map, in id order, as is or run-length encoded
+    index   the length of each of those blocks in the file (uint16 each), in the same order
+            ("BSC1" images: the length and then the CRC32C of the block, uint32)
+    footer  number of blocks stored (uint32), "BSXE"
+   all numbers little-endian; the index is at the end so the file can be written in one pass
+   "BSX2" and "BSC2" images are the same for a geometry that does not fit that header: block size (uint32),
+   block count and first block of the map (uint64 each) in the header, and uint32 lengths in the index */
+#define IMAGE_MAGIC "BSX1"
+#define IMAGE_CHECKSUM_MAGIC "BSC1" // same, but each index entry is followed by the block's CRC32C (uint32), written by a device with checksums on
+#define IMAGE_WIDE_MAGIC "BSX2"
+#define IMAGE_WIDE_CHECKSUM_MAGIC "BSC2"
+#define IMAGE_END_MAGIC "BSXE"
+#define IMAGE_HEADER_BYTES 8
+#define IMAGE_WIDE_HEADER_BYTES 24
+#define IMAGE_FOOTER_BYTES 8
+
+// takes the device lock while checksums are on, a device without them is only used from one thread
+void block_store_lock(const block_store_t *const bs){
+    if (bs->checksums){
+        pthread_mutex_lock(&((block_store_t*)bs)->lock);
+    }
+}
+
+void block_store_unlock(const block_store_t *const bs){
+    if (bs->checksums){
+        pthread_mutex_unlock(&((block_store_t*)bs)->lock);
+    }
+}
+
+// the blocks holding the free block map, served from map_blocks
+bool block_in_map(const block_store_t *const bs, const size_t block_id){
+    return block_id >= bs->bitmap_start && block_id < bs->bitmap_start + bs->bitmap_blocks;
+}
+
+// the blocks holding the free block map change under bitmap_set, they are left out of checksumming
+bool block_checksummed(const block_store_t *const bs, const size_t block_id){
+    return block_id < bs->block_count && !block_in_map(bs, block_id);
+}
+
+// writes the map block holding block_id's bit through to the backend, after the map changed
+bool block_store_map_sync(const block_store_t *const bs, const size_t block_id){
+    size_t map_block = block_id / (bs->block_size * 8);
+    return bs->backend.ops->write(bs->backend.state, bs->bitmap_start + map_block, bs->map_blocks + map_block * bs->block_size) == bs->block_size;
+}
+
+/** Fills in the defaults of a geometry and checks that a device can be made with it
+    \param geometry The geometry, 0 and BLOCK_STORE_BITMAP_DEFAULT fields are replaced by the defaults
+    \return true if it is valid
+*/
+bool block_store_geometry_check(block_store_geometry_t *const geometry){
+    if (geometry->block_size == 0){
+        geometry->block_size = BLOCK_SIZE_BYTES;
+    }
+    if (geometry->block_count == 0){
+        geometry->block_count = BLOCK_STORE_NUM_BLOCKS;
+    }
+    if (geometry->bitmap_start == BLOCK_STORE_BITMAP_DEFAULT){ // a quarter of the way in, less one: block 127 of 512
+        geometry->bitmap_start = geometry->block_count >= 4 ? geometry->block_count / 4 - 1 : 0;
+    }
+    size_t bits_per_block = geometry->block_size * 8;
+    size_t bitmap_blocks = (geometry->block_count + bits_per_block - 1) / bits_per_block;
+    return (geometry->block_size & (geometry->block_size - 1)) == 0
+        && geometry->block_size >= BLOCK_STORE_MIN_BLOCK_SIZE && geometry->block_size <= BLOCK_STORE_MAX_BLOCK_SIZE
+        && geometry->block_count <= BLOCK_STORE_MAX_BLOCKS && geometry->block_count > bitmap_blocks // room for the map and a block more
+        && geometry->bitmap_start <= geometry->block_count - bitmap_blocks;
+}
+
+block_store_t *block_store_create(){
+    return block_store_create_backend(BLOCK_STORE_BACKEND_HEAP, 0, -1);
+}
+
+block_store_t *block_store_create_backend(const block_store_backend_type_t type, const int flags, const int numa_node){
+    return block_store_create_on(block_store_backend_memory(type, flags, numa_node));
+}
+
+block_store_t *block_store_create_on(const block_store_backend_t backend){
+    return block_store_create_geometry(NULL, backend);
+}
+
+/** Creates a BS device of the given geometry on the given backend, bringing back the device it holds if it holds one
+    \param geometry The geometry, NULL for BLOCK_STORE_DEFAULT_GEOMETRY
+    \param backend The backend, owned by the device from here on
+    \return Pointer to a new block storage device, NULL on error
+*/
+block_store_t *block_store_create_geometry(const block_store_geometry_t *const geometry, const block_store_backend_t backend){
+    if (!backend.ops){
+        return NULL;
+    }
+    block_store_geometry_t checked = geometry ? *geometry : (block_store_geometry_t)BLOCK_STORE_DEFAULT_GEOMETRY;
+    block_store_t*bs = NULL;
+    if (!block_store_geometry_check(&checked) || !backend.ops->open(backend.state, checked.block_size, checked.block_count)
+        || !(bs = (block_store_t*)calloc(1, sizeof(block_store_t)))){ // allocate memory block for block store
+        backend.ops->close(backend.state);
+        return NULL;
+    }
+    bs->backend = backend;
+    bs->block_size = checked.block_size;
+    bs->block_count = checked.block_count;
+    bs->bitmap_start = checked.bitmap_start;
+    bs->bitmap_blocks = (bs->block_count + bs->block_size * 8 - 1) / (bs->block_size * 8);
+    bs->image_fd = -1;
+    pthread_mutex_init(&bs->lock, NULL);
+    pthread_cond_init(&bs->scrub_wake, NULL);
+    // create a bitmap with a bit per block, each representing a block, over the copy of the map's blocks (127/128 by default)
+    bs->map_blocks = (uint8_t*)calloc(bs->bitmap_blocks, bs->block_size);
+    bs->scratch = (uint8_t*)malloc(3 * bs->block_size);
+    bs->fbm = bs->map_blocks ? bitmap_overlay(bs->block_count, bs->map_blocks) : NULL;
+    bool loaded = bs->fbm != NULL && bs->scratch != NULL;
+    for (size_t i = 0; i < bs->bitmap_blocks && loaded; i++){
+        loaded = backend.ops->read(backend.state, bs->bitmap_start + i, bs->map_blocks + i * bs->block_size) == bs->block_size;
+    }
+    if (!loaded){ // check for failed bitmap create
+        block_store_destroy(bs);
+        return NULL;
+    }
+    // a fresh backend is all zeros, a device always has the map's own blocks in use
+    if (!bitmap_test(bs->fbm, bs->bitmap_start)){
+        for (size_t i = 0; i < bs->bitmap_blocks; i++){
+            bitmap_set(bs->fbm, bs->bitmap_start + i);
+        }
+        for (size_t i = 0; i < bs->bitmap_blocks && loaded; i++){
+            loaded = block_store_map_sync(bs, i * bs->block_size * 8);
+        }
+        if (!loaded){
+            block_store_destroy(bs);
+            return NULL;
+        }
+    }
+    return bs; // return block store object 
+}
+
+void block_store_destroy(block_store_t *const bs){
+    if (!bs){ // param check
+        return; 
+    }
+    block_store_scrub_stop(bs);
+    // destory bitmap object and free the block store device
+    bitmap_destroy(bs->fbm); 
+    if (bs->image_pending){ // imported and never fully read in
+        bitmap_destroy(bs->image_pending);
+        close(bs->image_fd);
+    }
+    pthread_mutex_destroy(&bs->lock);
+    pthread_cond_destroy(&bs->scrub_wake);
+    bs->backend.ops->close(bs->backend.state);
+    free(bs->map_blocks);
+    free(bs->scratch);
+    free(bs->image_offset);
+    free(bs->image_length);
+    free(bs->checksum);
+    free(bs);
+}
+
+/** Reports the geometry a device was made with
+    \param bs BS device
+    \param geometry Where to put it, with every default filled in
+    \return true on success
+*/
+bool block_store_get_geometry(const block_store_t *const bs, block_store_geometry_t *const geometry){
+    if (!bs || !geometry){
+        return false;
+    }
+    geometry->block_size = bs->block_size;
+    geometry->block_count = bs->block_count;
+    geometry->bitmap_start = bs->bitmap_start;
+    return true;
+}
+
+/** Reports where a device keeps its blocks
+    \param bs BS device
+    \param info Where to put it
+    \return true on success
+*/
+bool block_store_backend_info(const block_store_t *const bs, block_store_backend_info_t *const info){
+    if (!bs || !info){
+        return false;
+    }
+    info->backend = bs->backend.ops->name;
+    bs->backend.ops->info(bs->backend.state, info);
+    return true;
+}
+
+/** Makes every write to the device so far durable in its backend
+    \param bs BS device
+    \return true on success
+*/
+bool block_store_flush(block_store_t *const bs){
+    if (!bs){
+        return false;
+    }
+    block_store_lock(bs);
+    bool flushed = bs->backend.ops->flush(bs->backend.state);
+    block_store_unlock(bs);
+    return flushed;
+}
+
+size_t block_store_allocate(block_store_t *const bs){
+    if (bs){ // param check
+        block_store_lock(bs);
+        size_t ffz = bitmap_ffz(bs->fbm); // find first zero bit in free-block-map
+        if (ffz >= SIZE_MAX || ffz >= bs->block_count || !bs->backend.ops->allocate(bs->backend.state, ffz)){ // error check size of returned block, and whether the backend takes it
+            block_store_unlock(bs);
+            return SIZE_MAX; 
+        }    
+        bitmap_set(bs->fbm, ffz); // else set ffz bit in fbm
+        if (!block_store_map_sync(bs, ffz)){
+            bitmap_reset(bs->fbm, ffz);
+            bs->backend.ops->release(bs->backend.state, ffz);
+            ffz = SIZE_MAX;
+        }
+        block_store_unlock(bs);
+        return ffz; 
+    }
+    return SIZE_MAX; // else return SIZE_MAX on error 
+}
+
+/** Attempts to allocate the requested block id
+	\param bs the block store object
+	\param block_id the requested block identifier
+	\return boolean indicating succes of operation
+*/
+bool block_store_request(block_store_t *const bs, const size_t block_id){
+    
+    if (bs && block_id > 0 && block_id < bs->block_count){ // check params  
+        block_store_lock(bs);
+        if (bitmap_test(bs->fbm, block_id) == 1 || !bs->backend.ops->allocate(bs->backend.state, block_id)){ // check if bit is already set, or the backend will not have it
+            block_store_unlock(bs);
+            return false; 
+        } // if bit is not set
+        bitmap_set(bs->fbm, block_id); // set block bit at block_id
+        bool set = bitmap_test(bs->fbm, block_id) != 0 && block_store_map_sync(bs, block_id); // check bit again after setting to ensure it was set correctly 
+        if (!set){
+            bitmap_reset(bs->fbm, block_id);
+            bs->backend.ops->release(bs->backend.state, block_id);
+        }
+        block_store_unlock(bs);
+        return set; // if the current block wasn't set, return false
+    }
+    return false;
+}
+
+/* Frees the specified block */
+void block_store_release(block_store_t *const bs, const size_t block_id){ 
+    if (bs && block_id < bs->block_count){ // param check 
+        block_store_lock(bs);
+        if (bitmap_test(bs->fbm, block_id) != 0){ // check if block that block_id is at is free
+            bitmap_reset(bs->fbm, block_id); // if block isn't free, reset block value (1 -> 0)
+            bs->backend.ops->release(bs->backend.state, block_id);
+            block_store_map_sync(bs, block_id);
+        }
+        block_store_unlock(bs);
+        return;
+    }
+    return; 
+}
+
+size_t block_store_get_used_blocks(const block_store_t *const bs){
+    if (bs){ // param check
+        size_t blocks_set = bitmap_total_set(bs->fbm); // count total # of bits in fbm
+        return blocks_set; // return total # of bits
+    } // else if theres no block storage device
+    return SIZE_MAX; // return SIZE_MAX 
+}
+
+size_t block_store_get_free_blocks(const block_store_t *const bs){
+    if (bs){ // param check
+        block_store_lock(bs); // the scrubber must not see the flipped map
+        bitmap_invert(bs->fbm); // flip all bits 
+        // get the total # of set bits now that all bits are flipped 
+        // bitmap_total_set() can only get SET blocks, thus temporarily flip bits so that bit = 1 means its free
+        size_t blocks_free = bitmap_total_set(bs->fbm);
+        bitmap_invert(bs->fbm); // flip bits back to correct values 
+        block_store_unlock(bs);
+        return blocks_free; // return counted bits
+    } // else if theres no block store device
+    return SIZE_MAX; // return SIZE_MAX 
+}
+
+size_t block_store_get_total_blocks(){
+    return BLOCK_STORE_NUM_BLOCKS; // return total blocks
+}
+
+/** Decodes a run-length encoded block, (count, byte) pairs
+    \param src The encoded block
+    \param length Number of bytes in src
+    \param dst Where to put the block
+    \param size Bytes in a block
+    \return true on success, false if src does not decode to exactly one block
+*/
+bool block_rle_decode(const uint8_t *src, const size_t length, uint8_t *dst, const size_t size){
+    size_t out = 0;
+    for (size_t i = 0; i + 1 < length; i += 2){
+        if (src[i] == 0 || out + src[i] > size){
+            return false;
+        }
+        memset(dst + out, src[i + 1], src[i]);
+        out += src[i];
+    }
+    return length % 2 == 0 && out == size;
+}
+
+/** Run-length encodes a block as (count, byte) pairs, if that makes it smaller
+    \param src The block
+    \param dst Where to put the encoded block, room for a block
+    \param size Bytes in a block
+    \return number of bytes in dst, 0 if the block does not get any smaller
+*/
+size_t block_rle_encode(const uint8_t *src, uint8_t *dst, const size_t size){
+    size_t length = 0;
+    for (size_t i = 0; i < size;){
+        size_t run = 1;
+        while (i + run < size && src[i + run] == src[i] && run < UINT8_MAX){
+            run++;
+        }
+        if (length + 2 >= size){ // no gain
+            return 0;
+        }
+        dst[length++] = run;
+        dst[length++] = src[i];
+        i += run;
+    }
+    return length;
+}
+
+// CRC32C (Castagnoli), reflected, the polynomial the SSE4.2 crc32 instruction uses
+#define CRC32C_POLY 0x82F63B78
+uint32_t crc32c_table[256];
+pthread_once_t crc32c_table_once = PTHREAD_ONCE_INIT;
+
+void block_crc32c_table_init(void){
+    for (uint32_t i = 0; i < 256; i++){
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++){
+            crc = (crc >> 1) ^ ((crc & 1) ? CRC32C_POLY : 0);
+        }
+        crc32c_table[i] = crc;
+    }
+}
+
+// a byte at a time from the table, for CPUs without SSE4.2
+uint32_t block_crc32c_sw(uint32_t crc, const uint8_t *data, size_t length){
+    pthread_once(&crc32c_table_once, block_crc32c_table_init);
+    while (length--){
+        crc = crc32c_table[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#ifdef BLOCK_CRC32C_HW
+// 8 bytes per crc32 instruction, a 32 byte block takes 4
+__attribute__((target("sse4.2")))
+uint32_t block_crc32c_hw(uint32_t crc, const uint8_t *data, size_t length){
+    uint64_t wide = crc;
+    for (; length >= 8; data += 8, length -= 8){
+        uint64_t word;
+        memcpy(&word, data, 8);
+        wide = _mm_crc32_u64(wide, word);
+    }
+    crc = (uint32_t)wide;
+    while (length--){
+        crc = _mm_crc32_u8(crc, *data++);
+    }
+    return crc;
+}
+#endif
+
+uint32_t block_store_crc32c(uint32_t crc, const void *const data, const size_t length){
+    if (!data){
+        return crc;
+    }
+#ifdef BLOCK_CRC32C_HW
+    if (__builtin_cpu_supports("sse4.2")){
+        return ~block_crc32c_hw(~crc, data, length);
+    }
+#endif
+    return ~block_crc32c_sw(~crc, data, length);
+}
+
+/** Marks a block of an imported device as in memory, and lets go of the file once the last one is in
+    \param bs BS device
+    \param block_id The block now in memory
+*/
+void block_store_settle(block_store_t *const bs, const size_t block_id){
+    bitmap_reset(bs->image_pending, block_id);
+    if (--bs->image_left == 0){ // everything is in, the file is no longer needed
+        bitmap_destroy(bs->image_pending);
+        bs->image_pending = NULL;
+        close(bs->image_fd);
+        bs->image_fd = -1;
+    }
+}
+
+/** Reads a block of an imported device in from its file into the backend, the first time the block is used
+      Filling the block in does not change what the device holds, so this works on a const device
+    \param bs BS device
+    \param block_id The block about to be used
+    \return true if the block is in the backend, false if it could not be read in
+*/
+bool block_store_fault(const block_store_t *const bs, const size_t block_id){
+    if (bs->image_pending == NULL || block_id >= bs->block_count || !bitmap_test(bs->image_pending, block_id)){
+        return true;
+    }
+    block_store_t *cache = (block_store_t*)bs;
+    uint8_t *record = bs->scratch, *block = bs->scratch + bs->block_size;
+    size_t length = bs->image_length[block_id];
+    if (pread(bs->image_fd, record, length, bs->image_offset[block_id]) != (ssize_t)length){
+        return false;
+    }
+    if (length == bs->block_size){ // stored as is
+        block = record;
+    } else if (!block_rle_decode(record, length, block, bs->block_size)){
+        return false;
+    }
+    if (bs->backend.ops->write(bs->backend.state, block_id, block) != bs->block_size){
+        return false;
+    }
+    block_store_settle(cache, block_id);
+    return true;
+}
+
+/** Reads a block from wherever it is: the map, an imported file it is still only in, or the backend
+      Call with the device locked
+    \param bs BS device
+    \param block_id The block
+    \param buffer Where to put it
+    \return true on success
+*/
+bool block_store_load(const block_store_t *const bs, const size_t block_id, void *buffer){
+    if (!block_store_fault(bs, block_id)){
+        return false;
+    }
+    if (block_in_map(bs, block_id)){
+        memcpy(buffer, bs->map_blocks + (block_id - bs->bitmap_start) * bs->block_size, bs->block_size);
+        return true;
+    }
+    return bs->backend.ops->read(bs->backend.state, block_id, buffer) == bs->block_size;
+}
+
+/** Checks a block just loaded against its checksum
+      Call with the device locked and checksums on
+    \param bs BS device
+    \param block_id The block to check
+    \param block Its contents
+    \return true if the block is intact
+*/
+bool block_store_verify(const block_store_t *const bs, const size_t block_id, const void *block){
+    block_store_t *stats = (block_store_t*)bs;
+    if (!block_checksummed(bs, block_id)){
+        return true;
+    }
+    stats->stats.verified++;
+    if (block_store_crc32c(0, block, bs->block_size) != bs->checksum[block_id]){
+        stats->stats.mismatches++;
+        return false;
+    }
+    return true;
+}
+
+/** Reads data from the specified block and writes it to the designated buffer
+ \param bs BS device
+ \param block_id Source block id
+ \param buffer Data buffer to write to
+ \return Number of bytes read, 0 on error
+*/
+size_t block_store_read(const block_store_t *const bs, const size_t block_id, void *buffer){
+    if (bs && block_id < bs->block_count && buffer){ // param check
+        block_store_lock(bs);
+        // copy data from specified (from block_id) in block-store device into buffer | copy a whole block into buffer at a time
+        // fails for an imported block that could not be read in, or one that no longer matches its checksum
+        bool copy_data = block_store_load(bs, block_id, buffer) && (!bs->checksums || block_store_verify(bs, block_id, buffer));
+        block_store_unlock(bs);
+        if (!copy_data){
+            return 0; // return 0 if copy fails
+        }
+        return bs->block_size; // return the # of bytes read
+    }
+    return 0; 
+}
+
+/** Reads data from the specified buffer and writes it to the designated block
+ \param bs BS device
+ \param block_id Destination block id
+ \param buffer Data buffer to read from
+ \return Number of bytes written, 0 on error
+*/
+size_t block_store_write(block_store_t *const bs, const size_t block_id, const void *buffer){
+    if (bs && block_id < bs->block_count && buffer){ // check params
+        block_store_lock(bs);
+        if (bs->image_pending && bitmap_test(bs->image_pending, block_id)){ // the whole block is replaced, no need to read it in
+            block_store_settle(bs, block_id);
+        }
+        // write data from buffer into block-store device at specified block_id location, a map block changes the map too
+        if (block_in_map(bs, block_id)){
+            memcpy(bs->map_blocks + (block_id - bs->bitmap_start) * bs->block_size, buffer, bs->block_size);
+        }
+        bool copy_data = bs->backend.ops->write(bs->backend.state, block_id, buffer) == bs->block_size;
+        if (copy_data && bs->checksums && block_checksummed(bs, block_id)){
+            bs->checksum[block_id] = block_store_crc32c(0, buffer, bs->block_size);
+        }
+        block_store_unlock(bs);
+        if(!copy_data){
+            return 0; // if copy failed return 0
+        }
+        return bs->block_size; // else return the # of bytes written
+    }
+    return 0; 
+}
+
+/* ---- EXTRA CREDIT ---- */
+
+/** Imports BS device from the given file - for grads/bonus
+    \param filename The file to load
+    \return Pointer to new BS device, NULL on error
+*/
+block_store_t *block_store_deserialize(const char *const filename){
+    if (filename){
+        // the image holds the blocks of a device of the default geometry, map and all
+        block_store_t*bs = block_store_create();
+        uint8_t *image = (uint8_t*)calloc(1, BLOCK_STORE_NUM_BYTES);
+        if (bs == NULL || image == NULL){
+            free(image);
+            block_store_destroy(bs);
+            return NULL;
+        }
+    
+        int fd = open(filename, O_RDONLY);
+        // read the whole device from file, a short one leaves the rest zeros
+        ssize_t read_bytes = fd < 0 ? -1 : read(fd, image, BLOCK_STORE_NUM_BYTES);
+        if (read_bytes < 0){ // check if open or read failed
+                if (fd >= 0){
+                    close(fd);
+                }
+                free(image);
+                block_store_destroy(bs);
+                return NULL;
+            }
+        for (size_t block_id = 0; block_id < BLOCK_STORE_NUM_BLOCKS; block_id++){ // the map's blocks bring the map along
+            block_store_write(bs, block_id, image + block_id * BLOCK_SIZE_BYTES);
+        }
+        free(image);
+        
+        int is_closed = close(fd); // close file 
+        if (is_closed < 0){ // check if file closed successfully 
+            block_store_destroy(bs);
+            return NULL;
+        }
+        return bs; // return block store device 
+    }
+    return NULL;
+}
+
+/** Writes the entirety of the BS device to file, overwriting it if it exists - for grads/bonus
+ \param bs BS device
+ \param filename The file to write to
+ \return Number of bytes written, 0 on error
+*/ 
+size_t block_store_serialize(const block_store_t *const bs, const char *const filename){
+    if (bs && filename){
+        /* references: 
+            http://www.ss64.com/bash/chmod.html
+            https://stackoverflow.com/questions/15798450/open-with-o-creat-was-it-opened-or-created 
+            https://stackoverflow.com/questions/18415904/what-does-mode-t-0644-mean
+            
+            0x644:
+            * (owning) User: read & write
+            * Group: read
+            * Other: read               */
+
+        // open file in write only mode, truncating it if it exists
+        FILE *file = fopen(filename, "wb"); // open file 
+        if (!file){ // check if file opened succesfully 
+            return 0;
+        }
+        // the whole device goes out a block at a time, from the backend and what an import left behind
+        uint8_t *block = bs->scratch + 2 * bs->block_size;
+        bool written = true;
+        block_store_lock(bs);
+        for (size_t block_id = 0; block_id < bs->block_count && written; block_id++){
+            written = block_store_load(bs, block_id, block) && fwrite(block, 1, bs->block_size, file) == bs->block_size;
+        }
+        block_store_unlock(bs);
+        int is_closed = fclose(file); // close file
+        if (is_closed != 0 || !written){ // check if every block went out and the file closed successfully
+            return 0;
+        }
+        return bs->block_size * bs->block_count; // return written bytes 
+    }
+    return 0;
+}
+
+// writes value as n little-endian bytes
+bool image_put(FILE *file, const uint64_t value, const size_t n){
+    uint8_t bytes[8];
+    for (size_t i = 0; i < n; i++){
+        bytes[i] = (value >> (8 * i)) & 0xFF;
+    }
+    return fwrite(bytes, 1, n, file) == n;
+}
+
+// reads n little-endian bytes
+uint64_t image_get(const uint8_t *bytes, const size_t n){
+    uint64_t value = 0;
+    for (size_t i = 0; i < n; i++){
+        value |= (uint64_t)bytes[i] << (8 * i);
+    }
+    return value;
+}
+
+// the blocks holding the free block map are not stored with the others, the header carries the map
+bool image_stores(const block_store_t *const bs, const size_t block_id){
+    return bitmap_test(bs->fbm, block_id) && !block_in_map(bs, block_id);
+}
+
+// the narrow "BSX1" header only has room for small geometries with the map where it is by default
+bool image_narrow(const block_store_t *const bs){
+    block_store_geometry_t geometry = {bs->block_size, bs->block_count, BLOCK_STORE_BITMAP_DEFAULT};
+    block_store_geometry_check(&geometry);
+    return bs->block_size <= UINT16_MAX && bs->block_count <= UINT16_MAX && bs->bitmap_start == geometry.bitmap_start;
+}
+
+/** Writes only the blocks in use to file, in the compact format block_store_import reads
+    \param bs BS device
+    \param filename The file to write to, overwritten if it exists
+    \param flags BLOCK_STORE_EXPORT_RLE to run-length encode the blocks that get smaller from it
+    \return Number of bytes written, 0 on error
+*/
+size_t block_store_export(const block_store_t *const bs, const char *const filename, const int flags){
+    if (!bs || !filename){
+        return 0;
+    }
+    FILE *file = fopen(filename, "wb");
+    if (!file){
+        return 0;
+    }
+    bool narrow = image_narrow(bs);
+    size_t bitmap_bytes = (bs->block_count + 7) / 8;
+    size_t length_bytes = narrow ? 2 : 4; // per index entry, then 4 more for the checksum
+    bool ok = narrow ? fwrite(bs->checksums ? IMAGE_CHECKSUM_MAGIC : IMAGE_MAGIC, 1, 4, file) == 4 && image_put(file, bs->block_size, 2) && image_put(file, bs->block_count, 2)
+        : fwrite(bs->checksums ? IMAGE_WIDE_CHECKSUM_MAGIC : IMAGE_WIDE_MAGIC, 1, 4, file) == 4 && image_put(file, bs->block_size, 4)
+            && image_put(file, bs->block_count, 8) && image_put(file, bs->bitmap_start, 8);
+    ok = ok && fwrite(bitmap_export(bs->fbm), 1, bitmap_bytes, file) == bitmap_bytes;
+    size_t written = (narrow ? IMAGE_HEADER_BYTES : IMAGE_WIDE_HEADER_BYTES) + bitmap_bytes;
+
+    // the blocks stream out one at a time, only their lengths (and checksums) are kept for the index
+    uint32_t *lengths = (uint32_t*)malloc(bs->block_count * sizeof(uint32_t));
+    uint32_t *checksums = (uint32_t*)malloc(bs->block_count * sizeof(uint32_t));
+    uint8_t *block = (uint8_t*)malloc(2 * bs->block_size), *encoded = block + bs->block_size;
+    ok = ok && lengths && checksums && block;
+    size_t stored = 0;
+    for (size_t block_id = 0; block_id < bs->block_count && ok; block_id++){
+        if (!image_stores(bs, block_id)){
+            continue;
+        }
+        ok = block_store_read(bs, block_id, block) == bs->block_size; // with checksums on, a damaged block fails the export
+        checksums[stored] = block_store_crc32c(0, block, bs->block_size);
+        size_t length = (flags & BLOCK_STORE_EXPORT_RLE) ? block_rle_encode(block, encoded, bs->block_size) : 0;
+        if (length == 0){ // as is
+            length = bs->block_size;
+            memcpy(encoded, block, bs->block_size);
+        }
+        ok = ok && fwrite(encoded, 1, length, file) == length;
+        lengths[stored++] = length;
+        written += length;
+    }
+    for (size_t i = 0; i < stored && ok; i++){
+        ok = image_put(file, lengths[i], length_bytes) && (!bs->checksums || image_put(file, checksums[i], 4));
+    }
+    ok = ok && image_put(file, stored, 4) && fwrite(IMAGE_END_MAGIC, 1, 4, file) == 4;
+    written += (length_bytes + (bs->checksums ? 4 : 0)) * stored + IMAGE_FOOTER_BYTES;
+    free(lengths);
+    free(checksums);
+    free(block);
+    if (fclose(file) != 0 || !ok){
+        return 0;
+    }
+    return written;
+}
+
+/** Imports a BS device written by block_store_export
+      Only the free block map and the index are read here, each block is read in the first time it is used
+    \param filename The file to load, it must stay in place until the device is destroyed
+    \return Pointer to new BS device, NULL on error
+*/
+block_store_t *block_store_import(const char *const filename){
+    if (!filename){
+        return NULL;
+    }
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0){
+        return NULL;
+    }
+    struct stat st;
+    uint8_t head[IMAGE_WIDE_HEADER_BYTES], foot[IMAGE_FOOTER_BYTES];
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)(IMAGE_HEADER_BYTES + sizeof(foot))
+        || pread(fd, head, IMAGE_HEADER_BYTES, 0) != IMAGE_HEADER_BYTES
+        || pread(fd, foot, sizeof(foot), st.st_size - sizeof(foot)) != (ssize_t)sizeof(foot) || memcmp(foot + 4, IMAGE_END_MAGIC, 4) != 0){
+        close(fd);
+        return NULL;
+    }
+    // the geometry comes from the header, the narrow one leaves the map where it is by default
+    bool narrow = memcmp(head, IMAGE_MAGIC, 4) == 0 || memcmp(head, IMAGE_CHECKSUM_MAGIC, 4) == 0;
+    bool wide = memcmp(head, IMAGE_WIDE_MAGIC, 4) == 0 || memcmp(head, IMAGE_WIDE_CHECKSUM_MAGIC, 4) == 0;
+    size_t head_bytes = narrow ? IMAGE_HEADER_BYTES : IMAGE_WIDE_HEADER_BYTES;
+    block_store_geometry_t geometry = {0, 0, BLOCK_STORE_BITMAP_DEFAULT};
+    if (narrow){
+        geometry.block_size = image_get(head + 4, 2);
+        geometry.block_count = image_get(head + 6, 2);
+    } else if (wide && pread(fd, head, IMAGE_WIDE_HEADER_BYTES, 0) == IMAGE_WIDE_HEADER_BYTES){
+        geometry.block_size = image_get(head + 4, 4);
+        geometry.block_count = image_get(head + 8, 8);
+        geometry.bitmap_start = image_get(head + 16, 8);
+    }
+    size_t bitmap_bytes = (geometry.block_count + 7) / 8;
+    block_store_t *bs = NULL;
+    if ((!narrow && !wide) || geometry.block_size == 0 || geometry.block_count == 0 // no defaults from a file
+        || st.st_size < (off_t)(head_bytes + bitmap_bytes + sizeof(foot))
+        || !(bs = block_store_create_geometry(&geometry, block_store_backend_memory(BLOCK_STORE_BACKEND_HEAP, 0, -1)))){
+        close(fd);
+        return NULL;
+    }
+    bool checksums = memcmp(head, IMAGE_CHECKSUM_MAGIC, 4) == 0 || memcmp(head, IMAGE_WIDE_CHECKSUM_MAGIC, 4) == 0;
+    size_t length_bytes = narrow ? 2 : 4;
+    size_t entry = length_bytes + (checksums ? 4 : 0); // bytes per index entry
+    size_t stored = image_get(foot, 4);
+    off_t index_at = st.st_size - sizeof(foot) - entry * stored;
+    uint8_t *index = stored < bs->block_count ? (uint8_t*)malloc(entry * stored + 1) : NULL;
+    bs->image_pending = bitmap_create(bs->block_count);
+    bs->image_offset = (uint64_t*)calloc(bs->block_count, sizeof(uint64_t));
+    bs->image_length = (uint32_t*)calloc(bs->block_count, sizeof(uint32_t));
+    bs->checksum = checksums ? (uint32_t*)calloc(bs->block_count, sizeof(uint32_t)) : NULL;
+    bool ok = index && bs->image_pending && bs->image_offset && bs->image_length && (!checksums || bs->checksum)
+        && index_at >= (off_t)(head_bytes + bitmap_bytes)
+        && pread(fd, bs->map_blocks, bitmap_bytes, head_bytes) == (ssize_t)bitmap_bytes // the map is overlaid there
+        && pread(fd, index, entry * stored, index_at) == (ssize_t)(entry * stored);
+    for (size_t i = 0; i < bs->bitmap_blocks && ok; i++){
+        ok = block_store_map_sync(bs, i * bs->block_size * 8);
+    }
+    size_t offset = head_bytes + bitmap_bytes, i = 0;
+    for (size_t block_id = 0; block_id < bs->block_count && ok; block_id++){
+        if (!image_stores(bs, block_id)){
+            continue;
+        }
+        ok = i < stored;
+        size_t length = ok ? image_get(index + entry * i, length_bytes) : 0;
+        if (ok && checksums){
+            bs->checksum[block_id] = image_get(index + entry * i + length_bytes, 4);
+        }
+        i++;
+        ok = ok && length > 0 && length <= bs->block_size;
+        bs->image_offset[block_id] = offset;
+        bs->image_length[block_id] = length;
+        bitmap_set(bs->image_pending, block_id);
+        bs->image_left++;
+        offset += length;
+    }
+    free(index);
+    if (!ok || i != stored || offset != (size_t)index_at){ // the map, the index and the file size have to agree
+        close(fd);
+        block_store_destroy(bs);
+        return NULL;
+    }
+    if (checksums){ // the blocks read in later are checked against the index, the rest are all zeros in the backend already
+        uint8_t *zeros = bs->scratch + 2 * bs->block_size;
+        memset(zeros, 0, bs->block_size);
+        uint32_t zeros_crc = block_store_crc32c(0, zeros, bs->block_size);
+        for (size_t block_id = 0; block_id < bs->block_count; block_id++){
+            if (block_checksummed(bs, block_id) && !image_stores(bs, block_id)){
+                bs->checksum[block_id] = zeros_crc;
+            }
+        }
+        bs->checksums = true;
+    }
+    if (stored == 0){ // nothing to read in
+        bitmap_destroy(bs->image_pending);
+        bs->image_pending = NULL;
+        close(fd);
+        return bs;
+    }
+    bs->image_fd = fd;
+    return bs;
+}
+
+/** Turns per-block CRC32C checksums on or off
+      Turning them on reads in every block an import left in its file and computes all the checksums
+    \param bs BS device
+    \param enable true to turn them on
+    \return true on success
+*/
+bool block_store_checksums(block_store_t *const bs, const bool enable){
+    if (!bs){
+        return false;
+    }
+    if (!enable){
+        block_store_scrub_stop(bs);
+        bs->checksums = false;
+        return true;
+    }
+    if (bs->checksums){
+        return true;
+    }
+    if (!bs->checksum && !(bs->checksum = (uint32_t*)calloc(bs->block_count, sizeof(uint32_t)))){
+        return false;
+    }
+    uint8_t *block = bs->scratch + 2 * bs->block_size;
+    for (size_t block_id = 0; block_id < bs->block_count; block_id++){
+        if (!block_store_load(bs, block_id, block)){
+            return false;
+        }
+        if (block_checksummed(bs, block_id)){
+            bs->checksum[block_id] = block_store_crc32c(0, block, bs->block_size);
+        }
+    }
+    bs->checksums = true;
+    return true;
+}
+
+/** Copies out the checksum counters
+    \param bs BS device
+    \param stats Where to put them
+    \return true on success
+*/
+bool block_store_checksum_stats(const block_store_t *const bs, block_store_checksum_stats_t *const stats){
+    if (!bs || !stats){
+        return false;
+    }
+    block_store_lock(bs);
+    *stats = bs->stats;
+    block_store_unlock(bs);
+    return true;
+}
+
+// waits out the pause after a block, with the device locked; false once the scrubber is told to stop
+bool block_store_scrub_wait(block_store_t *const bs){
+    struct timespec until;
+    clock_gettime(CLOCK_REALTIME, &until);
+    until.tv_sec += bs->scrub_pause.tv_sec;
+    until.tv_nsec += bs->scrub_pause.tv_nsec;
+    if (until.tv_nsec >= 1000000000L){
+        until.tv_sec++;
+        until.tv_nsec -= 1000000000L;
+    }
+    int waited = 0;
+    while (!bs->scrub_stop && waited != ETIMEDOUT){
+        waited = pthread_cond_timedwait(&bs->scrub_wake, &bs->lock, &until);
+    }
+    return !bs->scrub_stop;
+}
+
+// the scrubber thread: checks every block in use, one per pause, over and over
+void *block_store_scrub(void *arg){
+    block_store_t *bs = (block_store_t*)arg;
+    pthread_mutex_lock(&bs->lock);
+    bool running = !bs->scrub_stop;
+    while (running){
+        bool checked = false;
+        uint8_t *block = bs->scratch + 2 * bs->block_size;
+        for (size_t block_id = 0; block_id < bs->block_count && running; block_id++){
+            if (!block_checksummed(bs, block_id) || !bitmap_test(bs->fbm, block_id)){
+                continue;
+            }
+            if (block_store_load(bs, block_id, block)){
+                block_store_verify(bs, block_id, block); // a mismatch is counted, the block is left as is for the owner to deal with
+            }
+            bs->stats.scrubbed++;
+            checked = true;
+            running = block_store_scrub_wait(bs);
+        }
+        if (running){
+            bs->stats.passes++;
+            running = checked || block_store_scrub_wait(bs); // nothing in use, do not spin
+        }
+    }
+    pthread_mutex_unlock(&bs->lock);
+    return NULL;
+}
+
+/** Starts a background thread that checks the blocks in use against their checksums
+    \param bs BS device, with checksums on
+    \param blocks_per_second How many blocks it checks per second at most
+    \return true if the scrubber was started
+*/
+bool block_store_scrub_start(block_store_t *const bs, const size_t blocks_per_second){
+    if (!bs || !bs->checksums || bs->scrubbing || blocks_per_second == 0){
+        return false;
+    }
+    long pause = 1000000000L / (blocks_per_second < 1000000000L ? (long)blocks_per_second : 1000000000L);
+    bs->scrub_pause.tv_sec = pause / 1000000000L;
+    bs->scrub_pause.tv_nsec = pause % 1000000000L;
+    bs->scrub_stop = false;
+    if (pthread_create(&bs->scrubber, NULL, block_store_scrub, bs) != 0){
+        return false;
+    }
+    bs->scrubbing = true;
+    return true;
+}
+
+/** Stops the scrubber and waits for it, if it is running
+    \param bs BS device
+*/
+void block_store_scrub_stop(block_store_t *const bs){
+    if (!bs || !bs->scrubbing){
+        return;
+    }
+    pthread_mutex_lock(&bs->lock);
+    bs->scrub_stop = true;
+    pthread_cond_signal(&bs->scrub_wake);
+    pthread_mutex_unlock(&bs->lock);
+    pthread_join(bs->scrubber, NULL);
+    bs->scrubbing = false;
+}
@@ -0,0 +1,600 @@
+#define _DEFAULT_SOURCE // MAP_ANONYMOUS, MAP_HUGETLB, madvise and syscall, on top of _XOPEN_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "block_store.h"
+
+/* The backends a BS device keeps its blocks in, see block_store_create_on
+    heap   calloc'd memory, what block_store_create uses
+    ram    an anonymous mapping, optionally on huge pages and bound to a NUMA node
+    file   a file of the device's size, read and written with pread/pwrite
+    mmap   the same file, mapped shared
+    trace  any other backend, with every call logged as text
+    record any other backend, with every call logged in binary with its timing, see block_store_trace_read
+   Each one only moves whole blocks, the device above it does the free block map, checksums and locking
+   A backend is set up with its options first and sized by the device when the device is made, see open */
+
+// the heap, RAM and mmap backends: the blocks in memory
+typedef struct memory_backend{
+    uint8_t *blocks; // block_count of them, NULL until opened
+    size_t block_size, block_count;
+    size_t mapped_bytes; // what was set aside for them, at least block_size * block_count
+    const char *pages; // what backs them, see block_store_backend_info_t
+    int flags; // BLOCK_STORE_HUGE_PAGES, BLOCK_STORE_NUMA_BIND
+    int numa_node; // -1 for none
+    int fd; // mmap: the file, -1 otherwise
+}memory_backend_t;
+
+size_t memory_read(void *const state, const size_t block_id, void *buffer){
+    memory_backend_t *memory = (memory_backend_t*)state;
+    if (block_id >= memory->block_count){
+        return 0;
+    }
+    memcpy(buffer, memory->blocks + block_id * memory->block_size, memory->block_size);
+    return memory->block_size;
+}
+
+size_t memory_write(void *const state, const size_t block_id, const void *buffer){
+    memory_backend_t *memory = (memory_backend_t*)state;
+    if (block_id >= memory->block_count){
+        return 0;
+    }
+    memcpy(memory->blocks + block_id * memory->block_size, buffer, memory->block_size);
+    return memory->block_size;
+}
+
+// nothing to claim or give back, the whole device is set aside up front
+bool memory_allocate(void *const state, const size_t block_id){
+    (void)state; (void)block_id;
+    return true;
+}
+
+void memory_release(void *const state, const size_t block_id){
+    (void)state; (void)block_id;
+}
+
+bool memory_flush(void *const state){
+    (void)state;
+    return true;
+}
+
+void memory_info(void *const state, block_store_backend_info_t *const info){
+    memory_backend_t *memory = (memory_backend_t*)state;
+    info->pages = memory->pages;
+    info->mapped_bytes = memory->mapped_bytes;
+    info->numa_node = memory->numa_node;
+}
+
+bool heap_open(void *const state, const size_t block_size, const size_t block_count){
+    memory_backend_t *memory = (memory_backend_t*)state;
+    memory->blocks = (uint8_t*)calloc(block_count, block_size);
+    memory->block_size = block_size;
+    memory->block_count = block_count;
+    memory->mapped_bytes = block_size * block_count;
+    return memory->blocks != NULL;
+}
+
+void heap_close(void *const state){
+    memory_backend_t *memory = (memory_backend_t*)state;
+    free(memory->blocks);
+    free(memory);
+}
+
+void ram_close(void *const state){
+    memory_backend_t *memory = (memory_backend_t*)state;
+    if (memory->blocks){
+        munmap(memory->blocks, memory->mapped_bytes);
+    }
+    free(memory);
+}
+
+#define HUGE_PAGE_BYTES (2UL << 20) // x86-64 and arm64 default
+#define NUMA_MPOL_BIND 2 // MPOL_BIND from linux/mempolicy.h, libnuma is not needed for a single node
+
+/** Binds a fresh mapping to a NUMA node, before anything touches it
+    \return true on success, false if the node does not exist or the kernel has no NUMA support
+*/
+bool ram_bind(void *const at, const size_t bytes, const int node){
+#ifdef SYS_mbind
+    unsigned long mask[4] = {0};
+    if (node < 0 || node >= (int)(8 * sizeof(mask))){
+        return false;
+    }
+    mask[node / (8 * sizeof(unsigned long))] = 1UL << (node % (8 * sizeof(unsigned long)));
+    return syscall(SYS_mbind, at, bytes, NUMA_MPOL_BIND, mask, 8 * sizeof(mask), 0) == 0;
+#else
+    (void)at; (void)bytes; (void)node;
+    return false;
+#endif
+}
+
+/** Maps the blocks anonymously, with BLOCK_STORE_HUGE_PAGES on huge pages
+      Reserved huge pages (MAP_HUGETLB) are tried first; without any, the mapping is aligned to a huge page
+      and madvise(MADV_HUGEPAGE) asks for transparent ones. Either way the mapping is rounded up to whole huge pages
+    \return true on success
+*/
+bool ram_open(void *const state, const size_t block_size, const size_t block_count){
+    memory_backend_t *memory = (memory_backend_t*)state;
+    const int prot = PROT_READ | PROT_WRITE, anon = MAP_PRIVATE | MAP_ANONYMOUS;
+    void *at = MAP_FAILED;
+    size_t bytes = block_size * block_count;
+    memory->pages = "normal";
+    if (memory->flags & BLOCK_STORE_HUGE_PAGES){
+        bytes = (bytes + HUGE_PAGE_BYTES - 1) & ~(HUGE_PAGE_BYTES - 1);
+#ifdef MAP_HUGETLB
+        at = mmap(NULL, bytes, prot, anon | MAP_HUGETLB, -1, 0);
+        memory->pages = at != MAP_FAILED ? "hugetlb" : memory->pages;
+#endif
+        if (at == MAP_FAILED){ // map a huge page more than needed and trim it down to an aligned one
+            uint8_t *over = (uint8_t*)mmap(NULL, bytes + HUGE_PAGE_BYTES, prot, anon, -1, 0);
+            if (over != MAP_FAILED){
+                uint8_t *aligned = (uint8_t*)(((uintptr_t)over + HUGE_PAGE_BYTES - 1) & ~(uintptr_t)(HUGE_PAGE_BYTES - 1));
+                if (aligned > over){
+                    munmap(over, aligned - over);
+                }
+                munmap(aligned + bytes, over + bytes + HUGE_PAGE_BYTES - aligned - bytes);
+                at = aligned;
+#ifdef MADV_HUGEPAGE
+                memory->pages = madvise(at, bytes, MADV_HUGEPAGE) == 0 ? "transparent" : memory->pages;
+#endif
+            }
+        }
+    } else {
+        at = mmap(NULL, bytes, prot, anon, -1, 0);
+    }
+    if (at == MAP_FAILED){
+        return false;
+    }
+    if ((memory->flags & BLOCK_STORE_NUMA_BIND) && !ram_bind(at, bytes, memory->numa_node)){
+        munmap(at, bytes);
+        return false;
+    }
+    memory->blocks = (uint8_t*)at;
+    memory->block_size = block_size;
+    memory->block_count = block_count;
+    memory->mapped_bytes = bytes;
+    return true;
+}
+
+const block_store_ops_t heap_ops = {"heap", heap_open, memory_read, memory_write, memory_allocate, memory_release, memory_flush, heap_close, memory_info};
+const block_store_ops_t ram_ops = {"ram", ram_open, memory_read, memory_write, memory_allocate, memory_release, memory_flush, ram_close, memory_info};
+
+/** Sets up a backend that keeps the blocks in memory
+    \param type BLOCK_STORE_BACKEND_HEAP or BLOCK_STORE_BACKEND_RAM
+    \param flags BLOCK_STORE_HUGE_PAGES and BLOCK_STORE_NUMA_BIND, RAM only
+    \param numa_node The node to bind to with BLOCK_STORE_NUMA_BIND
+    \return The backend, with no ops on error
+*/
+block_store_backend_t block_store_backend_memory(const block_store_backend_type_t type, const int flags, const int numa_node){
+    block_store_backend_t backend = {NULL, NULL};
+    if ((type != BLOCK_STORE_BACKEND_HEAP && type != BLOCK_STORE_BACKEND_RAM) || (type == BLOCK_STORE_BACKEND_HEAP && flags != 0)){ // calloc can do neither flag
+        return backend;
+    }
+    memory_backend_t *memory = (memory_backend_t*)calloc(1, sizeof(memory_backend_t));
+    if (!memory){
+        return backend;
+    }
+    memory->flags = flags;
+    memory->numa_node = (flags & BLOCK_STORE_NUMA_BIND) ? numa_node : -1;
+    memory->fd = -1;
+    memory->pages = "normal";
+    backend.ops = type == BLOCK_STORE_BACKEND_HEAP ? &heap_ops : &ram_ops;
+    backend.state = memory;
+    return backend;
+}
+
+/** Grows the file a file or mmap backend keeps the device in to the device's size, if it is new or short
+    \return true on success
+*/
+bool backend_file_size(const int fd, const size_t bytes){
+    struct stat st;
+    return fstat(fd, &st) == 0 && (st.st_size >= (off_t)bytes || ftruncate(fd, bytes) == 0);
+}
+
+bool mmap_open(void *const state, const size_t block_size, const size_t block_count){
+    memory_backend_t *memory = (memory_backend_t*)state;
+    size_t bytes = block_size * block_count;
+    void *at = backend_file_size(memory->fd, bytes) ? mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, memory->fd, 0) : MAP_FAILED;
+    if (at == MAP_FAILED){
+        return false;
+    }
+    memory->blocks = (uint8_t*)at;
+    memory->block_size = block_size;
+    memory->block_count = block_count;
+    memory->mapped_bytes = bytes;
+    return true;
+}
+
+bool mmap_flush(void *const state){
+    memory_backend_t *memory = (memory_backend_t*)state;
+    return msync(memory->blocks, memory->mapped_bytes, MS_SYNC) == 0;
+}
+
+void mmap_close(void *const state){
+    memory_backend_t *memory = (memory_backend_t*)state;
+    if (memory->blocks){
+        munmap(memory->blocks, memory->mapped_bytes);
+    }
+    close(memory->fd);
+    free(memory);
+}
+
+const block_store_ops_t mmap_ops = {"mmap", mmap_open, memory_read, memory_write, memory_allocate, memory_release, mmap_flush, mmap_close, memory_info};
+
+/** Sets up a backend that keeps the blocks in a file mapped shared, writes reach the file when the kernel writes the pages back or on flush
+    \param filename The file, created if it does not exist; one holding a device (or a block_store_serialize image) brings it back
+    \return The backend, with no ops on error
+*/
+block_store_backend_t block_store_backend_mmap(const char *const filename){
+    block_store_backend_t backend = {NULL, NULL};
+    if (!filename){
+        return backend;
+    }
+    memory_backend_t *memory = (memory_backend_t*)calloc(1, sizeof(memory_backend_t));
+    if (!memory){
+        return backend;
+    }
+    memory->fd = open(filename, O_RDWR | O_CREAT, 0644);
+    if (memory->fd < 0){
+        free(memory);
+        return backend;
+    }
+    memory->pages = "file";
+    memory->numa_node = -1;
+    backend.ops = &mmap_ops;
+    backend.state = memory;
+    return backend;
+}
+
+// the file backend: the descriptor and the device's geometry
+typedef struct file_backend{
+    int fd;
+    size_t block_size, block_count;
+}file_backend_t;
+
+bool file_open(void *const state, const size_t block_size, const size_t block_count){
+    file_backend_t *file = (file_backend_t*)state;
+    file->block_size = block_size;
+    file->block_count = block_count;
+    return backend_file_size(file->fd, block_size * block_count);
+}
+
+size_t file_read(void *const state, const size_t block_id, void *buffer){
+    file_backend_t *file = (file_backend_t*)state;
+    if (block_id >= file->block_count){
+        return 0;
+    }
+    return pread(file->fd, buffer, file->block_size, block_id * file->block_size) == (ssize_t)file->block_size ? file->block_size : 0;
+}
+
+size_t file_write(void *const state, const size_t block_id, const void *buffer){
+    file_backend_t *file = (file_backend_t*)state;
+    if (block_id >= file->block_count){
+        return 0;
+    }
+    return pwrite(file->fd, buffer, file->block_size, block_id * file->block_size) == (ssize_t)file->block_size ? file->block_size : 0;
+}
+
+bool file_flush(void *const state){
+    return fsync(((file_backend_t*)state)->fd) == 0;
+}
+
+void file_close(void *const state){
+    close(((file_backend_t*)state)->fd);
+    free(state);
+}
+
+void file_info(void *const state, block_store_backend_info_t *const info){
+    (void)state;
+    info->pages = "file";
+    info->mapped_bytes = 0;
+    info->numa_node = -1;
+}
+
+const block_store_ops_t file_ops = {"file", file_open, file_read, file_write, memory_allocate, memory_release, file_flush, file_close, file_info};
+
+/** Sets up a backend that keeps the blocks in a file, every block read and write is a pread or pwrite
+    \param filename The file, created if it does not exist; one holding a device (or a block_store_serialize image) brings it back
+    \return The backend, with no ops on error
+*/
+block_store_backend_t block_store_backend_file(const char *const filename){
+    block_store_backend_t backend = {NULL, NULL};
+    file_backend_t *file = filename ? (file_backend_t*)calloc(1, sizeof(file_backend_t)) : NULL;
+    if (!file){
+        return backend;
+    }
+    file->fd = open(filename, O_RDWR | O_CREAT, 0644);
+    if (file->fd < 0){
+        free(file);
+        return backend;
+    }
+    backend.ops = &file_ops;
+    backend.state = file;
+    return backend;
+}
+
+// the tracing backend: another backend, and where its calls are logged
+typedef struct trace_backend{
+    block_store_backend_t inner;
+    FILE *log;
+}trace_backend_t;
+
+bool trace_open(void *const state, const size_t block_size, const size_t block_count){
+    trace_backend_t *trace = (trace_backend_t*)state;
+    bool opened = trace->inner.ops->open(trace->inner.state, block_size, block_count);
+    fprintf(trace->log, "open %zu %zu %d\n", block_size, block_count, opened);
+    return opened;
+}
+
+size_t trace_read(void *const state, const size_t block_id, void *buffer){
+    trace_backend_t *trace = (trace_backend_t*)state;
+    size_t read = trace->inner.ops->read(trace->inner.state, block_id, buffer);
+    fprintf(trace->log, "read %zu %zu\n", block_id, read);
+    return read;
+}
+
+size_t trace_write(void *const state, const size_t block_id, const void *buffer){
+    trace_backend_t *trace = (trace_backend_t*)state;
+    size_t written = trace->inner.ops->write(trace->inner.state, block_id, buffer);
+    fprintf(trace->log, "write %zu %zu\n", block_id, written);
+    return written;
+}
+
+bool trace_allocate(void *const state, const size_t block_id){
+    trace_backend_t *trace = (trace_backend_t*)state;
+    bool allocated = trace->inner.ops->allocate(trace->inner.state, block_id);
+    fprintf(trace->log, "allocate %zu %d\n", block_id, allocated);
+    return allocated;
+}
+
+void trace_release(void *const state, const size_t block_id){
+    trace_backend_t *trace = (trace_backend_t*)state;
+    trace->inner.ops->release(trace->inner.state, block_id);
+    fprintf(trace->log, "release %zu\n", block_id);
+}
+
+bool trace_flush(void *const state){
+    trace_backend_t *trace = (trace_backend_t*)state;
+    bool flushed = trace->inner.ops->flush(trace->inner.state);
+    fprintf(trace->log, "flush %d\n", flushed);
+    return fflush(trace->log) == 0 && flushed;
+}
+
+void trace_close(void *const state){
+    trace_backend_t *trace = (trace_backend_t*)state;
+    trace->inner.ops->close(trace->inner.state);
+    fflush(trace->log);
+    free(trace);
+}
+
+void trace_info(void *const state, block_store_backend_info_t *const info){
+    trace_backend_t *trace = (trace_backend_t*)state;
+    trace->inner.ops->info(trace->inner.state, info);
+}
+
+const block_store_ops_t trace_ops = {"trace", trace_open, trace_read, trace_write, trace_allocate, trace_release, trace_flush, trace_close, trace_info};
+
+/** Wraps a backend so every call to it is logged, one line each: the call, the block id and what it returned
+    \param inner The backend to trace, closed along with this one
+    \param log Where the lines go, left open
+    \return The backend, with no ops on error (inner is closed then too)
+*/
+block_store_backend_t block_store_backend_trace(const block_store_backend_t inner, FILE *const log){
+    block_store_backend_t backend = {NULL, NULL};
+    if (!inner.ops){
+        return backend;
+    }
+    trace_backend_t *trace = log ? (trace_backend_t*)malloc(sizeof(trace_backend_t)) : NULL;
+    if (!trace){
+        inner.ops->close(inner.state);
+        return backend;
+    }
+    trace->inner = inner;
+    trace->log = log;
+    backend.ops = &trace_ops;
+    backend.state = trace;
+    return backend;
+}
+
+/* the recording backend: another backend, and where its calls go
+    header  "BST1"
+    then one record per call: the call (a block_store_trace_op_t, | TRACE_OK if it succeeded), then as varints
+    (7 bits a byte, low ones first, the top bit set on all but the last) the ns since the previous call started,
+    the ns this one took, and the block id; open has the block size and block count instead, flush and close nothing */
+#define TRACE_MAGIC "BST1"
+#define TRACE_OK 0x80
+#define TRACE_RECORD_MAX (1 + 4 * 10) // the call and four varints of at most 10 bytes
+
+typedef struct record_backend{
+    block_store_backend_t inner;
+    FILE *out;
+    uint64_t epoch; // when it was set up
+    uint64_t last; // when the previous call started, since epoch
+}record_backend_t;
+
+// nanoseconds on a monotonic clock, what the records are timed with
+uint64_t trace_clock(void){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + now.tv_nsec;
+}
+
+size_t trace_varint(uint8_t *const out, uint64_t value){
+    size_t n = 0;
+    while (value >= 0x80){
+        out[n++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = (uint8_t)value;
+    return n;
+}
+
+// logs a call that started at start (since epoch) and has just returned; the backend calls are never made concurrently
+void record_call(record_backend_t *const record, const block_store_trace_op_t op, const bool ok, const uint64_t start, const uint64_t arg, const uint64_t count){
+    uint8_t buffer[TRACE_RECORD_MAX];
+    uint64_t took = trace_clock() - record->epoch - start;
+    size_t n = 0;
+    buffer[n++] = (uint8_t)(op | (ok ? TRACE_OK : 0));
+    n += trace_varint(buffer + n, start - record->last);
+    n += trace_varint(buffer + n, took);
+    if (op == BLOCK_STORE_TRACE_OPEN){
+        n += trace_varint(buffer + n, arg);
+        n += trace_varint(buffer + n, count);
+    }
+    else if (op != BLOCK_STORE_TRACE_FLUSH && op != BLOCK_STORE_TRACE_CLOSE){
+        n += trace_varint(buffer + n, arg);
+    }
+    record->last = start;
+    fwrite(buffer, 1, n, record->out);
+}
+
+uint64_t record_start(const record_backend_t *const record){
+    return trace_clock() - record->epoch;
+}
+
+bool record_open(void *const state, const size_t block_size, const size_t block_count){
+    record_backend_t *record = (record_backend_t*)state;
+    uint64_t start = record_start(record);
+    bool opened = record->inner.ops->open(record->inner.state, block_size, block_count);
+    record_call(record, BLOCK_STORE_TRACE_OPEN, opened, start, block_size, block_count);
+    return opened;
+}
+
+size_t record_read(void *const state, const size_t block_id, void *buffer){
+    record_backend_t *record = (record_backend_t*)state;
+    uint64_t start = record_start(record);
+    size_t read = record->inner.ops->read(record->inner.state, block_id, buffer);
+    record_call(record, BLOCK_STORE_TRACE_READ, read != 0, start, block_id, 0);
+    return read;
+}
+
+size_t record_write(void *const state, const size_t block_id, const void *buffer){
+    record_backend_t *record = (record_backend_t*)state;
+    uint64_t start = record_start(record);
+    size_t written = record->inner.ops->write(record->inner.state, block_id, buffer);
+    record_call(record, BLOCK_STORE_TRACE_WRITE, written != 0, start, block_id, 0);
+    return written;
+}
+
+bool record_allocate(void *const state, const size_t block_id){
+    record_backend_t *record = (record_backend_t*)state;
+    uint64_t start = record_start(record);
+    bool allocated = record->inner.ops->allocate(record->inner.state, block_id);
+    record_call(record, BLOCK_STORE_TRACE_ALLOCATE, allocated, start, block_id, 0);
+    return allocated;
+}
+
+void record_release(void *const state, const size_t block_id){
+    record_backend_t *record = (record_backend_t*)state;
+    uint64_t start = record_start(record);
+    record->inner.ops->release(record->inner.state, block_id);
+    record_call(record, BLOCK_STORE_TRACE_RELEASE, true, start, block_id, 0);
+}
+
+bool record_flush(void *const state){
+    record_backend_t *record = (record_backend_t*)state;
+    uint64_t start = record_start(record);
+    bool flushed = record->inner.ops->flush(record->inner.state);
+    record_call(record, BLOCK_STORE_TRACE_FLUSH, flushed, start, 0, 0);
+    return fflush(record->out) == 0 && flushed;
+}
+
+void record_close(void *const state){
+    record_backend_t *record = (record_backend_t*)state;
+    uint64_t start = record_start(record);
+    record->inner.ops->close(record->inner.state);
+    record_call(record, BLOCK_STORE_TRACE_CLOSE, true, start, 0, 0);
+    fflush(record->out);
+    free(record);
+}
+
+void record_info(void *const state, block_store_backend_info_t *const info){
+    record_backend_t *record = (record_backend_t*)state;
+    record->inner.ops->info(record->inner.state, info);
+}
+
+const block_store_ops_t record_ops = {"record", record_open, record_read, record_write, record_allocate, record_release, record_flush, record_close, record_info};
+
+/** Wraps a backend so every call to it is logged in binary, with when it was made and how long it took
+    \param inner The backend to record, closed along with this one
+    \param out Where the trace goes, left open
+    \return The backend, with no ops on error (inner is closed then too)
+*/
+block_store_backend_t block_store_backend_record(const block_store_backend_t inner, FILE *const out){
+    block_store_backend_t backend = {NULL, NULL};
+    if (!inner.ops){
+        return backend;
+    }
+    record_backend_t *record = out ? (record_backend_t*)calloc(1, sizeof(record_backend_t)) : NULL;
+    if (!record || fwrite(TRACE_MAGIC, 1, 4, out) != 4){
+        free(record);
+        inner.ops->close(inner.state);
+        return backend;
+    }
+    record->inner = inner;
+    record->out = out;
+    record->epoch = trace_clock();
+    backend.ops = &record_ops;
+    backend.state = record;
+    return backend;
+}
+
+bool trace_varint_read(FILE *const in, uint64_t *const value){
+    *value = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7){
+        int c = getc(in);
+        if (c == EOF){
+            return false;
+        }
+        *value |= (uint64_t)(c & 0x7F) << shift;
+        if (!(c & 0x80)){
+            return true;
+        }
+    }
+    return false;
+}
+
+/** Reads the next call from a trace made by block_store_backend_record
+    \param in The trace, read from where the previous call left it
+    \param record The call read, its start is taken from the previous one; zeroed for the first, which checks the header too
+    \return 1 for a call, 0 at the end of the trace, -1 if it is not a trace or is cut short
+*/
+int block_store_trace_read(FILE *const in, block_store_trace_record_t *const record){
+    if (!in || !record){
+        return -1;
+    }
+    if (record->op == BLOCK_STORE_TRACE_NONE){
+        char magic[4];
+        if (fread(magic, 1, 4, in) != 4 || memcmp(magic, TRACE_MAGIC, 4) != 0){
+            return -1;
+        }
+    }
+    int op = getc(in);
+    if (op == EOF){
+        return 0;
+    }
+    record->op = (block_store_trace_op_t)(op & ~TRACE_OK);
+    record->ok = op & TRACE_OK;
+    record->block_id = record->block_size = record->block_count = 0;
+    uint64_t since;
+    if (record->op < BLOCK_STORE_TRACE_OPEN || record->op > BLOCK_STORE_TRACE_CLOSE
+        || !trace_varint_read(in, &since) || !trace_varint_read(in, &record->nanos)){
+        return -1;
+    }
+    record->start_ns += since;
+    switch (record->op){
+    case BLOCK_STORE_TRACE_OPEN:
+        return trace_varint_read(in, &record->block_size) && trace_varint_read(in, &record->block_count) ? 1 : -1;
+    case BLOCK_STORE_TRACE_FLUSH:
+    case BLOCK_STORE_TRACE_CLOSE:
+        return 1;
+    default:
+        return trace_varint_read(in, &record->block_id) ? 1 : -1;
+    }
+}
@@ -3,6 +3,7 @@
 
 #include <gtest/gtest.h>
 #include <sys/stat.h>
+#include <unistd.h>
 #include "block_store.h"
 
 // The object is opaque, so we can't really test things directly....
@@ -516,3 +517,517 @@ TEST(block_store_deserialize, null_filename)
     score += 2;
 }
 
+
+
+TEST(block_store_export, round_trip)
+{
+    block_store_t *bs = block_store_create();
+    ASSERT_NE(nullptr, bs);
+    uint8_t same[BLOCK_SIZE_BYTES], mixed[BLOCK_SIZE_BYTES];
+    memset(same, 'a', BLOCK_SIZE_BYTES);
+    for (size_t i = 0; i < BLOCK_SIZE_BYTES; i++) {
+        mixed[i] = (uint8_t)(i * 7 + 1);
+    }
+    ASSERT_TRUE(block_store_request(bs, 10));
+    ASSERT_TRUE(block_store_request(bs, 300));
+    ASSERT_TRUE(block_store_request(bs, 511));
+    ASSERT_EQ(BLOCK_SIZE_BYTES, block_store_write(bs, 10, same));
+    ASSERT_EQ(BLOCK_SIZE_BYTES, block_store_write(bs, 300, mixed));
+    ASSERT_EQ(BLOCK_SIZE_BYTES, block_store_write(bs, 511, same));
+
+    // only the 3 blocks in use are stored, the ones holding the map go in the header
+    size_t raw = block_store_export(bs, "test_export.bs", 0);
+    ASSERT_EQ((size_t)(8 + BITMAP_SIZE_BYTES + 3 * (BLOCK_SIZE_BYTES + 2) + 8), raw);
+    size_t rle = block_store_export(bs, "test_export.bs", BLOCK_STORE_EXPORT_RLE);
+    ASSERT_EQ(raw - 2 * (BLOCK_SIZE_BYTES - 2), rle);   // the two blocks of 'a' shrink to one pair each
+    struct stat st;
+    ASSERT_EQ(0, stat("test_export.bs", &st));
+    ASSERT_EQ((off_t)rle, st.st_size);
+
+    block_store_t *imported = block_store_import("test_export.bs");
+    ASSERT_NE(nullptr, imported);
+    ASSERT_EQ(block_store_get_used_blocks(bs), block_store_get_used_blocks(imported));
+    ASSERT_FALSE(block_store_request(imported, 300));
+    ASSERT_TRUE(block_store_request(imported, 11));
+    uint8_t buffer[BLOCK_SIZE_BYTES];
+    ASSERT_EQ(BLOCK_SIZE_BYTES, block_store_read(imported, 300, buffer));
+    ASSERT_EQ(0, memcmp(buffer, mixed, BLOCK_SIZE_BYTES));
+    ASSERT_EQ(BLOCK_SIZE_BYTES, block_store_read(imported, 10, buffer));
+    ASSERT_EQ(0, memcmp(buffer, same, BLOCK_SIZE_BYTES));
+    ASSERT_EQ(BLOCK_SIZE_BYTES, block_store_write(imported, 511, mixed));  // replaced before it was ever read in
+    ASSERT_EQ(BLOCK_SIZE_BYTES, block_store_read(imported, 511, buffer));
+    ASSERT_EQ(0, memcmp(buffer, mixed, BLOCK_SIZE_BYTES));
+
+    // the full image of an imported device has every block in it
+    ASSERT_EQ((size_t)BLOCK_STORE_NUM_BYTES, block_store_serialize(imported, "test_export_full.bs"));
+    block_store_t *full = block_store_deserialize("test_export_full.bs");
+    ASSERT_NE(nullptr, full);
+    ASSERT_EQ(BLOCK_SIZE_BYTES, block_store_read(full, 10, buffer));
+    ASSERT_EQ(0, memcmp(buffer, same, BLOCK_SIZE_BYTES));
+
+    block_store_destroy(full);
+    block_store_destroy(imported);
+    block_store_destroy(bs);
+}
+
+TEST(block_store_export, lazy_import)
+{
+    block_store_t *bs = block_store_create();
+    ASSERT_NE(nullptr, bs);
+    uint8_t block[BLOCK_SIZE_BYTES];
+    memset(block, 'z', BLOCK_SIZE_BYTES);
+    ASSERT_TRUE(block_store_request(bs, 20));
+    ASSERT_TRUE(block_store_request(bs, 21));
+    ASSERT_EQ(BLOCK_SIZE_BYTES, block_store_write(bs, 20, block));
+    ASSERT_EQ(BLOCK_SIZE_BYTES, block_store_write(bs, 21, block));
+    ASSERT_NE(0u, block_store_export(bs, "test_lazy.bs", 0));
+    block_store_destroy(bs);
+
+    // a block read before the file goes away is there, one read after it is not
+    block_store_t *imported = block_store_import("test_lazy.bs");
+    ASSERT_NE(nullptr, imported);
+    uint8_t buffer[BLOCK_SIZE_BYTES];
+    ASSERT_EQ(BLOCK_SIZE_BYTES, block_store_read(imported, 20, buffer));
+    ASSERT_EQ(0, truncate("test_lazy.bs", 0));
+    ASSERT_EQ(BLOCK_SIZE_BYTES, block_store_read(imported, 20, buffer));
+    ASSERT_EQ(0, memcmp(buffer, block, BLOCK_SIZE_BYTES));
+    ASSERT_EQ(0u, block_store_read(imported, 21, buffer));
+    block_store_destroy(imported);
+}
+
+TEST(block_store_export, bad_input)
+{
+    ASSERT_EQ(0u, block_store_export(nullptr, "test_bad.bs", 0));
+    block_store_t *bs = block_store_create();
+    ASSERT_NE(nullptr, bs);
+    ASSERT_EQ(0u, block_store_export(bs, nullptr, 0));
+    ASSERT_EQ(nullptr, block_store_import(nullptr));
+    ASSERT_EQ(nullptr, block_store_import("test_missing.bs"));
+
+    // a full image is not a compact one, and neither is a cut off compact one
+    ASSERT_EQ((size_t)BLOCK_STORE_NUM_BYTES, block_store_serialize(bs, "test_bad.bs"));
+    ASSERT_EQ(nullptr, block_store_import("test_bad.bs"));
+    ASSERT_TRUE(block_store_request(bs, 5));
+    size_t size = block_store_export(bs, "test_bad.bs", 0);
+    ASSERT_NE(0u, size);
+    ASSERT_EQ(0, truncate("test_bad.bs", size - 12));
+    ASSERT_EQ(nullptr, block_store_import("test_bad.bs"));
+    block_store_destroy(bs);
+}
+
+TEST(block_store_checksum, crc32c)
+{
+    // the standard check value, and the same CRC when the data comes in pieces
+    const char *check = "123456789";
+    ASSERT_EQ(0xE3069283u, block_store_crc32c(0, check, 9));
+    ASSERT_EQ(0xE3069283u, block_store_crc32c(block_store_crc32c(0, check, 4), check + 4, 5));
+    ASSERT_EQ(0u, block_store_crc32c(0, check, 0));
+
+    // against a bit at a time reference, at every length around the 8 byte steps
+    uint8_t data[100];
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = (uint8_t)(i * 37 + 11);
+    }
+    for (size_t length = 0; length <= sizeof(data); length++) {
+        uint32_t crc = 0xFFFFFFFF;
+        for (size_t i = 0; i < length; i++) {
+            crc ^= data[i];
+            for (int bit = 0; bit < 8; bit++) {
+                crc = (crc >> 1) ^ ((crc & 1) ? 0x82F63B78 : 0);
+            }
+        }
+        ASSERT_EQ(~crc, block_store_crc32c(0, data, length));
+    }
+}
+
+TEST(block_store_checksum, verified_reads)
+{
+    block_store_t *bs = block_store_create();
+    ASSERT_NE(nullptr, bs);
+    ASSERT_FALSE(block_store_checksums(nullptr, true));
+    ASSERT_TRUE(block_store_checksums(bs, true));
+    uint8_t block[BLOCK_SIZE_BYTES], buffer[BLOCK_SIZE_BYTES];
+    memset(block, 'c', BLOCK_SIZE_BYTES);
+    ASSERT_TRUE(block_store_request(bs, 30));
+    ASSERT_TRUE(block_store_request(bs, 31));
+    ASSERT_EQ(BLOCK_SIZE_BYTES, block_store_write(bs, 30, block));
+    ASSERT_EQ(BLOCK_SIZE_BYTES, block_store_write(bs, 31, block));
+    ASSERT_EQ(BLOCK_SIZE_BYTES, block_store_read(bs, 30, buffer));
+    ASSERT_EQ(0, memcmp(buffer, block, BLOCK_SIZE_BYTES));
+    block_store_checksum_stats_t stats;
+    ASSERT_TRUE(block_store_checksum_stats(bs, &stats));
+    ASSERT_EQ(1u, stats.verified);
+    ASSERT_EQ(0u, stats.mismatches);
+
+    // the checksums go out with the image; damage one stored block in the file
+    size_t size = block_store_export(bs, "test_checksum.bs", 0);
+    ASSERT_EQ((size_t)(8 + BITMAP_SIZE_BYTES + 2 * (BLOCK_SIZE_BYTES + 6) + 8), size);
+    FILE *file = fopen("test_checksum.bs", "r+b");
+    ASSERT_NE(nullptr, file);
+    ASSERT_EQ(0, fseek(file, 8 + BITMAP_SIZE_BYTES + BLOCK_SIZE_BYTES + 3, SEEK_SET));
+    ASSERT_EQ('x', fputc('x', file));
+    ASSERT_EQ(0, fclose(file));
+    block_store_destroy(bs);
+
+    // the damaged block fails to read, every time, the other one and the unused ones are fine
+    block_store_t *imported = block_store_import("test_checksum.bs");
+    ASSERT_NE(nullptr, imported);
+    ASSERT_EQ(BLOCK_SIZE_BYTES, block_store_read(imported, 30, buffer));
+    ASSERT_EQ(0, memcmp(buffer, block, BLOCK_SIZE_BYTES));
+    ASSERT_EQ(0u, block_store_read(imported, 31, buffer));
+    ASSERT_EQ(0u, block_store_read(imported, 31, buffer));
+    ASSERT_EQ(BLOCK_SIZE_BYTES, block_store_read(imported, 400, buffer));
+    ASSERT_TRUE(block_store_checksum_stats(imported, &stats));
+    ASSERT_EQ(4u, stats.verified);
+    ASSERT_EQ(2u, stats.mismatches);
+    ASSERT_EQ(0u, block_store_export(imported, "test_checksum_copy.bs", 0));   // checks 30 and 31 once more
+
+    // rewriting the block repairs it, turning checksums off stops the checking
+    ASSERT_EQ(BLOCK_SIZE_BYTES, block_store_write(imported, 31, block));
+    ASSERT_EQ(BLOCK_SIZE_BYTES, block_store_read(imported, 31, buffer));
+    ASSERT_TRUE(block_store_checksums(imported, false));
+    ASSERT_EQ(BLOCK_SIZE_BYTES, block_store_read(imported, 31, buffer));
+    ASSERT_TRUE(block_store_checksum_stats(imported, &stats));
+    ASSERT_EQ(7u, stats.verified);
+    ASSERT_EQ(3u, stats.mismatches);
+    block_store_destroy(imported);
+}
+
+TEST(block_store_checksum, scrubber)
+{
+    block_store_t *bs = block_store_create();
+    ASSERT_NE(nullptr, bs);
+    ASSERT_FALSE(block_store_scrub_start(bs, 1000));    // checksums are off
+    ASSERT_TRUE(block_store_checksums(bs, true));
+    uint8_t block[BLOCK_SIZE_BYTES];
+    memset(block, 's', BLOCK_SIZE_BYTES);
+    for (size_t block_id = 40; block_id < 50; block_id++) {
+        ASSERT_TRUE(block_store_request(bs, block_id));
+        ASSERT_EQ(BLOCK_SIZE_BYTES, block_store_write(bs, block_id, block));
+    }
+    ASSERT_NE(0u, block_store_export(bs, "test_scrub.bs", 0));
+    FILE *file = fopen("test_scrub.bs", "r+b");
+    ASSERT_NE(nullptr, file);
+    ASSERT_EQ(0, fseek(file, 8 + BITMAP_SIZE_BYTES + 5 * BLOCK_SIZE_BYTES, SEEK_SET));
+    ASSERT_EQ('x', fputc('x', file));
+    ASSERT_EQ(0, fclose(file));
+    block_store_destroy(bs);
+
+    // the scrubber finds the damaged block without anyone reading it, while the device stays in use
+    block_store_t *imported = block_store_import("test_scrub.bs");
+    ASSERT_NE(nullptr, imported);
+    ASSERT_FALSE(block_store_scrub_start(imported, 0));
+    ASSERT_TRUE(block_store_scrub_start(imported, 100000));
+    ASSERT_FALSE(block_store_scrub_start(imported, 100000));
+    block_store_checksum_stats_t stats = {0, 0, 0, 0};
+    for (int i = 0; i < 2000 && stats.passes < 2; i++) {
+        size_t block_id = block_store_allocate(imported);
+        ASSERT_NE(SIZE_MAX, block_id);
+        ASSERT_EQ(BLOCK_SIZE_BYTES, block_store_write(imported, block_id, block));
+        block_store_release(imported, block_id);
+        usleep(1000);
+        ASSERT_TRUE(block_store_checksum_stats(imported, &stats));
+    }
+    block_store_scrub_stop(imported);
+    block_store_scrub_stop(imported);
+    ASSERT_GE(stats.passes, 2u);
+    ASSERT_GE(stats.scrubbed, 20u);
+    ASSERT_GE(stats.mismatches, 2u);    // found again on every pass
+
+    // a slow scrubber still stops right away
+    ASSERT_TRUE(block_store_scrub_start(imported, 1));
+    block_store_destroy(imported);
+}
+
+TEST(block_store_backend, ram)
+{
+    ASSERT_EQ(nullptr, block_store_create_backend(BLOCK_STORE_BACKEND_HEAP, BLOCK_STORE_HUGE_PAGES, -1));
+    ASSERT_EQ(nullptr, block_store_create_backend(BLOCK_STORE_BACKEND_RAM, BLOCK_STORE_NUMA_BIND, 4096));
+    block_store_backend_info_t info;
+    ASSERT_FALSE(block_store_backend_info(nullptr, &info));
+
+    const int flags[] = {0, BLOCK_STORE_HUGE_PAGES, BLOCK_STORE_HUGE_PAGES | BLOCK_STORE_NUMA_BIND};
+    for (int f : flags) {
+        block_store_t *bs = block_store_create_backend(BLOCK_STORE_BACKEND_RAM, f, 0);
+        if (bs == nullptr && (f & BLOCK_STORE_NUMA_BIND)) {
+            continue;    // a kernel without NUMA support
+        }
+        ASSERT_NE(nullptr, bs);
+        ASSERT_TRUE(block_store_backend_info(bs, &info));
+        ASSERT_STREQ("ram", info.backend);
+        ASSERT_EQ((f & BLOCK_STORE_NUMA_BIND) ? 0 : -1, info.numa_node);
+        if (f & BLOCK_STORE_HUGE_PAGES) {
+            ASSERT_EQ(0u, info.mapped_bytes % (2u << 20));
+        } else {
+            ASSERT_STREQ("normal", info.pages);
+        }
+
+        // the same device as any other, and it carries over to a heap one
+        ASSERT_EQ(BLOCK_STORE_NUM_BLOCKS - 2, block_store_get_free_blocks(bs));
+        uint8_t block[BLOCK_SIZE_BYTES], buffer[BLOCK_SIZE_BYTES];
+        memset(block, 'r', BLOCK_SIZE_BYTES);
+        size_t id = block_store_allocate(bs);
+        ASSERT_EQ(0u, id);
+        ASSERT_EQ(BLOCK_SIZE_BYTES, block_store_write(bs, id, block));
+        ASSERT_EQ(BLOCK_STORE_NUM_BYTES, block_store_serialize(bs, "test_ram.bs"));
+        block_store_destroy(bs);
+        bs = block_store_deserialize("test_ram.bs");
+        ASSERT_NE(nullptr, bs);
+        ASSERT_TRUE(block_store_backend_info(bs, &info));
+        ASSERT_STREQ("heap", info.backend);
+        ASSERT_FALSE(block_store_request(bs, id));
+        ASSERT_EQ(BLOCK_SIZE_BYTES, block_store_read(bs, id, buffer));
+        ASSERT_EQ(0, memcmp(block, buffer, BLOCK_SIZE_BYTES));
+        block_store_destroy(bs);
+    }
+}
+
+TEST(block_store_backend, file_and_mmap)
+{
+    uint8_t block[BLOCK_SIZE_BYTES], buffer[BLOCK_SIZE_BYTES];
+    memset(block, 'f', BLOCK_SIZE_BYTES);
+    ASSERT_EQ(nullptr, block_store_backend_file(nullptr).ops);
+    ASSERT_EQ(nullptr, block_store_create_on(block_store_backend_mmap(nullptr)));
+
+    for (int mapped = 0; mapped < 2; mapped++) {
+        const char *name = mapped ? "test_backend_mmap.bs" : "test_backend_file.bs";
+        unlink(name);
+        block_store_t *bs = block_store_create_on(mapped ? block_store_backend_mmap(name) : block_store_backend_file(name));
+        ASSERT_NE(nullptr, bs);
+        block_store_backend_info_t info;
+        ASSERT_TRUE(block_store_backend_info(bs, &info));
+        ASSERT_STREQ(mapped ? "mmap" : "file", info.backend);
+        ASSERT_STREQ("file", info.pages);
+        ASSERT_EQ(BLOCK_STORE_NUM_BLOCKS - 2, block_store_get_free_blocks(bs));
+        ASSERT_TRUE(block_store_request(bs, 300));
+        ASSERT_EQ(BLOCK_SIZE_BYTES, block_store_write(bs, 300, block));
+        ASSERT_TRUE(block_store_checksums(bs, true));    // checksums sit above any backend
+        ASSERT_EQ(BLOCK_SIZE_BYTES, block_store_read(bs, 300, buffer));
+        ASSERT_TRUE(block_store_flush(bs));
+        block_store_destroy(bs);
+
+        // the file is a serialize image, the map and the block are in it
+        struct stat st;
+        ASSERT_EQ(0, stat(name, &st));
+        ASSERT_EQ(BLOCK_STORE_NUM_BYTES, st.st_size);
+        bs = block_store_deserialize(name);
+        ASSERT_NE(nullptr, bs);
+        ASSERT_FALSE(block_store_request(bs, 300));
+        block_store_destroy(bs);
+
+        // and opening it again brings the device back
+        bs = block_store_create_on(mapped ? block_store_backend_file(name) : block_store_backend_mmap(name));
+        ASSERT_NE(nullptr, bs);
+        ASSERT_EQ(BLOCK_STORE_NUM_BLOCKS - 3, block_store_get_free_blocks(bs));
+        ASSERT_FALSE(block_store_request(bs, 300));
+        ASSERT_EQ(BLOCK_SIZE_BYTES, block_store_read(bs, 300, buffer));
+        ASSERT_EQ(0, memcmp(block, buffer, BLOCK_SIZE_BYTES));
+        block_store_destroy(bs);
+    }
+}
+
+TEST(block_store_backend, trace)
+{
+    FILE *log = tmpfile();
+    ASSERT_NE(nullptr, log);
+    ASSERT_EQ(nullptr, block_store_backend_trace(block_store_backend_memory(BLOCK_STORE_BACKEND_HEAP, 0, -1), nullptr).ops);
+    block_store_t *bs = block_store_create_on(block_store_backend_trace(block_store_backend_memory(BLOCK_STORE_BACKEND_HEAP, 0, -1), log));
+    ASSERT_NE(nullptr, bs);
+    block_store_backend_info_t info;
+    ASSERT_TRUE(block_store_backend_info(bs, &info));
+    ASSERT_STREQ("trace", info.backend);
+    ASSERT_STREQ("normal", info.pages);
+
+    uint8_t block[BLOCK_SIZE_BYTES];
+    memset(block, 't', BLOCK_SIZE_BYTES);
+    size_t id = block_store_allocate(bs);
+    ASSERT_EQ(0u, id);
+    ASSERT_EQ(BLOCK_SIZE_BYTES, block_store_write(bs, id, block));
+    ASSERT_EQ(BLOCK_SIZE_BYTES, block_store_read(bs, id, block));
+    ASSERT_EQ(BLOCK_SIZE_BYTES, block_store_read(bs, BITMAP_START_BLOCK, block));    // the map is served by the device
+    block_store_release(bs, id);
+    ASSERT_TRUE(block_store_flush(bs));
+    block_store_destroy(bs);
+
+    // the backend is sized, the map is loaded and set up, then every call in order
+    const char *expected =
+        "open 32 512 1\nread 127 32\nread 128 32\nwrite 127 32\nwrite 128 32\n"
+        "allocate 0 1\nwrite 127 32\nwrite 0 32\nread 0 32\nrelease 0\nwrite 127 32\nflush 1\n";
+    char lines[512] = {0};
+    rewind(log);
+    ASSERT_EQ(strlen(expected), fread(lines, 1, sizeof(lines) - 1, log));
+    ASSERT_STREQ(expected, lines);
+    fclose(log);
+}
+
+TEST(block_store_backend, record)
+{
+    FILE *out = tmpfile();
+    ASSERT_NE(nullptr, out);
+    ASSERT_EQ(nullptr, block_store_backend_record(block_store_backend_memory(BLOCK_STORE_BACKEND_HEAP, 0, -1), nullptr).ops);
+    block_store_t *bs = block_store_create_on(block_store_backend_record(block_store_backend_memory(BLOCK_STORE_BACKEND_HEAP, 0, -1), out));
+    ASSERT_NE(nullptr, bs);
+    block_store_backend_info_t info;
+    ASSERT_TRUE(block_store_backend_info(bs, &info));
+    ASSERT_STREQ("record", info.backend);
+
+    uint8_t block[BLOCK_SIZE_BYTES];
+    memset(block, 'r', BLOCK_SIZE_BYTES);
+    size_t id = block_store_allocate(bs);
+    ASSERT_EQ(BLOCK_SIZE_BYTES, block_store_write(bs, id, block));
+    ASSERT_EQ(BLOCK_SIZE_BYTES, block_store_read(bs, id, block));
+    block_store_release(bs, id);
+    ASSERT_TRUE(block_store_flush(bs));
+    block_store_destroy(bs);
+
+    // the same calls as the text trace, then the close; each record takes a few bytes
+    const block_store_trace_op_t O = BLOCK_STORE_TRACE_OPEN, R = BLOCK_STORE_TRACE_READ, W = BLOCK_STORE_TRACE_WRITE,
+        A = BLOCK_STORE_TRACE_ALLOCATE, F = BLOCK_STORE_TRACE_FLUSH, C = BLOCK_STORE_TRACE_CLOSE;
+    const block_store_trace_op_t expected[] = {O, R, R, W, W, A, W, W, R, BLOCK_STORE_TRACE_RELEASE, W, F, C};
+    const uint64_t ids[] = {0, 127, 128, 127, 128, 0, 127, 0, 0, 0, 127, 0, 0};
+    ASSERT_GT(16 * sizeof(expected) / sizeof(expected[0]), (size_t)ftell(out));
+    rewind(out);
+    block_store_trace_record_t record;
+    memset(&record, 0, sizeof(record));
+    uint64_t last_start = 0;
+    for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); i++) {
+        ASSERT_EQ(1, block_store_trace_read(out, &record));
+        ASSERT_EQ(expected[i], record.op);
+        ASSERT_TRUE(record.ok);
+        ASSERT_EQ(ids[i], record.block_id);
+        ASSERT_LE(last_start, record.start_ns);
+        last_start = record.start_ns;
+    }
+    ASSERT_EQ(0, block_store_trace_read(out, &record));
+
+    // it replays onto another backend with the same outcome
+    rewind(out);
+    memset(&record, 0, sizeof(record));
+    ASSERT_EQ(1, block_store_trace_read(out, &record));
+    ASSERT_EQ(BLOCK_SIZE_BYTES, record.block_size);
+    ASSERT_EQ(BLOCK_STORE_NUM_BLOCKS, record.block_count);
+    block_store_backend_t replay = block_store_backend_memory(BLOCK_STORE_BACKEND_HEAP, 0, -1);
+    ASSERT_TRUE(replay.ops->open(replay.state, record.block_size, record.block_count));
+    while (block_store_trace_read(out, &record) == 1) {
+        if (record.op == BLOCK_STORE_TRACE_READ) {
+            ASSERT_EQ(BLOCK_SIZE_BYTES, replay.ops->read(replay.state, record.block_id, block));
+        }
+        else if (record.op == BLOCK_STORE_TRACE_WRITE) {
+            ASSERT_EQ(BLOCK_SIZE_BYTES, replay.ops->write(replay.state, record.block_id, block));
+        }
+        else if (record.op == BLOCK_STORE_TRACE_ALLOCATE) {
+            ASSERT_TRUE(replay.ops->allocate(replay.state, record.block_id));
+        }
+    }
+    replay.ops->close(replay.state);
+
+    // not a trace, and one cut short
+    rewind(out);
+    fputs("BSX1", out);
+    rewind(out);
+    memset(&record, 0, sizeof(record));
+    ASSERT_EQ(-1, block_store_trace_read(out, &record));
+    fclose(out);
+    out = tmpfile();
+    ASSERT_NE(nullptr, out);
+    fwrite("BST1\x81\x80", 1, 6, out);
+    rewind(out);
+    memset(&record, 0, sizeof(record));
+    ASSERT_EQ(-1, block_store_trace_read(out, &record));
+    ASSERT_EQ(-1, block_store_trace_read(nullptr, &record));
+    fclose(out);
+}
+
+TEST(block_store_geometry, create)
+{
+    block_store_geometry_t bad[] = {
+        {48, 1024, BLOCK_STORE_BITMAP_DEFAULT},      // not a power of two
+        {16, 1024, BLOCK_STORE_BITMAP_DEFAULT},      // too small
+        {1 << 17, 1024, BLOCK_STORE_BITMAP_DEFAULT}, // too big
+        {512, BLOCK_STORE_MAX_BLOCKS + 1, BLOCK_STORE_BITMAP_DEFAULT},
+        {512, 1, 0},                                 // nothing but the map
+        {512, 8192, 8191},                           // the map runs off the end
+    };
+    for (const block_store_geometry_t &geometry : bad) {
+        ASSERT_EQ(nullptr, block_store_create_geometry(&geometry, block_store_backend_memory(BLOCK_STORE_BACKEND_HEAP, 0, -1)));
+    }
+
+    // zeros are the defaults
+    block_store_geometry_t geometry = {0, 0, BLOCK_STORE_BITMAP_DEFAULT};
+    block_store_t *bs = block_store_create_geometry(&geometry, block_store_backend_memory(BLOCK_STORE_BACKEND_HEAP, 0, -1));
+    ASSERT_NE(nullptr, bs);
+    ASSERT_TRUE(block_store_get_geometry(bs, &geometry));
+    ASSERT_EQ((size_t)BLOCK_SIZE_BYTES, geometry.block_size);
+    ASSERT_EQ((size_t)BLOCK_STORE_NUM_BLOCKS, geometry.block_count);
+    ASSERT_EQ((size_t)BITMAP_START_BLOCK, geometry.bitmap_start);
+    block_store_destroy(bs);
+
+    // 4 KiB blocks, more than a uint16 count, the map (4 blocks) up front
+    geometry = {4096, 100000, 0};
+    bs = block_store_create_geometry(&geometry, block_store_backend_memory(BLOCK_STORE_BACKEND_HEAP, 0, -1));
+    ASSERT_NE(nullptr, bs);
+    ASSERT_EQ(100000u - 4, block_store_get_free_blocks(bs));
+    ASSERT_EQ(4u, block_store_allocate(bs));
+    ASSERT_TRUE(block_store_request(bs, 99999));
+    ASSERT_FALSE(block_store_request(bs, 100000));
+    uint8_t *block = (uint8_t *) malloc(4096), *buffer = (uint8_t *) malloc(4096);
+    for (size_t i = 0; i < 4096; i++) {
+        block[i] = (uint8_t)(i / 100);
+    }
+    ASSERT_EQ(4096u, block_store_write(bs, 99999, block));
+    ASSERT_EQ(4096u, block_store_read(bs, 99999, buffer));
+    ASSERT_EQ(0, memcmp(block, buffer, 4096));
+    ASSERT_EQ(0u, block_store_write(bs, 100000, block));
+
+    // the wide export header carries the geometry, checksums and all
+    ASSERT_TRUE(block_store_checksums(bs, true));
+    size_t size = block_store_export(bs, "test_geometry.bs", BLOCK_STORE_EXPORT_RLE);
+    ASSERT_NE(0u, size);
+    ASSERT_LT(size, 100000u / 8 + 2 * 4096);    // the map and two blocks, one of them all zeros and RLE'd
+    block_store_destroy(bs);
+    bs = block_store_import("test_geometry.bs");
+    ASSERT_NE(nullptr, bs);
+    ASSERT_TRUE(block_store_get_geometry(bs, &geometry));
+    ASSERT_EQ(4096u, geometry.block_size);
+    ASSERT_EQ(100000u, geometry.block_count);
+    ASSERT_EQ(0u, geometry.bitmap_start);
+    ASSERT_EQ(100000u - 6, block_store_get_free_blocks(bs));
+    ASSERT_EQ(4096u, block_store_read(bs, 99999, buffer));
+    ASSERT_EQ(0, memcmp(block, buffer, 4096));
+    block_store_checksum_stats_t stats;
+    ASSERT_TRUE(block_store_checksum_stats(bs, &stats));
+    ASSERT_EQ(1u, stats.verified);
+    block_store_destroy(bs);
+    free(block);
+    free(buffer);
+}
+
+TEST(block_store_geometry, file_backend)
+{
+    // 64 KiB blocks, the map at its default place (block 15 of 64)
+    block_store_geometry_t geometry = {65536, 64, BLOCK_STORE_BITMAP_DEFAULT};
+    unlink("test_geometry_file.bs");
+    block_store_t *bs = block_store_create_geometry(&geometry, block_store_backend_file("test_geometry_file.bs"));
+    ASSERT_NE(nullptr, bs);
+    ASSERT_TRUE(block_store_get_geometry(bs, &geometry));
+    ASSERT_EQ(15u, geometry.bitmap_start);
+    ASSERT_EQ(0u, block_store_allocate(bs));
+    ASSERT_TRUE(block_store_request(bs, 63));
+    uint8_t *block = (uint8_t *) calloc(1, 65536), *buffer = (uint8_t *) calloc(1, 65536);
+    memset(block + 1000, 'g', 1000);
+    ASSERT_EQ(65536u, block_store_write(bs, 63, block));
+    ASSERT_EQ(64u * 65536, block_store_serialize(bs, "test_geometry_full.bs"));
+    block_store_destroy(bs);
+
+    struct stat st;
+    ASSERT_EQ(0, stat("test_geometry_file.bs", &st));
+    ASSERT_EQ(64 * 65536, st.st_size);
+    bs = block_store_create_geometry(&geometry, block_store_backend_mmap("test_geometry_file.bs"));
+    ASSERT_NE(nullptr, bs);
+    ASSERT_EQ(64u - 3, block_store_get_free_blocks(bs));
+    ASSERT_EQ(65536u, block_store_read(bs, 63, buffer));
+    ASSERT_EQ(0, memcmp(block, buffer, 65536));
+    block_store_destroy(bs);
+    free(block);
+    free(buffer);
+}
@@ -0,0 +1,246 @@
+// Benchmarks of the FS metadata and data paths, on Google Benchmark.
+//  usage: fs_bench [--benchmark_filter=regex] [--benchmark_format=json] [--benchmark_out=results.json --benchmark_out_format=json]
+//  Each benchmark formats its own image (fs_bench_<thread>.FS in the working directory) outside the timed loop and removes it after.
+//  Besides time, every benchmark reports the blocks the FS read and wrote per iteration (see fs_get_stats) and,
+//  for the data paths, bytes per second.
+//    create_remove   fs_create, fs_open, fs_close and fs_remove of one file, in a directory already holding arg files
+//    deep_open       fs_open and fs_close of a file arg directories down
+//    seq_write       fs_write of arg bytes at a time, going around a file of bench_file_size bytes
+//    seq_read        fs_read of the same
+//    rand_read       fs_seek to a random multiple of arg, then fs_read of arg bytes
+//    rand_write      fs_seek to a random multiple of arg, then fs_write of arg bytes
+//    list_dir        fs_get_dir of a directory of arg entries, and fs_opendir/fs_readdir through it
+//    mixed           70% random reads, 20% random writes, 10% create/remove, on 1, 2 and 4 threads
+//  The FS does no locking of its own, so each thread of the mixed load works on an image of its own.
+#include <benchmark/benchmark.h>
+#include <random>
+#include <string>
+#include <unistd.h>
+extern "C"
+{
+#include "FS.h"
+}
+
+// the file the data paths work on: 16 MiB, well into the double indirect blocks
+static const size_t bench_file_size = 16u << 20;
+
+// an image for one thread of one benchmark, formatted before and removed after the timed loop
+class Image
+{
+public:
+    explicit Image(const benchmark::State &state) : path("fs_bench_" + std::to_string(state.thread_index()) + ".FS")
+    {
+        fs = fs_format(path.c_str());
+    }
+    ~Image()
+    {
+        fs_unmount(fs);
+        unlink(path.c_str());
+    }
+    // the block reads and writes per iteration since the last call, as counters of state (averaged over the threads)
+    void report(benchmark::State &state, size_t iterations)
+    {
+        fs_stats_t *stats = new fs_stats_t;
+        fs_get_stats(fs, stats);
+        if (stats->enabled && iterations > 0)
+        {
+            double reads = (double)(stats->ops[FS_OP_BLOCK_READ].calls - block_reads) / iterations;
+            double writes = (double)(stats->ops[FS_OP_BLOCK_WRITE].calls - block_writes) / iterations;
+            state.counters["block_reads"] = benchmark::Counter(reads, benchmark::Counter::kAvgThreads);
+            state.counters["block_writes"] = benchmark::Counter(writes, benchmark::Counter::kAvgThreads);
+        }
+        block_reads = stats->ops[FS_OP_BLOCK_READ].calls;
+        block_writes = stats->ops[FS_OP_BLOCK_WRITE].calls;
+        delete stats;
+    }
+    FS_t *fs;
+
+private:
+    std::string path;
+    uint64_t block_reads = 0, block_writes = 0;
+};
+
+// creates path and fills it with size bytes, returning it open; -1 on error
+static int make_file(FS_t *fs, const char *path, size_t size)
+{
+    std::string chunk(64 << 10, 'f');
+    int fd = fs_create(fs, path, FS_REGULAR) == 0 ? fs_open(fs, path) : -1;
+    for (size_t done = 0; fd >= 0 && done < size; done += chunk.size())
+    {
+        if (fs_write(fs, fd, chunk.data(), chunk.size()) != (ssize_t)chunk.size())
+        {
+            return -1;
+        }
+    }
+    return fd;
+}
+
+static void create_remove(benchmark::State &state)
+{
+    Image image(state);
+    for (int64_t i = 0; i < state.range(0); i++)
+    {
+        fs_create(image.fs, ("/other" + std::to_string(i)).c_str(), FS_REGULAR);
+    }
+    image.report(state, 0);
+    for (auto _ : state)
+    {
+        if (fs_create(image.fs, "/file", FS_REGULAR) < 0)
+        {
+            state.SkipWithError("fs_create failed");
+            break;
+        }
+        fs_close(image.fs, fs_open(image.fs, "/file"));
+        fs_remove(image.fs, "/file");
+    }
+    image.report(state, state.iterations());
+}
+BENCHMARK(create_remove)->Arg(0)->Arg(8)->Arg(30);
+
+static void deep_open(benchmark::State &state)
+{
+    Image image(state);
+    std::string path;
+    for (int64_t depth = 0; depth < state.range(0); depth++)
+    {
+        path += "/dir" + std::to_string(depth);
+        fs_create(image.fs, path.c_str(), FS_DIRECTORY);
+    }
+    path += "/file";
+    fs_create(image.fs, path.c_str(), FS_REGULAR);
+    image.report(state, 0);
+    for (auto _ : state)
+    {
+        int fd = fs_open(image.fs, path.c_str());
+        if (fd < 0)
+        {
+            state.SkipWithError("fs_open failed");
+            break;
+        }
+        fs_close(image.fs, fd);
+    }
+    image.report(state, state.iterations());
+}
+BENCHMARK(deep_open)->Arg(0)->Arg(4)->Arg(16)->Arg(64);
+
+// sequential passes over the bench file, arg bytes a call
+static void sequential(benchmark::State &state, bool write)
+{
+    Image image(state);
+    size_t size = (size_t)state.range(0);
+    int fd = make_file(image.fs, "/data", bench_file_size);
+    std::string buffer(size, 'w');
+    fs_seek(image.fs, fd, 0, FS_SEEK_SET);
+    image.report(state, 0);
+    size_t position = 0;
+    for (auto _ : state)
+    {
+        if (position + size > bench_file_size)
+        {
+            fs_seek(image.fs, fd, 0, FS_SEEK_SET);
+            position = 0;
+        }
+        ssize_t moved = write ? fs_write(image.fs, fd, buffer.data(), size) : fs_read(image.fs, fd, &buffer[0], size);
+        if (moved != (ssize_t)size)
+        {
+            state.SkipWithError(write ? "fs_write failed" : "fs_read failed");
+            break;
+        }
+        position += size;
+    }
+    state.SetBytesProcessed(state.iterations() * size);
+    image.report(state, state.iterations());
+}
+
+// arg bytes a call at random multiples of arg in the bench file
+static void random_access(benchmark::State &state, bool write)
+{
+    Image image(state);
+    size_t size = (size_t)state.range(0);
+    int fd = make_file(image.fs, "/data", bench_file_size);
+    std::string buffer(size, 'w');
+    std::mt19937_64 random(4520 + state.thread_index());
+    image.report(state, 0);
+    for (auto _ : state)
+    {
+        off_t offset = (off_t)(random() % (bench_file_size / size)) * size;
+        fs_seek(image.fs, fd, offset, FS_SEEK_SET);
+        ssize_t moved = write ? fs_write(image.fs, fd, buffer.data(), size) : fs_read(image.fs, fd, &buffer[0], size);
+        if (moved != (ssize_t)size)
+        {
+            state.SkipWithError(write ? "fs_write failed" : "fs_read failed");
+            break;
+        }
+    }
+    state.SetBytesProcessed(state.iterations() * size);
+    image.report(state, state.iterations());
+}
+
+BENCHMARK_CAPTURE(sequential, seq_write, true)->RangeMultiplier(8)->Range(64, 256 << 10);
+BENCHMARK_CAPTURE(sequential, seq_read, false)->RangeMultiplier(8)->Range(64, 256 << 10);
+BENCHMARK_CAPTURE(random_access, rand_read, false)->RangeMultiplier(8)->Range(64, 256 << 10);
+BENCHMARK_CAPTURE(random_access, rand_write, true)->RangeMultiplier(8)->Range(64, 256 << 10);
+
+static void list_dir(benchmark::State &state)
+{
+    Image image(state);
+    fs_create(image.fs, "/dir", FS_DIRECTORY);
+    for (int64_t i = 0; i < state.range(0); i++)
+    {
+        fs_create(image.fs, ("/dir/entry" + std::to_string(i)).c_str(), i % 2 ? FS_DIRECTORY : FS_REGULAR);
+    }
+    image.report(state, 0);
+    file_record_t record;
+    size_t listed = 0;
+    for (auto _ : state)
+    {
+        dyn_array_t *entries = fs_get_dir(image.fs, "/dir");
+        fs_dir_t *dir = fs_opendir(image.fs, "/dir");
+        if (entries == NULL || dir == NULL)
+        {
+            state.SkipWithError("could not list /dir");
+            break;
+        }
+        while (fs_readdir(dir, &record) == 1)
+        {
+            listed++;
+        }
+        fs_closedir(dir);
+        dyn_array_destroy(entries);
+    }
+    state.counters["entries"] = state.iterations() ? (double)listed / state.iterations() : 0;
+    image.report(state, state.iterations());
+}
+BENCHMARK(list_dir)->Arg(1)->Arg(8)->Arg(31);
+
+static void mixed(benchmark::State &state)
+{
+    Image image(state);
+    const size_t size = BLOCK_SIZE_BYTES;
+    int fd = make_file(image.fs, "/data", bench_file_size);
+    std::string buffer(size, 'm');
+    std::mt19937_64 random(4520 + state.thread_index());
+    image.report(state, 0);
+    for (auto _ : state)
+    {
+        uint64_t pick = random();
+        if (pick % 10 == 9)
+        {
+            fs_create(image.fs, "/file", FS_REGULAR);
+            fs_close(image.fs, fs_open(image.fs, "/file"));
+            fs_remove(image.fs, "/file");
+            continue;
+        }
+        fs_seek(image.fs, fd, (off_t)((pick >> 8) % (bench_file_size / size)) * size, FS_SEEK_SET);
+        ssize_t moved = pick % 10 < 7 ? fs_read(image.fs, fd, &buffer[0], size) : fs_write(image.fs, fd, buffer.data(), size);
+        if (moved != (ssize_t)size)
+        {
+            state.SkipWithError("fs_read/fs_write failed");
+            break;
+        }
+    }
+    image.report(state, state.iterations());
+}
+BENCHMARK(mixed)->Threads(1)->Threads(2)->Threads(4)->UseRealTime();
+
+BENCHMARK_MAIN();
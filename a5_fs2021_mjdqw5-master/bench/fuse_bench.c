@@ -0,0 +1,113 @@
+// Sequential throughput through a mounted fs_fuse compared to the FS library called directly.
+//  usage: fs_fuse_bench mountpoint [MiB] [KiB]
+//    mountpoint  where fs_fuse has an image mounted, e.g. fs_fuse bench.FS /tmp/mnt
+//    MiB         size of the file written and read back (default 64)
+//    KiB         bytes per call (default 1024, the largest request fs_fuse asks the kernel for)
+//  The direct side writes and reads the same file with fs_write and fs_read on an image of its own
+//  (fuse_bench.FS in the working directory); the FUSE side uses pwrite and pread on mountpoint/fuse_bench.dat,
+//  Both sides flush after the writes (fs_flush, fsync) so the clock stops only once the data is on disk.
+//  The FUSE reads come back through the page cache once written, drop it first (echo 1 > /proc/sys/vm/drop_caches)
+//  to time the daemon rather than the cache.
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "FS.h"
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// ns to write size bytes, chunk at a time, then read them back; -1 when a call falls short
+static int direct_pass(size_t size, size_t chunk, uint8_t *buffer, double *write_ns, double *read_ns)
+{
+    unlink("fuse_bench.FS");
+    FS_t *fs = fs_format("fuse_bench.FS");
+    int fd = fs != NULL && fs_create(fs, "/fuse_bench.dat", FS_REGULAR) == 0 ? fs_open(fs, "/fuse_bench.dat") : -1;
+    int result = fd < 0 ? -1 : 0;
+    double start = now_ns();
+    for (size_t done = 0; result == 0 && done < size; done += chunk)
+    {
+        result = fs_write(fs, fd, buffer, chunk) == (ssize_t)chunk ? 0 : -1;
+    }
+    result = result == 0 ? fs_flush(fs) : result;
+    *write_ns = now_ns() - start;
+    fs_seek(fs, fd, 0, FS_SEEK_SET);
+    start = now_ns();
+    for (size_t done = 0; result == 0 && done < size; done += chunk)
+    {
+        result = fs_read(fs, fd, buffer, chunk) == (ssize_t)chunk ? 0 : -1;
+    }
+    *read_ns = now_ns() - start;
+    fs_unmount(fs);
+    unlink("fuse_bench.FS");
+    return result;
+}
+
+static int fuse_pass(const char *path, size_t size, size_t chunk, uint8_t *buffer, double *write_ns, double *read_ns)
+{
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    int result = fd < 0 ? -1 : 0;
+    double start = now_ns();
+    for (size_t done = 0; result == 0 && done < size; done += chunk)
+    {
+        result = pwrite(fd, buffer, chunk, (off_t)done) == (ssize_t)chunk ? 0 : -1;
+    }
+    result = result == 0 ? fsync(fd) : result;
+    *write_ns = now_ns() - start;
+    start = now_ns();
+    for (size_t done = 0; result == 0 && done < size; done += chunk)
+    {
+        result = pread(fd, buffer, chunk, (off_t)done) == (ssize_t)chunk ? 0 : -1;
+    }
+    *read_ns = now_ns() - start;
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+    unlink(path);
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    size_t mib = argc > 2 ? strtoul(argv[2], NULL, 10) : 64;
+    size_t chunk = (argc > 3 ? strtoul(argv[3], NULL, 10) : 1024) << 10;
+    if (argc < 2 || mib == 0 || chunk == 0 || (mib << 20) % chunk != 0)
+    {
+        fprintf(stderr, "usage: %s mountpoint [MiB] [KiB, dividing MiB]\n", argv[0]);
+        return 1;
+    }
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/fuse_bench.dat", argv[1]);
+    size_t size = mib << 20;
+    uint8_t *buffer = (uint8_t *)malloc(chunk);
+    if (buffer == NULL)
+    {
+        return 1;
+    }
+    memset(buffer, 0xA5, chunk);
+
+    double direct_write, direct_read, fuse_write, fuse_read;
+    if (direct_pass(size, chunk, buffer, &direct_write, &direct_read) < 0)
+    {
+        fprintf(stderr, "fs_write or fs_read fell short, is %zu MiB more than an image holds?\n", mib);
+        return 1;
+    }
+    if (fuse_pass(path, size, chunk, buffer, &fuse_write, &fuse_read) < 0)
+    {
+        perror(path);
+        return 1;
+    }
+    printf("%zu MiB, %zu KiB a call\n", mib, chunk >> 10);
+    printf("%-8s %10s %10s\n", "", "write MB/s", "read MB/s");
+    printf("%-8s %10.0f %10.0f\n", "direct", size * 1e3 / direct_write, size * 1e3 / direct_read);
+    printf("%-8s %10.0f %10.0f\n", "fuse", size * 1e3 / fuse_write, size * 1e3 / fuse_read);
+    printf("fuse at %.0f%% of direct for writes, %.0f%% for reads\n", 100 * direct_write / fuse_write, 100 * direct_read / fuse_read);
+    free(buffer);
+    return 0;
+}
@@ -0,0 +1,119 @@
+// Random 64-byte lookups through fs_mmap views compared to fs_seek + fs_read.
+//  usage: fs_mmap_bench [lookups]
+#include <time.h>
+#include "FS.h"
+
+#define LOOKUP_SIZE 64
+#define FILE_BLOCKS number_direct_pointers
+
+// keeps the compiler from dropping the lookups
+static volatile uint8_t sink;
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// fill a file one block at a time, optionally interleaving writes to a second file
+// so the blocks of the first one end up scattered across the image
+static int fill_file(FS_t *fs, const char *path, const char *interleave)
+{
+    uint8_t block[BLOCK_SIZE_BYTES];
+    int fd = fs_open(fs, path);
+    int other = interleave ? fs_open(fs, interleave) : -1;
+    if (fd < 0 || (interleave && other < 0))
+    {
+        return -1;
+    }
+    for (size_t i = 0; i < FILE_BLOCKS; i++)
+    {
+        memset(block, (int)(i + 1), BLOCK_SIZE_BYTES);
+        if (fs_write(fs, fd, block, BLOCK_SIZE_BYTES) != BLOCK_SIZE_BYTES)
+        {
+            return -1;
+        }
+        if (other >= 0 && fs_write(fs, other, block, BLOCK_SIZE_BYTES) != BLOCK_SIZE_BYTES)
+        {
+            return -1;
+        }
+    }
+    if (other >= 0)
+    {
+        fs_close(fs, other);
+    }
+    return fd;
+}
+
+static void run(FS_t *fs, int fd, const char *label, size_t lookups)
+{
+    size_t file_size = FILE_BLOCKS * BLOCK_SIZE_BYTES;
+    size_t slots = file_size / LOOKUP_SIZE;
+    uint8_t buffer[LOOKUP_SIZE];
+
+    srand(4520);
+    double start = now_ns();
+    for (size_t i = 0; i < lookups; i++)
+    {
+        off_t offset = (off_t)(rand() % slots) * LOOKUP_SIZE;
+        fs_seek(fs, fd, offset, FS_SEEK_SET);
+        fs_read(fs, fd, buffer, LOOKUP_SIZE);
+        sink = buffer[0];
+    }
+    double read_ns = (now_ns() - start) / lookups;
+
+    fs_map_t *map = fs_mmap(fs, fd);
+    if (map == NULL)
+    {
+        fprintf(stderr, "%s: fs_mmap failed\n", label);
+        return;
+    }
+    srand(4520);
+    start = now_ns();
+    for (size_t i = 0; i < lookups; i++)
+    {
+        size_t offset = (size_t)(rand() % slots) * LOOKUP_SIZE;
+        const uint8_t *bytes = fs_map_at(map, offset, LOOKUP_SIZE);
+        memcpy(buffer, bytes, LOOKUP_SIZE);
+        sink = buffer[0];
+    }
+    double map_ns = (now_ns() - start) / lookups;
+
+    printf("%-12s %-10s seek+read %8.1f ns/op   mmap %8.1f ns/op   speedup %5.1fx\n", label,
+           fs_map_is_direct(map) ? "zero-copy" : "window", read_ns, map_ns, read_ns / map_ns);
+    fs_munmap(map);
+}
+
+int main(int argc, char **argv)
+{
+    size_t lookups = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+    FS_t *fs = fs_format("mmap_bench.FS");
+    if (fs == NULL)
+    {
+        fprintf(stderr, "could not format mmap_bench.FS\n");
+        return 1;
+    }
+    if (fs_create(fs, "/contiguous", FS_REGULAR) < 0 || fs_create(fs, "/scattered", FS_REGULAR) < 0 ||
+        fs_create(fs, "/filler", FS_REGULAR) < 0)
+    {
+        fprintf(stderr, "could not create the bench files\n");
+        return 1;
+    }
+
+    int contiguous = fill_file(fs, "/contiguous", NULL);
+    int scattered = fill_file(fs, "/scattered", "/filler");
+    if (contiguous < 0 || scattered < 0)
+    {
+        fprintf(stderr, "could not fill the bench files\n");
+        return 1;
+    }
+
+    run(fs, contiguous, "/contiguous", lookups);
+    run(fs, scattered, "/scattered", lookups);
+
+    fs_close(fs, contiguous);
+    fs_close(fs, scattered);
+    fs_unmount(fs);
+    return 0;
+}
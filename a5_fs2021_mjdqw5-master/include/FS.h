@@ -11,6 +11,7 @@
 #include <string.h>
 
 #include "block_store.h"
+#include "bitmap.h"
 
 
 // components of FS
@@ -27,29 +28,136 @@
 
 
 #define number_inodes 256
-#define inode_size 64
+#define inode_size 64	// fixed by the prebuilt block store, its inode table has 64 byte slots
+#define number_inode_blocks (number_inodes * inode_size / BLOCK_SIZE_BYTES)
 #define number_fd 256
 #define fd_size 6	// any number as you see fit
 
 #define folder_number_entries 31
 
+// furthest a descriptor can be seeked: the 63472 blocks left once every control block of a single file is taken, minus one byte
+#define FS_MAX_SEEK ((off_t)63472 * BLOCK_SIZE_BYTES - 1)
+// no file grows past this, it is as far as a descriptor's locate_order can count
+#define FS_MAX_FILE_SIZE ((off_t)UINT16_MAX * BLOCK_SIZE_BYTES)
+
+#define number_direct_pointers 6
+#define pointers_per_block (BLOCK_SIZE_BYTES / sizeof(uint16_t))	// block ids held by one indirect block
+
+// blocks holding one reference count byte per block of the store, set up by the first fs_clone/fs_snapshot
+//  the root directory never has extents of its own, its first extent records where the table lives and its third the
+//  blocks at the top the block store keeps for itself (see fs_format)
+#define number_ref_blocks (BLOCK_STORE_NUM_BLOCKS / BLOCK_SIZE_BYTES)
+
+// bits of inode flags
+#define FS_INODE_INLINE 0x01	// file data lives in inlineData instead of blocks
+#define FS_INODE_DIRTY 0x02		// root only: the FS is mounted, fs_mount runs fs_check if it finds it still set
+#define FS_INODE_COMPRESSED 0x04	// regular files only: data is kept in compressed clusters, see fs_set_compressed
+#define FS_INODE_DEDUP 0x08		// root only: writes are deduplicated, the fingerprint index is in root's second extent (see fs_set_dedup)
+
+// a compressed file is cut into clusters of fs_cluster_blocks blocks, each compressed on its own
+//  cluster n is kept in the first of block slots n * fs_cluster_blocks on, as few as it compresses into;
+//  its last slot is only in use when the cluster did not compress and is stored as is
+#define fs_cluster_blocks 4
+#define fs_cluster_size (fs_cluster_blocks * BLOCK_SIZE_BYTES)
+// decompressed clusters the FS keeps around for reads that come back to them
+#define fs_cluster_cache_entries 8
+
+// fingerprint index of deduplicated writes: one 8 byte slot per block of the store (48 bits of a block's fingerprint and its id),
+//  followed by a bitmap of the blocks whose slot still describes them, which fs_block_free clears
+#define number_dedup_blocks (BLOCK_STORE_NUM_BLOCKS * (sizeof(uint64_t) * 8 + 1) / BLOCK_SIZE_BITS)
+// slots tried after the one a fingerprint lands on, before a lookup gives up
+#define fs_dedup_probe 8
+
+// threads fs_check scans the inode table with unless told otherwise
+#define fs_check_threads 4
+
+// per-operation counts and latency histograms, see fs_get_stats; -Dfs_stats=0 leaves every bit of it out
+#ifndef fs_stats
+#define fs_stats 1
+#endif
+// latency histograms keep 2^fs_stats_sub_bits buckets per power of two of ns, each about 6% wide, up to 2^fs_stats_max_bits ns
+#define fs_stats_sub_bits 4
+#define fs_stats_max_bits 40
+#define fs_stats_buckets ((fs_stats_max_bits - fs_stats_sub_bits + 1) << fs_stats_sub_bits)
+
+// bumped whenever the on-disk inode layout changes, fs_mount refuses images with another version
+#define FS_INODE_VERSION 1
+
+// layout of disk_inode_t, the data area starts right after the fixed 24 byte header
+#define disk_inode_header_size 24
+#define disk_inode_pointers_size 16	// 6 direct + 1 indirect + 1 double indirect block id
+#define disk_extent_size 8
+
+// bytes of file data an inode can hold in place of its block pointers
+#define FS_INLINE_DATA_MAX (inode_size - disk_inode_header_size)
+
+// extent descriptors that fit behind the block pointers (3 with 64 byte inodes)
+#define FS_INODE_EXTENTS ((inode_size - disk_inode_header_size - disk_inode_pointers_size) / disk_extent_size)
+
+// a run of blockCount blocks starting at startBlock, reserved by fs_fallocate for the file's blocks from logicalBlock on
+//  the blocks are unwritten: they read back as zeros and move into the block pointers as writes reach them
+//  blockCount 0 marks an unused descriptor
+struct extent
+{
+    uint32_t logicalBlock;
+    uint16_t startBlock;
+    uint16_t blockCount;
+};
+
+// how an inode is laid out in the inode table
+//  every field is little-endian and the struct is packed, so the image reads the same on any host
+//  inode_t below is the form the rest of FS works with, inode_load/inode_store convert between the two
+struct disk_inode
+{
+    uint32_t vacantFile;        //  0
+    uint8_t fileType;           //  4
+    uint8_t flags;              //  5
+    uint16_t version;           //  6  FS_INODE_VERSION
+    uint32_t fileSize;          //  8
+    uint16_t linkCount;         // 12
+    uint8_t inodeNumber;        // 14
+    uint8_t reserved;           // 15
+    uint32_t mtime;             // 16  seconds since the epoch
+    uint32_t ctime;             // 20
+    union {                     // 24
+        struct {
+            uint16_t directPointer[6];
+            uint16_t indirectPointer;
+            uint16_t doubleIndirectPointer;
+            struct extent extents[FS_INODE_EXTENTS];
+        } __attribute__((packed)) blocks;
+        uint8_t inlineData[FS_INLINE_DATA_MAX];	// FS_INODE_INLINE files
+    } __attribute__((packed)) data;
+} __attribute__((packed));
+
 // each inode represents a regular file or a directory file
+//  in-memory form, aligned so a loaded inode never straddles two cache lines more than it has to
 struct inode 
 {
     uint32_t vacantFile;    // this parameter is only for directory. Used as a bitmap denoting availibility of entries in a directory file.
-    char owner[18];         // for alignment purpose only   
 
     char fileType;          // 'r' denotes regular file, 'd' denotes directory file
+    uint8_t flags;          // FS_INODE_* bits
+    uint16_t version;
 
     size_t inodeNumber;			// for FS, the range should be 0-255
     size_t fileSize; 			  // the unit is in byte	
     size_t linkCount;
 
+    time_t mtime;           // last write
+    time_t ctime;           // creation
+
     // to realize the 16-bit addressing, pointers are acutally block numbers, rather than 'real' pointers.
     uint16_t directPointer[6];
     uint16_t indirectPointer[1];
     uint16_t doubleIndirectPointer;
-};
+
+    struct extent extents[FS_INODE_EXTENTS];
+
+    // small regular files keep their bytes right here (FS_INODE_INLINE) and have no blocks at all,
+    // they are moved out to a block once they grow past FS_INLINE_DATA_MAX
+    uint8_t inlineData[FS_INLINE_DATA_MAX];
+} __attribute__((aligned(64)));
 
 
 struct fileDescriptor 
@@ -73,15 +181,43 @@ struct FS {
     block_store_t * BlockStore_whole;
     block_store_t * BlockStore_inode;
     block_store_t * BlockStore_fd;
+    bitmap_t * FreeBlockMap;    // the free block map of BlockStore_whole, overlaid in place (see fs_fallocate)
+    uint8_t * BlockRefs;        // per block count of extra files sharing it, in place in the image; NULL until a clone is made
+    size_t FreeBlocks;          // free blocks of BlockStore_whole, kept current by fs_block_alloc/fs_block_free (see fs_statfs)
+    size_t FreeInodes;          // free inodes of BlockStore_inode, kept current by fs_inode_alloc/fs_inode_free
+    size_t StoreReserved;       // first of the blocks at the top BlockStore_whole keeps for itself, fs_check leaves them be
+    bitmap_t * Released;        // blocks released since the last fs_trim, the image file still has pages behind them
+    struct fs_cluster * Clusters;   // fs_cluster_cache_entries decompressed clusters of compressed files, NULL until one is read
+    size_t ClusterClock;        // ticks on every use of the cache, the entry used longest ago is replaced first
+    size_t ClusterHits;         // cluster reads the cache answered
+    size_t ClusterMisses;       // cluster reads that had to decompress
+    uint64_t * DedupIndex;      // fingerprint index in place in the image, NULL unless dedup is on (see fs_set_dedup)
+    bitmap_t * DedupValid;      // the bitmap behind it, overlaid in place
+    size_t DedupHashed;         // whole blocks looked up since mount
+    size_t DedupShared;         // of those, the ones that took no block of their own
+    uint64_t DedupNanos;        // time spent hashing and looking up written blocks since mount
+    struct fs_op_stats * Stats; // FS_OP_COUNT per-operation counts since mount, NULL when built with fs_stats 0
+    FILE * Trace;               // where fs_trace logs block calls, NULL when it is off
+    uint64_t TraceEpoch;        // fs_clock() when the trace was started
+    uint64_t TraceLast;         // when the previously logged call started, in ns since TraceEpoch
+    bool Inspect;               // mounted with FS_MOUNT_INSPECT, fs_unmount writes nothing back
 };
 
 
 typedef struct inode inode_t;
+typedef struct disk_inode disk_inode_t;
+typedef struct extent extent_t;
 typedef struct fileDescriptor fileDescriptor_t;
 typedef struct directoryFile directoryFile_t;
 
 typedef struct FS FS_t;
 
+// read-only view over the contents of a file, see fs_mmap
+typedef struct fs_map fs_map_t;
+
+// open directory, see fs_opendir
+typedef struct fs_dir fs_dir_t;
+
 // seek_t is for fs_seek
 typedef enum { FS_SEEK_SET, FS_SEEK_CUR, FS_SEEK_END } seek_t;
 
@@ -97,6 +233,97 @@ typedef struct {
     file_t type;
 } file_record_t;
 
+// what fs_stat/fs_fstat report about a file
+typedef struct {
+    size_t inodeNumber;
+    file_t type;
+    size_t fileSize;    // in bytes
+    size_t linkCount;   // directory entries naming the file
+    time_t mtime;
+    time_t ctime;
+} fs_stat_t;
+
+// what fs_statfs reports about the volume
+typedef struct {
+    size_t blockSize;
+    size_t totalBlocks;
+    size_t freeBlocks;
+    size_t totalInodes;
+    size_t freeInodes;
+} fs_statfs_t;
+
+// how scattered blocks are, see fs_file_frag/fs_volume_frag
+typedef struct {
+    size_t files;       // regular files with at least one data block
+    size_t blocks;      // their data blocks
+    size_t breaks;      // places where the next data block of a file is not the one right after the last
+    double score;       // breaks out of the most there could be: 0 every file in one run, 1 no two blocks in a row
+    size_t freeBlocks;  // fs_volume_frag only, free blocks
+    size_t largestFree; // fs_volume_frag only, longest run of free blocks
+    double freeScore;   // fs_volume_frag only, 1 - largestFree / freeBlocks: 0 when free space is one run
+} fs_frag_t;
+
+// what deduplication has done since the FS was mounted, see fs_dedup_stats
+typedef struct {
+    size_t blocksHashed;    // whole blocks written while dedup was on, each hashed and looked up
+    size_t blocksShared;    // of those, the ones that matched a stored block and took no block of their own
+    double ratio;           // blocks written out of the blocks stored for them, 1 when nothing matched
+    double hashNanos;       // average time a written block spent being hashed and looked up, in ns
+    size_t sharedBlocks;    // blocks of the volume used by more than one file right now, clones included
+} fs_dedup_t;
+
+// operations fs_get_stats times; the block ones are the reads and writes the FS makes of its block store
+typedef enum {
+    FS_OP_CREATE, FS_OP_OPEN, FS_OP_CLOSE, FS_OP_SEEK, FS_OP_READ, FS_OP_WRITE, FS_OP_REMOVE,
+    FS_OP_BLOCK_READ, FS_OP_BLOCK_WRITE,
+    FS_OP_COUNT
+} fs_op_t;
+
+// calls of one operation since the FS was mounted
+typedef struct fs_op_stats {
+    uint64_t calls;
+    uint64_t errors;        // calls that failed
+    uint64_t bytes;         // bytes the calls moved, for the operations that move any
+    uint64_t totalNanos;
+    uint64_t minNanos;      // 0 until the first call
+    uint64_t maxNanos;
+    uint64_t histogram[fs_stats_buckets];   // calls per latency bucket, see fs_stats_percentile
+} fs_op_stats_t;
+
+// what fs_get_stats reports
+typedef struct {
+    bool enabled;           // false when built with fs_stats 0, everything but the cache and dedup counts is zero then
+    fs_op_stats_t ops[FS_OP_COUNT];
+    size_t clusterHits;     // cluster reads of compressed files the cache answered
+    size_t clusterMisses;   // cluster reads that had to decompress
+    double clusterHitRatio; // hits out of all cluster reads, 0 when there were none
+    size_t dedupHashed;     // whole blocks written while dedup was on
+    size_t dedupShared;     // of those, the ones that matched a stored block
+    double dedupHitRatio;   // shared out of hashed, 0 when nothing was hashed
+} fs_stats_t;
+
+// what fs_check found, one count per kind of problem
+typedef struct {
+    size_t blocksLeaked;    // marked in use in the free block map, but no file points at them
+    size_t blocksMissing;   // pointed at by a file, but marked free
+    size_t refCounts;       // blocks whose count in the reference count table differs from the files sharing them
+    size_t linkCounts;      // inodes whose link count differs from the directory entries naming them
+    size_t orphanInodes;    // inodes in use that no directory entry names
+    size_t danglingEntries; // directory entries naming an inode that is not in use
+    size_t badPointers;     // inodes pointing at blocks a file can not have (the inode table, past the store)
+} fs_check_t;
+
+// what one operation of fs_batch does
+typedef enum { FS_BATCH_CREATE, FS_BATCH_REMOVE, FS_BATCH_MOVE } fs_batch_op_t;
+
+typedef struct {
+    fs_batch_op_t op;
+    const char *path;   // file to create, remove or move
+    const char *dst;    // FS_BATCH_MOVE: where to move it
+    file_t type;        // FS_BATCH_CREATE: what to create
+    int result;         // set by fs_batch, 0 on success, < 0 on error
+} fs_batch_entry_t;
+
 ///
 /// Formats (and mounts) an FS file for use
 /// \param fname The file to format
@@ -113,6 +340,18 @@ FS_t *fs_format(const char *path);
 ///
 FS_t *fs_mount(const char *path);
 
+// fs_mount_flags: leave the image as it was found, no repair of an image that was not unmounted and nothing written
+//  back by fs_unmount (no clearing of FS_INODE_DIRTY, no fs_trim); for looking at an image, see tools/fs_check -n
+#define FS_MOUNT_INSPECT 0x01
+
+///
+/// Mounts an FS object like fs_mount, with flags changing how
+/// \param path The file to mount
+/// \param flags 0 or FS_MOUNT_INSPECT
+/// \return Mounted FS object, NULL on error
+///
+FS_t *fs_mount_flags(const char *path, int flags);
+
 ///
 /// Unmounts the given object and frees all related resources
 /// \param fs The FS object to unmount
@@ -120,6 +359,13 @@ FS_t *fs_mount(const char *path);
 ///
 int fs_unmount(FS_t *fs);
 
+///
+/// Waits for every change made to the image so far to reach the file on disk (msync of the image mapping)
+/// \param fs The FS to flush
+/// \return 0 on success, < 0 on error
+///
+int fs_flush(FS_t *fs);
+
 ///
 /// Creates a new file at the specified location
 ///   Directories along the path that do not exist are not created
@@ -150,8 +396,8 @@ int fs_close(FS_t *fs, int fd);
 
 ///
 /// Moves the R/W position of the given descriptor to the given location
-///   Files cannot be seeked past EOF or before BOF (beginning of file)
-///   Seeking past EOF will seek to EOF, seeking before BOF will seek to BOF
+///   Files can be seeked past EOF, up to FS_MAX_SEEK, but not before BOF (beginning of file)
+///   Seeking further than that stops at FS_MAX_SEEK, seeking before BOF will seek to BOF
 /// \param fs The FS containing the file
 /// \param fd The descriptor to seek
 /// \param offset Desired offset relative to whence
@@ -163,6 +409,7 @@ off_t fs_seek(FS_t *fs, int fd, off_t offset, seek_t whence);
 ///
 /// Reads data from the file linked to the given descriptor
 ///   Reading past EOF returns data up to EOF
+///   Holes in the file read back as zeros
 ///   R/W position in incremented by the number of bytes read
 /// \param fs The FS containing the file
 /// \param fd The file to read from
@@ -174,7 +421,7 @@ ssize_t fs_read(FS_t *fs, int fd, void *dst, size_t nbyte);
 
 ///
 /// Writes data from given buffer to the file linked to the descriptor
-///   Writing past EOF extends the file
+///   Writing past EOF extends the file, any gap left between the old EOF and the write stays a hole
 ///   Writing inside a file overwrites existing data
 ///   R/W position in incremented by the number of bytes written
 /// \param fs The FS containing the file
@@ -185,6 +432,33 @@ ssize_t fs_read(FS_t *fs, int fd, void *dst, size_t nbyte);
 ///
 ssize_t fs_write(FS_t *fs, int fd, const void *src, size_t nbyte);
 
+///
+/// Releases the blocks behind a range of the file, which then reads back as zeros
+///   The file size does not change, parts of the range past EOF are ignored
+///   Blocks only partly inside the range are kept, the bytes inside it are zeroed
+///   Compressed files (see fs_set_compressed) are refused
+/// \param fs The FS containing the file
+/// \param fd The file to punch
+/// \param offset Offset from BOF where the range starts
+/// \param len Length of the range in bytes
+/// \return 0 on success, < 0 on error
+///
+int fs_punch_hole(FS_t *fs, int fd, off_t offset, off_t len);
+
+///
+/// Reserves the blocks behind a range of the file ahead of the writes that will fill it
+///   Each hole in the range gets a contiguous run of blocks, taken out of the free block map at once
+///   Reserved blocks read back as zeros and later writes land in them without allocating
+///   The file grows to cover the range if it is shorter, it never shrinks
+///   Compressed files (see fs_set_compressed) are refused
+/// \param fs The FS containing the file
+/// \param fd The file to reserve blocks for
+/// \param offset Offset from BOF where the range starts
+/// \param len Length of the range in bytes
+/// \return 0 on success, < 0 on error or if the store ran out of blocks
+///
+int fs_fallocate(FS_t *fs, int fd, off_t offset, off_t len);
+
 ///
 /// Deletes the specified file and closes all open descriptors to the file
 ///   Directories can only be removed when empty
@@ -203,6 +477,180 @@ int fs_remove(FS_t *fs, const char *path);
 ///
 dyn_array_t *fs_get_dir(FS_t *fs, const char *path);
 
+///
+/// Opens a directory to step through its entries with fs_readdir, or to resolve paths against with the *at calls
+///   The path is resolved and the directory read once, here
+///   Entries added or removed after the call are not seen by fs_readdir (the *at calls always see them)
+/// \param fs The FS containing the directory
+/// \param path Absolute path to the directory
+/// \return The handle, NULL on error
+///
+fs_dir_t *fs_opendir(FS_t *fs, const char *path);
+
+///
+/// Fills record with the next entry of an open directory
+/// \param dir The directory handle
+/// \param record Where to put the entry
+/// \return 1 if an entry was returned, 0 once every entry has been, < 0 on error
+///
+int fs_readdir(fs_dir_t *dir, file_record_t *record);
+
+///
+/// Fills up to count records with the next entries of an open directory
+/// \param dir The directory handle
+/// \param records Array of at least count records
+/// \param count Number of records the caller has room for
+/// \return number of records filled (0 once every entry has been returned), < 0 on error
+///
+ssize_t fs_readdir_batch(fs_dir_t *dir, file_record_t *records, size_t count);
+
+///
+/// Starts the entries of an open directory over from the first one
+/// \param dir The directory handle
+/// \return 0 on success, < 0 on error
+///
+int fs_rewinddir(fs_dir_t *dir);
+
+///
+/// Releases a directory handle
+/// \param dir The handle to release
+/// \return 0 on success, < 0 on error
+///
+int fs_closedir(fs_dir_t *dir);
+
+///
+/// Opens a directory relative to an open one
+/// \param dir The directory path is relative to
+/// \param path Path of the directory to open, absolute paths start from root
+/// \return The handle, NULL on error
+///
+fs_dir_t *fs_opendirat(fs_dir_t *dir, const char *path);
+
+///
+/// Opens a file relative to an open directory, see fs_open
+///   Only the part of the path below the directory is walked
+/// \param dir The directory path is relative to
+/// \param path Path of the file to open, absolute paths start from root
+/// \return file descriptor to the opened file, < 0 on error
+///
+int fs_openat(fs_dir_t *dir, const char *path);
+
+///
+/// Creates a file relative to an open directory, see fs_create
+/// \param dir The directory path is relative to
+/// \param path Path of the file to create, absolute paths start from root
+/// \param type Type of file to create (regular/directory)
+/// \return 0 on success, < 0 on failure
+///
+int fs_createat(fs_dir_t *dir, const char *path, file_t type);
+
+///
+/// Removes a file relative to an open directory, see fs_remove
+/// \param dir The directory path is relative to
+/// \param path Path of the file to remove, absolute paths start from root
+/// \return 0 on success, < 0 on error
+///
+int fs_removeat(fs_dir_t *dir, const char *path);
+
+///
+/// Fills st with the inode fields of the file at path
+///   Only the inode is read, never the file's data blocks
+/// \param fs The FS containing the file
+/// \param path Absolute path to the file (regular or directory)
+/// \param st Where to put the fields
+/// \return 0 on success, < 0 on error
+///
+int fs_stat(FS_t *fs, const char *path, fs_stat_t *st);
+
+///
+/// Fills st with the inode fields of the file linked to the descriptor, see fs_stat
+/// \param fs The FS containing the file
+/// \param fd The open file
+/// \param st Where to put the fields
+/// \return 0 on success, < 0 on error
+///
+int fs_fstat(FS_t *fs, int fd, fs_stat_t *st);
+
+///
+/// Fills st with the usage of the volume
+///   Free counts come from counters kept as blocks and inodes are allocated, nothing is scanned
+/// \param fs The FS to report on
+/// \param st Where to put the usage
+/// \return 0 on success, < 0 on error
+///
+int fs_statfs(FS_t *fs, fs_statfs_t *st);
+
+///
+/// Turns transparent compression on or off for an empty regular file
+///   The data of a compressed file is kept in clusters of fs_cluster_blocks blocks, each compressed into as few blocks as it takes
+///   (a cluster that does not get smaller is kept as is, one of only zeros is left a hole)
+///   fs_read decompresses only the clusters it touches, through a small cache, so fs_seek and random reads work as on any file
+///   fs_punch_hole and fs_fallocate refuse compressed files
+/// \param fs The FS containing the file
+/// \param path Absolute path to the file
+/// \param compressed true to compress the file's data, false to store it as is
+/// \return 0 on success, < 0 on error or if the file is not empty
+///
+int fs_set_compressed(FS_t *fs, const char *path, bool compressed);
+
+///
+/// Turns block deduplication on or off for the whole volume, the setting is kept in the image
+///   While on, every whole block fs_write writes is hashed and looked up in a fingerprint index kept in the image;
+///   a block whose bytes are already stored is shared with its other users (see fs_clone) instead of taking a block
+///   Candidates are compared byte for byte before they are shared, so a fingerprint collision never shares the wrong data
+///   Writes to compressed files are not deduplicated
+///   Turning it off frees the index, blocks already shared stay shared
+/// \param fs The FS to set up
+/// \param enable true to deduplicate from now on
+/// \return 0 on success, < 0 on error or if the store has no room for the index
+///
+int fs_set_dedup(FS_t *fs, bool enable);
+
+///
+/// Fills stats with what deduplication has done since the FS was mounted
+/// \param fs The FS to report on
+/// \param stats Where to put the counts
+/// \return 0 on success, < 0 on error
+///
+int fs_dedup_stats(FS_t *fs, fs_dedup_t *stats);
+
+///
+/// Reports per-operation counts, bytes moved and latencies, and the cache hit ratios, since the FS was mounted
+///   Latencies are taken with CLOCK_MONOTONIC around fs_create, fs_open, fs_close, fs_seek, fs_read, fs_write,
+///   fs_remove and every block the FS reads or writes; built with fs_stats 0 nothing is timed and enabled is false
+/// \param fs The FS to report on
+/// \param stats Where to put the counts
+/// \return 0 on success, < 0 on error
+///
+int fs_get_stats(FS_t *fs, fs_stats_t *stats);
+
+///
+/// Reads a latency percentile off an operation's histogram, to within the width of a bucket
+/// \param op The operation's counts, from fs_get_stats
+/// \param percentile Share of calls in percent, e.g. 99.9
+/// \return The latency in ns no more than that share of calls took longer than, 0 if there were no calls
+///
+uint64_t fs_stats_percentile(const fs_op_stats_t *op, double percentile);
+
+///
+/// Writes stats out as one JSON object: per operation its counts, mean and p50/p90/p99/p99.9 latencies and
+///   the non-empty histogram buckets as [highest ns, calls] pairs, then the cache and dedup hit ratios
+/// \param stats The counts to write, from fs_get_stats
+/// \param out Where to write them
+/// \return 0 on success, < 0 on error
+///
+int fs_stats_json(const fs_stats_t *stats, FILE *out);
+
+///
+/// Logs every block the FS reads, writes, allocates and releases in the binary trace format of the a4 block store
+///   ("BST1", see block_store_backend_record there), so its trace_replay can replay FS workloads on any backend
+///   The trace opens with the geometry of the store and closes at fs_trace(fs, NULL) or fs_unmount
+/// \param fs The FS to trace
+/// \param out Where the trace goes, left open; NULL to stop tracing
+/// \return 0 on success, < 0 on error
+///
+int fs_trace(FS_t *fs, FILE *out);
+
 /// Moves the file from one location to the other
 ///   Moving files does not affect open descriptors
 /// \param fs The FS containing the file
@@ -212,6 +660,18 @@ dyn_array_t *fs_get_dir(FS_t *fs, const char *path);
 ///
 int fs_move(FS_t *fs, const char *src, const char *dst);
 
+///
+/// Applies a list of create, remove and move operations, in order
+///   Each directory touched is read once and written back once, when the whole batch is done
+///   Runs of operations under the same directory resolve its path once
+///   Operations fail on their own (see result), the others still go through
+/// \param fs The FS to operate on
+/// \param ops The operations, result of each is filled in
+/// \param count Number of operations
+/// \return number of operations that failed, < 0 on error
+///
+int fs_batch(FS_t *fs, fs_batch_entry_t *ops, size_t count);
+
 /// Link the dst with the src
 /// dst and src should be in the same File type, say, both are files or both are directories
 /// \param fs The F18FS containing the file
@@ -221,4 +681,164 @@ int fs_move(FS_t *fs, const char *src, const char *dst);
 ///
 int fs_link(FS_t *fs, const char *src, const char *dst);
 
+///
+/// Makes dst a copy of the regular file src that shares its data blocks
+///   Only the inode and indirect blocks are copied, a shared block is copied the first time either file writes to it
+///   Space src has reserved with fs_fallocate is not carried over
+/// \param fs The FS containing the file
+/// \param src Absolute path of the file to clone
+/// \param dst Absolute path of the clone, must not exist
+/// \return 0 on success, < 0 on error
+///
+int fs_clone(FS_t *fs, const char *src, const char *dst);
+
+///
+/// Makes dst a copy of the directory tree under src, cloning every file in it (see fs_clone)
+///   Files linked more than once in the tree are linked the same way in the copy
+///   "/" snapshots the whole volume, dst may then sit anywhere in it
+/// \param fs The FS containing the tree
+/// \param src Absolute path of the directory to snapshot
+/// \param dst Absolute path of the snapshot, must not exist
+/// \return 0 on success, < 0 on error (nothing is left behind)
+///
+int fs_snapshot(FS_t *fs, const char *src, const char *dst);
+
+///
+/// Moves the blocks of a regular file into one contiguous run
+///   The data is copied into the run with pointer blocks of its own, then the inode is switched over to it in one write
+///   Descriptors open on the file are not affected, views made by fs_mmap before the call must be unmapped first
+///   Files sharing blocks with a clone are left as they are
+/// \param fs The FS containing the file
+/// \param path Absolute path to the file
+/// \return 0 on success (or if the file already was contiguous), < 0 on error or if no free run is long enough
+///
+int fs_defrag(FS_t *fs, const char *path);
+
+///
+/// Defragments every regular file (see fs_defrag) and packs them toward the start of the store
+///   Files are taken in the order their data starts in and move into the first free run that holds them, when it comes earlier
+///   Directory and pointer blocks stay where they are
+/// \param fs The FS to defragment
+/// \return number of files moved, < 0 on error
+///
+int fs_defrag_volume(FS_t *fs);
+
+///
+/// Reports how scattered the blocks of a regular file are
+/// \param fs The FS containing the file
+/// \param path Absolute path to the file
+/// \param frag Where to put the report, the free space fields are left 0
+/// \return 0 on success, < 0 on error
+///
+int fs_file_frag(FS_t *fs, const char *path, fs_frag_t *frag);
+
+///
+/// Reports how scattered the blocks of every regular file are, and how broken up free space is
+/// \param fs The FS to report on
+/// \param frag Where to put the report
+/// \return 0 on success, < 0 on error
+///
+int fs_volume_frag(FS_t *fs, fs_frag_t *frag);
+
+///
+/// Checks the FS for consistency, and repairs what it finds if asked to
+///   The inode table is scanned by several threads at once, building a reference bitmap of the blocks files point at,
+///   which is diffed against the free block map; link counts are checked against the directory entries naming each inode,
+///   and directory entries against the inodes in use
+///   fs_mount runs it, repairing, on an image that was not unmounted
+/// \param fs The FS to check, nothing else may use it meanwhile
+/// \param repair Repair what is found, otherwise only report it
+/// \param threads Number of threads to scan with, 0 for fs_check_threads
+/// \param report Where to put the counts of what was found, may be NULL
+/// \return number of problems found (0 for a clean FS), < 0 on error
+///
+int fs_check(FS_t *fs, bool repair, size_t threads, fs_check_t *report);
+
+///
+/// Punches holes in the image file where blocks have been released, so it only takes up space for blocks in use
+///   Blocks are collected as they are released and handed back to the host in runs, here and on fs_unmount
+///   Call it now and then on a long running FS to keep its image sparse
+/// \param fs The FS to trim
+/// \param all Trim every free block, not only the ones released since the last trim (for images that were never trimmed)
+/// \return number of blocks trimmed (0 if the host can not punch holes), < 0 on error
+///
+int fs_trim(FS_t *fs, bool all);
+
+
+//////////////////////////////////////////////////////////////////////
+/// some added library functions for this specific implementation  ///
+//////////////////////////////////////////////////////////////////////
+
+// read inode inode_ID out of the inode table into its in-memory form, 0 on error
+size_t inode_load(FS_t *fs, size_t inode_ID, inode_t *inode);
+
+// write the in-memory inode back to slot inode_ID of the inode table, 0 on error
+size_t inode_store(FS_t *fs, size_t inode_ID, const inode_t *inode);
+
+// take a block out of the whole block store (0 when full) / give it back, keeping FreeBlocks current
+uint16_t fs_block_alloc(FS_t *fs);
+void fs_block_free(FS_t *fs, uint16_t block_id);
+
+// take an inode out of the inode table (SIZE_MAX when full) / give it back, keeping FreeInodes current
+size_t fs_inode_alloc(FS_t *fs);
+void fs_inode_free(FS_t *fs, size_t inode_ID);
+
+// inode number of entry name in directory dir (its index in *entry), SIZE_MAX if there is none
+size_t dir_entry_find(FS_t *fs, const inode_t *dir, const char *name, size_t *entry);
+
+// add an entry linking name to inode_ID to directory dir_ID, < 0 if the name is taken or the directory is full
+int dir_entry_add(FS_t *fs, size_t dir_ID, const char *name, size_t inode_ID);
+
+// drop entry number entry from directory dir_ID
+void dir_entry_remove(FS_t *fs, size_t dir_ID, size_t entry);
+
+// inode number an absolute path names, SIZE_MAX if it does not exist
+size_t fs_path_lookup(FS_t *fs, const char *path);
+
+// inode number of the directory an absolute path would live in, last part of the path copied to name; SIZE_MAX on error
+size_t fs_path_parent(FS_t *fs, const char *path, char *name);
+
+
+///
+/// Maps the file linked to the given descriptor as a read-only view
+///   Files whose blocks are contiguous in the image are viewed in place (zero-copy)
+///   Any other file is assembled in a private window, one block at a time (a cluster for compressed files), as fs_map_at touches it
+///   The view reflects the file at the time of the call, its size does not follow later writes
+/// \param fs The FS containing the file
+/// \param fd The file to map
+/// \return The new view, NULL on error
+///
+fs_map_t *fs_mmap(FS_t *fs, int fd);
+
+///
+/// Returns a pointer to nbyte bytes of the mapped file starting at offset
+///   Blocks of an assembled view that have not been touched yet are faulted in first
+/// \param map The view to index into
+/// \param offset Offset from BOF of the first byte
+/// \param nbyte Number of bytes the caller is going to look at
+/// \return Pointer to the bytes, NULL on error or if the range passes EOF
+///
+const void *fs_map_at(fs_map_t *map, size_t offset, size_t nbyte);
+
+///
+/// Returns the size in bytes of the mapped file
+/// \param map The view
+/// \return Size of the view, 0 on error
+///
+size_t fs_map_size(const fs_map_t *map);
+
+///
+/// Reports whether the view points straight into the image
+/// \param map The view
+/// \return true if the view is zero-copy, false if it is assembled or on error
+///
+bool fs_map_is_direct(const fs_map_t *map);
+
+///
+/// Releases a view returned by fs_mmap
+/// \param map The view to release
+/// \return 0 on success, < 0 on error
+///
+int fs_munmap(fs_map_t *map);
+
 #endif
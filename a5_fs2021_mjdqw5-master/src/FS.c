@@ -1,1305 +1,4692 @@
-#include "dyn_array.h"
-#include "bitmap.h"
-#include "block_store.h"
-#include "FS.h"
-
-#define BLOCK_STORE_NUM_BLOCKS 65536    // 2^16 blocks.
-#define BLOCK_STORE_AVAIL_BLOCKS 65534  // Last 2 blocks consumed by the FBM
-#define BLOCK_SIZE_BITS 32768           // 2^12 BYTES per block *2^3 BITS per BYTES
-#define BLOCK_SIZE_BYTES 4096           // 2^12 BYTES per block
-#define BLOCK_STORE_NUM_BYTES (BLOCK_STORE_NUM_BLOCKS * BLOCK_SIZE_BYTES)  // 2^16 blocks of 2^12 bytes.
-
-
-// You might find this handy.  I put it around unused parameters, but you should
-// remove it before you submit. Just allows things to compile initially.
-#define UNUSED(x) (void)(x)
-
-/// Formats (and mounts) an FS file for use
-/// \param fname The file to format
-/// \return Mounted FS object, NULL on error
-///
-FS_t *fs_format(const char *path)
-{
-    if(path != NULL && strlen(path) != 0)
-    {
-        FS_t * ptr_FS = (FS_t *)calloc(1, sizeof(FS_t));	// get started
-        ptr_FS->BlockStore_whole = block_store_create(path);				// pointer to start of a large chunck of memory
-
-        // reserve the 1st block for bitmap of inode
-        size_t bitmap_ID = block_store_allocate(ptr_FS->BlockStore_whole);
-        //		printf("bitmap_ID = %zu\n", bitmap_ID);
-
-        // 2rd - 5th block for inodes, 4 blocks in total
-        size_t inode_start_block = block_store_allocate(ptr_FS->BlockStore_whole);
-        //		printf("inode_start_block = %zu\n", inode_start_block);		
-        for(int i = 0; i < 3; i++)
-        {
-            block_store_allocate(ptr_FS->BlockStore_whole);
-            //			printf("all the way with block %zu\n", block_store_allocate(ptr_FS->BlockStore_whole));
-        }
-
-        // install inode block store inside the whole block store
-        ptr_FS->BlockStore_inode = block_store_inode_create(block_store_Data_location(ptr_FS->BlockStore_whole) + bitmap_ID * BLOCK_SIZE_BYTES, block_store_Data_location(ptr_FS->BlockStore_whole) + inode_start_block * BLOCK_SIZE_BYTES);
-
-        // the first inode is reserved for root dir
-        block_store_sub_allocate(ptr_FS->BlockStore_inode);
-        //		printf("first inode ID = %zu\n", block_store_sub_allocate(ptr_FS->BlockStore_inode));
-
-        // update the root inode info.
-        uint8_t root_inode_ID = 0;	// root inode is the first one in the inode table
-        inode_t * root_inode = (inode_t *) calloc(1, sizeof(inode_t));
-        //		printf("size of inode_t = %zu\n", sizeof(inode_t));
-        root_inode->vacantFile = 0x00000000;
-        root_inode->fileType = 'd';								
-        root_inode->inodeNumber = root_inode_ID;
-        root_inode->linkCount = 1;
-        //		root_inode->directPointer[0] = root_data_ID;	// not allocate date block for it until it has a sub-folder or file
-        block_store_inode_write(ptr_FS->BlockStore_inode, root_inode_ID, root_inode);		
-        free(root_inode);
-
-        // now allocate space for the file descriptors
-        ptr_FS->BlockStore_fd = block_store_fd_create();
-
-        return ptr_FS;
-    }
-
-    return NULL;	
-}
-
-
-
-///
-/// Mounts an FS object and prepares it for use
-/// \param fname The file to mount
-
-/// \return Mounted FS object, NULL on error
-
-///
-FS_t *fs_mount(const char *path)
-{
-    if(path != NULL && strlen(path) != 0)
-    {
-        FS_t * ptr_FS = (FS_t *)calloc(1, sizeof(FS_t));	// get started
-        ptr_FS->BlockStore_whole = block_store_open(path);	// get the chunck of data	
-
-        // the bitmap block should be the 1st one
-        size_t bitmap_ID = 0;
-
-        // the inode blocks start with the 2nd block, and goes around until the 5th block, 4 in total
-        size_t inode_start_block = 1;
-
-        // attach the bitmaps to their designated place
-        ptr_FS->BlockStore_inode = block_store_inode_create(block_store_Data_location(ptr_FS->BlockStore_whole) + bitmap_ID * BLOCK_SIZE_BYTES, block_store_Data_location(ptr_FS->BlockStore_whole) + inode_start_block * BLOCK_SIZE_BYTES);
-
-        // since file descriptors are allocated outside of the whole blocks, we can simply reallocate space for it.
-        ptr_FS->BlockStore_fd = block_store_fd_create();
-
-        return ptr_FS;
-    }
-
-    return NULL;		
-}
-
-
-
-
-///
-/// Unmounts the given object and frees all related resources
-/// \param fs The FS object to unmount
-/// \return 0 on success, < 0 on failure
-///
-int fs_unmount(FS_t *fs)
-{
-    if(fs != NULL)
-    {	
-        block_store_inode_destroy(fs->BlockStore_inode);
-
-        block_store_destroy(fs->BlockStore_whole);
-        block_store_fd_destroy(fs->BlockStore_fd);
-
-        free(fs);
-        return 0;
-    }
-    return -1;
-}
-
-
-// check if the input filename is valid or not
-bool isValidFileName(const char *filename)
-{
-    if(!filename || strlen(filename) == 0 || strlen(filename) > 127 || '/'==filename[0])
-    {
-        return false;
-    }
-
-    return true;
-}
-
-
-
-// use str_split to decompose the input string into filenames along the path, '/' as delimiter
-char** str_split(char* a_str, const char a_delim, size_t * count)
-{
-    if(*a_str != '/')
-    {
-        return NULL;
-    }
-    char** result    = 0;
-    char* tmp        = a_str;
-    char delim[2];
-    delim[0] = a_delim;
-    delim[1] = '\0';
-
-    /* Count how many elements will be extracted. */
-    while (*tmp)
-    {
-        if (a_delim == *tmp)
-        {
-            (*count)++;
-        }
-        tmp++;
-    }
-
-    result = (char**)calloc(1, sizeof(char*) * (*count));
-    for(size_t i = 0; i < (*count); i++)
-    {
-        *(result + i) = (char*)calloc(1, 200);
-    }
-
-    if (result)
-    {
-        size_t idx  = 0;
-        char* token = strtok(a_str, delim);
-
-        while (token)
-        {
-            strcpy(*(result + idx++), token);
-            //    *(result + idx++) = strdup(token);
-            token = strtok(NULL, delim);
-        }
-
-    }
-    return result;
-}
-
-
-
-///
-/// Creates a new file at the specified location
-///   Directories along the path that do not exist are not created
-/// \param fs The FS containing the file
-/// \param path Absolute path to file to create
-/// \param type Type of file to create (regular/directory)
-/// \return 0 on success, < 0 on failure
-///
-/** MILESTONE 2 **
-------------------------------
-    - fs_create
-    - fs_open
-    - fs_close
-    - fs_get_dir
-
-    typedef enum { FS_REGULAR, FS_DIRECTORY } file_t;
-*/
-
-/** Function to split the given path, using delimiters, into individual tokens
-    Majority of the code used in this function is taken from this stackoverflow thread
-    - https://stackoverflow.com/questions/9210528/split-string-with-delimiters-in-c
-*/
-char **tokenize(const char *path, size_t *token_count){
-    if (*path != '/'){
-        return NULL;
-    }
-    char**result = 0;
-    char *path_copy = calloc(1, 300);
-    strcpy(path_copy, path);
-    char *temp = path_copy;
-    while (*temp){
-        if (*temp == '/'){
-            (*token_count)++;
-        }
-        temp++;
-    }
-    result = (char**)calloc(1, sizeof(char*) * (*token_count));
-    for (size_t i = 0; i < (*token_count); i++){
-        *(result + i) = (char*)calloc(1, 300);
-    }
-    size_t index = 0;
-    char *token = strtok(path_copy, "/");
-    while (token){
-        strcpy(result[index], token);
-        token = strtok(NULL, "/");    
-        index++;
-    }
-    free(path_copy);
-    return result;
-}
-
-/** Creates a new file at the specified location
-     Directories along the path that do not exist are not created
-    \param fs The FS containing the file
-    \param path Absolute path to file to create
-    \param type Type of file to create (regular/directory)
-    \return 0 on success, < 0 on failure
-*/
-int fs_create(FS_t *fs, const char *path, file_t type) {
-    // param checks
-    if (fs != NULL && path != NULL && strlen(path) != 0 && (type == FS_REGULAR || type == FS_DIRECTORY)){ 
-        inode_t*new_inode = calloc(1, sizeof(inode_t)); // allocate space for a new inode
-        if (new_inode == NULL){ // malloc check
-            return -1;
-        }
-        size_t new_inode_num = 0; // initialize a new corresponding inode number
-        block_store_inode_read(fs->BlockStore_inode, 0, new_inode); // read the new inode into the first space -> becomes parent inode temporarily
-
-        directoryFile_t*directory = calloc(1, BLOCK_SIZE_BYTES); // allocate space for a new directory
-        if (directory == NULL){ // malloc check
-            return -1;
-        }
-        size_t dir_counter = 0; // the depth/level in the directory (counter to help keep track of position)        
-        block_store_read(fs->BlockStore_whole, new_inode->directPointer[0], directory); // read inode data into the new directory
-
-        size_t token_count = 0; // # of tokens
-        char**tokens_arr; // array of 'tokens' created by splitting the path using a delimiter 
-        tokens_arr = tokenize(path, &token_count); // tokenize the path
-        if (tokens_arr == NULL){ // check if tokenize was successful
-            return -1; 
-        }
-        size_t n = 0;
-        while (n < token_count){ // loop through array of tokens
-            if (strlen(tokens_arr[n]) == 0 || strchr(tokens_arr[n], '!') != NULL){ // check for empty tokens or tokens that contain invalid chars
-                for (size_t i = 0; i < token_count; i++){ // if empty string or invalid char, free all tokens
-                    free(tokens_arr[i]);
-                }
-                free(tokens_arr);
-                return -1; 
-            }
-            n++;
-        }
-
-        fs->bitmap = bitmap_overlay(32, &(new_inode->vacantFile)); // create bitmap using the parent inode data
-        for (size_t i = 0; i < token_count - 1; i++){ // loop through tokens array - 1
-            // REMEMBER: have to be in a dir to create a new file/dir
-            if ( (new_inode->fileType) == 'd'){ // extra layer check in case dir/file have the same name
-                int curr_dir = 0;
-                while (curr_dir < folder_number_entries){
-                    block_store_read(fs->BlockStore_whole, new_inode->directPointer[0], directory); // update directory data with parent inode data        
-                    if (strcmp((directory + curr_dir)->filename, tokens_arr[i]) == 0){ // if the 2 strings/tokens are equal
-                        new_inode_num = (directory + curr_dir)->inodeNumber; // update inode number
-                        block_store_inode_read(fs->BlockStore_inode, new_inode_num, new_inode); // read updated inode number into parent inode
-                        dir_counter++;
-                    }
-                    curr_dir++;                    
-                }
-            }
-        }
-        
-        /*
-            printf("Path:%s\n", path);
-            printf("# of Subpaths = %zu\n", dir_counter);
-            printf("Parent Inode # = %lu\n", new_inode_num);
-            printf("# of Tokens = %zu\n", token_count);
-            printf("------------------------\n");
-        */
-
-        if (new_inode->fileType == 'd' && dir_counter == token_count - 1 ){  // check that we're in a dir -> cannot create a file inside a file
-            size_t first_zero = bitmap_ffz(fs->bitmap); // find first 0 bit to store to be created directory in
-            for (size_t i = 0; i < first_zero; i++){ // loop through non-set bits
-                // check if the filename trying to be created already exists 
-                if (strcmp((directory + i)->filename, tokens_arr[token_count - 1]) == 0){ // if they're the same, error and free
-                    free(directory);
-                    free(new_inode);
-                    for (size_t j = 0; j < token_count; j++){ 
-                        free(tokens_arr[j]);
-                    }
-                    free(tokens_arr);
-                    return -1; 
-                }
-            }
-
-            if (first_zero < folder_number_entries){ // check that theres not more than the # of allowed entries
-                if (first_zero == 0){ // double check that bit found is not set
-                    size_t temp_block_id = block_store_allocate(fs->BlockStore_whole); // allocate a new bs device for the inode table 
-                    if (temp_block_id > BLOCK_STORE_AVAIL_BLOCKS){ // if there are no blocks availible -> free everything
-                        free(directory); 
-                        free(new_inode); 
-                        for(size_t i = 0; i < token_count; i++){
-                            free(tokens_arr[i]);
-                        }
-                        free(tokens_arr);
-                        bitmap_destroy(fs->bitmap);
-                        return -1;
-                    } 
-                    // else, store created block data in inode table
-                    new_inode->directPointer[0] = temp_block_id;
-                }
-                bitmap_set(fs->bitmap, first_zero); // change bit to set and update bitmap
-                block_store_inode_write(fs->BlockStore_inode, new_inode_num, new_inode); // update inode with new data
-
-                size_t temp_file_id = block_store_allocate(fs->BlockStore_inode); // allocate memory for file to be created
-                if (temp_file_id == SIZE_MAX){ // if failed to allocate new block
-                    free(new_inode);
-                    free(directory);
-                    for(size_t i = 0; i < token_count; i++){
-                        free(tokens_arr[i]);
-                    }
-                    free(tokens_arr);
-                    bitmap_destroy(fs->bitmap);
-                    return -1; 
-                }
-                strcpy((directory + first_zero)->filename, tokens_arr[token_count - 1]); // update filename
-                (directory + first_zero)->inodeNumber = temp_file_id; // update the inode num to the new file block's id 
-                block_store_write(fs->BlockStore_whole, new_inode->directPointer[0], directory); // write the inode data to the directory
-                
-                inode_t*fs_inode = (inode_t*)calloc(1, sizeof(inode_t)); // allocate a new inode for the file or directory
-                if (fs_inode == NULL){ // malloc check
-                    free(fs_inode);
-                    return -1; 
-                }
-                // set the filetype data for the new inode
-                if (type == FS_REGULAR){
-                    fs_inode->fileType = 'r';
-                } else if (type == FS_DIRECTORY) {
-                    fs_inode->fileType = 'd'; 
-                }
-                block_store_inode_write(fs->BlockStore_inode, temp_file_id, fs_inode); // update new inode with file block id data
-
-                free(directory);
-                free(new_inode);
-                free(fs_inode);
-                for (size_t i = 0; i < token_count; i++){
-                    free(tokens_arr[i]);
-                }
-                free(tokens_arr); 
-                bitmap_destroy(fs->bitmap);
-                return 0;
-            }
-        }
-        free(new_inode); 
-        free(directory);
-        for (size_t i = 0; i < token_count; i++){
-            free(tokens_arr[i]);
-        }
-        free(tokens_arr);
-    }
-    return -1;
-}
-
-/** Opens the specified file for use
-      R/W position is set to the beginning of the file (BOF)
-      Directories cannot be opened
-    \param fs The FS containing the file
-    \param path path to the requested file
-    \return file descriptor to the requested file, < 0 on error
-*/
-int fs_open(FS_t *fs, const char *path) {
-    if (fs != NULL && path != NULL && strlen(path) > 0) {
-        inode_t*new_inode = (inode_t*)calloc(1, sizeof(inode_t)); // create new inode 
-        if (new_inode == NULL){ // malloc check
-            return -1;
-        }
-        size_t new_inode_num = 0; // start at the first inode
-        block_store_inode_read(fs->BlockStore_inode, 0, new_inode); // read the first inode to our new parent inode
-
-        directoryFile_t*directory = (directoryFile_t*)calloc(1, BLOCK_SIZE_BYTES); // create a new directory
-        if (directory == NULL){ // malloc check 
-            return -1; 
-        }
-        size_t dir_counter = 0; // counter variable to track depth in directory (should be the same as the token)
-        block_store_read(fs->BlockStore_whole, new_inode->directPointer[0], directory);  // read the directory data from new inode to the directory
-
-        size_t token_count = 0;
-        char**tokens_arr;
-        tokens_arr = tokenize(path, &token_count);
-        if (tokens_arr == NULL){ // check tokenize worked as expected
-            return -1;
-        }
-        
-        for (size_t i = 0; i < token_count; i++){ // loop through tokens array
-            if (new_inode->fileType == 'd'){ // check that it's a directory -> because we can't open a file the way we would a directory
-                int curr_dir = 0; 
-                while (curr_dir < folder_number_entries){ // loop through the entire directory
-                    /* NOT ENTERING IF BLOCK
-                        Loop 1: 
-                            token[0] = folder
-                                |folder|file|0|0|0|0|
-                            directory[0]->filename = file
-                                |file|0|0|0|0|0|
-                                >> 1 = |folder|file|0|0|0|0|
-                     */
-                        // printf("Path = %s\n", path);
-                        // printf("tokens[%zu]    = %s\n", i, tokens[i]);
-                        // printf("directory[%zu] = %s\n", i, directory->filename);
-                        // printf("Dir Counter = %zu\n", dir_counter);
-                        // printf("Current dir = %x\n", curr_dir);
-                        // printf("------------------------------\n"); 
-                    
-                    block_store_read(fs->BlockStore_whole, new_inode->directPointer[0], directory); // update directory data
-                    if (strcmp((directory + curr_dir)->filename, tokens_arr[i]) == 0) { // check that the current directory name and token name match 
-                        new_inode_num = (directory + curr_dir)->inodeNumber; // set inode position to current and increment
-                        dir_counter++; 
-                    } 
-                    curr_dir++; 
-                }
-            }
-            block_store_inode_read(fs->BlockStore_inode, new_inode_num, new_inode); // update inode number
-        }
-        free(directory); 
-
-        /*
-            printf("Path: %s\n", path);
-            printf("# of Directories = %zu\n", dir_counter);  
-            printf("Parent Inode ID  = %lu\n", new_inode_num);
-            printf("# of Tokens      = %zu\n", token_count);
-            for (size_t test = 0; test < token_count; test++){
-            printf("Token %zu)         = %s\n", test, tokens[test]);
-            }
-            printf("------------------------\n"); 
-        */
-
-        if (dir_counter == token_count){  // if the dir counter and token count values are = continue 
-            size_t fd_table = block_store_sub_allocate(fs->BlockStore_fd); // allocate file descriptor table in empty block
-            if (fd_table < number_fd){ // check that we have not exceeded the limit for # of file descriptors
-                if ((new_inode->fileType) == 'd'){ // if the parent inode corresponds to a dir, free and error -> we are trying to open a file
-                    free(new_inode); 
-                        for (size_t i = 0; i < token_count; i++){
-                            free(tokens_arr[i]);
-                        }
-                    free(tokens_arr);
-                    return -1; 
-                }
-                size_t fd_inode_num = new_inode_num; // create new fd inode num and set it to the current inode number
-                inode_t*fd_inode = (inode_t*)calloc(1, sizeof(inode_t)); // allocate a new inode
-                if (fd_inode == NULL){ // malloc check
-                    return -1;
-                }
-                fileDescriptor_t*new_fd = (fileDescriptor_t*)calloc(1, sizeof(fileDescriptor_t)); // allocate a new fd
-                if (new_fd == NULL){ // malloc check 
-                    return -1; 
-                }
-                block_store_inode_read(fs->BlockStore_inode, fd_inode_num, fd_inode); // read fd_inode data with the fd inode num
-                new_fd->inodeNum = new_inode_num; // update the inode number to the current inode #
-                block_store_fd_write(fs->BlockStore_fd, fd_table, new_fd); // add the file descriptor table to the file descriptor 
-                free(new_inode);
-                free(new_fd);
-                for (size_t j = 0; j < token_count; j++){
-                    free(tokens_arr[j]);
-                }
-                free(tokens_arr);
-                return fd_table; 
-            }
-        } // else free all tokens
-        for (size_t i = 0; i < token_count; i++){
-            free(tokens_arr[i]);
-        }
-        free(tokens_arr);
-    }
-    return -1; 
-}
-
-/** Closes the given file descriptor
-    \param fs The FS containing the file
-    \param fd The file to close
-    \return 0 on success, < 0 on failure
-*/
-int fs_close(FS_t *fs, int fd){
-    // param check
-    if(fs != NULL && fd >= 0 && fd < number_fd && block_store_sub_test(fs->BlockStore_fd, fd)){
-        // if the fd is being used, "release" it 
-        block_store_sub_release(fs->BlockStore_fd, fd);
-        return 0;   
-    } // else nothing to close -> error
-    return -1;
-}
-
-/** Populates a dyn_array with information about the files in a directory
-      Array contains up to 15 file_record_t structures
-    \param fs The FS containing the file
-    \param path Absolute path to the directory to inspect
-    \return dyn_array of file records, NULL on error
-*/
-dyn_array_t *fs_get_dir(FS_t *fs, const char *path) {
-    // param check
-    if (fs != NULL && path != NULL && strlen(path) > 0){
-        inode_t*new_inode = (inode_t*)calloc(1, sizeof(inode_t)); // create a new inode 
-        if (new_inode == NULL){
-            return NULL;
-        }
-        size_t new_inode_num = 0; // initialize the inode num
-        block_store_inode_read(fs->BlockStore_inode, 0, new_inode); // set the inode position to the first block 
-
-        directoryFile_t*directory = (directoryFile_t*)calloc(1, BLOCK_SIZE_BYTES); // create a new directory
-        if (directory == NULL){
-            return NULL;
-        }
-        size_t dir_counter = 0; 
-        block_store_read(fs->BlockStore_whole, new_inode->directPointer[0], directory); // add inode data to directory
-
-        size_t token_count = 0;
-        char**tokens_arr; 
-        tokens_arr = tokenize(path, &token_count);
-        if (strlen(*tokens_arr) == 0){
-            token_count = token_count - 1;
-        } 
-        
-        size_t j = 0;
-        while (j < token_count){ // loop through array of tokens
-            if (strlen(tokens_arr[j]) == 0 || strchr(tokens_arr[j], '!') != NULL){ // check for empty tokens or tokens that contain invalid chars
-                for (size_t i = 0; i < token_count; i++){ // if empty string or invalid char, free all tokens
-                    free(tokens_arr[i]);
-                }
-                free(tokens_arr);
-                return NULL; 
-            }
-            j++;
-        }
-
-        for (size_t i = 0; i < token_count; i++){
-            if (new_inode->fileType == 'd'){
-                int curr_dir = 0;
-                while (curr_dir < folder_number_entries){
-                    if (strcmp((directory + curr_dir)->filename, tokens_arr[i]) == 0){
-                        block_store_read(fs->BlockStore_whole, new_inode->directPointer[0], directory);
-                        new_inode_num = (directory + curr_dir)->inodeNumber;
-                        dir_counter++;
-                    }
-                    curr_dir++;
-                }
-            }
-            block_store_inode_read(fs->BlockStore_whole, new_inode_num, new_inode);
-        }
-        fs->bitmap = bitmap_overlay(32, &(new_inode->vacantFile));
-        free(new_inode);
-        free(directory);
-
-        // check current position and token # match | check the parent inode is a directory
-        if (dir_counter == token_count){ // check current position and token # match (aka we're in the right spot)
-            inode_t*dir_inode = (inode_t*)calloc(1, sizeof(inode_t)); // allocate a new inode for the file
-            if (dir_inode == NULL){
-                return NULL;
-            }
-            directoryFile_t*dir_file = (directoryFile_t*)calloc(1, BLOCK_SIZE_BYTES); // create a directory file to hold the data
-            if (dir_file == NULL){
-                return NULL;
-            }
-            dyn_array_t*dyn_arr = dyn_array_create(20, sizeof(file_record_t), NULL); // create dynamic array to hold up to 20 directory file objects
-
-            block_store_inode_read(fs->BlockStore_inode, new_inode_num, dir_inode); // read the parent inode data into the file inode
-            if (dir_inode->fileType == 'd'){ // double check that we're at a directory -> files can't contain other files
-                block_store_read(fs->BlockStore_whole, dir_inode->directPointer[0], dir_file); // once we know we're at a dir - read data from inode to directory file
-                int curr_dir = 0;
-                while (curr_dir < folder_number_entries){ // loop through directory
-                    if (bitmap_test(fs->bitmap, curr_dir) == 1){  // look for a populated bit (aka contains a file)
-                        file_record_t*file_data = (file_record_t*)calloc(1, sizeof(file_record_t)); // allocate space for file metadata
-                        strcpy(file_data->name, (dir_file + curr_dir)->filename); // copy current dir filename to the files data 
-                        dyn_array_push_front(dyn_arr, file_data); // add the file data at the front of the dynamic array
-                        free(file_data);
-                    }
-                    curr_dir++; 
-                }
-            }
-            free(dir_inode);
-            free(dir_file);
-            return dyn_arr;
-        }
-        bitmap_destroy(fs->bitmap);
-    }
-    return NULL;
-}
-
-/** Moves the R/W position of the given descriptor to the given location
-      Files cannot be seeked past EOF or before BOF (beginning of file)
-      Seeking past EOF will seek to EOF, seeking before BOF will seek to BOF
-    \param fs The FS containing the file
-    \param fd The descriptor to seek
-    \param offset Desired offset relative to whence
-    \param whence Position from which offset is applied
-    \return offset from BOF, < 0 on error 
-*/
-off_t fs_seek(FS_t *fs, int fd, off_t offset, seek_t whence) {
-    if (fs != NULL && (whence == FS_SEEK_CUR || whence == FS_SEEK_SET)){ // initial param check
-        if (block_store_sub_test(fs->BlockStore_fd, fd) == false){ // check file descriptor table block which fd corresponds to
-            return -1;
-        }
-        if (offset < 0){
-            return 0;
-        }
-        
-        fileDescriptor_t new_fd;
-        block_store_fd_read(fs->BlockStore_fd, fd, &new_fd);
-        
-        // if we surpass max offset, seek to the max offset 
-        if (offset > 259981311){
-            new_fd.locate_order = 0;
-            new_fd.locate_offset = 0;
-            offset = 259981311;
-            // updateFileDescriptor(&fileDescriptor, 63472 * 4096 - 1);
-            size_t remaining = 4096 - new_fd.locate_offset;
-            new_fd.locate_offset += (63472 * 4096) - 1;  // offset - 1
-            if (remaining < (63472 * 4096) - 1){
-                new_fd.locate_offset += ((63472 * 4096) - 1) / 4096;
-                new_fd.locate_offset = ((63472 * 4096) - 1) % 4096;
-            }
-            block_store_fd_write(fs->BlockStore_fd, fd, &new_fd);
-            return offset;
-        } else {
-            inode_t inode;
-            block_store_inode_read(fs->BlockStore_inode, new_fd.inodeNum, &inode);
-            if (whence == FS_SEEK_CUR) {
-                off_t prev_offset = 0;
-                if (new_fd.locate_offset != 0) {
-                    prev_offset += new_fd.locate_order * BLOCK_SIZE_BYTES;
-                    prev_offset += new_fd.locate_offset;
-                }
-                if (offset > (int)inode.fileSize){
-                    offset = inode.fileSize;
-                } else {
-                    offset = offset + prev_offset;
-                }
-            }
-            new_fd.locate_order = 0;
-            new_fd.locate_offset = 0;
-            // updateFileDescriptor(&fileDescriptor, offset);
-            int remaining = 4096 - new_fd.locate_offset;
-            new_fd.locate_offset += offset;
-            if (remaining < offset) {
-                new_fd.locate_order += offset / 4096;
-                new_fd.locate_offset = offset % 4096;
-            }
-            block_store_fd_write(fs->BlockStore_fd, fd, &new_fd);
-            return offset;
-        }
-    }
-    return -1;
-}
-
-/** Reads data from the file linked to the given descriptor
-      Reading past EOF returns data up to EOF
-      R/W position in incremented by the number of bytes read
-    \param fs The FS containing the file
-    \param fd The file to read from 
-    \param dst The buffer to write to
-    \param nbyte The number of bytes to read
-    \return number of bytes read (< nbyte IFF read passes EOF), < 0 on error
-*/
-/* Notes: 
-    - int fd = index into file descriptor table / fd ID
-        - allows us to use block_store_fd_read() on that int to access the corresponding fd struct
-    - idea: fs_open() does the path traversal to find the inode number for the file that's being opened
-        - stores that inode number in the file descriptor so other functions, like fs_read() and fs_write(),
-        don't have to traverse the path
-        - Inode number in a file descriptor should be the inode ID for the inode that represents the file 
-*/
-ssize_t fs_read(FS_t *fs, int fd, void *dst, size_t nbyte){
-    if (fs != NULL && fd < number_fd && dst != NULL){ // error check params
-        fileDescriptor_t new_fd;
-        block_store_fd_read(fs->BlockStore_fd, fd, &new_fd);
-        inode_t fd_inode;
-        block_store_inode_read(fs->BlockStore_inode, new_fd.inodeNum, &fd_inode);
-        off_t prev_offset = 0;
-
-        if (new_fd.locate_order == 0) {
-            prev_offset = new_fd.locate_offset;
-        } else if (new_fd.locate_offset != 0) {
-            prev_offset += ((new_fd.locate_order - 1) * 4096);
-            prev_offset += new_fd.locate_offset;
-        } else {
-            prev_offset += (new_fd.locate_order * 4096);
-        }
-        if (prev_offset + nbyte > fd_inode.fileSize){
-            nbyte = fd_inode.fileSize - prev_offset;
-        }
-        uint16_t block_id = fd_inode.directPointer[new_fd.locate_order];
-        uint8_t block_buff[4096];
-        block_store_read(fs->BlockStore_whole, block_id, block_buff);
-        memcpy(dst, block_buff + new_fd.locate_offset, nbyte);
-        int remaining = 4096 - new_fd.locate_offset;
-        new_fd.locate_offset += nbyte; 
-        if (remaining > (int)nbyte){
-            new_fd.locate_order += nbyte / 4096;
-            new_fd.locate_offset = nbyte % 4096;
-        }
-        block_store_fd_write(fs->BlockStore_fd, fd, &new_fd);
-        return nbyte;
-    }        
-    return -1; 
-}
-
-ssize_t write_indirect_ptr(FS_t*fs, uint16_t fd_order, uint16_t fd_offset, const void*src, size_t nbyte, size_t block_num){
-    uint16_t block_buff[2048]; // buffer holder 
-    block_store_read(fs->BlockStore_whole, block_num, block_buff); // add the indirect block id to the buffer
-    ssize_t retBytes = 0;
-    int avail = (fd_order - fd_size) % 2048;
-    while (nbyte > 0 && avail < 2048){ // check that there is available space and data to write
-        size_t block_space = BLOCK_SIZE_BYTES - fd_offset; // calculate space available in block
-        if (block_space > nbyte){
-            block_space = nbyte;
-        }
-        // update data
-        avail = avail + 1; 
-        nbyte = nbyte - block_space;
-        src = src + block_space;
-        retBytes = retBytes + block_space;
-        fd_order += 1;
-    }
-    block_store_write(fs->BlockStore_whole, block_num, block_buff);
-    return retBytes;
-}
-
-ssize_t write_double_indirect_ptr(FS_t *fs, inode_t *inode, uint16_t fd_order, uint16_t fd_offset, const void *src, size_t nbyte){
-    uint16_t block_buff[2048];
-    block_store_read(fs->BlockStore_whole, inode->doubleIndirectPointer, block_buff);
-    size_t block_num = block_buff[(fd_order - (6 + 2048)) / 2048]; // udpate the new indirect block number for indirect ptr
-    
-    return write_indirect_ptr(fs, fd_order, fd_offset, src, nbyte, block_num + 2048);
-}
-
-ssize_t write_direct_ptr(FS_t*fs, inode_t*inode, uint16_t fd_order, uint16_t fd_offset, const void*src, size_t nbyte){
-    uint8_t block_buff[BLOCK_SIZE_BYTES]; // a buffer for the current block we are writing to block id
-    memset(block_buff, '\0', BLOCK_SIZE_BYTES);
-    // calculate availible space that we can write to with the fd offset
-    size_t available_space = 4096 - fd_offset; 
-    if (available_space > nbyte){ // if there is more space than we need
-        available_space = nbyte; // set the space to exact # we want to write
-    } 
-    if (inode->directPointer[fd_order] == 0){ // if inode  doesn't already have direct pointers allocated
-        inode->directPointer[fd_order] = block_store_allocate(fs->BlockStore_whole);;
-        memcpy(block_buff, src, BLOCK_SIZE_BYTES); // src path to buff holder
-    } else { // if direct pointers are already there
-        block_store_read(fs->BlockStore_whole, inode->directPointer[fd_order], block_buff); // read the updated block id into the buffer
-        memcpy(block_buff + fd_offset, src, available_space); // copy contents of src to the buffer at the current fd offset
-    }
-    // update direct pointer with new data
-    block_store_write(fs->BlockStore_whole, inode->directPointer[fd_order], block_buff); 
-    nbyte = nbyte - available_space; // update nbytes
-    if (nbyte == 0){ // if all bytes have been written
-        return available_space;
-    }
-    if (fd_order + 1 < 6){ // if theres still more to be bytes to be written use next availible direct pointer
-        fd_order = fd_order + 1;
-        return available_space + write_direct_ptr(fs, inode, fd_order, 0, src + available_space, nbyte);
-    } 
-    return available_space;
-}
-
-void update_order_offset(fileDescriptor_t*new_fd, size_t nbyte){
-    size_t remaining = 4096 - new_fd->locate_offset;
-    if (remaining < nbyte){
-        nbyte = nbyte - remaining ;
-        new_fd->locate_order = new_fd->locate_order + 1;
-        new_fd->locate_order += nbyte / 4096;
-        new_fd->locate_offset = nbyte % 4096;
-    } else {
-        new_fd->locate_offset += nbyte;
-        if (new_fd->locate_offset == 1024){
-            new_fd->locate_order = new_fd->locate_order + 1;
-            new_fd->locate_offset = 0;
-        }
-    }
-}
-
-/** Writes data from given buffer to the file linked to the descriptor
-      Writing past EOF extends the file
-      Writing inside a file overwrites existing data
-      R/W position in incremented by the number of bytes written
-    \param fs The FS containing the file
-    \param fd The file to write to
-    \param dst The buffer to read from
-    \param nbyte The number of bytes to write
-    \return number of bytes written (< nbyte IFF out of space), < 0 on error
-*/
-ssize_t fs_write(FS_t *fs, int fd, const void *src, size_t nbyte) {
-    if (fs != NULL && src != NULL){ // param check 
-        if (!block_store_sub_test(fs->BlockStore_fd, fd)){
-            return -1;
-        }
-		fileDescriptor_t new_fd; // create file descriptor
-		block_store_fd_read(fs->BlockStore_fd, fd, &new_fd); // update file descriptor with fd value 
-        uint16_t fd_order = new_fd.locate_order;
-        uint16_t fd_offset = new_fd.locate_offset;
-
-		inode_t fd_inode;
-		block_store_inode_read(fs->BlockStore_inode, new_fd.inodeNum, &fd_inode);
-
-		ssize_t num_bytes_written = 0;
-		if (fd_order < fd_size){
-			num_bytes_written = write_direct_ptr(fs, &fd_inode, fd_order, fd_offset, src, nbyte);
-            update_order_offset(&new_fd, nbyte);
-		    
-        } else if (fd_order >= fd_size && fd_order < (fd_size + 2048)){ // write to the indirect pointer
-			size_t block_num;
-			if (fd_inode.indirectPointer[0] == 0){
-                uint16_t block_buff[fd_size + 2048];
-                block_num = block_store_allocate(fs->BlockStore_whole);
-                if (block_num == SIZE_MAX){
-                    return 0;
-                }
-                memset(block_buff, '\0', BLOCK_SIZE_BYTES);
-                block_store_write(fs->BlockStore_whole, block_num, block_buff);
-				fd_inode.indirectPointer[0] = block_num;
-			} 
-			block_num = fd_inode.indirectPointer[0];
-			num_bytes_written = write_indirect_ptr(fs, fd_order, fd_offset, src, nbyte, block_num);
-
-		} else if(fd_order >= (fd_size + 2048)) { // allocate the double indirect pointers
-			num_bytes_written = write_double_indirect_ptr(fs, &fd_inode, fd_order, fd_offset, src, nbyte);
-            update_order_offset(&new_fd, nbyte);
-		}
-        block_store_fd_write(fs->BlockStore_fd, fd, &new_fd);
-        fd_inode.fileSize += num_bytes_written;
-        block_store_inode_write(fs->BlockStore_inode, new_fd.inodeNum, &fd_inode);
-		return num_bytes_written;
-    }
-    return -1;
-}
-
-/** tokenize helper function I used in A5.2 */
-char **tokenize(const char *path, size_t *token_count){
-    if (*path != '/'){
-        return NULL;
-    }
-    char**result = 0;
-    char *path_copy = calloc(1, 65535);
-    strcpy(path_copy, path);
-    char *temp = path_copy;
-    while (*temp){
-        if (*temp == '/'){
-            (*token_count)++;
-        }
-        temp++;
-    }
-    result = (char**)calloc(1, sizeof(char*) * (*token_count));
-    for (size_t i = 0; i < (*token_count); i++){
-        *(result + i) = (char*)calloc(1, 65535);
-    }
-    size_t index = 0;
-    char *token = strtok(path_copy, "/");
-    while (token){
-        strcpy(result[index], token);
-        token = strtok(NULL, "/");    
-        index++;
-    }
-    free(path_copy);
-    return result;
-}
-
-
-/*
-    bool isValidFileName(const char *filename)
-    {
-        if(!filename || strlen(filename) == 0 || strlen(filename) > 127 || '/'==filename[0])
-        {
-            return false;
-        }
-
-        return true;
-    }
-*/
-
-void free_tokens(char** tokens, size_t token_count) {
-    for (size_t i = 0; i < token_count; i++){
-        free(tokens[i]);
-    }
-    free(tokens);
-}
-
-/** Deletes the specified file and closes all open descriptors to the file
-      Directories can only be removed when empty
-    \param fs The FS containing the file
-    \param path Absolute path to file to remove
-    \return 0 on success, < 0 on error
-*/
-/**** NOTE ****
-    A LOT OF THIS CODE FOR THIS FUNCTION
-    WAS TAKEN FROM PREVIOUS FUNCTIONS WHICH
-     JIMR GAVE US SOLUTIONS TO 
-     -> THUS A LOT IS COPY PASTED JIMR CODE
-*/
-int fs_remove(FS_t *fs, const char *path) {
-    if(fs != NULL && path != NULL && strlen(path) != 0) {
-        size_t token_count = 0;
-        char**tokens;
-        tokens = tokenize(path, &token_count);
-        if(tokens == NULL) {
-            return -1;
-        }
-
-        directoryFile_t*parent_data = (directoryFile_t*)calloc(1, BLOCK_SIZE_BYTES);
-        if (parent_data == NULL){
-            free(parent_data);
-            return -1; 
-        }
-        size_t dir_counter = 0;
-        
-        inode_t*parent_inode = (inode_t*)calloc(1, sizeof(inode_t));	
-        if (parent_inode == NULL){
-            free(parent_inode);
-            return -1;
-        }
-        size_t parent_inode_ID = 0;	// start from the 1st inode, ie., the inode for root directory
-
-        /* 
-         *
-         * FOLLOWING CODE IS TAKEN FROM JIMRS 'fs_create()' FUNCTION SOLUTION 
-         *
-         */
-
-        // we declare parent_inode and parent_data here since it will still be used after the for loop
-        
-
-        for(size_t i = 0; i < token_count - 1; i++){
-            block_store_inode_read(fs->BlockStore_inode, parent_inode_ID, parent_inode); // read inode number to parent inode
-            if(parent_inode->fileType == 'd') { // check case where file and dir have same name
-                block_store_read(fs->BlockStore_whole, parent_inode->directPointer[0], parent_data);
-                int j = 0;
-                while (j < folder_number_entries){
-                    if( ((parent_inode->vacantFile >> j) & 1) == 1 && strcmp((parent_data + j) -> filename, *(tokens + i)) == 0 ){
-                        parent_inode_ID = (parent_data + j) -> inodeNumber;
-                        dir_counter++;
-                    }
-                    j++;
-                }
-            }					
-        }
-        block_store_inode_read(fs->BlockStore_inode, parent_inode_ID, parent_inode);
-
-
-        /* 
-         *
-         * FOLLOWING CODE IS TAKEN FROM JIMRS 'fs_create()' FUNCTION SOLUTION 
-         *
-         */
-
-        // for deleting empty directories  
-        if(dir_counter == token_count - 1) {
-            inode_t*new_inode = calloc(1, sizeof(inode_t));
-            if (new_inode == NULL){
-                return -1; 
-            }
-            int curr_dir = 0;
-            int temp_counter = 0;
-            if (parent_inode->fileType == 'd'){
-                // same file or dir name in the same path is intolerable
-                int curr_pos = 0;
-                while (curr_dir < folder_number_entries){
-                    if( ((parent_inode->vacantFile >> curr_dir) & 1) == 1){
-                        block_store_read(fs->BlockStore_whole, parent_inode->directPointer[0], parent_data);
-                        block_store_inode_read(fs->BlockStore_inode, (parent_data + curr_dir) -> inodeNumber, new_inode);
-                        // if (strcmp((parent_data + curr_dir) -> filename, *(tokens + token_count - 1)) == 0)
-                        curr_pos = strcmp((parent_data + curr_dir) -> filename, *(tokens + token_count - 1)) == 0;
-                        // strcmp((parent_data + curr_dir) -> filename, *(tokens + token_count - 1)) == 0;
-                        // block_store_inode_read(fs->BlockStore_inode, (parent_data + curr_dir) -> inodeNumber, new_inode);
-                        for(size_t i = 0; i < folder_number_entries; i++){
-                            if(((new_inode->vacantFile >> curr_dir)) != 0 && new_inode->fileType == 'd') {
-                                temp_counter++;       
-                            }
-                        }
-                        if( strcmp((parent_data + curr_dir) -> filename, *(tokens + token_count - 1)) == 0 ){
-                            break;											
-                        }
-                    }
-                    curr_dir++;
-                }
-
-                if (curr_pos == 1 && temp_counter == 0){
-                    block_store_sub_release(fs->BlockStore_inode, (parent_data + curr_dir)->inodeNumber);
-                    bitmap_t*temp_bm = bitmap_overlay(31,&(parent_inode->vacantFile));
-                    bitmap_reset(temp_bm, curr_dir);
-
-                    parent_inode->directPointer[curr_dir] = 0;
-                    block_store_inode_write(fs->BlockStore_inode, parent_inode_ID, parent_inode);
-                    memset((parent_data + curr_dir)->filename, 0, 127);
-                    block_store_write(fs->BlockStore_whole, parent_inode->directPointer[curr_dir], parent_data);
-
-                    free_tokens(tokens, token_count);
-                    free(parent_inode);	
-                    free(parent_data);
-                    return 0;
-
-                } 
-                // if we are not currently at a directory 
-                free_tokens(tokens, token_count);
-                free(parent_inode);	
-                free(parent_data);
-                return -1;
-            }
-        }
-
-        /* 
-         *
-         * FOLLOWING CODE IS TAKEN FROM JIMRS 'fs_create()' FUNCTION SOLUTION 
-         *
-         */
-        if (dir_counter == token_count - 1 && parent_inode->fileType == 'd'){
-            // same file or dir name in the same path is intolerable
-            int k = 0;
-            int curr_dir = 0;
-            while (curr_dir < folder_number_entries){
-                if ( ((parent_inode->vacantFile >> curr_dir) & 1) == 1){
-                    if ( strcmp((parent_data + curr_dir) -> filename, *(tokens + token_count - 1)) == 0 ){
-                        free(parent_inode);	
-                        free(parent_data);
-                        free_tokens(tokens, token_count);
-                        return -1;   			
-                    }
-                    block_store_read(fs->BlockStore_whole, parent_inode->directPointer[0], parent_data);
-                    k = strcmp((parent_data + curr_dir) -> filename, *(tokens + token_count - 1)) == 0;
-                }
-                curr_dir++;
-            }
-
-            if (k == 1){ // if a file is found
-                block_store_sub_release(fs->BlockStore_inode, (parent_data + curr_dir)->inodeNumber); // release the block at the current inode
-                bitmap_t*temp_bm = bitmap_overlay(folder_number_entries, &(parent_inode->vacantFile));
-                bitmap_reset(temp_bm, curr_dir);
-                
-                parent_inode->directPointer[curr_dir]=0;
-                block_store_inode_write(fs->BlockStore_inode, parent_inode_ID, parent_inode);
-    
-                memset((parent_data+curr_dir)->filename, 0, 127);
-                block_store_write(fs->BlockStore_whole, parent_inode->directPointer[curr_dir], parent_data);
-                free_tokens(tokens, token_count);
-                free(parent_inode);	
-                free(parent_data);
-                return 0;
-            }
-            free_tokens(tokens, token_count);
-            free(parent_inode);	
-            free(parent_data);
-        }
-    }
-    return -1;
-}
-
-/** Moves the file from one location to the other
-      Moving files does not affect open descriptors
-    \param fs The FS containing the file
-    \param src Absolute path of the file to move
-    \param dst Absolute path to move the file to
-    \return 0 on success, < 0 on error
-
-    **************
-    **** NOTE ****
-    **************
-    A LOT OF THIS CODE FOR THIS FUNCTION
-    WAS TAKEN FROM PREVIOUS FUNCTIONS WHICH
-     JIMR GAVE US SOLUTIONS TO 
-     -> THUS A LOT IS COPY PASTED JIMR CODE
-*/
-int fs_move(FS_t *fs, const char *src, const char *dst) {
-    if (fs != NULL && src != NULL && strlen(src) != 0 && dst != NULL && strlen(dst)!=0) {
-        directoryFile_t * parent_data = (directoryFile_t *)calloc(1, BLOCK_SIZE_BYTES);
-        if (parent_data == NULL){
-            return -1;
-        }
-        size_t dir_counter = 0;
-        
-        inode_t * parent_inode = (inode_t *) calloc(1, sizeof(inode_t));	
-        if (parent_inode == NULL){
-            return -1; 
-        }
-        size_t parent_inode_ID = 0;	// start from the 1st inode, ie., the inode for root directory
-
-        size_t count = 0;
-        char**tokens;
-        tokens = tokenize(src, &count);
-        if(tokens == NULL) {
-            free_tokens(tokens, count);
-            return -1;
-        }
-        // let's check if the filenames are valid or not
-        /* SEG FAULT WITHOUT CHECK */
-        for(size_t n = 0; n < count; n++){	
-            if(isValidFileName(tokens[n]) == false){
-                free_tokens(tokens, n);
-                return -1;
-            }
-        }
-
-        char token_save[127];
-        strcpy(token_save, tokens[count-1]);
-    
-        /* 
-         *
-         * FOLLOWING CODE IS TAKEN FROM JIMRS 'fs_create()' FUNCTION SOLUTION 
-         *
-         */
-        for(size_t i = 0; i < count - 1; i++){
-            block_store_inode_read(fs->BlockStore_inode, parent_inode_ID, parent_inode);
-            if(parent_inode->fileType == 'd'){ // in case file and dir has the same name
-                block_store_read(fs->BlockStore_whole, parent_inode->directPointer[0], parent_data);
-                int curr_dir = 0; 
-                while (curr_dir < folder_number_entries){
-                    if( ((parent_inode->vacantFile >> curr_dir) & 1) == 1 && strcmp((parent_data + curr_dir) -> filename, tokens[i]) == 0 ) {
-                        parent_inode_ID = (parent_data + curr_dir) -> inodeNumber;
-                        dir_counter++;
-                    }
-                    curr_dir++;
-                }
-            }					
-        }
-        block_store_inode_read(fs->BlockStore_inode, parent_inode_ID, parent_inode);
-
-        
-        int target_src, src_num;
-        if (dir_counter == count - 1 && parent_inode->fileType == 'd') {
-            int flag = 0;
-            int curr_dir = 0;
-            while (curr_dir < folder_number_entries) {
-                if( ((parent_inode->vacantFile >> curr_dir) & 1) == 1) {
-                    block_store_read(fs->BlockStore_whole, parent_inode->directPointer[0], parent_data);
-                    flag = strcmp((parent_data + curr_dir) -> filename, tokens[count - 1]) == 0;
-                    if( strcmp((parent_data + curr_dir) -> filename, tokens[count - 1]) == 0) {
-                        target_src = flag;
-                        src_num = curr_dir;
-                    }
-                }
-                curr_dir++;
-            }
-        }
-
-
-        /* clear token values and tokenize dst string now */
-        count = 0; 
-        tokens = tokenize(dst, &count);
-        if(tokens == NULL){
-            return -1;
-        }
-        for(size_t n = 0; n < count; n++){	
-            if(isValidFileName(tokens[n]) == false){
-                free_tokens(tokens, n);
-                return -1;
-            }
-        }
-
-        
-        
-        directoryFile_t * dst_directory = (directoryFile_t *)calloc(1, BLOCK_SIZE_BYTES);
-        if (dst_directory == NULL){
-            return -1;
-        }
-        dir_counter = 0;
-
-        inode_t * dst_inode = (inode_t *) calloc(1, sizeof(inode_t));	
-        if (dst_inode == NULL){
-            return -1;
-        }
-        size_t dst_inode_id = 0;	
-
-        for(size_t i = 0; i < count - 1; i++) {
-            block_store_inode_read(fs->BlockStore_inode, dst_inode_id, dst_inode);	// read out the parent inode
-            if(dst_inode->fileType == 'd'){
-                block_store_read(fs->BlockStore_whole, dst_inode->directPointer[0], dst_directory);
-                int curr_dir = 0;
-                while (curr_dir < folder_number_entries) {
-                    if( ((dst_inode->vacantFile >> curr_dir) & 1) == 1 && strcmp((dst_directory + curr_dir) -> filename, tokens[i]) == 0 ) {
-                        dst_inode_id = (dst_directory + curr_dir) -> inodeNumber;
-                        dir_counter++;
-                    }
-                    curr_dir++;            
-                }
-            }					
-        }
-        
-        // read out the parent inode
-        block_store_inode_read(fs->BlockStore_inode, dst_inode_id, dst_inode);
-        bool dst_flag;
-        //int entryNumberDst;
-        uint8_t inode_dst_stat;
-
-        if(dir_counter == count - 1 && dst_inode->fileType == 'd') {
-            // same file or dir name in the same path is intolerable
-
-            bool temp_flag = false;
-            int curr_dir = 0;
-            while (curr_dir < folder_number_entries){
-                if( ((dst_inode->vacantFile >> curr_dir) & 1) == 1){
-                    block_store_read(fs->BlockStore_whole, dst_inode->directPointer[0], dst_directory);
-                    temp_flag = strcmp((dst_directory + curr_dir) -> filename, *(tokens + count - 1)) == 0;
-                    if(strcmp((dst_directory + curr_dir)->filename, token_save) == 0){
-                        dst_flag = true;
-                        break;
-                    }
-                    if( strcmp((dst_directory + curr_dir) -> filename, *(tokens + count - 1)) == 0 ){
-                        dst_flag = temp_flag;
-                        inode_dst_stat = (dst_directory + curr_dir)->inodeNumber;
-                        break;
-                    }
-                }
-                curr_dir++;
-            } 
-        } else {
-            dst_flag = true;
-        }
-        
-        
-
-        if(dst_flag == false && target_src == true) {
-            bitmap_t* src_store = bitmap_overlay(folder_number_entries, &(parent_inode->vacantFile));
-            bitmap_reset(src_store, src_num);
-            
-            memset((parent_data + src_num)->filename,0,127);
-            block_store_write(fs->BlockStore_whole,parent_inode->directPointer[0],parent_data);
-            block_store_inode_write(fs->BlockStore_inode,parent_inode_ID,parent_inode);
-           
-            bitmap_t* dst_store =bitmap_overlay(31,&(dst_inode->vacantFile));
-            size_t temp_ffz = bitmap_ffz(dst_store);
-            bitmap_set(dst_store, temp_ffz);
-            (dst_directory + temp_ffz)->inodeNumber = inode_dst_stat;
-            strcpy((dst_directory + temp_ffz)->filename, tokens[count - 1]);
-            block_store_write(fs->BlockStore_whole, dst_inode->directPointer[0], dst_directory);
-            block_store_inode_write(fs->BlockStore_inode, dst_inode_id, dst_inode);
-
-            free_tokens(tokens, count);
-            free(parent_inode);	
-            free(parent_data);
-            return 0;
-        }
-        free_tokens(tokens, count);
-        free(parent_inode);	
-        free(parent_data);
-    }
-    return -1;
-}
-
-
-/** Link the dst with the src
-     dst and src should be in the same File type, say, both are files or both are directories
-    \param fs The F18FS containing the file
-    \param src Absolute path of the source file
-    \param dst Absolute path to link the source to
-    \return 0 on success, < 0 on error
-*/
-int fs_link(FS_t *fs, const char *src, const char *dst){
-    if (fs && src != NULL && strlen(src) > 0 && dst != NULL && strlen(dst) > 0){
-        return 0;
-    }
-    return -1;
-}
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
+#define _DEFAULT_SOURCE	// for MADV_REMOVE, see fs_trim
+
+#include "dyn_array.h"
+#include "bitmap.h"
+#include "block_store.h"
+#include "FS.h"
+
+#include <stddef.h>	// for offsetof
+#include <pthread.h>	// for fs_check
+#include <sys/mman.h>	// for madvise, msync
+#include <unistd.h>	// for sysconf
+
+#define BLOCK_STORE_NUM_BLOCKS 65536    // 2^16 blocks.
+#define BLOCK_STORE_AVAIL_BLOCKS 65534  // Last 2 blocks consumed by the FBM
+#define BLOCK_SIZE_BITS 32768           // 2^12 BYTES per block *2^3 BITS per BYTES
+#define BLOCK_SIZE_BYTES 4096           // 2^12 BYTES per block
+#define BLOCK_STORE_NUM_BYTES (BLOCK_STORE_NUM_BLOCKS * BLOCK_SIZE_BYTES)  // 2^16 blocks of 2^12 bytes.
+
+
+// You might find this handy.  I put it around unused parameters, but you should
+// remove it before you submit. Just allows things to compile initially.
+#define UNUSED(x) (void)(x)
+
+// the on-disk inode layout is fixed, catch any compiler that lays it out differently
+_Static_assert(inode_size == 64, "block_store_inode_read/write copy 64 byte inode slots");
+_Static_assert(sizeof(disk_inode_t) == inode_size, "disk inode must fill exactly inode_size bytes");
+_Static_assert(offsetof(disk_inode_t, fileSize) == 8, "disk inode layout changed");
+_Static_assert(offsetof(disk_inode_t, mtime) == 16, "disk inode layout changed");
+_Static_assert(offsetof(disk_inode_t, data) == disk_inode_header_size, "disk inode layout changed");
+_Static_assert(offsetof(disk_inode_t, data.blocks.extents) == disk_inode_header_size + disk_inode_pointers_size, "disk inode layout changed");
+_Static_assert(sizeof(extent_t) == disk_extent_size, "extent descriptor must stay 8 bytes");
+_Static_assert(BLOCK_SIZE_BYTES % inode_size == 0, "inodes must not straddle blocks");
+
+// the image is little-endian, these swap on big-endian hosts and compile away everywhere else
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define le16(x) __builtin_bswap16(x)
+#define le32(x) __builtin_bswap32(x)
+#define le64(x) __builtin_bswap64(x)
+#else
+#define le16(x) ((uint16_t)(x))
+#define le32(x) ((uint32_t)(x))
+#define le64(x) ((uint64_t)(x))
+#endif
+
+// nanoseconds on a monotonic clock, for the dedup counters and fs_get_stats
+uint64_t fs_clock(void){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + now.tv_nsec;
+}
+
+#if fs_stats
+// histogram bucket of a latency: exact below 2^fs_stats_sub_bits ns, then 2^fs_stats_sub_bits buckets per power of two
+size_t fs_stats_bucket(uint64_t nanos){
+    if (nanos < (1u << fs_stats_sub_bits)){
+        return nanos;
+    }
+    unsigned top = 63 - __builtin_clzll(nanos);
+    if (top >= fs_stats_max_bits){
+        return fs_stats_buckets - 1;
+    }
+    unsigned shift = top - fs_stats_sub_bits;
+    return ((size_t)(shift + 1) << fs_stats_sub_bits) + ((nanos >> shift) & ((1u << fs_stats_sub_bits) - 1));
+}
+
+/** Counts one call of an operation that started at start
+     fs_check reads blocks from several threads at once, so the counts are only ever updated atomically
+    \param fs The FS the call was made on, nothing is counted without one
+    \param op The operation
+    \param start fs_clock() when the call started
+    \param failed Whether the call failed
+    \param bytes Bytes the call moved
+*/
+void fs_stats_record(FS_t *fs, fs_op_t op, uint64_t start, bool failed, size_t bytes){
+    if (fs == NULL || fs->Stats == NULL){
+        return;
+    }
+    uint64_t nanos = fs_clock() - start;
+    fs_op_stats_t *stats = &fs->Stats[op];
+    __atomic_fetch_add(&stats->calls, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats->errors, failed, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats->bytes, bytes, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats->totalNanos, nanos, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats->histogram[fs_stats_bucket(nanos)], 1, __ATOMIC_RELAXED);
+    uint64_t seen = __atomic_load_n(&stats->minNanos, __ATOMIC_RELAXED);
+    while ((seen == 0 || nanos < seen) && !__atomic_compare_exchange_n(&stats->minNanos, &seen, nanos, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    seen = __atomic_load_n(&stats->maxNanos, __ATOMIC_RELAXED);
+    while (nanos > seen && !__atomic_compare_exchange_n(&stats->maxNanos, &seen, nanos, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+#else
+// nothing to time, the operations are their own entry points (see fs_get_stats for the timed ones)
+#define fs_create_op fs_create
+#define fs_open_op fs_open
+#define fs_close_op fs_close
+#define fs_seek_op fs_seek
+#define fs_read_op fs_read
+#define fs_write_op fs_write
+#define fs_remove_op fs_remove
+#endif
+
+/* fs_trace records the FS's block calls in the binary trace format of the a4 block store's block_store_backend_record,
+    so its trace_replay can replay them
+    header  "BST1"
+    then one record per call: the call (numbered as block_store_trace_op_t, | FS_TRACE_OK if it succeeded), then as
+    varints (7 bits a byte, low ones first, the top bit set on all but the last) the ns since the previous call started,
+    the ns this one took, and the block id; open has the block size and block count instead, close nothing */
+#define FS_TRACE_MAGIC "BST1"
+#define FS_TRACE_OK 0x80
+#define FS_TRACE_RECORD_MAX (1 + 4 * 10) // the call and four varints of at most 10 bytes
+#define FS_TRACE_OPEN 1
+#define FS_TRACE_READ 2
+#define FS_TRACE_WRITE 3
+#define FS_TRACE_ALLOCATE 4
+#define FS_TRACE_RELEASE 5
+#define FS_TRACE_CLOSE 7
+
+size_t fs_trace_varint(uint8_t *out, uint64_t value){
+    size_t n = 0;
+    while (value >= 0x80){
+        out[n++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = (uint8_t)value;
+    return n;
+}
+
+/** Logs a block call that started at start and has just returned, if fs_trace is on
+      fs_check reads blocks from several threads at once, the stream lock keeps their records whole and in order
+    \param fs The FS the call was made on
+    \param op The call, one of FS_TRACE_*
+    \param ok Whether it succeeded
+    \param start fs_clock() when the call started
+    \param block_id The block, for read, write, allocate and release
+*/
+void fs_trace_record(FS_t *fs, uint8_t op, bool ok, uint64_t start, size_t block_id){
+    if (fs->Trace == NULL){
+        return;
+    }
+    uint64_t took = fs_clock() - start;
+    uint8_t buffer[FS_TRACE_RECORD_MAX];
+    size_t n = 0;
+    flockfile(fs->Trace);
+    start = start > fs->TraceEpoch ? start - fs->TraceEpoch : 0;
+    buffer[n++] = op | (ok ? FS_TRACE_OK : 0);
+    n += fs_trace_varint(buffer + n, start > fs->TraceLast ? start - fs->TraceLast : 0); // another thread may have logged a later start first
+    n += fs_trace_varint(buffer + n, took);
+    if (op == FS_TRACE_OPEN){
+        n += fs_trace_varint(buffer + n, BLOCK_SIZE_BYTES);
+        n += fs_trace_varint(buffer + n, BLOCK_STORE_NUM_BLOCKS);
+    } else if (op != FS_TRACE_CLOSE){
+        n += fs_trace_varint(buffer + n, block_id);
+    }
+    if (start > fs->TraceLast){
+        fs->TraceLast = start;
+    }
+    fwrite(buffer, 1, n, fs->Trace);
+    funlockfile(fs->Trace);
+}
+
+// block_store_read of the FS's own store, counted as FS_OP_BLOCK_READ and logged by fs_trace
+size_t fs_block_read(FS_t *fs, size_t block_id, void *buffer){
+    uint64_t start = fs_stats || fs->Trace != NULL ? fs_clock() : 0;
+    size_t read = block_store_read(fs->BlockStore_whole, block_id, buffer);
+#if fs_stats
+    fs_stats_record(fs, FS_OP_BLOCK_READ, start, read == 0, read);
+#endif
+    fs_trace_record(fs, FS_TRACE_READ, read != 0, start, block_id);
+    return read;
+}
+
+// block_store_write of the FS's own store, counted as FS_OP_BLOCK_WRITE and logged by fs_trace
+size_t fs_block_write(FS_t *fs, size_t block_id, const void *buffer){
+    uint64_t start = fs_stats || fs->Trace != NULL ? fs_clock() : 0;
+    size_t written = block_store_write(fs->BlockStore_whole, block_id, buffer);
+#if fs_stats
+    fs_stats_record(fs, FS_OP_BLOCK_WRITE, start, written == 0, written);
+#endif
+    fs_trace_record(fs, FS_TRACE_WRITE, written != 0, start, block_id);
+    return written;
+}
+
+/** Converts an inode from its in-memory form to the on-disk layout
+    \param inode The inode to convert
+    \param disk The on-disk inode to fill
+*/
+void inode_encode(const inode_t *inode, disk_inode_t *disk){
+    memset(disk, 0, sizeof(disk_inode_t));
+    disk->vacantFile = le32(inode->vacantFile);
+    disk->fileType = inode->fileType;
+    disk->flags = inode->flags;
+    disk->version = le16(FS_INODE_VERSION);
+    disk->fileSize = le32(inode->fileSize);
+    disk->linkCount = le16(inode->linkCount);
+    disk->inodeNumber = inode->inodeNumber;
+    disk->mtime = le32(inode->mtime);
+    disk->ctime = le32(inode->ctime);
+    if (inode->flags & FS_INODE_INLINE){
+        memcpy(disk->data.inlineData, inode->inlineData, FS_INLINE_DATA_MAX);
+        return;
+    }
+    for (int i = 0; i < number_direct_pointers; i++){
+        disk->data.blocks.directPointer[i] = le16(inode->directPointer[i]);
+    }
+    disk->data.blocks.indirectPointer = le16(inode->indirectPointer[0]);
+    disk->data.blocks.doubleIndirectPointer = le16(inode->doubleIndirectPointer);
+    for (size_t i = 0; i < FS_INODE_EXTENTS; i++){
+        disk->data.blocks.extents[i].logicalBlock = le32(inode->extents[i].logicalBlock);
+        disk->data.blocks.extents[i].startBlock = le16(inode->extents[i].startBlock);
+        disk->data.blocks.extents[i].blockCount = le16(inode->extents[i].blockCount);
+    }
+}
+
+/** Converts an inode from the on-disk layout to its in-memory form
+    \param disk The on-disk inode
+    \param inode The inode to fill
+*/
+void inode_decode(const disk_inode_t *disk, inode_t *inode){
+    memset(inode, 0, sizeof(inode_t));
+    inode->vacantFile = le32(disk->vacantFile);
+    inode->fileType = disk->fileType;
+    inode->flags = disk->flags;
+    inode->version = le16(disk->version);
+    inode->fileSize = le32(disk->fileSize);
+    inode->linkCount = le16(disk->linkCount);
+    inode->inodeNumber = disk->inodeNumber;
+    inode->mtime = le32(disk->mtime);
+    inode->ctime = le32(disk->ctime);
+    if (inode->flags & FS_INODE_INLINE){
+        memcpy(inode->inlineData, disk->data.inlineData, FS_INLINE_DATA_MAX);
+        return;
+    }
+    for (int i = 0; i < number_direct_pointers; i++){
+        inode->directPointer[i] = le16(disk->data.blocks.directPointer[i]);
+    }
+    inode->indirectPointer[0] = le16(disk->data.blocks.indirectPointer);
+    inode->doubleIndirectPointer = le16(disk->data.blocks.doubleIndirectPointer);
+    for (size_t i = 0; i < FS_INODE_EXTENTS; i++){
+        inode->extents[i].logicalBlock = le32(disk->data.blocks.extents[i].logicalBlock);
+        inode->extents[i].startBlock = le16(disk->data.blocks.extents[i].startBlock);
+        inode->extents[i].blockCount = le16(disk->data.blocks.extents[i].blockCount);
+    }
+}
+
+// read inode inode_ID out of the inode table into its in-memory form
+size_t inode_load(FS_t *fs, size_t inode_ID, inode_t *inode){
+    disk_inode_t disk;
+    if (block_store_inode_read(fs->BlockStore_inode, inode_ID, &disk) == 0){
+        return 0;
+    }
+    inode_decode(&disk, inode);
+    return sizeof(inode_t);
+}
+
+// write the in-memory inode back to slot inode_ID of the inode table
+size_t inode_store(FS_t *fs, size_t inode_ID, const inode_t *inode){
+    disk_inode_t disk;
+    inode_encode(inode, &disk);
+    return block_store_inode_write(fs->BlockStore_inode, inode_ID, &disk);
+}
+
+// overlay the free block map the block store keeps in its last 2 blocks, so runs of blocks can be found and taken at once
+bitmap_t *fs_free_block_map(block_store_t *whole){
+    if (whole == NULL){
+        return NULL;
+    }
+    return bitmap_overlay(BLOCK_STORE_NUM_BLOCKS, (uint8_t*)block_store_Data_location(whole) + BLOCK_STORE_AVAIL_BLOCKS * BLOCK_SIZE_BYTES);
+}
+
+// the first of the blocks at the top of the store it keeps for itself, its free block map among them: the run already
+//  in use there right after block_store_create (the prebuilt library takes more than the 2 map blocks)
+size_t fs_store_reserved(bitmap_t *free_block_map){
+    size_t block = BLOCK_STORE_AVAIL_BLOCKS;
+    while (block > 1 && bitmap_test(free_block_map, block - 1)){
+        block--;
+    }
+    return block;
+}
+
+// one decompressed cluster of a compressed file, see inode_cluster_load
+//  entries are keyed by the first block the cluster is kept in: a cluster's blocks are only ever rewritten together,
+//  through inode_cluster_store which refreshes the entry, and an entry is dropped as soon as its block is freed
+struct fs_cluster {
+    uint16_t block_id;  // 0 for an unused entry
+    size_t used;        // ClusterClock at the last use
+    uint8_t data[fs_cluster_size];
+};
+
+// the cached copy of the cluster kept from block_id on, NULL if there is none
+const uint8_t *fs_cluster_cached(FS_t *fs, uint16_t block_id){
+    for (size_t i = 0; fs->Clusters != NULL && i < fs_cluster_cache_entries; i++){
+        if (fs->Clusters[i].block_id == block_id){
+            fs->Clusters[i].used = ++fs->ClusterClock;
+            return fs->Clusters[i].data;
+        }
+    }
+    return NULL;
+}
+
+// put the decompressed cluster kept from block_id on in the cache, in place of the entry used longest ago
+void fs_cluster_remember(FS_t *fs, uint16_t block_id, const uint8_t *data){
+    if (fs->Clusters == NULL){
+        fs->Clusters = (struct fs_cluster*)calloc(fs_cluster_cache_entries, sizeof(struct fs_cluster));
+        if (fs->Clusters == NULL){ // the cache is only a shortcut, go without it
+            return;
+        }
+    }
+    struct fs_cluster *entry = &fs->Clusters[0];
+    for (size_t i = 0; i < fs_cluster_cache_entries; i++){
+        if (fs->Clusters[i].block_id == block_id){ // rewritten in place
+            entry = &fs->Clusters[i];
+            break;
+        }
+        if (fs->Clusters[i].used < entry->used){
+            entry = &fs->Clusters[i];
+        }
+    }
+    entry->block_id = block_id;
+    entry->used = ++fs->ClusterClock;
+    memcpy(entry->data, data, fs_cluster_size);
+}
+
+// drop the cached cluster kept from block_id on, the block is about to hold something else
+void fs_cluster_forget(FS_t *fs, uint16_t block_id){
+    for (size_t i = 0; fs->Clusters != NULL && i < fs_cluster_cache_entries; i++){
+        if (fs->Clusters[i].block_id == block_id){
+            fs->Clusters[i].block_id = 0;
+            fs->Clusters[i].used = 0;
+        }
+    }
+}
+
+// allocate a block out of the whole block store, 0 when the store is full (block 0 is never handed out to files)
+//  fs_trace logs only the blocks handed out, like the block store's own backends see them
+uint16_t fs_block_alloc(FS_t *fs){
+    uint64_t start = fs->Trace != NULL ? fs_clock() : 0;
+    size_t block_id = block_store_allocate(fs->BlockStore_whole);
+    if (block_id == SIZE_MAX || block_id > BLOCK_STORE_AVAIL_BLOCKS){
+        return 0;
+    }
+    fs->FreeBlocks--;
+    fs_trace_record(fs, FS_TRACE_ALLOCATE, true, start, block_id);
+    return block_id;
+}
+
+// give a block of a file back to the whole block store, or just drop one reference if other files share it
+void fs_block_free(FS_t *fs, uint16_t block_id){
+    if (block_id != 0){
+        fs_cluster_forget(fs, block_id);
+        if (fs->BlockRefs != NULL && fs->BlockRefs[block_id] > 0){
+            fs->BlockRefs[block_id]--;
+            return;
+        }
+        if (fs->DedupValid != NULL){ // whatever the index says about the block no longer holds
+            bitmap_reset(fs->DedupValid, block_id);
+        }
+        uint64_t start = fs->Trace != NULL ? fs_clock() : 0;
+        block_store_release(fs->BlockStore_whole, block_id);
+        fs_trace_record(fs, FS_TRACE_RELEASE, true, start, block_id);
+        fs->FreeBlocks++;
+        if (fs->Released != NULL){ // left for fs_trim
+            bitmap_set(fs->Released, block_id);
+        }
+    }
+}
+
+// allocate an inode out of the inode table, SIZE_MAX when the table is full
+size_t fs_inode_alloc(FS_t *fs){
+    size_t inode_ID = block_store_sub_allocate(fs->BlockStore_inode);
+    if (inode_ID == SIZE_MAX || inode_ID >= number_inodes){
+        return SIZE_MAX;
+    }
+    fs->FreeInodes--;
+    return inode_ID;
+}
+
+// give an inode back to the inode table
+void fs_inode_free(FS_t *fs, size_t inode_ID){
+    if (block_store_sub_test(fs->BlockStore_inode, inode_ID)){
+        block_store_sub_release(fs->BlockStore_inode, inode_ID);
+        fs->FreeInodes++;
+    }
+}
+
+// count the free blocks and inodes once, at format and mount, every allocation after that keeps the counts current
+void fs_count_free(FS_t *fs){
+    fs->FreeBlocks = block_store_get_free_blocks(fs->BlockStore_whole);
+    fs->FreeInodes = 0;
+    for (size_t inode_ID = 0; inode_ID < number_inodes; inode_ID++){
+        if (!block_store_sub_test(fs->BlockStore_inode, inode_ID)){
+            fs->FreeInodes++;
+        }
+    }
+}
+
+/// Formats (and mounts) an FS file for use
+/// \param fname The file to format
+/// \return Mounted FS object, NULL on error
+///
+FS_t *fs_format(const char *path)
+{
+    if(path != NULL && strlen(path) != 0)
+    {
+        FS_t * ptr_FS = (FS_t *)calloc(1, sizeof(FS_t));	// get started
+        if (ptr_FS == NULL){
+            return NULL;
+        }
+        ptr_FS->BlockStore_whole = block_store_create(path);				// pointer to start of a large chunck of memory
+        if (ptr_FS->BlockStore_whole == NULL){ // the image could not be made
+            free(ptr_FS);
+            return NULL;
+        }
+#if fs_stats
+        ptr_FS->Stats = (fs_op_stats_t *)calloc(FS_OP_COUNT, sizeof(fs_op_stats_t));
+#endif
+
+        // reserve the 1st block for bitmap of inode
+        size_t bitmap_ID = block_store_allocate(ptr_FS->BlockStore_whole);
+        //		printf("bitmap_ID = %zu\n", bitmap_ID);
+
+        // blocks right after it hold the inodes, number_inode_blocks in total (4 with 64 byte inodes)
+        size_t inode_start_block = block_store_allocate(ptr_FS->BlockStore_whole);
+        //		printf("inode_start_block = %zu\n", inode_start_block);		
+        for(int i = 0; i < number_inode_blocks - 1; i++)
+        {
+            block_store_allocate(ptr_FS->BlockStore_whole);
+            //			printf("all the way with block %zu\n", block_store_allocate(ptr_FS->BlockStore_whole));
+        }
+
+        // install inode block store inside the whole block store
+        ptr_FS->BlockStore_inode = block_store_inode_create(block_store_Data_location(ptr_FS->BlockStore_whole) + bitmap_ID * BLOCK_SIZE_BYTES, block_store_Data_location(ptr_FS->BlockStore_whole) + inode_start_block * BLOCK_SIZE_BYTES);
+
+        // the first inode is reserved for root dir
+        block_store_sub_allocate(ptr_FS->BlockStore_inode);
+        //		printf("first inode ID = %zu\n", block_store_sub_allocate(ptr_FS->BlockStore_inode));
+
+        // update the root inode info.
+        uint8_t root_inode_ID = 0;	// root inode is the first one in the inode table
+        inode_t * root_inode = (inode_t *) calloc(1, sizeof(inode_t));
+        //		printf("size of inode_t = %zu\n", sizeof(inode_t));
+        root_inode->vacantFile = 0x00000000;
+        root_inode->fileType = 'd';								
+        root_inode->inodeNumber = root_inode_ID;
+        root_inode->linkCount = 1;
+        root_inode->flags = FS_INODE_DIRTY;	// mounted from here on
+        root_inode->ctime = root_inode->mtime = time(NULL);
+        //		root_inode->directPointer[0] = root_data_ID;	// not allocate date block for it until it has a sub-folder or file
+        inode_store(ptr_FS, root_inode_ID, root_inode);		
+        free(root_inode);
+
+        // now allocate space for the file descriptors
+        ptr_FS->BlockStore_fd = block_store_fd_create();
+
+        ptr_FS->FreeBlockMap = fs_free_block_map(ptr_FS->BlockStore_whole);
+        ptr_FS->Released = bitmap_create(BLOCK_STORE_NUM_BLOCKS);
+        fs_count_free(ptr_FS);
+
+        // nothing but the store is at the top yet, note down where its own blocks start in root's third extent for fs_check
+        ptr_FS->StoreReserved = fs_store_reserved(ptr_FS->FreeBlockMap);
+        inode_t root;
+        inode_load(ptr_FS, root_inode_ID, &root);
+        root.extents[2].startBlock = ptr_FS->StoreReserved;
+        root.extents[2].blockCount = BLOCK_STORE_AVAIL_BLOCKS - ptr_FS->StoreReserved;
+        inode_store(ptr_FS, root_inode_ID, &root);
+
+        return ptr_FS;
+    }
+
+    return NULL;	
+}
+
+
+
+// point the FS at the fingerprint index kept from start_block on, see fs_set_dedup
+void fs_dedup_attach(FS_t *fs, uint16_t start_block){
+    uint8_t *index = block_store_Data_location(fs->BlockStore_whole) + start_block * BLOCK_SIZE_BYTES;
+    fs->DedupIndex = (uint64_t*)index;
+    fs->DedupValid = bitmap_overlay(BLOCK_STORE_NUM_BLOCKS, index + BLOCK_STORE_NUM_BLOCKS * sizeof(uint64_t));
+    if (fs->DedupValid == NULL){
+        fs->DedupIndex = NULL;
+    }
+}
+
+///
+/// Mounts an FS object and prepares it for use
+/// \param fname The file to mount
+
+/// \return Mounted FS object, NULL on error
+
+///
+FS_t *fs_mount(const char *path)
+{
+    return fs_mount_flags(path, 0);
+}
+
+/** Mounts an FS object, FS_MOUNT_INSPECT leaves the image exactly as it was found
+    \param path The file to mount
+    \param flags 0 or FS_MOUNT_INSPECT
+    \return Mounted FS object, NULL on error
+*/
+FS_t *fs_mount_flags(const char *path, int flags)
+{
+    if(path != NULL && strlen(path) != 0)
+    {
+        FS_t * ptr_FS = (FS_t *)calloc(1, sizeof(FS_t));	// get started
+        if (ptr_FS == NULL){
+            return NULL;
+        }
+        ptr_FS->Inspect = (flags & FS_MOUNT_INSPECT) != 0;
+        ptr_FS->BlockStore_whole = block_store_open(path);	// get the chunck of data	
+        if (ptr_FS->BlockStore_whole == NULL){ // no image there, nothing to read the root inode from
+            free(ptr_FS);
+            return NULL;
+        }
+#if fs_stats
+        ptr_FS->Stats = (fs_op_stats_t *)calloc(FS_OP_COUNT, sizeof(fs_op_stats_t));
+#endif
+
+        // the bitmap block should be the 1st one
+        size_t bitmap_ID = 0;
+
+        // the inode blocks start with the 2nd block, and goes around until the 5th block, 4 in total
+        size_t inode_start_block = 1;
+
+        // attach the bitmaps to their designated place
+        ptr_FS->BlockStore_inode = block_store_inode_create(block_store_Data_location(ptr_FS->BlockStore_whole) + bitmap_ID * BLOCK_SIZE_BYTES, block_store_Data_location(ptr_FS->BlockStore_whole) + inode_start_block * BLOCK_SIZE_BYTES);
+
+        // since file descriptors are allocated outside of the whole blocks, we can simply reallocate space for it.
+        ptr_FS->BlockStore_fd = block_store_fd_create();
+
+        ptr_FS->FreeBlockMap = fs_free_block_map(ptr_FS->BlockStore_whole);
+        ptr_FS->Released = bitmap_create(BLOCK_STORE_NUM_BLOCKS);
+
+        // the root inode tells us which inode layout the image was formatted with
+        inode_t root_inode;
+        inode_load(ptr_FS, 0, &root_inode);
+        if (root_inode.version != FS_INODE_VERSION){
+            fs_unmount(ptr_FS);
+            return NULL;
+        }
+        if (root_inode.extents[0].blockCount == number_ref_blocks){ // files have been cloned, pick up the reference counts
+            ptr_FS->BlockRefs = block_store_Data_location(ptr_FS->BlockStore_whole) + root_inode.extents[0].startBlock * BLOCK_SIZE_BYTES;
+        }
+        if (root_inode.extents[2].blockCount != 0){ // where the store's own blocks start, noted down by fs_format
+            ptr_FS->StoreReserved = root_inode.extents[2].startBlock;
+        } else { // formatted before that was kept, take the run in use at the top as the store's
+            ptr_FS->StoreReserved = fs_store_reserved(ptr_FS->FreeBlockMap);
+        }
+        if ((root_inode.flags & FS_INODE_DEDUP) && root_inode.extents[1].blockCount == number_dedup_blocks){ // pick up the fingerprint index
+            fs_dedup_attach(ptr_FS, root_inode.extents[1].startBlock);
+        }
+        fs_count_free(ptr_FS);
+        if (ptr_FS->Inspect){ // only looked at, nothing is repaired or marked
+            return ptr_FS;
+        }
+        if (root_inode.flags & FS_INODE_DIRTY){ // never unmounted, whatever was in flight may be half done
+            fs_check(ptr_FS, true, 0, NULL);
+            inode_load(ptr_FS, 0, &root_inode);
+        }
+        root_inode.flags |= FS_INODE_DIRTY;
+        inode_store(ptr_FS, 0, &root_inode);
+
+        return ptr_FS;
+    }
+
+    return NULL;		
+}
+
+
+
+
+///
+/// Unmounts the given object and frees all related resources
+/// \param fs The FS object to unmount
+/// \return 0 on success, < 0 on failure
+///
+int fs_unmount(FS_t *fs)
+{
+    if(fs != NULL)
+    {	
+        inode_t root_inode;	// cleanly unmounted, the next mount need not be checked
+        inode_load(fs, 0, &root_inode);
+        if (root_inode.version == FS_INODE_VERSION && !fs->Inspect){	// an inode in some other layout is not ours to rewrite
+            root_inode.flags &= ~FS_INODE_DIRTY;
+            inode_store(fs, 0, &root_inode);
+        }
+
+        if (!fs->Inspect){
+            fs_trim(fs, false);	// hand what was released back to the host before the image is closed
+        }
+        block_store_inode_destroy(fs->BlockStore_inode);
+        bitmap_destroy(fs->FreeBlockMap);	// only the overlay, the map itself lives in the image
+        bitmap_destroy(fs->Released);
+        free(fs->Clusters);
+        if (fs->DedupValid != NULL){ // only the overlay, the index lives in the image
+            bitmap_destroy(fs->DedupValid);
+        }
+
+        fs_trace(fs, NULL);	// the store goes away, so does its trace
+        block_store_destroy(fs->BlockStore_whole);
+        block_store_fd_destroy(fs->BlockStore_fd);
+        free(fs->Stats);
+
+        free(fs);
+        return 0;
+    }
+    return -1;
+}
+
+///
+/// Waits for every change made to the image so far to reach the file on disk
+///   Nothing is held back by the FS, each call leaves its changes in the shared mapping of the image; this has
+///   the kernel write the dirty pages of that mapping back (msync) before returning
+/// \param fs The FS to flush
+/// \return 0 on success, < 0 on error
+///
+int fs_flush(FS_t *fs)
+{
+    if (fs == NULL){
+        return -1;
+    }
+    // the store maps the whole image from its first byte, see trim_range
+    return msync(block_store_Data_location(fs->BlockStore_whole), BLOCK_STORE_NUM_BYTES, MS_SYNC) == 0 ? 0 : -1;
+}
+
+
+// check if the input filename is valid or not
+bool isValidFileName(const char *filename)
+{
+    if(!filename || strlen(filename) == 0 || strlen(filename) > 127 || '/'==filename[0])
+    {
+        return false;
+    }
+
+    return true;
+}
+
+
+
+// use str_split to decompose the input string into filenames along the path, '/' as delimiter
+char** str_split(char* a_str, const char a_delim, size_t * count)
+{
+    if(*a_str != '/')
+    {
+        return NULL;
+    }
+    char** result    = 0;
+    char* tmp        = a_str;
+    char delim[2];
+    delim[0] = a_delim;
+    delim[1] = '\0';
+
+    /* Count how many elements will be extracted. */
+    while (*tmp)
+    {
+        if (a_delim == *tmp)
+        {
+            (*count)++;
+        }
+        tmp++;
+    }
+
+    result = (char**)calloc(1, sizeof(char*) * (*count));
+    for(size_t i = 0; i < (*count); i++)
+    {
+        *(result + i) = (char*)calloc(1, 200);
+    }
+
+    if (result)
+    {
+        size_t idx  = 0;
+        char* rest;	// strtok_r, not strtok: FS objects may be used from different threads
+        char* token = strtok_r(a_str, delim, &rest);
+
+        while (token)
+        {
+            strcpy(*(result + idx++), token);
+            //    *(result + idx++) = strdup(token);
+            token = strtok_r(NULL, delim, &rest);
+        }
+
+    }
+    return result;
+}
+
+
+
+///
+/// Creates a new file at the specified location
+///   Directories along the path that do not exist are not created
+/// \param fs The FS containing the file
+/// \param path Absolute path to file to create
+/// \param type Type of file to create (regular/directory)
+/// \return 0 on success, < 0 on failure
+///
+/** MILESTONE 2 **
+------------------------------
+    - fs_create
+    - fs_open
+    - fs_close
+    - fs_get_dir
+
+    typedef enum { FS_REGULAR, FS_DIRECTORY } file_t;
+*/
+
+/** Function to split the given path, using delimiters, into individual tokens
+    Majority of the code used in this function is taken from this stackoverflow thread
+    - https://stackoverflow.com/questions/9210528/split-string-with-delimiters-in-c
+*/
+char **tokenize(const char *path, size_t *token_count){
+    if (*path != '/'){
+        return NULL;
+    }
+    char**result = 0;
+    size_t path_size = strlen(path) + 1; // no token is longer than the path, however deep it goes
+    char *path_copy = calloc(1, path_size);
+    strcpy(path_copy, path);
+    char *temp = path_copy;
+    while (*temp){
+        if (*temp == '/'){
+            (*token_count)++;
+        }
+        temp++;
+    }
+    result = (char**)calloc(1, sizeof(char*) * (*token_count));
+    for (size_t i = 0; i < (*token_count); i++){
+        *(result + i) = (char*)calloc(1, path_size);
+    }
+    size_t index = 0;
+    char *rest;
+    char *token = strtok_r(path_copy, "/", &rest);
+    while (token){
+        strcpy(result[index], token);
+        token = strtok_r(NULL, "/", &rest);    
+        index++;
+    }
+    free(path_copy);
+    return result;
+}
+
+/** Creates a new file at the specified location
+     Directories along the path that do not exist are not created
+    \param fs The FS containing the file
+    \param path Absolute path to file to create
+    \param type Type of file to create (regular/directory)
+    \return 0 on success, < 0 on failure
+*/
+int fs_create_op(FS_t *fs, const char *path, file_t type) {
+    // param checks
+    if (fs != NULL && path != NULL && strlen(path) != 0 && (type == FS_REGULAR || type == FS_DIRECTORY)){ 
+        inode_t*new_inode = calloc(1, sizeof(inode_t)); // allocate space for a new inode
+        if (new_inode == NULL){ // malloc check
+            return -1;
+        }
+        size_t new_inode_num = 0; // initialize a new corresponding inode number
+        inode_load(fs, 0, new_inode); // read the new inode into the first space -> becomes parent inode temporarily
+
+        directoryFile_t*directory = calloc(1, BLOCK_SIZE_BYTES); // allocate space for a new directory
+        if (directory == NULL){ // malloc check
+            return -1;
+        }
+        size_t dir_counter = 0; // the depth/level in the directory (counter to help keep track of position)        
+        fs_block_read(fs, new_inode->directPointer[0], directory); // read inode data into the new directory
+
+        size_t token_count = 0; // # of tokens
+        char**tokens_arr; // array of 'tokens' created by splitting the path using a delimiter 
+        tokens_arr = tokenize(path, &token_count); // tokenize the path
+        if (tokens_arr == NULL){ // check if tokenize was successful
+            return -1; 
+        }
+        size_t n = 0;
+        while (n < token_count){ // loop through array of tokens
+            if (strlen(tokens_arr[n]) == 0 || strchr(tokens_arr[n], '!') != NULL){ // check for empty tokens or tokens that contain invalid chars
+                for (size_t i = 0; i < token_count; i++){ // if empty string or invalid char, free all tokens
+                    free(tokens_arr[i]);
+                }
+                free(tokens_arr);
+                return -1; 
+            }
+            n++;
+        }
+
+        bitmap_t *dir_bitmap = bitmap_overlay(32, &(new_inode->vacantFile)); // create bitmap using the parent inode data
+        for (size_t i = 0; i < token_count - 1; i++){ // loop through tokens array - 1
+            // REMEMBER: have to be in a dir to create a new file/dir
+            if ( (new_inode->fileType) == 'd'){ // extra layer check in case dir/file have the same name
+                int curr_dir = 0;
+                while (curr_dir < folder_number_entries){
+                    fs_block_read(fs, new_inode->directPointer[0], directory); // update directory data with parent inode data        
+                    if (strcmp((directory + curr_dir)->filename, tokens_arr[i]) == 0){ // if the 2 strings/tokens are equal
+                        new_inode_num = (directory + curr_dir)->inodeNumber; // update inode number
+                        inode_load(fs, new_inode_num, new_inode); // read updated inode number into parent inode
+                        dir_counter++;
+                    }
+                    curr_dir++;                    
+                }
+            }
+        }
+        
+        /*
+            printf("Path:%s\n", path);
+            printf("# of Subpaths = %zu\n", dir_counter);
+            printf("Parent Inode # = %lu\n", new_inode_num);
+            printf("# of Tokens = %zu\n", token_count);
+            printf("------------------------\n");
+        */
+
+        if (new_inode->fileType == 'd' && dir_counter == token_count - 1 ){  // check that we're in a dir -> cannot create a file inside a file
+            size_t first_zero = bitmap_ffz(dir_bitmap); // find first 0 bit to store to be created directory in
+            for (size_t i = 0; i < first_zero; i++){ // loop through non-set bits
+                // check if the filename trying to be created already exists 
+                if (strcmp((directory + i)->filename, tokens_arr[token_count - 1]) == 0){ // if they're the same, error and free
+                    free(directory);
+                    free(new_inode);
+                    for (size_t j = 0; j < token_count; j++){ 
+                        free(tokens_arr[j]);
+                    }
+                    free(tokens_arr);
+                    return -1; 
+                }
+            }
+
+            if (first_zero < folder_number_entries){ // check that theres not more than the # of allowed entries
+                if (first_zero == 0){ // double check that bit found is not set
+                    size_t temp_block_id = fs_block_alloc(fs); // allocate a new bs device for the inode table 
+                    if (temp_block_id == 0){ // if there are no blocks availible -> free everything
+                        free(directory); 
+                        free(new_inode); 
+                        for(size_t i = 0; i < token_count; i++){
+                            free(tokens_arr[i]);
+                        }
+                        free(tokens_arr);
+                        bitmap_destroy(dir_bitmap);
+                        return -1;
+                    } 
+                    // else, store created block data in inode table
+                    new_inode->directPointer[0] = temp_block_id;
+                }
+                bitmap_set(dir_bitmap, first_zero); // change bit to set and update bitmap
+                inode_store(fs, new_inode_num, new_inode); // update inode with new data
+
+                size_t temp_file_id = fs_inode_alloc(fs); // allocate memory for file to be created
+                if (temp_file_id == SIZE_MAX){ // if failed to allocate new block
+                    free(new_inode);
+                    free(directory);
+                    for(size_t i = 0; i < token_count; i++){
+                        free(tokens_arr[i]);
+                    }
+                    free(tokens_arr);
+                    bitmap_destroy(dir_bitmap);
+                    return -1; 
+                }
+                strcpy((directory + first_zero)->filename, tokens_arr[token_count - 1]); // update filename
+                (directory + first_zero)->inodeNumber = temp_file_id; // update the inode num to the new file block's id 
+                fs_block_write(fs, new_inode->directPointer[0], directory); // write the inode data to the directory
+                
+                inode_t*fs_inode = (inode_t*)calloc(1, sizeof(inode_t)); // allocate a new inode for the file or directory
+                if (fs_inode == NULL){ // malloc check
+                    free(fs_inode);
+                    return -1; 
+                }
+                // set the filetype data for the new inode
+                if (type == FS_REGULAR){
+                    fs_inode->fileType = 'r';
+                    fs_inode->flags = FS_INODE_INLINE; // regular files start out inline until they outgrow the inode
+                } else if (type == FS_DIRECTORY) {
+                    fs_inode->fileType = 'd'; 
+                }
+                fs_inode->linkCount = 1; // the entry just made
+                fs_inode->ctime = fs_inode->mtime = time(NULL);
+                inode_store(fs, temp_file_id, fs_inode); // update new inode with file block id data
+
+                free(directory);
+                free(new_inode);
+                free(fs_inode);
+                for (size_t i = 0; i < token_count; i++){
+                    free(tokens_arr[i]);
+                }
+                free(tokens_arr); 
+                bitmap_destroy(dir_bitmap);
+                return 0;
+            }
+        }
+        free(new_inode); 
+        free(directory);
+        for (size_t i = 0; i < token_count; i++){
+            free(tokens_arr[i]);
+        }
+        free(tokens_arr);
+    }
+    return -1;
+}
+
+/** Opens the specified file for use
+      R/W position is set to the beginning of the file (BOF)
+      Directories cannot be opened
+    \param fs The FS containing the file
+    \param path path to the requested file
+    \return file descriptor to the requested file, < 0 on error
+*/
+int fs_open_op(FS_t *fs, const char *path) {
+    if (fs != NULL && path != NULL && strlen(path) > 0) {
+        inode_t*new_inode = (inode_t*)calloc(1, sizeof(inode_t)); // create new inode 
+        if (new_inode == NULL){ // malloc check
+            return -1;
+        }
+        size_t new_inode_num = 0; // start at the first inode
+        inode_load(fs, 0, new_inode); // read the first inode to our new parent inode
+
+        directoryFile_t*directory = (directoryFile_t*)calloc(1, BLOCK_SIZE_BYTES); // create a new directory
+        if (directory == NULL){ // malloc check 
+            return -1; 
+        }
+        size_t dir_counter = 0; // counter variable to track depth in directory (should be the same as the token)
+        fs_block_read(fs, new_inode->directPointer[0], directory);  // read the directory data from new inode to the directory
+
+        size_t token_count = 0;
+        char**tokens_arr;
+        tokens_arr = tokenize(path, &token_count);
+        if (tokens_arr == NULL){ // check tokenize worked as expected
+            return -1;
+        }
+        
+        for (size_t i = 0; i < token_count; i++){ // loop through tokens array
+            if (new_inode->fileType == 'd'){ // check that it's a directory -> because we can't open a file the way we would a directory
+                int curr_dir = 0; 
+                while (curr_dir < folder_number_entries){ // loop through the entire directory
+                    /* NOT ENTERING IF BLOCK
+                        Loop 1: 
+                            token[0] = folder
+                                |folder|file|0|0|0|0|
+                            directory[0]->filename = file
+                                |file|0|0|0|0|0|
+                                >> 1 = |folder|file|0|0|0|0|
+                     */
+                        // printf("Path = %s\n", path);
+                        // printf("tokens[%zu]    = %s\n", i, tokens[i]);
+                        // printf("directory[%zu] = %s\n", i, directory->filename);
+                        // printf("Dir Counter = %zu\n", dir_counter);
+                        // printf("Current dir = %x\n", curr_dir);
+                        // printf("------------------------------\n"); 
+                    
+                    fs_block_read(fs, new_inode->directPointer[0], directory); // update directory data
+                    if (strcmp((directory + curr_dir)->filename, tokens_arr[i]) == 0) { // check that the current directory name and token name match 
+                        new_inode_num = (directory + curr_dir)->inodeNumber; // set inode position to current and increment
+                        dir_counter++; 
+                    } 
+                    curr_dir++; 
+                }
+            }
+            inode_load(fs, new_inode_num, new_inode); // update inode number
+        }
+        free(directory); 
+
+        /*
+            printf("Path: %s\n", path);
+            printf("# of Directories = %zu\n", dir_counter);  
+            printf("Parent Inode ID  = %lu\n", new_inode_num);
+            printf("# of Tokens      = %zu\n", token_count);
+            for (size_t test = 0; test < token_count; test++){
+            printf("Token %zu)         = %s\n", test, tokens[test]);
+            }
+            printf("------------------------\n"); 
+        */
+
+        if (dir_counter == token_count){  // if the dir counter and token count values are = continue 
+            size_t fd_table = block_store_sub_allocate(fs->BlockStore_fd); // allocate file descriptor table in empty block
+            if (fd_table < number_fd){ // check that we have not exceeded the limit for # of file descriptors
+                if ((new_inode->fileType) == 'd'){ // if the parent inode corresponds to a dir, free and error -> we are trying to open a file
+                    block_store_sub_release(fs->BlockStore_fd, fd_table); // and give the descriptor back
+                    free(new_inode); 
+                        for (size_t i = 0; i < token_count; i++){
+                            free(tokens_arr[i]);
+                        }
+                    free(tokens_arr);
+                    return -1; 
+                }
+                size_t fd_inode_num = new_inode_num; // create new fd inode num and set it to the current inode number
+                inode_t*fd_inode = (inode_t*)calloc(1, sizeof(inode_t)); // allocate a new inode
+                if (fd_inode == NULL){ // malloc check
+                    return -1;
+                }
+                fileDescriptor_t*new_fd = (fileDescriptor_t*)calloc(1, sizeof(fileDescriptor_t)); // allocate a new fd
+                if (new_fd == NULL){ // malloc check 
+                    return -1; 
+                }
+                inode_load(fs, fd_inode_num, fd_inode); // read fd_inode data with the fd inode num
+                new_fd->inodeNum = new_inode_num; // update the inode number to the current inode #
+                block_store_fd_write(fs->BlockStore_fd, fd_table, new_fd); // add the file descriptor table to the file descriptor 
+                free(new_inode);
+                free(fd_inode);
+                free(new_fd);
+                for (size_t j = 0; j < token_count; j++){
+                    free(tokens_arr[j]);
+                }
+                free(tokens_arr);
+                return fd_table; 
+            }
+        } // else free all tokens
+        free(new_inode);
+        for (size_t i = 0; i < token_count; i++){
+            free(tokens_arr[i]);
+        }
+        free(tokens_arr);
+    }
+    return -1; 
+}
+
+/** Closes the given file descriptor
+    \param fs The FS containing the file
+    \param fd The file to close
+    \return 0 on success, < 0 on failure
+*/
+int fs_close_op(FS_t *fs, int fd){
+    // param check
+    if(fs != NULL && fd >= 0 && fd < number_fd && block_store_sub_test(fs->BlockStore_fd, fd)){
+        // if the fd is being used, "release" it 
+        block_store_sub_release(fs->BlockStore_fd, fd);
+        return 0;   
+    } // else nothing to close -> error
+    return -1;
+}
+
+/** Populates a dyn_array with information about the files in a directory
+      Array contains up to 15 file_record_t structures
+    \param fs The FS containing the file
+    \param path Absolute path to the directory to inspect
+    \return dyn_array of file records, NULL on error
+*/
+dyn_array_t *fs_get_dir(FS_t *fs, const char *path) {
+    fs_dir_t *dir = fs_opendir(fs, path);
+    if (dir == NULL){
+        return NULL;
+    }
+    dyn_array_t*dyn_arr = dyn_array_create(folder_number_entries, sizeof(file_record_t), NULL);
+    if (dyn_arr != NULL){
+        file_record_t file_data;
+        while (fs_readdir(dir, &file_data) == 1){
+            dyn_array_push_front(dyn_arr, &file_data);
+        }
+    }
+    fs_closedir(dir);
+    return dyn_arr;
+}
+
+struct fs_dir {
+    FS_t *fs;
+    size_t inodeNumber;         // of the directory
+    uint32_t vacantFile;        // entries in use when the directory was opened
+    size_t next;                // index of the entry fs_readdir looks at next
+    directoryFile_t entries[folder_number_entries];
+};
+
+// opens a handle on directory dir_ID, NULL if it is not a directory
+fs_dir_t *fs_dir_open(FS_t *fs, size_t dir_ID){
+    inode_t dir_inode;
+    inode_load(fs, dir_ID, &dir_inode);
+    if (dir_inode.fileType != 'd'){
+        return NULL;
+    }
+    fs_dir_t *dir = (fs_dir_t*)calloc(1, sizeof(fs_dir_t));
+    if (dir == NULL){
+        return NULL;
+    }
+    dir->fs = fs;
+    dir->inodeNumber = dir_ID;
+    dir->vacantFile = dir_inode.vacantFile;
+    if (dir->vacantFile != 0){ // an empty directory may not even have its block yet
+        uint8_t block_buff[BLOCK_SIZE_BYTES];
+        fs_block_read(fs, dir_inode.directPointer[0], block_buff);
+        memcpy(dir->entries, block_buff, sizeof(dir->entries));
+    }
+    return dir;
+}
+
+/** Opens a directory to step through its entries with fs_readdir, or to resolve paths against with the *at calls
+      The path is resolved and the directory read once, here
+      Entries added or removed after the call are not seen by fs_readdir (the *at calls always see them)
+    \param fs The FS containing the directory
+    \param path Absolute path to the directory
+    \return The handle, NULL on error
+*/
+fs_dir_t *fs_opendir(FS_t *fs, const char *path){
+    if (fs == NULL || path == NULL){
+        return NULL;
+    }
+    size_t dir_ID = fs_path_lookup(fs, path);
+    if (dir_ID == SIZE_MAX){
+        return NULL;
+    }
+    return fs_dir_open(fs, dir_ID);
+}
+
+/** Fills record with the next entry of an open directory
+    \param dir The directory handle
+    \param record Where to put the entry
+    \return 1 if an entry was returned, 0 once every entry has been, < 0 on error
+*/
+int fs_readdir(fs_dir_t *dir, file_record_t *record){
+    if (dir == NULL || record == NULL){
+        return -1;
+    }
+    while (dir->next < folder_number_entries && ((dir->vacantFile >> dir->next) & 1) == 0){ // skip vacant entries
+        dir->next++;
+    }
+    if (dir->next == folder_number_entries){
+        return 0;
+    }
+    const directoryFile_t *entry = &dir->entries[dir->next++];
+    strncpy(record->name, entry->filename, FS_FNAME_MAX - 1);
+    record->name[FS_FNAME_MAX - 1] = '\0';
+    inode_t entry_inode;
+    inode_load(dir->fs, entry->inodeNumber, &entry_inode);
+    record->type = entry_inode.fileType == 'd' ? FS_DIRECTORY : FS_REGULAR;
+    return 1;
+}
+
+/** Fills up to count records with the next entries of an open directory
+    \param dir The directory handle
+    \param records Array of at least count records
+    \param count Number of records the caller has room for
+    \return number of records filled (0 once every entry has been returned), < 0 on error
+*/
+ssize_t fs_readdir_batch(fs_dir_t *dir, file_record_t *records, size_t count){
+    if (dir == NULL || records == NULL){
+        return -1;
+    }
+    size_t filled = 0;
+    while (filled < count && fs_readdir(dir, &records[filled]) == 1){
+        filled++;
+    }
+    return filled;
+}
+
+/** Starts the entries of an open directory over from the first one
+    \param dir The directory handle
+    \return 0 on success, < 0 on error
+*/
+int fs_rewinddir(fs_dir_t *dir){
+    if (dir == NULL){
+        return -1;
+    }
+    dir->next = 0;
+    return 0;
+}
+
+/** Releases a directory handle
+    \param dir The handle to release
+    \return 0 on success, < 0 on error
+*/
+int fs_closedir(fs_dir_t *dir){
+    if (dir == NULL){
+        return -1;
+    }
+    free(dir);
+    return 0;
+}
+
+// byte offset from BOF the descriptor's cursor is at
+size_t fd_get_position(const fileDescriptor_t *file_descriptor){
+    return (size_t)file_descriptor->locate_order * BLOCK_SIZE_BYTES + file_descriptor->locate_offset;
+}
+
+// move the descriptor's cursor to the given byte offset from BOF
+void fd_set_position(fileDescriptor_t *file_descriptor, size_t position){
+    file_descriptor->locate_order = position / BLOCK_SIZE_BYTES;
+    file_descriptor->locate_offset = position % BLOCK_SIZE_BYTES;
+}
+
+/** Takes block index of the file out of the extents reserved by fs_fallocate
+      The extent holding it shrinks, or is split in two around it
+      If no descriptor is left for the second half, that half's blocks go back to the store
+    \param fs The FS containing the file
+    \param inode The inode of the file, its extents are updated in memory only
+    \param index Serial number of the block within the file
+    \return the block reserved for index (now owned by the caller), 0 if none was
+*/
+uint16_t inode_extent_take(FS_t *fs, inode_t *inode, size_t index){
+    if (inode->flags & FS_INODE_INLINE){
+        return 0;
+    }
+    for (size_t i = 0; i < FS_INODE_EXTENTS; i++){
+        extent_t *extent = &inode->extents[i];
+        if (extent->blockCount == 0 || index < extent->logicalBlock || index >= extent->logicalBlock + extent->blockCount){
+            continue;
+        }
+        size_t skip = index - extent->logicalBlock;
+        uint16_t block_id = extent->startBlock + skip;
+        extent_t tail = {index + 1, block_id + 1, extent->blockCount - skip - 1};
+        extent->blockCount = skip; // keep the head in place
+        if (extent->blockCount == 0){ // took the first block, the tail can reuse the descriptor
+            *extent = tail;
+        } else if (tail.blockCount != 0){
+            extent_t *spare = NULL;
+            for (size_t j = 0; j < FS_INODE_EXTENTS && spare == NULL; j++){
+                if (inode->extents[j].blockCount == 0){
+                    spare = &inode->extents[j];
+                }
+            }
+            if (spare != NULL){
+                *spare = tail;
+            } else { // out of descriptors, the reservation for the tail is dropped
+                for (size_t j = 0; j < tail.blockCount; j++){
+                    fs_block_free(fs, tail.startBlock + j);
+                }
+            }
+        }
+        return block_id;
+    }
+    return 0;
+}
+
+// true if fs_fallocate has set a block aside for block index of the file
+bool inode_extent_covers(const inode_t *inode, size_t index){
+    for (size_t i = 0; i < FS_INODE_EXTENTS; i++){
+        const extent_t *extent = &inode->extents[i];
+        if (extent->blockCount != 0 && index >= extent->logicalBlock && index < extent->logicalBlock + extent->blockCount){
+            return true;
+        }
+    }
+    return false;
+}
+
+// give every block still reserved in the inode's extents back to the store
+void inode_extents_release(FS_t *fs, inode_t *inode){
+    for (size_t i = 0; i < FS_INODE_EXTENTS; i++){
+        for (size_t j = 0; j < inode->extents[i].blockCount; j++){
+            fs_block_free(fs, inode->extents[i].startBlock + j);
+        }
+        inode->extents[i].blockCount = 0;
+    }
+}
+
+/** Takes a run of free blocks out of the free block map in a single pass over it
+      The first run of want free blocks is used, if there is none the longest one found is
+    \param fs The FS to allocate from
+    \param want Number of blocks wanted
+    \param got Set to the number of blocks in the run
+    \return block id of the first block of the run, 0 if the store is full
+*/
+uint16_t fs_block_alloc_run(FS_t *fs, size_t want, size_t *got){
+    *got = 0;
+    if (fs->FreeBlockMap == NULL || want == 0){
+        return 0;
+    }
+    const uint8_t *map = bitmap_export(fs->FreeBlockMap);
+    size_t best_start = 0, best_count = 0;
+    size_t run_start = 0, run_count = 0;
+    for (size_t block = 1; block < BLOCK_STORE_AVAIL_BLOCKS && best_count < want; block++){
+        if (block % 8 == 0 && map[block / 8] == 0xFF && block + 8 <= BLOCK_STORE_AVAIL_BLOCKS){ // 8 used blocks in a row
+            run_count = 0;
+            block += 7;
+            continue;
+        }
+        if (bitmap_test(fs->FreeBlockMap, block)){
+            run_count = 0;
+            continue;
+        }
+        if (run_count++ == 0){
+            run_start = block;
+        }
+        if (run_count > best_count){
+            best_start = run_start;
+            best_count = run_count;
+        }
+    }
+    uint64_t start = fs->Trace != NULL ? fs_clock() : 0;
+    for (size_t i = 0; i < best_count; i++){
+        bitmap_set(fs->FreeBlockMap, best_start + i);
+        fs_trace_record(fs, FS_TRACE_ALLOCATE, true, start, best_start + i); // taken one by one as far as a replay goes
+    }
+    fs->FreeBlocks -= best_count;
+    *got = best_count;
+    return best_start;
+}
+
+/** Records a reserved run in a free extent descriptor, or grows the extent it directly follows
+    \return 0 on success, < 0 if every descriptor is in use
+*/
+int inode_extent_add(inode_t *inode, size_t logical_block, uint16_t start_block, size_t block_count){
+    extent_t *spare = NULL;
+    for (size_t i = 0; i < FS_INODE_EXTENTS; i++){
+        extent_t *extent = &inode->extents[i];
+        if (extent->blockCount == 0){
+            if (spare == NULL){
+                spare = extent;
+            }
+        } else if (extent->logicalBlock + extent->blockCount == logical_block && extent->startBlock + extent->blockCount == start_block
+                   && extent->blockCount + block_count <= UINT16_MAX){ // continues this one on both sides
+            extent->blockCount += block_count;
+            return 0;
+        }
+    }
+    if (spare == NULL){
+        return -1;
+    }
+    spare->logicalBlock = logical_block;
+    spare->startBlock = start_block;
+    spare->blockCount = block_count;
+    return 0;
+}
+
+/** Translates the index of a block within a file into its block id in the whole block store
+    \param fs The FS containing the file
+    \param inode The inode of the file
+    \param index Serial number of the block within the file (0 is the first direct pointer)
+    \return block id, 0 if that part of the file has no block behind it
+*/
+uint16_t inode_block_lookup(FS_t *fs, const inode_t *inode, size_t index){
+    if (inode->flags & FS_INODE_INLINE){ // the file has no blocks, its bytes are in the inode
+        return 0;
+    }
+    if (index < number_direct_pointers){ // direct range
+        return inode->directPointer[index];
+    }
+    uint16_t ptr_buff[pointers_per_block]; // holds the contents of an indirect block
+    index -= number_direct_pointers;
+    if (index < pointers_per_block){ // indirect range
+        if (inode->indirectPointer[0] == 0){
+            return 0;
+        }
+        fs_block_read(fs, inode->indirectPointer[0], ptr_buff);
+        return ptr_buff[index];
+    }
+    index -= pointers_per_block;
+    if (index < pointers_per_block * pointers_per_block){ // double indirect range
+        if (inode->doubleIndirectPointer == 0){
+            return 0;
+        }
+        fs_block_read(fs, inode->doubleIndirectPointer, ptr_buff);
+        uint16_t indirect_id = ptr_buff[index / pointers_per_block];
+        if (indirect_id == 0){
+            return 0;
+        }
+        fs_block_read(fs, indirect_id, ptr_buff);
+        return ptr_buff[index % pointers_per_block];
+    }
+    return 0;
+}
+
+/** Returns the block id held in one slot of an indirect block, allocating whatever is missing on the way
+    \param fs The FS containing the file
+    \param table_id Block id of the indirect block, allocated (and zeroed) first if it is 0
+    \param slot Index of the entry within the indirect block
+    \param fresh Set to true if the entry had to be allocated
+    \param zero_new Zero a newly allocated entry on disk (for blocks that will hold pointers)
+    \param reserved Block to put in an empty entry instead of allocating one, 0 to allocate
+    \return block id in the slot, 0 if the store ran out of blocks
+*/
+uint16_t pointer_block_slot(FS_t *fs, uint16_t *table_id, size_t slot, bool *fresh, bool zero_new, uint16_t reserved){
+    uint16_t ptr_buff[pointers_per_block];
+    *fresh = false;
+    if (*table_id == 0){ // first block behind this pointer, start with an empty table
+        *table_id = fs_block_alloc(fs);
+        if (*table_id == 0){
+            return 0;
+        }
+        memset(ptr_buff, 0, BLOCK_SIZE_BYTES);
+    } else {
+        fs_block_read(fs, *table_id, ptr_buff);
+    }
+    if (ptr_buff[slot] == 0){
+        ptr_buff[slot] = reserved != 0 ? reserved : fs_block_alloc(fs);
+        if (ptr_buff[slot] == 0){
+            return 0;
+        }
+        if (zero_new){
+            uint8_t zero_buff[BLOCK_SIZE_BYTES];
+            memset(zero_buff, 0, BLOCK_SIZE_BYTES);
+            fs_block_write(fs, ptr_buff[slot], zero_buff);
+        }
+        *fresh = true;
+        fs_block_write(fs, *table_id, ptr_buff);
+    }
+    return ptr_buff[slot];
+}
+
+/** Puts a block behind block index of the file, along with any indirect block leading to it
+    \param fs The FS containing the file
+    \param inode The inode of the file, its pointers are updated in memory only
+    \param index Serial number of the block within the file
+    \param block_id Block to put there if the file has none yet, 0 to allocate one
+    \param fresh Set to true if the slot was empty and now holds a block
+    \return block id, 0 if the store ran out of blocks or index is past the largest file
+*/
+uint16_t inode_block_attach(FS_t *fs, inode_t *inode, size_t index, uint16_t block_id, bool *fresh){
+    *fresh = false;
+    if (index < number_direct_pointers){
+        if (inode->directPointer[index] == 0){
+            inode->directPointer[index] = block_id != 0 ? block_id : fs_block_alloc(fs);
+            *fresh = inode->directPointer[index] != 0;
+        }
+        return inode->directPointer[index];
+    }
+    index -= number_direct_pointers;
+    if (index < pointers_per_block){
+        return pointer_block_slot(fs, &inode->indirectPointer[0], index, fresh, false, block_id);
+    }
+    index -= pointers_per_block;
+    if (index < pointers_per_block * pointers_per_block){
+        bool table_fresh;
+        uint16_t indirect_id = pointer_block_slot(fs, &inode->doubleIndirectPointer, index / pointers_per_block, &table_fresh, true, 0);
+        if (indirect_id != 0){
+            return pointer_block_slot(fs, &indirect_id, index % pointers_per_block, fresh, false, block_id);
+        }
+    }
+    return 0;
+}
+
+/** Like inode_block_lookup, but allocates the block (and any indirect block leading to it) if the file has none there yet
+    \param fs The FS containing the file
+    \param inode The inode of the file, its pointers are updated in memory only
+    \param index Serial number of the block within the file
+    \param fresh Set to true if the data block was just allocated, its contents are then undefined
+    \return block id, 0 if the store ran out of blocks or index is past the largest file
+*/
+uint16_t inode_block_alloc(FS_t *fs, inode_t *inode, size_t index, bool *fresh){
+    uint16_t reserved = inode_extent_take(fs, inode, index); // an unwritten block fs_fallocate set aside, if any
+    uint16_t block_id = inode_block_attach(fs, inode, index, reserved, fresh);
+    if (block_id == 0){ // no room for the pointer to it, the reserved block goes back
+        fs_block_free(fs, reserved);
+    }
+    return block_id;
+}
+
+/** Clears one slot of an indirect block, releasing the indirect block itself once it holds nothing
+    \param fs The FS containing the file
+    \param table_id Block id of the indirect block, set to 0 if it gets released
+    \param slot Index of the entry within the indirect block
+    \return block id that was in the slot, 0 for a hole
+*/
+uint16_t pointer_block_clear(FS_t *fs, uint16_t *table_id, size_t slot){
+    uint16_t ptr_buff[pointers_per_block];
+    fs_block_read(fs, *table_id, ptr_buff);
+    uint16_t block_id = ptr_buff[slot];
+    if (block_id == 0){
+        return 0;
+    }
+    ptr_buff[slot] = 0;
+    for (size_t i = 0; i < pointers_per_block; i++){
+        if (ptr_buff[i] != 0){ // still in use, just write the table back
+            fs_block_write(fs, *table_id, ptr_buff);
+            return block_id;
+        }
+    }
+    fs_block_free(fs, *table_id);
+    *table_id = 0;
+    return block_id;
+}
+
+/** Detaches block index from the file, turning it into a hole
+    \param fs The FS containing the file
+    \param inode The inode of the file, its pointers are updated in memory only
+    \param index Serial number of the block within the file
+    \return block id that was there (the caller releases it), 0 if it already was a hole
+*/
+uint16_t inode_block_clear(FS_t *fs, inode_t *inode, size_t index){
+    if (inode->flags & FS_INODE_INLINE){
+        return 0;
+    }
+    if (index < number_direct_pointers){
+        uint16_t block_id = inode->directPointer[index];
+        inode->directPointer[index] = 0;
+        return block_id;
+    }
+    index -= number_direct_pointers;
+    if (index < pointers_per_block){
+        if (inode->indirectPointer[0] == 0){
+            return 0;
+        }
+        return pointer_block_clear(fs, &inode->indirectPointer[0], index);
+    }
+    index -= pointers_per_block;
+    if (index < pointers_per_block * pointers_per_block && inode->doubleIndirectPointer != 0){
+        uint16_t ptr_buff[pointers_per_block];
+        fs_block_read(fs, inode->doubleIndirectPointer, ptr_buff);
+        uint16_t indirect_id = ptr_buff[index / pointers_per_block];
+        if (indirect_id == 0){
+            return 0;
+        }
+        uint16_t block_id = pointer_block_clear(fs, &indirect_id, index % pointers_per_block);
+        if (indirect_id == 0){ // the indirect block went away, drop it from the double indirect block too
+            pointer_block_clear(fs, &inode->doubleIndirectPointer, index / pointers_per_block);
+        }
+        return block_id;
+    }
+    return 0;
+}
+
+// points block index of the file, which must have a block already, at block_id instead
+void inode_block_replace(FS_t *fs, inode_t *inode, size_t index, uint16_t block_id){
+    if (index < number_direct_pointers){
+        inode->directPointer[index] = block_id;
+        return;
+    }
+    uint16_t ptr_buff[pointers_per_block];
+    uint16_t table_id = inode->indirectPointer[0];
+    index -= number_direct_pointers;
+    if (index >= pointers_per_block){ // find the indirect block through the double indirect one
+        index -= pointers_per_block;
+        fs_block_read(fs, inode->doubleIndirectPointer, ptr_buff);
+        table_id = ptr_buff[index / pointers_per_block];
+        index %= pointers_per_block;
+    }
+    fs_block_read(fs, table_id, ptr_buff);
+    ptr_buff[index] = block_id;
+    fs_block_write(fs, table_id, ptr_buff);
+}
+
+/** Makes sure block index of the file is not shared with a clone before it is written to
+      A shared block is copied to a block of the file's own, the other files keep the original
+    \param fs The FS containing the file
+    \param inode The inode of the file, its pointers are updated in memory only
+    \param index Serial number of the block within the file
+    \param block_id The block the file has there now
+    \return block id to write to, 0 if the store ran out of blocks
+*/
+uint16_t inode_block_private(FS_t *fs, inode_t *inode, size_t index, uint16_t block_id){
+    if (fs->BlockRefs == NULL || fs->BlockRefs[block_id] == 0){ // only this file has it
+        return block_id;
+    }
+    uint16_t copy_id = fs_block_alloc(fs);
+    if (copy_id == 0){
+        return 0;
+    }
+    uint8_t block_buff[BLOCK_SIZE_BYTES];
+    fs_block_read(fs, block_id, block_buff);
+    fs_block_write(fs, copy_id, block_buff);
+    inode_block_replace(fs, inode, index, copy_id);
+    fs_block_free(fs, block_id); // one sharer less
+    return copy_id;
+}
+
+// LZ77 in the layout of an LZ4 block: each sequence is a token (literal count << 4 | match length - lz_min_match),
+//  255 bytes continuing either count once it reaches 15, the literals, then the offset back to the match (uint16 little-endian)
+//  the last sequence has literals only and ends the input
+#define lz_min_match 4
+#define lz_hash_bits 12
+
+// append a length that did not fit in its 4 bits of the token, false if dst is full
+bool lz_put_length(uint8_t *dst, size_t capacity, size_t *out, size_t length){
+    for (; length >= 255; length -= 255){
+        if (*out >= capacity){
+            return false;
+        }
+        dst[(*out)++] = 255;
+    }
+    if (*out >= capacity){
+        return false;
+    }
+    dst[(*out)++] = length;
+    return true;
+}
+
+// append one sequence, match_length 0 for the last one; false if dst is full
+bool lz_put_sequence(uint8_t *dst, size_t capacity, size_t *out, const uint8_t *literals, size_t literal_count, size_t offset, size_t match_length){
+    size_t match_code = match_length == 0 ? 0 : match_length - lz_min_match;
+    if (*out >= capacity){
+        return false;
+    }
+    dst[(*out)++] = (literal_count < 15 ? literal_count : 15) << 4 | (match_code < 15 ? match_code : 15);
+    if (literal_count >= 15 && !lz_put_length(dst, capacity, out, literal_count - 15)){
+        return false;
+    }
+    if (*out + literal_count > capacity){
+        return false;
+    }
+    memcpy(dst + *out, literals, literal_count);
+    *out += literal_count;
+    if (match_length == 0){
+        return true;
+    }
+    if (*out + 2 > capacity){
+        return false;
+    }
+    dst[(*out)++] = offset & 0xFF;
+    dst[(*out)++] = offset >> 8;
+    return match_code < 15 || lz_put_length(dst, capacity, out, match_code - 15);
+}
+
+/** Compresses up to UINT16_MAX bytes, see the layout above
+      Matches are found through a hash table of the last position each 4 byte sequence was seen at
+    \param src The bytes to compress
+    \param length Number of bytes in src
+    \param dst Where to put the compressed bytes
+    \param capacity Room in dst
+    \return number of bytes in dst, 0 if they did not fit
+*/
+size_t lz_compress(const uint8_t *src, size_t length, uint8_t *dst, size_t capacity){
+    uint16_t table[1 << lz_hash_bits];
+    memset(table, 0xFF, sizeof(table)); // UINT16_MAX: not seen yet
+    size_t in = 0, anchor = 0, out = 0;
+    while (in + lz_min_match <= length){
+        uint32_t sequence;
+        memcpy(&sequence, src + in, sizeof(sequence));
+        size_t hash = (uint32_t)(sequence * 2654435761u) >> (32 - lz_hash_bits);
+        size_t candidate = table[hash];
+        table[hash] = in;
+        if (candidate == UINT16_MAX || memcmp(src + candidate, src + in, lz_min_match) != 0){
+            in++;
+            continue;
+        }
+        size_t match_length = lz_min_match;
+        while (in + match_length < length && src[candidate + match_length] == src[in + match_length]){
+            match_length++;
+        }
+        if (!lz_put_sequence(dst, capacity, &out, src + anchor, in - anchor, in - candidate, match_length)){
+            return 0;
+        }
+        in += match_length;
+        anchor = in;
+    }
+    if (!lz_put_sequence(dst, capacity, &out, src + anchor, length - anchor, 0, 0)){
+        return 0;
+    }
+    return out;
+}
+
+// read a length continued past its 4 bits of the token, false if src ends first
+bool lz_get_length(const uint8_t *src, size_t length, size_t *in, size_t *value){
+    uint8_t byte;
+    do {
+        if (*in >= length){
+            return false;
+        }
+        byte = src[(*in)++];
+        *value += byte;
+    } while (byte == 255);
+    return true;
+}
+
+/** Decompresses what lz_compress wrote
+    \param src The compressed bytes
+    \param length Number of bytes in src
+    \param dst Where to put the bytes
+    \param capacity Room in dst
+    \return number of bytes in dst, SIZE_MAX if src is damaged or does not fit
+*/
+size_t lz_decompress(const uint8_t *src, size_t length, uint8_t *dst, size_t capacity){
+    size_t in = 0, out = 0;
+    while (in < length){
+        uint8_t token = src[in++];
+        size_t literal_count = token >> 4;
+        if (literal_count == 15 && !lz_get_length(src, length, &in, &literal_count)){
+            return SIZE_MAX;
+        }
+        if (literal_count > length - in || literal_count > capacity - out){
+            return SIZE_MAX;
+        }
+        memcpy(dst + out, src + in, literal_count);
+        in += literal_count;
+        out += literal_count;
+        if (in == length){ // the last sequence
+            break;
+        }
+        if (length - in < 2){
+            return SIZE_MAX;
+        }
+        size_t offset = src[in] | (size_t)src[in + 1] << 8;
+        in += 2;
+        size_t match_length = token & 0x0F;
+        if (match_length == 15 && !lz_get_length(src, length, &in, &match_length)){
+            return SIZE_MAX;
+        }
+        match_length += lz_min_match;
+        if (offset == 0 || offset > out || match_length > capacity - out){
+            return SIZE_MAX;
+        }
+        for (size_t i = 0; i < match_length; i++, out++){ // byte by byte, the match may run into itself
+            dst[out] = dst[out - offset];
+        }
+    }
+    return out;
+}
+
+// block slots a file's pointers can cover: its size in blocks, up to the end of the last cluster for a compressed file
+size_t inode_block_span(const inode_t *inode){
+    size_t block_count = (inode->fileSize + BLOCK_SIZE_BYTES - 1) / BLOCK_SIZE_BYTES;
+    if (inode->flags & FS_INODE_COMPRESSED){
+        block_count = (block_count + fs_cluster_blocks - 1) / fs_cluster_blocks * fs_cluster_blocks;
+    }
+    return block_count;
+}
+
+/** Reads one cluster of a compressed file, decompressed, through the cluster cache
+    \param fs The FS containing the file
+    \param inode The inode of the file
+    \param cluster Serial number of the cluster within the file
+    \param data Where to put the fs_cluster_size bytes of the cluster
+    \return 0 on success, < 0 if the cluster does not decompress
+*/
+int inode_cluster_load(FS_t *fs, const inode_t *inode, size_t cluster, uint8_t *data){
+    uint16_t blocks[fs_cluster_blocks];
+    for (size_t i = 0; i < fs_cluster_blocks; i++){
+        blocks[i] = inode_block_lookup(fs, inode, cluster * fs_cluster_blocks + i);
+    }
+    if (blocks[0] == 0){ // hole, nothing was ever written here (or only zeros)
+        memset(data, 0, fs_cluster_size);
+        return 0;
+    }
+    const uint8_t *cached = fs_cluster_cached(fs, blocks[0]);
+    if (cached != NULL){
+        fs->ClusterHits++;
+        memcpy(data, cached, fs_cluster_size);
+        return 0;
+    }
+    fs->ClusterMisses++;
+    if (blocks[fs_cluster_blocks - 1] != 0){ // did not compress, stored as is
+        for (size_t i = 0; i < fs_cluster_blocks; i++){
+            if (blocks[i] == 0){
+                memset(data + i * BLOCK_SIZE_BYTES, 0, BLOCK_SIZE_BYTES);
+            } else {
+                fs_block_read(fs, blocks[i], data + i * BLOCK_SIZE_BYTES);
+            }
+        }
+    } else {
+        uint8_t packed[(fs_cluster_blocks - 1) * BLOCK_SIZE_BYTES];
+        size_t used = 0;
+        while (used < fs_cluster_blocks - 1 && blocks[used] != 0){
+            fs_block_read(fs, blocks[used], packed + used * BLOCK_SIZE_BYTES);
+            used++;
+        }
+        uint16_t header; // the compressed length leads the first block
+        memcpy(&header, packed, sizeof(header));
+        size_t length = le16(header);
+        if (length + sizeof(uint16_t) > used * BLOCK_SIZE_BYTES
+            || lz_decompress(packed + sizeof(uint16_t), length, data, fs_cluster_size) != fs_cluster_size){
+            return -1;
+        }
+    }
+    fs_cluster_remember(fs, blocks[0], data);
+    return 0;
+}
+
+/** Writes one whole cluster of a compressed file
+      Every block the cluster needs is in place before any of them is written, so running out of blocks leaves the old cluster as it was
+    \param fs The FS containing the file
+    \param inode The inode of the file, its pointers are updated in memory only
+    \param cluster Serial number of the cluster within the file
+    \param data The fs_cluster_size bytes of the cluster
+    \return 0 on success, < 0 if the store ran out of blocks
+*/
+int inode_cluster_store(FS_t *fs, inode_t *inode, size_t cluster, const uint8_t *data){
+    uint8_t packed[(fs_cluster_blocks - 1) * BLOCK_SIZE_BYTES];
+    const uint8_t *stored = data;
+    size_t used = 0;
+    for (size_t i = 0; i < fs_cluster_size && used == 0; i++){
+        used = data[i] != 0 ? fs_cluster_blocks : 0;
+    }
+    if (used != 0){ // only keep the compressed form if it saves at least a block
+        size_t length = lz_compress(data, fs_cluster_size, packed + sizeof(uint16_t), sizeof(packed) - sizeof(uint16_t));
+        if (length != 0){
+            uint16_t header = le16(length);
+            memcpy(packed, &header, sizeof(header));
+            used = (length + sizeof(uint16_t) + BLOCK_SIZE_BYTES - 1) / BLOCK_SIZE_BYTES;
+            memset(packed + length + sizeof(uint16_t), 0, used * BLOCK_SIZE_BYTES - length - sizeof(uint16_t));
+            stored = packed;
+        }
+    }
+
+    size_t first = cluster * fs_cluster_blocks;
+    uint16_t blocks[fs_cluster_blocks];
+    bool fresh[fs_cluster_blocks];
+    for (size_t i = 0; i < used; i++){
+        blocks[i] = inode_block_alloc(fs, inode, first + i, &fresh[i]);
+        if (blocks[i] != 0 && !fresh[i]){ // copy-on-write if a clone shares the block
+            blocks[i] = inode_block_private(fs, inode, first + i, blocks[i]);
+        }
+        if (blocks[i] == 0){ // out of space, give back what was taken for this write
+            for (size_t j = 0; j < i; j++){
+                if (fresh[j]){
+                    fs_block_free(fs, inode_block_clear(fs, inode, first + j));
+                }
+            }
+            return -1;
+        }
+    }
+    for (size_t i = 0; i < used; i++){
+        fs_block_write(fs, blocks[i], stored + i * BLOCK_SIZE_BYTES);
+    }
+    for (size_t i = used; i < fs_cluster_blocks; i++){ // slots the cluster no longer needs become holes
+        fs_block_free(fs, inode_block_clear(fs, inode, first + i));
+    }
+    if (used != 0){
+        fs_cluster_remember(fs, blocks[0], data);
+    }
+    return 0;
+}
+
+/** Reads a range of a compressed file, a cluster at a time, see fs_read
+    \return 0 on success, < 0 if a cluster does not decompress
+*/
+int inode_cluster_read(FS_t *fs, const inode_t *inode, size_t position, uint8_t *dst, size_t nbyte){
+    uint8_t cluster_buff[fs_cluster_size];
+    for (size_t done = 0; done < nbyte;){
+        size_t cluster_offset = (position + done) % fs_cluster_size;
+        size_t chunk = fs_cluster_size - cluster_offset;
+        if (chunk > nbyte - done){
+            chunk = nbyte - done;
+        }
+        if (inode_cluster_load(fs, inode, (position + done) / fs_cluster_size, cluster_buff) < 0){
+            return -1;
+        }
+        memcpy(dst + done, cluster_buff + cluster_offset, chunk);
+        done += chunk;
+    }
+    return 0;
+}
+
+/** Writes a range of a compressed file, a cluster at a time, see fs_write
+      A cluster the write only partly covers is read back first
+    \return number of bytes written, short if the store ran out of blocks or a cluster does not decompress
+*/
+size_t inode_cluster_write(FS_t *fs, inode_t *inode, size_t position, const uint8_t *src, size_t nbyte){
+    uint8_t cluster_buff[fs_cluster_size];
+    size_t written = 0;
+    while (written < nbyte){
+        size_t cluster = (position + written) / fs_cluster_size;
+        size_t cluster_offset = (position + written) % fs_cluster_size;
+        size_t chunk = fs_cluster_size - cluster_offset;
+        if (chunk > nbyte - written){
+            chunk = nbyte - written;
+        }
+        if (chunk < fs_cluster_size && inode_cluster_load(fs, inode, cluster, cluster_buff) < 0){
+            break;
+        }
+        memcpy(cluster_buff + cluster_offset, src + written, chunk);
+        if (inode_cluster_store(fs, inode, cluster, cluster_buff) < 0){
+            break;
+        }
+        written += chunk;
+    }
+    return written;
+}
+
+/** Fingerprints a block for the dedup index, 8 bytes at a time
+    \param block The BLOCK_SIZE_BYTES bytes of the block
+    \return its 64 bit fingerprint, the same on any host
+*/
+uint64_t block_fingerprint(const uint8_t *block){
+    uint64_t hash = 0x9E3779B97F4A7C15ull;
+    for (size_t i = 0; i < BLOCK_SIZE_BYTES; i += sizeof(uint64_t)){
+        uint64_t word;
+        memcpy(&word, block + i, sizeof(word));
+        hash = (hash ^ le64(word)) * 0xFF51AFD7ED558CCDull;
+        hash ^= hash >> 29;
+    }
+    return hash;
+}
+
+// a block in use holding exactly the bytes of block, found through the index; 0 if there is none
+uint16_t dedup_find(FS_t *fs, const uint8_t *block, uint64_t fingerprint){
+    uint8_t block_buff[BLOCK_SIZE_BYTES];
+    for (size_t probe = 0; probe <= fs_dedup_probe; probe++){
+        uint64_t slot = le64(fs->DedupIndex[(fingerprint + probe) % BLOCK_STORE_NUM_BLOCKS]);
+        uint16_t block_id = slot & 0xFFFF;
+        if (slot == 0){ // slots are never emptied, the fingerprint would have landed here
+            return 0;
+        }
+        if ((slot >> 16) != (fingerprint >> 16) || !bitmap_test(fs->DedupValid, block_id)){
+            continue;
+        }
+        fs_block_read(fs, block_id, block_buff);
+        if (memcmp(block_buff, block, BLOCK_SIZE_BYTES) == 0){
+            return block_id;
+        }
+    }
+    return 0;
+}
+
+// records that block_id now holds the bytes with this fingerprint, in place of an entry that no longer describes its block
+void dedup_insert(FS_t *fs, uint16_t block_id, uint64_t fingerprint){
+    size_t home = fingerprint % BLOCK_STORE_NUM_BLOCKS, at = home;
+    for (size_t probe = 0; probe <= fs_dedup_probe; probe++){
+        size_t index = (home + probe) % BLOCK_STORE_NUM_BLOCKS;
+        uint64_t slot = le64(fs->DedupIndex[index]);
+        if (slot == 0 || !bitmap_test(fs->DedupValid, slot & 0xFFFF) || (slot & 0xFFFF) == block_id){
+            at = index;
+            break;
+        }
+    }
+    fs->DedupIndex[at] = le64((fingerprint >> 16) << 16 | block_id); // with every slot taken, the home slot's entry is dropped
+    bitmap_set(fs->DedupValid, block_id);
+}
+
+/** Puts an already stored copy of a whole block behind block index of the file, see fs_set_dedup
+    \param fs The FS containing the file, with dedup on
+    \param inode The inode of the file, its pointers are updated in memory only
+    \param index Serial number of the block within the file
+    \param block The BLOCK_SIZE_BYTES bytes about to be written there
+    \param fingerprint Set to the fingerprint of block, for dedup_insert once it is written after all
+    \return 1 if a stored copy was shared, 0 if block has to be written as usual, < 0 if the store ran out of blocks
+*/
+int inode_block_dedup(FS_t *fs, inode_t *inode, size_t index, const uint8_t *block, uint64_t *fingerprint){
+    uint64_t start = fs_clock();
+    *fingerprint = block_fingerprint(block);
+    uint16_t copy_id = dedup_find(fs, block, *fingerprint);
+    fs->DedupNanos += fs_clock() - start;
+    fs->DedupHashed++;
+    uint16_t block_id = inode_block_lookup(fs, inode, index);
+    if (copy_id != 0 && copy_id == block_id){ // rewriting the same bytes
+        fs->DedupShared++;
+        return 1;
+    }
+    if (copy_id == 0 || fs->BlockRefs[copy_id] == UINT8_MAX){
+        return 0;
+    }
+    fs->BlockRefs[copy_id]++;
+    if (block_id != 0){
+        inode_block_replace(fs, inode, index, copy_id);
+        fs_block_free(fs, block_id);
+    } else {
+        bool fresh;
+        fs_block_free(fs, inode_extent_take(fs, inode, index)); // a block fs_fallocate set aside is not needed now
+        if (inode_block_attach(fs, inode, index, copy_id, &fresh) == 0){ // no room for a pointer block
+            fs->BlockRefs[copy_id]--;
+            return -1;
+        }
+    }
+    fs->DedupShared++;
+    return 1;
+}
+
+/** Moves the R/W position of the given descriptor to the given location
+      Files can be seeked past EOF, up to FS_MAX_SEEK, but not before BOF (beginning of file)
+      Seeking further than that stops at FS_MAX_SEEK, seeking before BOF will seek to BOF
+    \param fs The FS containing the file
+    \param fd The descriptor to seek
+    \param offset Desired offset relative to whence
+    \param whence Position from which offset is applied
+    \return offset from BOF, < 0 on error 
+*/
+off_t fs_seek_op(FS_t *fs, int fd, off_t offset, seek_t whence) {
+    if (fs != NULL && fd >= 0 && fd < number_fd && (whence == FS_SEEK_SET || whence == FS_SEEK_CUR || whence == FS_SEEK_END)){ // initial param check
+        if (block_store_sub_test(fs->BlockStore_fd, fd) == false){ // check file descriptor table block which fd corresponds to
+            return -1;
+        }
+        fileDescriptor_t new_fd;
+        block_store_fd_read(fs->BlockStore_fd, fd, &new_fd);
+
+        off_t position = offset;
+        if (whence == FS_SEEK_CUR){
+            position += fd_get_position(&new_fd);
+        } else if (whence == FS_SEEK_END){
+            inode_t inode;
+            inode_load(fs, new_fd.inodeNum, &inode);
+            position += inode.fileSize;
+        }
+
+        if (position < 0){ // before BOF
+            position = 0;
+        } else if (position > FS_MAX_SEEK){ // no file can reach past this
+            position = FS_MAX_SEEK;
+        }
+        fd_set_position(&new_fd, position);
+        block_store_fd_write(fs->BlockStore_fd, fd, &new_fd);
+        return position;
+    }
+    return -1;
+}
+
+/** Reads data from the file linked to the given descriptor
+      Reading past EOF returns data up to EOF
+      Holes in the file read back as zeros
+      R/W position in incremented by the number of bytes read
+    \param fs The FS containing the file
+    \param fd The file to read from 
+    \param dst The buffer to write to
+    \param nbyte The number of bytes to read
+    \return number of bytes read (< nbyte IFF read passes EOF), < 0 on error
+*/
+/* Notes: 
+    - int fd = index into file descriptor table / fd ID
+        - allows us to use block_store_fd_read() on that int to access the corresponding fd struct
+    - idea: fs_open() does the path traversal to find the inode number for the file that's being opened
+        - stores that inode number in the file descriptor so other functions, like fs_read() and fs_write(),
+        don't have to traverse the path
+        - Inode number in a file descriptor should be the inode ID for the inode that represents the file 
+*/
+ssize_t fs_read_op(FS_t *fs, int fd, void *dst, size_t nbyte){
+    if (fs != NULL && fd >= 0 && fd < number_fd && dst != NULL && block_store_sub_test(fs->BlockStore_fd, fd)){ // error check params
+        fileDescriptor_t new_fd;
+        block_store_fd_read(fs->BlockStore_fd, fd, &new_fd);
+        inode_t fd_inode;
+        inode_load(fs, new_fd.inodeNum, &fd_inode);
+        size_t position = fd_get_position(&new_fd);
+
+        if (position >= fd_inode.fileSize){ // already at (or past) EOF
+            nbyte = 0;
+        } else if (position + nbyte > fd_inode.fileSize){
+            nbyte = fd_inode.fileSize - position;
+        }
+        if (fd_inode.flags & FS_INODE_INLINE){ // the data sits in the inode we just read, no block I/O needed
+            memcpy(dst, fd_inode.inlineData + position, nbyte);
+        } else if (fd_inode.flags & FS_INODE_COMPRESSED){ // only the clusters the range touches are decompressed
+            if (inode_cluster_read(fs, &fd_inode, position, (uint8_t*)dst, nbyte) < 0){
+                return -1;
+            }
+        } else {
+            uint8_t block_buff[BLOCK_SIZE_BYTES];
+            size_t done = 0;
+            while (done < nbyte){ // one block at a time
+                size_t block_offset = (position + done) % BLOCK_SIZE_BYTES;
+                size_t chunk = BLOCK_SIZE_BYTES - block_offset;
+                if (chunk > nbyte - done){
+                    chunk = nbyte - done;
+                }
+                uint16_t block_id = inode_block_lookup(fs, &fd_inode, (position + done) / BLOCK_SIZE_BYTES);
+                if (block_id == 0){ // hole, nothing was ever written here
+                    memset((uint8_t*)dst + done, 0, chunk);
+                } else {
+                    fs_block_read(fs, block_id, block_buff);
+                    memcpy((uint8_t*)dst + done, block_buff + block_offset, chunk);
+                }
+                done += chunk;
+            }
+        }
+        fd_set_position(&new_fd, position + nbyte);
+        block_store_fd_write(fs->BlockStore_fd, fd, &new_fd);
+        return nbyte;
+    }        
+    return -1; 
+}
+
+/** Moves the data of an inline file out to a freshly allocated block
+    \param fs The FS containing the file
+    \param inode The inode of the file, updated in memory only
+    \return 0 on success, < 0 if no block is available
+*/
+int inode_promote_inline(FS_t *fs, inode_t *inode){
+    inode->flags &= ~FS_INODE_INLINE;
+    if (inode->fileSize == 0){ // nothing to carry over, leave every block a hole
+        return 0;
+    }
+    uint8_t block_buff[BLOCK_SIZE_BYTES];
+    memset(block_buff, '\0', BLOCK_SIZE_BYTES);
+    memcpy(block_buff, inode->inlineData, inode->fileSize);
+
+    uint16_t block_id = fs_block_alloc(fs);
+    if (block_id == 0){
+        inode->flags |= FS_INODE_INLINE;
+        return -1;
+    }
+    fs_block_write(fs, block_id, block_buff);
+
+    memset(inode->inlineData, 0, FS_INLINE_DATA_MAX);
+    inode->directPointer[0] = block_id;
+    return 0;
+}
+
+/** Writes data from given buffer to the file linked to the descriptor
+      Writing past EOF extends the file, any gap left between the old EOF and the write stays a hole
+      Writing inside a file overwrites existing data
+      R/W position in incremented by the number of bytes written
+    \param fs The FS containing the file
+    \param fd The file to write to
+    \param dst The buffer to read from
+    \param nbyte The number of bytes to write
+    \return number of bytes written (< nbyte IFF out of space), < 0 on error
+*/
+ssize_t fs_write_op(FS_t *fs, int fd, const void *src, size_t nbyte) {
+    if (fs != NULL && src != NULL && fd >= 0 && fd < number_fd){ // param check 
+        if (!block_store_sub_test(fs->BlockStore_fd, fd)){
+            return -1;
+        }
+		fileDescriptor_t new_fd; // create file descriptor
+		block_store_fd_read(fs->BlockStore_fd, fd, &new_fd); // update file descriptor with fd value 
+		inode_t fd_inode;
+		inode_load(fs, new_fd.inodeNum, &fd_inode);
+
+        size_t position = fd_get_position(&new_fd); // byte offset from BOF the write starts at
+        if (position + nbyte > (size_t)FS_MAX_FILE_SIZE){ // the cursor could not follow the write any further
+            nbyte = FS_MAX_FILE_SIZE - position;
+        }
+        if (fd_inode.flags & FS_INODE_INLINE){
+            if (position + nbyte <= FS_INLINE_DATA_MAX){ // still fits, keep it inside the inode
+                memcpy(fd_inode.inlineData + position, src, nbyte);
+                if (position + nbyte > fd_inode.fileSize){
+                    fd_inode.fileSize = position + nbyte;
+                }
+                fd_inode.mtime = time(NULL);
+                fd_set_position(&new_fd, position + nbyte);
+                block_store_fd_write(fs->BlockStore_fd, fd, &new_fd);
+                inode_store(fs, new_fd.inodeNum, &fd_inode);
+                return nbyte;
+            }
+            if (inode_promote_inline(fs, &fd_inode) < 0){ // outgrew the inode, move the data to a block first
+                return 0;
+            }
+        }
+
+        uint8_t block_buff[BLOCK_SIZE_BYTES]; // a buffer for the current block we are writing to
+        size_t written = 0;
+        if (fd_inode.flags & FS_INODE_COMPRESSED){ // whole clusters instead of blocks
+            written = inode_cluster_write(fs, &fd_inode, position, (const uint8_t*)src, nbyte);
+        }
+        while (written < nbyte && !(fd_inode.flags & FS_INODE_COMPRESSED)){ // one block at a time, only the blocks the write touches get allocated
+            size_t block_offset = (position + written) % BLOCK_SIZE_BYTES;
+            size_t chunk = BLOCK_SIZE_BYTES - block_offset;
+            if (chunk > nbyte - written){
+                chunk = nbyte - written;
+            }
+            uint64_t fingerprint = 0;
+            if (fs->DedupIndex != NULL && chunk == BLOCK_SIZE_BYTES){ // a whole block, it may be stored already
+                int shared = inode_block_dedup(fs, &fd_inode, (position + written) / BLOCK_SIZE_BYTES, (const uint8_t*)src + written, &fingerprint);
+                if (shared < 0){ // out of space
+                    break;
+                }
+                if (shared > 0){
+                    written += chunk;
+                    continue;
+                }
+            }
+            bool fresh;
+            uint16_t block_id = inode_block_alloc(fs, &fd_inode, (position + written) / BLOCK_SIZE_BYTES, &fresh);
+            if (block_id != 0 && !fresh){ // copy-on-write if a clone shares the block
+                block_id = inode_block_private(fs, &fd_inode, (position + written) / BLOCK_SIZE_BYTES, block_id);
+            }
+            if (block_id == 0){ // out of space
+                break;
+            }
+            if (fresh){ // bytes of a new block the write does not cover must read back as zeros
+                memset(block_buff, '\0', BLOCK_SIZE_BYTES);
+            } else if (chunk < BLOCK_SIZE_BYTES){ // partial overwrite, keep the rest of the block
+                fs_block_read(fs, block_id, block_buff);
+            }
+            memcpy(block_buff + block_offset, (const uint8_t*)src + written, chunk);
+            fs_block_write(fs, block_id, block_buff);
+            if (fs->DedupIndex != NULL){ // later copies of these bytes can share the block
+                if (chunk < BLOCK_SIZE_BYTES){
+                    uint64_t start = fs_clock();
+                    fingerprint = block_fingerprint(block_buff);
+                    fs->DedupNanos += fs_clock() - start;
+                }
+                dedup_insert(fs, block_id, fingerprint);
+            }
+            written += chunk;
+        }
+
+        fd_set_position(&new_fd, position + written);
+        block_store_fd_write(fs->BlockStore_fd, fd, &new_fd);
+        if (position + written > fd_inode.fileSize){ // only writes past EOF grow the file
+            fd_inode.fileSize = position + written;
+        }
+        fd_inode.mtime = time(NULL);
+        inode_store(fs, new_fd.inodeNum, &fd_inode);
+		return written;
+    }
+    return -1;
+}
+
+/** Releases the blocks behind a range of the file, which then reads back as zeros
+      The file size does not change, parts of the range past EOF are ignored
+      Blocks only partly inside the range are kept, the bytes inside it are zeroed
+    \param fs The FS containing the file
+    \param fd The file to punch
+    \param offset Offset from BOF where the range starts
+    \param len Length of the range in bytes
+    \return 0 on success, < 0 on error
+*/
+int fs_punch_hole(FS_t *fs, int fd, off_t offset, off_t len){
+    if (fs == NULL || fd < 0 || fd >= number_fd || offset < 0 || len < 0 || !block_store_sub_test(fs->BlockStore_fd, fd)){
+        return -1;
+    }
+    fileDescriptor_t punch_fd;
+    block_store_fd_read(fs->BlockStore_fd, fd, &punch_fd);
+    inode_t inode;
+    inode_load(fs, punch_fd.inodeNum, &inode);
+    if (inode.flags & FS_INODE_COMPRESSED){ // a cluster's blocks do not hold its bytes one for one
+        return -1;
+    }
+
+    size_t start = offset;
+    size_t end = start + len;
+    if (end > inode.fileSize){
+        end = inode.fileSize;
+    }
+    if (start >= end){ // nothing inside the file to punch
+        return 0;
+    }
+
+    int result = 0;
+    if (inode.flags & FS_INODE_INLINE){
+        memset(inode.inlineData + start, 0, end - start);
+    } else {
+        uint8_t block_buff[BLOCK_SIZE_BYTES];
+        size_t position = start;
+        while (position < end){
+            size_t index = position / BLOCK_SIZE_BYTES;
+            size_t block_offset = position % BLOCK_SIZE_BYTES;
+            size_t chunk = BLOCK_SIZE_BYTES - block_offset;
+            if (chunk > end - position){
+                chunk = end - position;
+            }
+            if (chunk == BLOCK_SIZE_BYTES){ // whole block is inside the range, give it back
+                fs_block_free(fs, inode_block_clear(fs, &inode, index));
+                fs_block_free(fs, inode_extent_take(fs, &inode, index)); // reserved but never written
+            } else { // edge of the range, zero just the covered bytes
+                uint16_t block_id = inode_block_lookup(fs, &inode, index);
+                if (block_id != 0){
+                    block_id = inode_block_private(fs, &inode, index, block_id);
+                    if (block_id == 0){ // shared with a clone and no block left to copy it to
+                        result = -1;
+                        break;
+                    }
+                    fs_block_read(fs, block_id, block_buff);
+                    memset(block_buff + block_offset, 0, chunk);
+                    fs_block_write(fs, block_id, block_buff);
+                }
+            }
+            position += chunk;
+        }
+    }
+    inode.mtime = time(NULL);
+    inode_store(fs, punch_fd.inodeNum, &inode);
+    return result;
+}
+
+/** Reserves the blocks behind a range of the file ahead of the writes that will fill it
+      Every hole in the range gets a run of contiguous blocks, recorded as an unwritten extent in the inode
+      Once the extent descriptors run out the remaining holes are allocated and zeroed block by block
+    \param fs The FS containing the file
+    \param fd The file to reserve blocks for
+    \param offset Offset from BOF where the range starts
+    \param len Length of the range in bytes
+    \return 0 on success, < 0 on error or if the store ran out of blocks
+*/
+int fs_fallocate(FS_t *fs, int fd, off_t offset, off_t len){
+    if (fs == NULL || fd < 0 || fd >= number_fd || offset < 0 || len <= 0 || offset + len > FS_MAX_FILE_SIZE || !block_store_sub_test(fs->BlockStore_fd, fd)){
+        return -1;
+    }
+    fileDescriptor_t alloc_fd;
+    block_store_fd_read(fs->BlockStore_fd, fd, &alloc_fd);
+    inode_t inode;
+    inode_load(fs, alloc_fd.inodeNum, &inode);
+    if (inode.fileType != 'r' || (inode.flags & FS_INODE_COMPRESSED)){
+        return -1;
+    }
+
+    size_t end = offset + len;
+    if ((inode.flags & FS_INODE_INLINE) && end > FS_INLINE_DATA_MAX && inode_promote_inline(fs, &inode) < 0){
+        return -1;
+    }
+
+    int result = 0;
+    if (!(inode.flags & FS_INODE_INLINE)){ // an inline file that stays inline already has all its bytes
+        size_t index = offset / BLOCK_SIZE_BYTES;
+        size_t last = (end - 1) / BLOCK_SIZE_BYTES;
+        while (index <= last && result == 0){
+            if (inode_block_lookup(fs, &inode, index) != 0 || inode_extent_covers(&inode, index)){ // already backed
+                index++;
+                continue;
+            }
+            size_t hole = 1; // length of the hole starting at index, within the range
+            while (index + hole <= last && inode_block_lookup(fs, &inode, index + hole) == 0 && !inode_extent_covers(&inode, index + hole)){
+                hole++;
+            }
+            size_t got;
+            uint16_t start_block = fs_block_alloc_run(fs, hole, &got);
+            if (start_block == 0){ // store is full
+                result = -1;
+            } else if (inode_extent_add(&inode, index, start_block, got) == 0){
+                index += got;
+            } else { // no descriptor left, fall back to ordinary zeroed blocks
+                for (size_t i = 0; i < got; i++){
+                    fs_block_free(fs, start_block + i);
+                }
+                uint8_t zero_buff[BLOCK_SIZE_BYTES];
+                memset(zero_buff, 0, BLOCK_SIZE_BYTES);
+                for (; hole > 0 && result == 0; hole--, index++){
+                    bool fresh;
+                    uint16_t block_id = inode_block_alloc(fs, &inode, index, &fresh);
+                    if (block_id == 0){
+                        result = -1;
+                    } else {
+                        fs_block_write(fs, block_id, zero_buff);
+                    }
+                }
+            }
+        }
+    }
+    if (result == 0 && end > inode.fileSize){
+        if (inode.flags & FS_INODE_INLINE){ // bytes between the old EOF and end read back as zeros
+            memset(inode.inlineData + inode.fileSize, 0, end - inode.fileSize);
+        }
+        inode.fileSize = end;
+    }
+    inode.mtime = time(NULL);
+    inode_store(fs, alloc_fd.inodeNum, &inode);
+    return result;
+}
+
+/*
+    bool isValidFileName(const char *filename)
+    {
+        if(!filename || strlen(filename) == 0 || strlen(filename) > 127 || '/'==filename[0])
+        {
+            return false;
+        }
+
+        return true;
+    }
+*/
+
+void free_tokens(char** tokens, size_t token_count) {
+    for (size_t i = 0; i < token_count; i++){
+        free(tokens[i]);
+    }
+    free(tokens);
+}
+
+/** Looks name up among the entries of a directory
+    \param fs The FS containing the directory
+    \param dir The inode of the directory
+    \param name Name of the entry
+    \param entry Set to the index of the entry within the directory if it is found, may be NULL
+    \return inode number the entry links to, SIZE_MAX if there is no such entry
+*/
+size_t dir_entry_find(FS_t *fs, const inode_t *dir, const char *name, size_t *entry){
+    if (dir->fileType != 'd' || dir->vacantFile == 0){
+        return SIZE_MAX;
+    }
+    directoryFile_t directory[folder_number_entries];
+    uint8_t block_buff[BLOCK_SIZE_BYTES];
+    fs_block_read(fs, dir->directPointer[0], block_buff);
+    memcpy(directory, block_buff, sizeof(directory));
+    for (size_t i = 0; i < folder_number_entries; i++){
+        if (((dir->vacantFile >> i) & 1) == 1 && strncmp(directory[i].filename, name, FS_FNAME_MAX) == 0){
+            if (entry != NULL){
+                *entry = i;
+            }
+            return directory[i].inodeNumber;
+        }
+    }
+    return SIZE_MAX;
+}
+
+/** Adds an entry linking name to an inode to a directory
+    \param fs The FS containing the directory
+    \param dir_ID Inode number of the directory
+    \param name Name of the new entry
+    \param inode_ID Inode number the entry links to
+    \return 0 on success, < 0 if the name is taken, the directory is full or out of blocks
+*/
+int dir_entry_add(FS_t *fs, size_t dir_ID, const char *name, size_t inode_ID){
+    inode_t dir;
+    inode_load(fs, dir_ID, &dir);
+    if (dir.fileType != 'd' || dir_entry_find(fs, &dir, name, NULL) != SIZE_MAX){
+        return -1;
+    }
+    size_t entry = 0;
+    while (entry < folder_number_entries && ((dir.vacantFile >> entry) & 1) == 1){
+        entry++;
+    }
+    if (entry == folder_number_entries){ // directory is full
+        return -1;
+    }
+    uint8_t block_buff[BLOCK_SIZE_BYTES];
+    if (dir.directPointer[0] == 0){ // first entry of the directory, it gets its block now
+        dir.directPointer[0] = fs_block_alloc(fs);
+        if (dir.directPointer[0] == 0){
+            return -1;
+        }
+        memset(block_buff, 0, BLOCK_SIZE_BYTES);
+    } else {
+        fs_block_read(fs, dir.directPointer[0], block_buff);
+    }
+    directoryFile_t *directory = (directoryFile_t*)block_buff;
+    memset(directory[entry].filename, 0, FS_FNAME_MAX);
+    strncpy(directory[entry].filename, name, FS_FNAME_MAX - 1);
+    directory[entry].inodeNumber = inode_ID;
+    fs_block_write(fs, dir.directPointer[0], block_buff);
+
+    dir.vacantFile |= (uint32_t)1 << entry;
+    dir.mtime = time(NULL);
+    inode_store(fs, dir_ID, &dir);
+    return 0;
+}
+
+// drops entry number entry from a directory, the block of the directory is kept for later entries
+void dir_entry_remove(FS_t *fs, size_t dir_ID, size_t entry){
+    inode_t dir;
+    inode_load(fs, dir_ID, &dir);
+    uint8_t block_buff[BLOCK_SIZE_BYTES];
+    fs_block_read(fs, dir.directPointer[0], block_buff);
+    memset(((directoryFile_t*)block_buff)[entry].filename, 0, FS_FNAME_MAX);
+    fs_block_write(fs, dir.directPointer[0], block_buff);
+
+    dir.vacantFile &= ~((uint32_t)1 << entry);
+    dir.mtime = time(NULL);
+    inode_store(fs, dir_ID, &dir);
+}
+
+/** Resolves the first length characters of a path to the inode they name
+    \param fs The FS to search
+    \param dir_ID Inode number of the directory a relative path starts from, an absolute path starts from root
+    \param path The path, a trailing '/' is allowed
+    \param length Number of characters of path to use
+    \return inode number, SIZE_MAX if the path is malformed or some part of it does not exist
+*/
+size_t fs_path_walk(FS_t *fs, size_t dir_ID, const char *path, size_t length){
+    size_t inode_ID = dir_ID;
+    size_t position = 0;
+    if (length > 0 && path[0] == '/'){
+        inode_ID = 0; // root
+        position = 1;
+    }
+    while (position < length){
+        size_t name_length = 0;
+        while (position + name_length < length && path[position + name_length] != '/'){
+            name_length++;
+        }
+        if (name_length == 0 || name_length >= FS_FNAME_MAX){ // "//" or a name that could never have been created
+            return SIZE_MAX;
+        }
+        char name[FS_FNAME_MAX];
+        memcpy(name, path + position, name_length);
+        name[name_length] = '\0';
+
+        inode_t dir;
+        inode_load(fs, inode_ID, &dir);
+        inode_ID = dir_entry_find(fs, &dir, name, NULL);
+        if (inode_ID == SIZE_MAX){
+            return SIZE_MAX;
+        }
+        position += name_length + 1;
+    }
+    return inode_ID;
+}
+
+// resolves an absolute path to the inode it names, SIZE_MAX if it does not exist
+size_t fs_path_lookup(FS_t *fs, const char *path){
+    if (path[0] != '/'){
+        return SIZE_MAX;
+    }
+    return fs_path_walk(fs, 0, path, strlen(path));
+}
+
+/** Resolves the directory a path would live in
+    \param fs The FS to search
+    \param dir_ID Inode number of the directory a relative path starts from, an absolute path starts from root
+    \param path Path of a file, which need not exist
+    \param name Receives the last part of the path, FS_FNAME_MAX bytes
+    \return inode number of the parent directory, SIZE_MAX if it does not exist or path names no file (e.g. "/" or "dir/")
+*/
+size_t fs_path_parent_at(FS_t *fs, size_t dir_ID, const char *path, char *name){
+    const char *last = strrchr(path, '/');
+    const char *file_name = last == NULL ? path : last + 1;
+    if (strlen(file_name) == 0 || strlen(file_name) >= FS_FNAME_MAX){
+        return SIZE_MAX;
+    }
+    size_t parent_ID = dir_ID;
+    if (last == path){ // "/name"
+        parent_ID = 0;
+    } else if (last != NULL){
+        parent_ID = fs_path_walk(fs, dir_ID, path, last - path);
+    }
+    if (parent_ID == SIZE_MAX){
+        return SIZE_MAX;
+    }
+    inode_t parent;
+    inode_load(fs, parent_ID, &parent);
+    if (parent.fileType != 'd'){
+        return SIZE_MAX;
+    }
+    strcpy(name, file_name);
+    return parent_ID;
+}
+
+// like fs_path_parent_at, for an absolute path
+size_t fs_path_parent(FS_t *fs, const char *path, char *name){
+    if (path[0] != '/'){
+        return SIZE_MAX;
+    }
+    return fs_path_parent_at(fs, 0, path, name);
+}
+
+// releases an indirect block along with every block it points to, level 2 for a double indirect block
+void pointer_block_release(FS_t *fs, uint16_t table_id, int level){
+    if (table_id == 0){
+        return;
+    }
+    uint16_t ptr_buff[pointers_per_block];
+    fs_block_read(fs, table_id, ptr_buff);
+    for (size_t i = 0; i < pointers_per_block; i++){
+        if (level > 1){
+            pointer_block_release(fs, ptr_buff[i], level - 1);
+        } else {
+            fs_block_free(fs, ptr_buff[i]);
+        }
+    }
+    fs_block_free(fs, table_id);
+}
+
+/** Gives an inode whose last link is gone back to the inode table, with all of its blocks
+      Descriptors still open on the inode are closed
+    \param fs The FS containing the inode
+    \param inode_ID Inode number
+    \param inode The inode, as loaded
+*/
+void inode_release(FS_t *fs, size_t inode_ID, inode_t *inode){
+    if (!(inode->flags & FS_INODE_INLINE)){ // inline files have nothing but the inode
+        for (size_t i = 0; i < number_direct_pointers; i++){
+            fs_block_free(fs, inode->directPointer[i]);
+        }
+        pointer_block_release(fs, inode->indirectPointer[0], 1);
+        pointer_block_release(fs, inode->doubleIndirectPointer, 2);
+        inode_extents_release(fs, inode);
+    }
+    for (int fd = 0; fd < number_fd; fd++){
+        fileDescriptor_t file_descriptor;
+        if (block_store_sub_test(fs->BlockStore_fd, fd)){
+            block_store_fd_read(fs->BlockStore_fd, fd, &file_descriptor);
+            if (file_descriptor.inodeNum == inode_ID){
+                block_store_sub_release(fs->BlockStore_fd, fd);
+            }
+        }
+    }
+    fs_inode_free(fs, inode_ID);
+}
+
+/** Removes entry name from directory parent_ID, see fs_remove
+    \param fs The FS containing the directory
+    \param parent_ID Inode number of the directory
+    \param name Name of the entry
+    \return 0 on success, < 0 on error
+*/
+int dir_entry_unlink(FS_t *fs, size_t parent_ID, const char *name){
+    inode_t parent;
+    inode_load(fs, parent_ID, &parent);
+    size_t entry;
+    size_t inode_ID = dir_entry_find(fs, &parent, name, &entry);
+    if (inode_ID == SIZE_MAX){
+        return -1;
+    }
+    inode_t inode;
+    inode_load(fs, inode_ID, &inode);
+    if (inode.fileType == 'd' && inode.vacantFile != 0){ // still has contents, through any of its links
+        return -1;
+    }
+
+    dir_entry_remove(fs, parent_ID, entry);
+    if (inode.linkCount > 1){ // other links keep the file alive
+        inode_load(fs, inode_ID, &inode); // the entry may have been in the file itself (a directory linked into itself)
+        inode.linkCount--;
+        inode_store(fs, inode_ID, &inode);
+        return 0;
+    }
+    inode_release(fs, inode_ID, &inode);
+    return 0;
+}
+
+/** Deletes the specified file and closes all open descriptors to the file
+      Directories can only be removed when empty
+      Only the given link goes away while the file has others, its blocks are freed along with the last one
+    \param fs The FS containing the file
+    \param path Absolute path to file to remove
+    \return 0 on success, < 0 on error
+*/
+int fs_remove_op(FS_t *fs, const char *path) {
+    if (fs == NULL || path == NULL){
+        return -1;
+    }
+    char name[FS_FNAME_MAX];
+    size_t parent_ID = fs_path_parent(fs, path, name);
+    if (parent_ID == SIZE_MAX){
+        return -1;
+    }
+    return dir_entry_unlink(fs, parent_ID, name);
+}
+
+// sets up the inode of a file that is about to be created
+void inode_init(inode_t *inode, size_t inode_ID, file_t type){
+    memset(inode, 0, sizeof(inode_t));
+    inode->fileType = type == FS_REGULAR ? 'r' : 'd';
+    inode->flags = type == FS_REGULAR ? FS_INODE_INLINE : 0; // regular files start out inline
+    inode->inodeNumber = inode_ID;
+    inode->linkCount = 1;
+    inode->ctime = inode->mtime = time(NULL);
+}
+
+/** Opens a directory relative to an open one
+    \param dir The directory path is relative to
+    \param path Path of the directory to open, absolute paths start from root
+    \return The handle, NULL on error
+*/
+fs_dir_t *fs_opendirat(fs_dir_t *dir, const char *path){
+    if (dir == NULL || path == NULL){
+        return NULL;
+    }
+    size_t dir_ID = fs_path_walk(dir->fs, dir->inodeNumber, path, strlen(path));
+    if (dir_ID == SIZE_MAX){
+        return NULL;
+    }
+    return fs_dir_open(dir->fs, dir_ID);
+}
+
+/** Opens a file relative to an open directory
+    \param dir The directory path is relative to
+    \param path Path of the file to open, absolute paths start from root
+    \return file descriptor to the opened file, < 0 on error
+*/
+int fs_openat(fs_dir_t *dir, const char *path){
+    if (dir == NULL || path == NULL){
+        return -1;
+    }
+    size_t inode_ID = fs_path_walk(dir->fs, dir->inodeNumber, path, strlen(path));
+    if (inode_ID == SIZE_MAX){
+        return -1;
+    }
+    inode_t inode;
+    inode_load(dir->fs, inode_ID, &inode);
+    if (inode.fileType != 'r'){ // directories are opened with fs_opendir
+        return -1;
+    }
+    size_t fd = block_store_sub_allocate(dir->fs->BlockStore_fd);
+    if (fd >= number_fd){
+        return -1;
+    }
+    fileDescriptor_t file_descriptor;
+    memset(&file_descriptor, 0, sizeof(file_descriptor));
+    file_descriptor.inodeNum = inode_ID;
+    block_store_fd_write(dir->fs->BlockStore_fd, fd, &file_descriptor);
+    return fd;
+}
+
+/** Creates a file relative to an open directory
+    \param dir The directory path is relative to
+    \param path Path of the file to create, absolute paths start from root
+    \param type Type of file to create (regular/directory)
+    \return 0 on success, < 0 on failure
+*/
+int fs_createat(fs_dir_t *dir, const char *path, file_t type){
+    if (dir == NULL || path == NULL || (type != FS_REGULAR && type != FS_DIRECTORY)){
+        return -1;
+    }
+    char name[FS_FNAME_MAX];
+    size_t parent_ID = fs_path_parent_at(dir->fs, dir->inodeNumber, path, name);
+    if (parent_ID == SIZE_MAX){
+        return -1;
+    }
+    size_t inode_ID = fs_inode_alloc(dir->fs);
+    if (inode_ID == SIZE_MAX){
+        return -1;
+    }
+    if (dir_entry_add(dir->fs, parent_ID, name, inode_ID) < 0){ // name taken or directory full
+        fs_inode_free(dir->fs, inode_ID);
+        return -1;
+    }
+    inode_t inode;
+    inode_init(&inode, inode_ID, type);
+    inode_store(dir->fs, inode_ID, &inode);
+    return 0;
+}
+
+/** Removes a file relative to an open directory, see fs_remove
+    \param dir The directory path is relative to
+    \param path Path of the file to remove, absolute paths start from root
+    \return 0 on success, < 0 on error
+*/
+int fs_removeat(fs_dir_t *dir, const char *path){
+    if (dir == NULL || path == NULL){
+        return -1;
+    }
+    char name[FS_FNAME_MAX];
+    size_t parent_ID = fs_path_parent_at(dir->fs, dir->inodeNumber, path, name);
+    if (parent_ID == SIZE_MAX){
+        return -1;
+    }
+    return dir_entry_unlink(dir->fs, parent_ID, name);
+}
+
+/** Fills st with the fields of inode inode_ID, see fs_stat
+    \return 0 on success, < 0 if the inode is not in use
+*/
+int inode_stat(FS_t *fs, size_t inode_ID, fs_stat_t *st){
+    inode_t inode;
+    if (inode_ID >= number_inodes || !block_store_sub_test(fs->BlockStore_inode, inode_ID) || inode_load(fs, inode_ID, &inode) == 0){
+        return -1;
+    }
+    st->inodeNumber = inode_ID;
+    st->type = inode.fileType == 'd' ? FS_DIRECTORY : FS_REGULAR;
+    st->fileSize = inode.fileSize;
+    st->linkCount = inode.linkCount != 0 ? inode.linkCount : 1; // images from before link counts
+    st->mtime = inode.mtime;
+    st->ctime = inode.ctime;
+    return 0;
+}
+
+/** Fills st with the inode fields of the file at path
+      Only the inode is read, never the file's data blocks
+    \param fs The FS containing the file
+    \param path Absolute path to the file (regular or directory)
+    \param st Where to put the fields
+    \return 0 on success, < 0 on error
+*/
+int fs_stat(FS_t *fs, const char *path, fs_stat_t *st){
+    if (fs == NULL || path == NULL || st == NULL){
+        return -1;
+    }
+    size_t inode_ID = fs_path_lookup(fs, path);
+    if (inode_ID == SIZE_MAX){
+        return -1;
+    }
+    return inode_stat(fs, inode_ID, st);
+}
+
+/** Fills st with the inode fields of the file linked to the descriptor, see fs_stat
+    \param fs The FS containing the file
+    \param fd The open file
+    \param st Where to put the fields
+    \return 0 on success, < 0 on error
+*/
+int fs_fstat(FS_t *fs, int fd, fs_stat_t *st){
+    if (fs == NULL || fd < 0 || fd >= number_fd || st == NULL || !block_store_sub_test(fs->BlockStore_fd, fd)){
+        return -1;
+    }
+    fileDescriptor_t file_descriptor;
+    block_store_fd_read(fs->BlockStore_fd, fd, &file_descriptor);
+    return inode_stat(fs, file_descriptor.inodeNum, st);
+}
+
+/** Fills st with the usage of the volume
+      Free counts come from counters kept as blocks and inodes are allocated, nothing is scanned
+    \param fs The FS to report on
+    \param st Where to put the usage
+    \return 0 on success, < 0 on error
+*/
+int fs_statfs(FS_t *fs, fs_statfs_t *st){
+    if (fs == NULL || st == NULL){
+        return -1;
+    }
+    st->blockSize = BLOCK_SIZE_BYTES;
+    st->totalBlocks = BLOCK_STORE_AVAIL_BLOCKS;
+    st->freeBlocks = fs->FreeBlocks;
+    st->totalInodes = number_inodes;
+    st->freeInodes = fs->FreeInodes;
+    return 0;
+}
+
+/** Turns transparent compression on or off for an empty regular file
+      Only an empty file can switch, so a file's data is always either all in clusters or all in plain blocks
+    \param fs The FS containing the file
+    \param path Absolute path to the file
+    \param compressed true to compress the file's data, false to store it as is
+    \return 0 on success, < 0 on error or if the file is not empty
+*/
+int fs_set_compressed(FS_t *fs, const char *path, bool compressed){
+    if (fs == NULL || path == NULL){
+        return -1;
+    }
+    size_t inode_ID = fs_path_lookup(fs, path);
+    inode_t inode;
+    if (inode_ID == SIZE_MAX || inode_load(fs, inode_ID, &inode) == 0 || inode.fileType != 'r' || inode.fileSize != 0){
+        return -1;
+    }
+    if (compressed){
+        inode.flags = (inode.flags & ~FS_INODE_INLINE) | FS_INODE_COMPRESSED; // an empty inline file has nothing to move out
+        memset(inode.inlineData, 0, FS_INLINE_DATA_MAX);
+    } else {
+        inode.flags &= ~FS_INODE_COMPRESSED;
+    }
+    inode_store(fs, inode_ID, &inode);
+    return 0;
+}
+
+/** Moves the file from one location to the other
+      Moving files does not affect open descriptors
+    \param fs The FS containing the file
+    \param src Absolute path of the file to move
+    \param dst Absolute path to move the file to
+    \return 0 on success, < 0 on error
+
+    **************
+    **** NOTE ****
+    **************
+    A LOT OF THIS CODE FOR THIS FUNCTION
+    WAS TAKEN FROM PREVIOUS FUNCTIONS WHICH
+     JIMR GAVE US SOLUTIONS TO 
+     -> THUS A LOT IS COPY PASTED JIMR CODE
+*/
+int fs_move(FS_t *fs, const char *src, const char *dst) {
+    if (fs != NULL && src != NULL && strlen(src) != 0 && dst != NULL && strlen(dst)!=0) {
+        directoryFile_t * parent_data = (directoryFile_t *)calloc(1, BLOCK_SIZE_BYTES);
+        if (parent_data == NULL){
+            return -1;
+        }
+        size_t dir_counter = 0;
+        
+        inode_t * parent_inode = (inode_t *) calloc(1, sizeof(inode_t));	
+        if (parent_inode == NULL){
+            return -1; 
+        }
+        size_t parent_inode_ID = 0;	// start from the 1st inode, ie., the inode for root directory
+
+        size_t count = 0;
+        char**tokens;
+        tokens = tokenize(src, &count);
+        if(tokens == NULL) {
+            free_tokens(tokens, count);
+            return -1;
+        }
+        // let's check if the filenames are valid or not
+        /* SEG FAULT WITHOUT CHECK */
+        for(size_t n = 0; n < count; n++){	
+            if(isValidFileName(tokens[n]) == false){
+                free_tokens(tokens, count);
+                free(parent_inode);
+                free(parent_data);
+                return -1;
+            }
+        }
+
+        if (count == 0) { // root does not move
+            free_tokens(tokens, count);
+            free(parent_inode);
+            free(parent_data);
+            return -1;
+        }
+
+        /* 
+         *
+         * FOLLOWING CODE IS TAKEN FROM JIMRS 'fs_create()' FUNCTION SOLUTION 
+         *
+         */
+        for(size_t i = 0; i < count - 1; i++){
+            inode_load(fs, parent_inode_ID, parent_inode);
+            if(parent_inode->fileType == 'd'){ // in case file and dir has the same name
+                fs_block_read(fs, parent_inode->directPointer[0], parent_data);
+                int curr_dir = 0; 
+                while (curr_dir < folder_number_entries){
+                    if( ((parent_inode->vacantFile >> curr_dir) & 1) == 1 && strcmp((parent_data + curr_dir) -> filename, tokens[i]) == 0 ) {
+                        parent_inode_ID = (parent_data + curr_dir) -> inodeNumber;
+                        dir_counter++;
+                    }
+                    curr_dir++;
+                }
+            }					
+        }
+        inode_load(fs, parent_inode_ID, parent_inode);
+
+        
+        bool target_src = false;
+        int src_num = 0;
+        if (dir_counter == count - 1 && parent_inode->fileType == 'd') {
+            int flag = 0;
+            int curr_dir = 0;
+            while (curr_dir < folder_number_entries) {
+                if( ((parent_inode->vacantFile >> curr_dir) & 1) == 1) {
+                    fs_block_read(fs, parent_inode->directPointer[0], parent_data);
+                    flag = strcmp((parent_data + curr_dir) -> filename, tokens[count - 1]) == 0;
+                    if( strcmp((parent_data + curr_dir) -> filename, tokens[count - 1]) == 0) {
+                        target_src = flag;
+                        src_num = curr_dir;
+                    }
+                }
+                curr_dir++;
+            }
+        }
+
+
+        /* clear token values and tokenize dst string now */
+        free_tokens(tokens, count);
+        count = 0; 
+        tokens = tokenize(dst, &count);
+        if(tokens == NULL || count == 0){ // nothing moves onto root either
+            free_tokens(tokens, count);
+            free(parent_inode);
+            free(parent_data);
+            return -1;
+        }
+        for(size_t n = 0; n < count; n++){	
+            if(isValidFileName(tokens[n]) == false){
+                free_tokens(tokens, count);
+                free(parent_inode);
+                free(parent_data);
+                return -1;
+            }
+        }
+
+        
+        
+        directoryFile_t * dst_directory = (directoryFile_t *)calloc(1, BLOCK_SIZE_BYTES);
+        if (dst_directory == NULL){
+            return -1;
+        }
+        dir_counter = 0;
+
+        inode_t * dst_inode = (inode_t *) calloc(1, sizeof(inode_t));	
+        if (dst_inode == NULL){
+            return -1;
+        }
+        size_t dst_inode_id = 0;	
+
+        for(size_t i = 0; i < count - 1; i++) {
+            inode_load(fs, dst_inode_id, dst_inode);	// read out the parent inode
+            if(dst_inode->fileType == 'd'){
+                fs_block_read(fs, dst_inode->directPointer[0], dst_directory);
+                int curr_dir = 0;
+                while (curr_dir < folder_number_entries) {
+                    if( ((dst_inode->vacantFile >> curr_dir) & 1) == 1 && strcmp((dst_directory + curr_dir) -> filename, tokens[i]) == 0 ) {
+                        dst_inode_id = (dst_directory + curr_dir) -> inodeNumber;
+                        dir_counter++;
+                    }
+                    curr_dir++;            
+                }
+            }					
+        }
+        
+        // read out the parent inode
+        inode_load(fs, dst_inode_id, dst_inode);
+        bool dst_flag = true;
+        size_t src_inode_ID = target_src ? (parent_data + src_num)->inodeNumber : 0;
+
+        if(dir_counter == count - 1 && dst_inode->fileType == 'd') {
+            // same file or dir name in the same path is intolerable
+            memset(dst_directory, 0, BLOCK_SIZE_BYTES);
+            if (dst_inode->directPointer[0] != 0) {
+                fs_block_read(fs, dst_inode->directPointer[0], dst_directory);
+            }
+            dst_flag = false;
+            for (int curr_dir = 0; curr_dir < folder_number_entries; curr_dir++){
+                if( ((dst_inode->vacantFile >> curr_dir) & 1) == 1 && strcmp((dst_directory + curr_dir) -> filename, tokens[count - 1]) == 0 ){
+                    dst_flag = true;
+                }
+            }
+            // nor can a directory go into itself, or anything under it
+            if (strncmp(src, dst, strlen(src)) == 0 && dst[strlen(src)] == '/') {
+                dst_flag = true;
+            }
+            // and a full directory takes nothing more, unless the entry is only renamed in it
+            if (dst_inode_id != parent_inode_ID && (dst_inode->vacantFile & ((1u << folder_number_entries) - 1)) == ((1u << folder_number_entries) - 1)) {
+                dst_flag = true;
+            }
+            if (!dst_flag && target_src && dst_inode->directPointer[0] == 0){ // first entry of the directory, it gets its block now
+                dst_inode->directPointer[0] = fs_block_alloc(fs);
+                dst_flag = dst_inode->directPointer[0] == 0;
+            }
+        }
+
+        if(dst_flag == false && target_src == true) {
+            // both ends in one directory: work on the one copy, else the second write undoes the first
+            if (dst_inode_id == parent_inode_ID) {
+                free(dst_inode);
+                free(dst_directory);
+                dst_inode = parent_inode;
+                dst_directory = parent_data;
+            }
+            bitmap_t* src_store = bitmap_overlay(folder_number_entries, &(parent_inode->vacantFile));
+            bitmap_reset(src_store, src_num);
+            bitmap_destroy(src_store);
+            memset((parent_data + src_num)->filename,0,127);
+            fs_block_write(fs, parent_inode->directPointer[0],parent_data);
+            inode_store(fs, parent_inode_ID, parent_inode);
+
+            bitmap_t* dst_store =bitmap_overlay(folder_number_entries,&(dst_inode->vacantFile));
+            size_t temp_ffz = bitmap_ffz(dst_store);
+            bitmap_set(dst_store, temp_ffz);
+            bitmap_destroy(dst_store);
+            (dst_directory + temp_ffz)->inodeNumber = src_inode_ID;
+            strcpy((dst_directory + temp_ffz)->filename, tokens[count - 1]);
+            fs_block_write(fs, dst_inode->directPointer[0], dst_directory);
+            inode_store(fs, dst_inode_id, dst_inode);
+            if (dst_inode != parent_inode) {
+                free(dst_inode);
+                free(dst_directory);
+            }
+            free_tokens(tokens, count);
+            free(parent_inode);	
+            free(parent_data);
+            return 0;
+        }
+        free(dst_inode);
+        free(dst_directory);
+        free_tokens(tokens, count);
+        free(parent_inode);	
+        free(parent_data);
+    }
+    return -1;
+}
+
+
+// a directory as fs_batch sees it, changes pile up here until the batch is done
+typedef struct {
+    inode_t inode;
+    uint8_t block[BLOCK_SIZE_BYTES];    // its entries, as directoryFile_t
+    bool dirty;
+} batch_dir_t;
+
+typedef struct {
+    FS_t *fs;
+    batch_dir_t *dirs[number_inodes];   // directories read in so far, by inode number
+    const char *parent_path;            // the parent resolved last, reused while operations stay in it
+    size_t parent_length;
+    size_t parent_ID;
+} batch_t;
+
+// the directory dir_ID, read in the first time the batch touches it; NULL if it is not a directory
+batch_dir_t *batch_dir_get(batch_t *batch, size_t dir_ID){
+    if (batch->dirs[dir_ID] == NULL){
+        batch_dir_t *dir = (batch_dir_t*)calloc(1, sizeof(batch_dir_t));
+        if (dir == NULL){
+            return NULL;
+        }
+        inode_load(batch->fs, dir_ID, &dir->inode);
+        if (dir->inode.fileType != 'd'){
+            free(dir);
+            return NULL;
+        }
+        if (dir->inode.directPointer[0] != 0){
+            fs_block_read(batch->fs, dir->inode.directPointer[0], dir->block);
+        }
+        batch->dirs[dir_ID] = dir;
+    }
+    return batch->dirs[dir_ID];
+}
+
+// index of entry name in a directory of the batch, SIZE_MAX if there is none
+size_t batch_entry_find(const batch_dir_t *dir, const char *name){
+    const directoryFile_t *entries = (const directoryFile_t*)dir->block;
+    for (size_t i = 0; i < folder_number_entries; i++){
+        if (((dir->inode.vacantFile >> i) & 1) == 1 && strncmp(entries[i].filename, name, FS_FNAME_MAX) == 0){
+            return i;
+        }
+    }
+    return SIZE_MAX;
+}
+
+/** Resolves the directory a path would live in, seeing the changes the batch has made so far
+    \param batch The batch
+    \param path Absolute path of a file, which need not exist
+    \param name Receives the last part of the path, FS_FNAME_MAX bytes
+    \param parent_ID Set to the inode number of the directory
+    \return the directory, NULL if it does not exist or path names no file
+*/
+batch_dir_t *batch_parent(batch_t *batch, const char *path, char *name, size_t *parent_ID){
+    const char *last = strrchr(path, '/');
+    if (last == NULL || path[0] != '/' || strlen(last + 1) == 0 || strlen(last + 1) >= FS_FNAME_MAX){
+        return NULL;
+    }
+    size_t length = last - path;
+    if (batch->parent_path == NULL || length != batch->parent_length || strncmp(path, batch->parent_path, length) != 0){
+        size_t dir_ID = 0; // root
+        size_t position = 1;
+        while (position < length){ // walk the batch's view of each directory on the way
+            size_t name_length = 0;
+            while (position + name_length < length && path[position + name_length] != '/'){
+                name_length++;
+            }
+            batch_dir_t *dir = batch_dir_get(batch, dir_ID);
+            if (name_length == 0 || name_length >= FS_FNAME_MAX || dir == NULL){
+                return NULL;
+            }
+            char part[FS_FNAME_MAX];
+            memcpy(part, path + position, name_length);
+            part[name_length] = '\0';
+            size_t entry = batch_entry_find(dir, part);
+            if (entry == SIZE_MAX){
+                return NULL;
+            }
+            dir_ID = ((directoryFile_t*)dir->block)[entry].inodeNumber;
+            position += name_length + 1;
+        }
+        batch->parent_path = path;
+        batch->parent_length = length;
+        batch->parent_ID = dir_ID;
+    }
+    strcpy(name, last + 1);
+    *parent_ID = batch->parent_ID;
+    return batch_dir_get(batch, batch->parent_ID);
+}
+
+// adds an entry to a directory of the batch, < 0 if the directory is full or out of blocks
+int batch_entry_add(batch_t *batch, batch_dir_t *dir, const char *name, size_t inode_ID){
+    size_t entry = 0;
+    while (entry < folder_number_entries && ((dir->inode.vacantFile >> entry) & 1) == 1){
+        entry++;
+    }
+    if (entry == folder_number_entries){
+        return -1;
+    }
+    if (dir->inode.directPointer[0] == 0){ // first entry of the directory, it gets its block now
+        dir->inode.directPointer[0] = fs_block_alloc(batch->fs);
+        if (dir->inode.directPointer[0] == 0){
+            return -1;
+        }
+        memset(dir->block, 0, BLOCK_SIZE_BYTES);
+    }
+    directoryFile_t *entries = (directoryFile_t*)dir->block;
+    memset(entries[entry].filename, 0, FS_FNAME_MAX);
+    strcpy(entries[entry].filename, name);
+    entries[entry].inodeNumber = inode_ID;
+    dir->inode.vacantFile |= (uint32_t)1 << entry;
+    dir->dirty = true;
+    return 0;
+}
+
+// drops entry number entry from a directory of the batch
+void batch_entry_remove(batch_dir_t *dir, size_t entry){
+    memset(((directoryFile_t*)dir->block)[entry].filename, 0, FS_FNAME_MAX);
+    dir->inode.vacantFile &= ~((uint32_t)1 << entry);
+    dir->dirty = true;
+}
+
+// FS_BATCH_CREATE, see fs_create
+int batch_create(batch_t *batch, const char *path, file_t type){
+    if (type != FS_REGULAR && type != FS_DIRECTORY){
+        return -1;
+    }
+    char name[FS_FNAME_MAX];
+    size_t parent_ID;
+    batch_dir_t *parent = batch_parent(batch, path, name, &parent_ID);
+    if (parent == NULL || batch_entry_find(parent, name) != SIZE_MAX){
+        return -1;
+    }
+    size_t inode_ID = fs_inode_alloc(batch->fs);
+    if (inode_ID == SIZE_MAX){
+        return -1;
+    }
+    inode_t inode;
+    inode_init(&inode, inode_ID, type);
+    if (batch_entry_add(batch, parent, name, inode_ID) < 0){
+        fs_inode_free(batch->fs, inode_ID);
+        return -1;
+    }
+    inode_store(batch->fs, inode_ID, &inode); // a brand new inode is written once anyway
+    return 0;
+}
+
+// FS_BATCH_REMOVE, see fs_remove
+int batch_remove(batch_t *batch, const char *path){
+    char name[FS_FNAME_MAX];
+    size_t parent_ID;
+    batch_dir_t *parent = batch_parent(batch, path, name, &parent_ID);
+    size_t entry = parent == NULL ? SIZE_MAX : batch_entry_find(parent, name);
+    if (entry == SIZE_MAX){
+        return -1;
+    }
+    size_t inode_ID = ((directoryFile_t*)parent->block)[entry].inodeNumber;
+    batch_dir_t *target = batch->dirs[inode_ID]; // a directory the batch already has changes for
+    inode_t inode;
+    if (target != NULL){
+        inode = target->inode;
+    } else {
+        inode_load(batch->fs, inode_ID, &inode);
+    }
+    if (inode.fileType == 'd' && inode.vacantFile != 0){
+        return -1;
+    }
+
+    batch_entry_remove(parent, entry);
+    if (inode.linkCount > 1){
+        if (target != NULL){
+            target->inode.linkCount--;
+            target->dirty = true;
+        } else {
+            inode.linkCount--;
+            inode_store(batch->fs, inode_ID, &inode);
+        }
+        return 0;
+    }
+    if (target != NULL){ // it is going away, nothing to write back
+        free(target);
+        batch->dirs[inode_ID] = NULL;
+    }
+    if (inode.fileType == 'd'){ // the parent cached for it may have been this very directory
+        batch->parent_path = NULL;
+    }
+    inode_release(batch->fs, inode_ID, &inode);
+    return 0;
+}
+
+// FS_BATCH_MOVE, see fs_move
+int batch_move(batch_t *batch, const char *src, const char *dst){
+    size_t src_length = strlen(src);
+    if (strncmp(src, dst, src_length) == 0 && dst[src_length] == '/'){ // a directory can't move into itself
+        return -1;
+    }
+    char name[FS_FNAME_MAX];
+    size_t src_parent_ID, dst_parent_ID;
+    batch_dir_t *src_parent = batch_parent(batch, src, name, &src_parent_ID);
+    size_t entry = src_parent == NULL ? SIZE_MAX : batch_entry_find(src_parent, name);
+    if (entry == SIZE_MAX){
+        return -1;
+    }
+    size_t inode_ID = ((directoryFile_t*)src_parent->block)[entry].inodeNumber;
+    batch_dir_t *dst_parent = batch_parent(batch, dst, name, &dst_parent_ID);
+    if (dst_parent == NULL || batch_entry_find(dst_parent, name) != SIZE_MAX){
+        return -1;
+    }
+    if (dst_parent == src_parent){ // a rename, the entry stays where it is
+        directoryFile_t *entries = (directoryFile_t*)src_parent->block;
+        memset(entries[entry].filename, 0, FS_FNAME_MAX);
+        strcpy(entries[entry].filename, name);
+        src_parent->dirty = true;
+    } else {
+        if (batch_entry_add(batch, dst_parent, name, inode_ID) < 0){
+            return -1;
+        }
+        batch_entry_remove(src_parent, entry);
+    }
+    batch->parent_path = NULL; // paths through what moved now lead elsewhere
+    return 0;
+}
+
+/** Applies a list of create, remove and move operations, in order
+      Each directory touched is read once and written back once, when the whole batch is done
+      Runs of operations under the same directory resolve its path once
+      Operations fail on their own (see result), the others still go through
+    \param fs The FS to operate on
+    \param ops The operations, result of each is filled in
+    \param count Number of operations
+    \return number of operations that failed, < 0 on error
+*/
+int fs_batch(FS_t *fs, fs_batch_entry_t *ops, size_t count){
+    if (fs == NULL || (ops == NULL && count > 0)){
+        return -1;
+    }
+    batch_t *batch = (batch_t*)calloc(1, sizeof(batch_t));
+    if (batch == NULL){
+        return -1;
+    }
+    batch->fs = fs;
+
+    int failed = 0;
+    for (size_t i = 0; i < count; i++){
+        fs_batch_entry_t *op = &ops[i];
+        op->result = -1;
+        if (op->path != NULL && op->op == FS_BATCH_CREATE){
+            op->result = batch_create(batch, op->path, op->type);
+        } else if (op->path != NULL && op->op == FS_BATCH_REMOVE){
+            op->result = batch_remove(batch, op->path);
+        } else if (op->path != NULL && op->dst != NULL && op->op == FS_BATCH_MOVE){
+            op->result = batch_move(batch, op->path, op->dst);
+        }
+        if (op->result < 0){
+            failed++;
+        }
+    }
+
+    time_t now = time(NULL);
+    for (size_t dir_ID = 0; dir_ID < number_inodes; dir_ID++){ // write back every directory that changed, once
+        batch_dir_t *dir = batch->dirs[dir_ID];
+        if (dir != NULL && dir->dirty){
+            dir->inode.mtime = now;
+            if (dir->inode.directPointer[0] != 0){
+                fs_block_write(fs, dir->inode.directPointer[0], dir->block);
+            }
+            inode_store(fs, dir_ID, &dir->inode);
+        }
+        free(dir);
+    }
+    free(batch);
+    return failed;
+}
+
+/** Link the dst with the src
+     dst and src should be in the same File type, say, both are files or both are directories
+     Both names then share one inode and its blocks, the file lives on until its last link is removed
+    \param fs The F18FS containing the file
+    \param src Absolute path of the source file
+    \param dst Absolute path to link the source to
+    \return 0 on success, < 0 on error
+*/
+int fs_link(FS_t *fs, const char *src, const char *dst){
+    if (fs == NULL || src == NULL || dst == NULL){
+        return -1;
+    }
+    size_t inode_ID = fs_path_lookup(fs, src);
+    char name[FS_FNAME_MAX];
+    size_t parent_ID = fs_path_parent(fs, dst, name);
+    if (inode_ID == SIZE_MAX || parent_ID == SIZE_MAX){
+        return -1;
+    }
+    inode_t inode;
+    inode_load(fs, inode_ID, &inode);
+    if (inode.linkCount >= UINT16_MAX){ // as many links as the inode can count
+        return -1;
+    }
+    if (dir_entry_add(fs, parent_ID, name, inode_ID) < 0){
+        return -1;
+    }
+    inode_load(fs, inode_ID, &inode); // dst may sit in the very directory being linked
+    inode.linkCount = (inode.linkCount == 0 ? 1 : inode.linkCount) + 1; // images made before link counts were kept hold 0
+    inode_store(fs, inode_ID, &inode);
+    return 0;
+}
+
+// the per block reference counts, set up in the image the first time a block gets shared
+uint8_t *fs_block_refs(FS_t *fs){
+    if (fs->BlockRefs == NULL){
+        size_t got;
+        uint16_t start_block = fs_block_alloc_run(fs, number_ref_blocks, &got);
+        if (got != number_ref_blocks){ // needs one contiguous run
+            for (size_t i = 0; i < got; i++){
+                fs_block_free(fs, start_block + i);
+            }
+            return NULL;
+        }
+        fs->BlockRefs = block_store_Data_location(fs->BlockStore_whole) + start_block * BLOCK_SIZE_BYTES;
+        memset(fs->BlockRefs, 0, number_ref_blocks * BLOCK_SIZE_BYTES); // every block has a single owner so far
+
+        inode_t root_inode;
+        inode_load(fs, 0, &root_inode);
+        root_inode.extents[0].logicalBlock = 0;
+        root_inode.extents[0].startBlock = start_block;
+        root_inode.extents[0].blockCount = number_ref_blocks;
+        inode_store(fs, 0, &root_inode);
+    }
+    return fs->BlockRefs;
+}
+
+// one more file uses block_id, returns the block the new user should point at (a copy once the count is maxed out), 0 on error
+uint16_t fs_block_share(FS_t *fs, uint16_t block_id){
+    if (block_id == 0){ // holes stay holes
+        return 0;
+    }
+    uint8_t *refs = fs_block_refs(fs);
+    if (refs != NULL && refs[block_id] < UINT8_MAX){
+        refs[block_id]++;
+        return block_id;
+    }
+    uint16_t copy_id = fs_block_alloc(fs);
+    if (copy_id != 0){
+        uint8_t block_buff[BLOCK_SIZE_BYTES];
+        fs_block_read(fs, block_id, block_buff);
+        fs_block_write(fs, copy_id, block_buff);
+    }
+    return copy_id;
+}
+
+/** Turns block deduplication on or off for the whole volume
+      The index takes one run of number_dedup_blocks blocks, recorded in root's second extent next to the reference counts in its first
+    \param fs The FS to set up
+    \param enable true to deduplicate from now on
+    \return 0 on success, < 0 on error or if the store has no room for the index
+*/
+int fs_set_dedup(FS_t *fs, bool enable){
+    if (fs == NULL){
+        return -1;
+    }
+    if (enable == (fs->DedupIndex != NULL)){ // nothing to change
+        return 0;
+    }
+    inode_t root_inode;
+    if (!enable){
+        inode_load(fs, 0, &root_inode);
+        for (size_t i = 0; i < number_dedup_blocks; i++){
+            fs_block_free(fs, root_inode.extents[1].startBlock + i);
+        }
+        bitmap_destroy(fs->DedupValid);
+        fs->DedupValid = NULL;
+        fs->DedupIndex = NULL;
+        memset(&root_inode.extents[1], 0, sizeof(extent_t));
+        root_inode.flags &= ~FS_INODE_DEDUP;
+        inode_store(fs, 0, &root_inode);
+        return 0;
+    }
+    if (fs_block_refs(fs) == NULL){ // shared blocks need their counts
+        return -1;
+    }
+    inode_load(fs, 0, &root_inode); // after fs_block_refs, which may have just set up the first extent
+    size_t got;
+    uint16_t start_block = fs_block_alloc_run(fs, number_dedup_blocks, &got);
+    if (got != number_dedup_blocks){ // needs one contiguous run
+        for (size_t i = 0; i < got; i++){
+            fs_block_free(fs, start_block + i);
+        }
+        return -1;
+    }
+    memset(block_store_Data_location(fs->BlockStore_whole) + start_block * BLOCK_SIZE_BYTES, 0, number_dedup_blocks * BLOCK_SIZE_BYTES);
+    fs_dedup_attach(fs, start_block);
+    if (fs->DedupIndex == NULL){
+        for (size_t i = 0; i < number_dedup_blocks; i++){
+            fs_block_free(fs, start_block + i);
+        }
+        return -1;
+    }
+    root_inode.extents[1].logicalBlock = 0;
+    root_inode.extents[1].startBlock = start_block;
+    root_inode.extents[1].blockCount = number_dedup_blocks;
+    root_inode.flags |= FS_INODE_DEDUP;
+    inode_store(fs, 0, &root_inode);
+    return 0;
+}
+
+/** Fills stats with what deduplication has done since the FS was mounted
+    \param fs The FS to report on
+    \param stats Where to put the counts
+    \return 0 on success, < 0 on error
+*/
+int fs_dedup_stats(FS_t *fs, fs_dedup_t *stats){
+    if (fs == NULL || stats == NULL){
+        return -1;
+    }
+    memset(stats, 0, sizeof(fs_dedup_t));
+    stats->blocksHashed = fs->DedupHashed;
+    stats->blocksShared = fs->DedupShared;
+    size_t stored = fs->DedupHashed - fs->DedupShared; // blocks that took one of their own
+    stats->ratio = fs->DedupHashed == 0 ? 1.0 : (double)fs->DedupHashed / (stored > 0 ? stored : 1);
+    stats->hashNanos = fs->DedupHashed == 0 ? 0.0 : (double)fs->DedupNanos / fs->DedupHashed;
+    for (size_t block = 0; fs->BlockRefs != NULL && block < BLOCK_STORE_NUM_BLOCKS; block++){
+        stats->sharedBlocks += fs->BlockRefs[block] > 0;
+    }
+    return 0;
+}
+
+#if fs_stats
+// the public operations time their _op, see fs_get_stats
+int fs_create(FS_t *fs, const char *path, file_t type){
+    uint64_t start = fs_clock();
+    int result = fs_create_op(fs, path, type);
+    fs_stats_record(fs, FS_OP_CREATE, start, result < 0, 0);
+    return result;
+}
+
+int fs_open(FS_t *fs, const char *path){
+    uint64_t start = fs_clock();
+    int fd = fs_open_op(fs, path);
+    fs_stats_record(fs, FS_OP_OPEN, start, fd < 0, 0);
+    return fd;
+}
+
+int fs_close(FS_t *fs, int fd){
+    uint64_t start = fs_clock();
+    int result = fs_close_op(fs, fd);
+    fs_stats_record(fs, FS_OP_CLOSE, start, result < 0, 0);
+    return result;
+}
+
+off_t fs_seek(FS_t *fs, int fd, off_t offset, seek_t whence){
+    uint64_t start = fs_clock();
+    off_t position = fs_seek_op(fs, fd, offset, whence);
+    fs_stats_record(fs, FS_OP_SEEK, start, position < 0, 0);
+    return position;
+}
+
+ssize_t fs_read(FS_t *fs, int fd, void *dst, size_t nbyte){
+    uint64_t start = fs_clock();
+    ssize_t read = fs_read_op(fs, fd, dst, nbyte);
+    fs_stats_record(fs, FS_OP_READ, start, read < 0, read > 0 ? (size_t)read : 0);
+    return read;
+}
+
+ssize_t fs_write(FS_t *fs, int fd, const void *src, size_t nbyte){
+    uint64_t start = fs_clock();
+    ssize_t written = fs_write_op(fs, fd, src, nbyte);
+    fs_stats_record(fs, FS_OP_WRITE, start, written < 0, written > 0 ? (size_t)written : 0);
+    return written;
+}
+
+int fs_remove(FS_t *fs, const char *path){
+    uint64_t start = fs_clock();
+    int result = fs_remove_op(fs, path);
+    fs_stats_record(fs, FS_OP_REMOVE, start, result < 0, 0);
+    return result;
+}
+#endif
+
+/** Fills stats with per-operation counts and latencies and the cache hit ratios since the FS was mounted
+    \param fs The FS to report on
+    \param stats Where to put the counts
+    \return 0 on success, < 0 on error
+*/
+int fs_get_stats(FS_t *fs, fs_stats_t *stats){
+    if (fs == NULL || stats == NULL){
+        return -1;
+    }
+    memset(stats, 0, sizeof(fs_stats_t));
+    for (size_t op = 0; fs->Stats != NULL && op < FS_OP_COUNT; op++){
+        fs_op_stats_t *from = &fs->Stats[op], *to = &stats->ops[op];
+        to->calls = __atomic_load_n(&from->calls, __ATOMIC_RELAXED);
+        to->errors = __atomic_load_n(&from->errors, __ATOMIC_RELAXED);
+        to->bytes = __atomic_load_n(&from->bytes, __ATOMIC_RELAXED);
+        to->totalNanos = __atomic_load_n(&from->totalNanos, __ATOMIC_RELAXED);
+        to->minNanos = __atomic_load_n(&from->minNanos, __ATOMIC_RELAXED);
+        to->maxNanos = __atomic_load_n(&from->maxNanos, __ATOMIC_RELAXED);
+        for (size_t bucket = 0; bucket < fs_stats_buckets; bucket++){
+            to->histogram[bucket] = __atomic_load_n(&from->histogram[bucket], __ATOMIC_RELAXED);
+        }
+    }
+    stats->enabled = fs->Stats != NULL;
+    stats->clusterHits = fs->ClusterHits;
+    stats->clusterMisses = fs->ClusterMisses;
+    size_t lookups = fs->ClusterHits + fs->ClusterMisses;
+    stats->clusterHitRatio = lookups == 0 ? 0.0 : (double)fs->ClusterHits / lookups;
+    stats->dedupHashed = fs->DedupHashed;
+    stats->dedupShared = fs->DedupShared;
+    stats->dedupHitRatio = fs->DedupHashed == 0 ? 0.0 : (double)fs->DedupShared / fs->DedupHashed;
+    return 0;
+}
+
+// highest latency in ns that lands in histogram bucket bucket, see fs_stats_bucket
+uint64_t fs_stats_bucket_top(size_t bucket){
+    if (bucket < (1u << fs_stats_sub_bits)){
+        return bucket;
+    }
+    unsigned shift = (bucket >> fs_stats_sub_bits) - 1;
+    uint64_t low = ((uint64_t)(1u << fs_stats_sub_bits) + (bucket & ((1u << fs_stats_sub_bits) - 1))) << shift;
+    return low + ((uint64_t)1 << shift) - 1;
+}
+
+/** Reads a latency percentile off an operation's histogram, to within the width of a bucket
+    \param op The operation's counts, from fs_get_stats
+    \param percentile Share of calls in percent, e.g. 99.9
+    \return The latency in ns no more than that share of calls took longer than, 0 if there were no calls
+*/
+uint64_t fs_stats_percentile(const fs_op_stats_t *op, double percentile){
+    if (op == NULL || op->calls == 0){
+        return 0;
+    }
+    double wanted = percentile < 0 ? 0 : percentile > 100 ? op->calls : percentile / 100 * op->calls;
+    uint64_t rank = (uint64_t)wanted + ((uint64_t)wanted < wanted); // calls at or below the answer, rounded up
+    rank = rank == 0 ? 1 : rank;
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < fs_stats_buckets; bucket++){
+        seen += op->histogram[bucket];
+        if (seen >= rank){
+            uint64_t top = fs_stats_bucket_top(bucket);
+            return top < op->maxNanos ? top : op->maxNanos; // no call took longer than the slowest one
+        }
+    }
+    return op->maxNanos;
+}
+
+// names of the operations in fs_stats_json, in fs_op_t order
+static const char *const fs_op_names[FS_OP_COUNT] = {
+    "create", "open", "close", "seek", "read", "write", "remove", "block_read", "block_write"
+};
+
+/** Writes stats out as one JSON object
+    \param stats The counts to write, from fs_get_stats
+    \param out Where to write them
+    \return 0 on success, < 0 on error
+*/
+int fs_stats_json(const fs_stats_t *stats, FILE *out){
+    if (stats == NULL || out == NULL){
+        return -1;
+    }
+    fprintf(out, "{\"enabled\": %s, \"ops\": {", stats->enabled ? "true" : "false");
+    for (size_t op = 0; op < FS_OP_COUNT; op++){
+        const fs_op_stats_t *counts = &stats->ops[op];
+        fprintf(out, "%s\n  \"%s\": {\"calls\": %" PRIu64 ", \"errors\": %" PRIu64 ", \"bytes\": %" PRIu64
+                ", \"total_ns\": %" PRIu64 ", \"min_ns\": %" PRIu64 ", \"max_ns\": %" PRIu64 ", \"mean_ns\": %.1f",
+                op == 0 ? "" : ",", fs_op_names[op], counts->calls, counts->errors, counts->bytes, counts->totalNanos,
+                counts->minNanos, counts->maxNanos, counts->calls == 0 ? 0.0 : (double)counts->totalNanos / counts->calls);
+        fprintf(out, ", \"p50_ns\": %" PRIu64 ", \"p90_ns\": %" PRIu64 ", \"p99_ns\": %" PRIu64 ", \"p999_ns\": %" PRIu64 ", \"histogram\": [",
+                fs_stats_percentile(counts, 50), fs_stats_percentile(counts, 90), fs_stats_percentile(counts, 99), fs_stats_percentile(counts, 99.9));
+        bool first = true;
+        for (size_t bucket = 0; bucket < fs_stats_buckets; bucket++){
+            if (counts->histogram[bucket] != 0){
+                fprintf(out, "%s[%" PRIu64 ", %" PRIu64 "]", first ? "" : ", ", fs_stats_bucket_top(bucket), counts->histogram[bucket]);
+                first = false;
+            }
+        }
+        fprintf(out, "]}");
+    }
+    fprintf(out, "\n  },\n  \"cluster_cache\": {\"hits\": %zu, \"misses\": %zu, \"hit_ratio\": %.4f},\n"
+            "  \"dedup\": {\"hashed\": %zu, \"shared\": %zu, \"hit_ratio\": %.4f}\n}\n",
+            stats->clusterHits, stats->clusterMisses, stats->clusterHitRatio, stats->dedupHashed, stats->dedupShared, stats->dedupHitRatio);
+    return ferror(out) ? -1 : 0;
+}
+
+/** Starts or stops logging the FS's block calls, in the trace format of the a4 block store (see fs_trace_record)
+    \param fs The FS to trace
+    \param out Where the trace goes, left open; NULL to stop
+    \return 0 on success, < 0 on error
+*/
+int fs_trace(FS_t *fs, FILE *out){
+    if (fs == NULL){
+        return -1;
+    }
+    if (fs->Trace != NULL){ // finish the trace being made
+        fs_trace_record(fs, FS_TRACE_CLOSE, true, fs_clock(), 0);
+        fflush(fs->Trace);
+        fs->Trace = NULL;
+    }
+    if (out == NULL){
+        return 0;
+    }
+    if (fwrite(FS_TRACE_MAGIC, 1, 4, out) != 4){
+        return -1;
+    }
+    fs->TraceEpoch = fs_clock();
+    fs->TraceLast = 0;
+    fs->Trace = out;
+    fs_trace_record(fs, FS_TRACE_OPEN, true, fs->TraceEpoch, 0); // a replay sets up a store of the same geometry
+    return 0;
+}
+
+/** Copies an indirect block for a clone, sharing the blocks it points to
+    \param fs The FS containing the file
+    \param table_id The indirect block to copy, 0 if the file has none
+    \param level 1 for an indirect block, 2 for a double indirect block
+    \param copy_id Set to the copy, which the caller owns even on error (0 if table_id is 0)
+    \return 0 on success, < 0 if the store ran out of blocks
+*/
+int pointer_block_clone(FS_t *fs, uint16_t table_id, int level, uint16_t *copy_id){
+    *copy_id = 0;
+    if (table_id == 0){
+        return 0;
+    }
+    uint16_t ptr_buff[pointers_per_block];
+    uint16_t copy_buff[pointers_per_block];
+    memset(copy_buff, 0, BLOCK_SIZE_BYTES);
+    *copy_id = fs_block_alloc(fs);
+    if (*copy_id == 0){
+        return -1;
+    }
+    fs_block_read(fs, table_id, ptr_buff);
+    int result = 0;
+    for (size_t i = 0; i < pointers_per_block && result == 0; i++){
+        if (level > 1){
+            result = pointer_block_clone(fs, ptr_buff[i], level - 1, &copy_buff[i]);
+        } else {
+            copy_buff[i] = fs_block_share(fs, ptr_buff[i]);
+            if (ptr_buff[i] != 0 && copy_buff[i] == 0){
+                result = -1;
+            }
+        }
+    }
+    fs_block_write(fs, *copy_id, copy_buff); // even a partial copy, so releasing it drops what was shared
+    return result;
+}
+
+/** Makes a new inode that is a copy of inode_ID, not linked from anywhere yet
+      A regular file shares its data blocks with the copy, a directory is copied empty
+    \param fs The FS containing the inode
+    \param inode_ID Inode number to copy
+    \return inode number of the copy (link count 1), SIZE_MAX on error
+*/
+size_t inode_clone(FS_t *fs, size_t inode_ID){
+    size_t clone_ID = fs_inode_alloc(fs);
+    if (clone_ID == SIZE_MAX){
+        return SIZE_MAX;
+    }
+    inode_t clone;
+    inode_load(fs, inode_ID, &clone);
+    clone.inodeNumber = clone_ID;
+    clone.linkCount = 1;
+    clone.ctime = time(NULL);
+    memset(clone.extents, 0, sizeof(clone.extents)); // reservations belong to the original
+
+    int result = 0;
+    if (clone.fileType == 'd'){ // entries are added back by the caller
+        clone.vacantFile = 0;
+        clone.flags &= ~(FS_INODE_DIRTY | FS_INODE_DEDUP); // a snapshot of root is a plain directory
+        memset(clone.directPointer, 0, sizeof(clone.directPointer));
+    } else if (!(clone.flags & FS_INODE_INLINE)){ // inline data came along with the inode
+        for (size_t i = 0; i < number_direct_pointers && result == 0; i++){
+            uint16_t block_id = clone.directPointer[i];
+            clone.directPointer[i] = fs_block_share(fs, block_id);
+            if (block_id != 0 && clone.directPointer[i] == 0){
+                result = -1;
+                memset(clone.directPointer + i, 0, sizeof(uint16_t) * (number_direct_pointers - i)); // not shared yet, not ours
+            }
+        }
+        uint16_t indirect_id = clone.indirectPointer[0], double_indirect_id = clone.doubleIndirectPointer;
+        clone.indirectPointer[0] = clone.doubleIndirectPointer = 0;
+        if (result == 0){
+            result = pointer_block_clone(fs, indirect_id, 1, &clone.indirectPointer[0]);
+        }
+        if (result == 0){
+            result = pointer_block_clone(fs, double_indirect_id, 2, &clone.doubleIndirectPointer);
+        }
+    }
+    if (result < 0){
+        inode_release(fs, clone_ID, &clone);
+        return SIZE_MAX;
+    }
+    inode_store(fs, clone_ID, &clone);
+    return clone_ID;
+}
+
+/** Clones the tree under inode_ID, see fs_snapshot
+    \param fs The FS containing the tree
+    \param inode_ID Inode number of the file or directory to clone
+    \param clones Inode number of the copy of each inode cloned so far (SIZE_MAX for none), number_inodes entries
+    \return inode number of the copy, SIZE_MAX on error
+*/
+size_t inode_clone_tree(FS_t *fs, size_t inode_ID, size_t *clones){
+    if (clones[inode_ID] != SIZE_MAX){ // reached again through another link, link to the same copy
+        inode_t clone;
+        inode_load(fs, clones[inode_ID], &clone);
+        clone.linkCount++;
+        inode_store(fs, clones[inode_ID], &clone);
+        return clones[inode_ID];
+    }
+    size_t clone_ID = inode_clone(fs, inode_ID);
+    if (clone_ID == SIZE_MAX){
+        return SIZE_MAX;
+    }
+    clones[inode_ID] = clone_ID;
+
+    inode_t inode;
+    inode_load(fs, inode_ID, &inode);
+    if (inode.fileType == 'd' && inode.vacantFile != 0){
+        directoryFile_t directory[folder_number_entries];
+        uint8_t block_buff[BLOCK_SIZE_BYTES];
+        fs_block_read(fs, inode.directPointer[0], block_buff);
+        memcpy(directory, block_buff, sizeof(directory));
+        for (size_t i = 0; i < folder_number_entries; i++){
+            if (((inode.vacantFile >> i) & 1) == 1){
+                size_t child_ID = inode_clone_tree(fs, directory[i].inodeNumber, clones);
+                if (child_ID == SIZE_MAX || dir_entry_add(fs, clone_ID, directory[i].filename, child_ID) < 0){
+                    return SIZE_MAX;
+                }
+            }
+        }
+    }
+    return clone_ID;
+}
+
+/** Makes dst a copy of the regular file src that shares its data blocks
+      Only the inode and indirect blocks are copied, a shared block is copied the first time either file writes to it
+      Space src has reserved with fs_fallocate is not carried over
+    \param fs The FS containing the file
+    \param src Absolute path of the file to clone
+    \param dst Absolute path of the clone, must not exist
+    \return 0 on success, < 0 on error
+*/
+int fs_clone(FS_t *fs, const char *src, const char *dst){
+    if (fs == NULL || src == NULL || dst == NULL){
+        return -1;
+    }
+    size_t inode_ID = fs_path_lookup(fs, src);
+    char name[FS_FNAME_MAX];
+    size_t parent_ID = fs_path_parent(fs, dst, name);
+    if (inode_ID == SIZE_MAX || parent_ID == SIZE_MAX){
+        return -1;
+    }
+    inode_t inode;
+    inode_load(fs, inode_ID, &inode);
+    if (inode.fileType != 'r'){ // directories go through fs_snapshot
+        return -1;
+    }
+    size_t clone_ID = inode_clone(fs, inode_ID);
+    if (clone_ID == SIZE_MAX){
+        return -1;
+    }
+    if (dir_entry_add(fs, parent_ID, name, clone_ID) < 0){ // dst exists or its directory is full
+        inode_load(fs, clone_ID, &inode);
+        inode_release(fs, clone_ID, &inode);
+        return -1;
+    }
+    return 0;
+}
+
+/** Makes dst a copy of the directory tree under src, cloning every file in it (see fs_clone)
+      Files linked more than once in the tree are linked the same way in the copy
+      "/" snapshots the whole volume, dst may then sit anywhere in it
+    \param fs The FS containing the tree
+    \param src Absolute path of the directory to snapshot
+    \param dst Absolute path of the snapshot, must not exist
+    \return 0 on success, < 0 on error (nothing is left behind)
+*/
+int fs_snapshot(FS_t *fs, const char *src, const char *dst){
+    if (fs == NULL || src == NULL || dst == NULL){
+        return -1;
+    }
+    size_t dir_ID = fs_path_lookup(fs, src);
+    char name[FS_FNAME_MAX];
+    size_t parent_ID = fs_path_parent(fs, dst, name);
+    if (dir_ID == SIZE_MAX || parent_ID == SIZE_MAX){
+        return -1;
+    }
+    inode_t inode;
+    inode_load(fs, dir_ID, &inode);
+    if (inode.fileType != 'd'){
+        return -1;
+    }
+    inode_load(fs, parent_ID, &inode);
+    if (dir_entry_find(fs, &inode, name, NULL) != SIZE_MAX){ // checked up front rather than after copying the whole tree
+        return -1;
+    }
+
+    size_t clones[number_inodes];
+    for (size_t i = 0; i < number_inodes; i++){
+        clones[i] = SIZE_MAX;
+    }
+    // the snapshot is only linked in once it is complete, so a dst inside src never ends up in its own copy
+    size_t clone_ID = inode_clone_tree(fs, dir_ID, clones);
+    if (clone_ID != SIZE_MAX && dir_entry_add(fs, parent_ID, name, clone_ID) == 0){
+        return 0;
+    }
+    for (size_t i = 0; i < number_inodes; i++){ // undo the partial copy
+        if (clones[i] != SIZE_MAX){
+            inode_load(fs, clones[i], &inode);
+            inode_release(fs, clones[i], &inode);
+        }
+    }
+    return -1;
+}
+
+
+/** Adds the data blocks of a regular file to frag, along with the places where its next block is not the one right after the last
+      Holes neither break nor continue a run
+    \param fs The FS containing the file
+    \param inode The inode of the file
+    \param frag Where to add the counts
+*/
+void inode_frag_count(FS_t *fs, const inode_t *inode, fs_frag_t *frag){
+    if (inode->fileType != 'r' || (inode->flags & FS_INODE_INLINE)){
+        return;
+    }
+    size_t block_count = inode_block_span(inode);
+    uint16_t last = 0;
+    for (size_t i = 0; i < block_count; i++){
+        uint16_t block_id = inode_block_lookup(fs, inode, i);
+        if (block_id == 0){
+            continue;
+        }
+        if (last == 0){
+            frag->files++;
+        } else if (block_id != last + 1){
+            frag->breaks++;
+        }
+        frag->blocks++;
+        last = block_id;
+    }
+}
+
+// turn the counts into a score, the breaks out of the most there could be (one less than the blocks of each file)
+void frag_score(fs_frag_t *frag){
+    size_t most = frag->blocks - frag->files;
+    frag->score = most == 0 ? 0.0 : (double)frag->breaks / most;
+    frag->freeScore = frag->freeBlocks == 0 ? 0.0 : 1.0 - (double)frag->largestFree / frag->freeBlocks;
+}
+
+/** Moves the data blocks of a regular file into one run of blocks, see fs_defrag
+      The copy is built in blocks the file does not use, with pointer blocks of its own,
+      and only replaces the old one when the inode is written back, all of its pointers at once
+    \param fs The FS containing the file
+    \param inode_ID Inode number of the file
+    \param compact Also move a file that is already in one run if the run found starts before it
+    \return 1 if the file was moved, 0 if it was left where it is, < 0 if no run was long enough or the store ran out of blocks
+*/
+int inode_defrag(FS_t *fs, size_t inode_ID, bool compact){
+    inode_t inode;
+    inode_load(fs, inode_ID, &inode);
+    size_t block_count = inode_block_span(&inode);
+    if (inode.fileType != 'r' || (inode.flags & FS_INODE_INLINE) || block_count == 0){
+        return 0;
+    }
+    uint16_t *blocks = (uint16_t*)malloc(block_count * sizeof(uint16_t));
+    if (blocks == NULL){
+        return -1;
+    }
+    size_t data_count = 0, breaks = 0;
+    uint16_t first = 0, last = 0;
+    for (size_t i = 0; i < block_count; i++){
+        blocks[i] = inode_block_lookup(fs, &inode, i);
+        if (blocks[i] == 0){
+            continue;
+        }
+        if (fs->BlockRefs != NULL && fs->BlockRefs[blocks[i]] > 0){ // moving a block a clone shares would unshare it
+            free(blocks);
+            return 0;
+        }
+        if (last == 0){
+            first = blocks[i];
+        } else if (blocks[i] != last + 1){
+            breaks++;
+        }
+        last = blocks[i];
+        data_count++;
+    }
+    if (data_count == 0 || (breaks == 0 && !compact)){
+        free(blocks);
+        return 0;
+    }
+
+    size_t got;
+    uint16_t start = fs_block_alloc_run(fs, data_count, &got);
+    if (got < data_count || (breaks == 0 && start > first)){ // no run long enough, or nothing to gain
+        for (size_t i = 0; i < got; i++){
+            fs_block_free(fs, start + i);
+        }
+        free(blocks);
+        return got < data_count && breaks != 0 ? -1 : 0;
+    }
+
+    inode_t moved = inode; // same file, no pointers yet
+    memset(moved.directPointer, 0, sizeof(moved.directPointer));
+    moved.indirectPointer[0] = 0;
+    moved.doubleIndirectPointer = 0;
+    uint8_t block_buff[BLOCK_SIZE_BYTES];
+    size_t placed = 0;
+    for (size_t i = 0; i < block_count; i++){
+        if (blocks[i] == 0){
+            continue;
+        }
+        bool fresh;
+        if (inode_block_attach(fs, &moved, i, start + placed, &fresh) == 0){ // no block left for a pointer block, undo the copy
+            for (size_t j = 0; j < number_direct_pointers; j++){
+                fs_block_free(fs, moved.directPointer[j]);
+            }
+            pointer_block_release(fs, moved.indirectPointer[0], 1);
+            pointer_block_release(fs, moved.doubleIndirectPointer, 2);
+            for (size_t j = placed; j < data_count; j++){
+                fs_block_free(fs, start + j);
+            }
+            free(blocks);
+            return -1;
+        }
+        fs_block_read(fs, blocks[i], block_buff);
+        fs_block_write(fs, start + placed, block_buff);
+        placed++;
+    }
+    free(blocks);
+
+    inode_store(fs, inode_ID, &moved); // the switch, from here on the file lives in the run
+    for (size_t i = 0; i < number_direct_pointers; i++){
+        fs_block_free(fs, inode.directPointer[i]);
+    }
+    pointer_block_release(fs, inode.indirectPointer[0], 1);
+    pointer_block_release(fs, inode.doubleIndirectPointer, 2);
+    return 1;
+}
+
+/** Moves the blocks of a regular file into one contiguous run
+      Descriptors open on the file are not affected
+      Files sharing blocks with a clone are left as they are
+    \param fs The FS containing the file
+    \param path Absolute path to the file
+    \return 0 on success (or if the file already was contiguous), < 0 on error or if no free run is long enough
+*/
+int fs_defrag(FS_t *fs, const char *path){
+    if (fs == NULL || path == NULL){
+        return -1;
+    }
+    size_t inode_ID = fs_path_lookup(fs, path);
+    if (inode_ID == SIZE_MAX){
+        return -1;
+    }
+    inode_t inode;
+    inode_load(fs, inode_ID, &inode);
+    if (inode.fileType != 'r'){
+        return -1;
+    }
+    return inode_defrag(fs, inode_ID, false) < 0 ? -1 : 0;
+}
+
+// where the data of a file starts, for packing files toward the start of the store in order
+typedef struct {
+    size_t inodeNumber;
+    uint16_t firstBlock;
+} defrag_file_t;
+
+int defrag_file_compare(const void *a, const void *b){
+    return (int)((const defrag_file_t*)a)->firstBlock - (int)((const defrag_file_t*)b)->firstBlock;
+}
+
+/** Defragments every regular file and packs them toward the start of the store
+      Files are taken in the order their data starts in, each moves into the first free run that holds it
+      if that run comes before it, which leaves free space behind the files in as few runs as it can
+      Directory and pointer blocks stay where they are
+    \param fs The FS to defragment
+    \return number of files moved, < 0 on error
+*/
+int fs_defrag_volume(FS_t *fs){
+    if (fs == NULL){
+        return -1;
+    }
+    defrag_file_t files[number_inodes];
+    size_t file_count = 0;
+    for (size_t inode_ID = 0; inode_ID < number_inodes; inode_ID++){
+        inode_t inode;
+        if (!block_store_sub_test(fs->BlockStore_inode, inode_ID)){
+            continue;
+        }
+        inode_load(fs, inode_ID, &inode);
+        if (inode.fileType != 'r' || (inode.flags & FS_INODE_INLINE)){
+            continue;
+        }
+        files[file_count].inodeNumber = inode_ID;
+        files[file_count].firstBlock = 0;
+        size_t block_count = inode_block_span(&inode);
+        for (size_t i = 0; i < block_count && files[file_count].firstBlock == 0; i++){
+            files[file_count].firstBlock = inode_block_lookup(fs, &inode, i);
+        }
+        if (files[file_count].firstBlock != 0){ // all holes, nothing to move
+            file_count++;
+        }
+    }
+    qsort(files, file_count, sizeof(defrag_file_t), defrag_file_compare);
+
+    int moved = 0;
+    for (size_t i = 0; i < file_count; i++){
+        if (inode_defrag(fs, files[i].inodeNumber, true) > 0){ // a file with no room to move to just stays
+            moved++;
+        }
+    }
+    return moved;
+}
+
+/** Reports how scattered the blocks of a regular file are
+    \param fs The FS containing the file
+    \param path Absolute path to the file
+    \param frag Where to put the report, the free space fields are left 0
+    \return 0 on success, < 0 on error
+*/
+int fs_file_frag(FS_t *fs, const char *path, fs_frag_t *frag){
+    if (fs == NULL || path == NULL || frag == NULL){
+        return -1;
+    }
+    size_t inode_ID = fs_path_lookup(fs, path);
+    if (inode_ID == SIZE_MAX){
+        return -1;
+    }
+    inode_t inode;
+    inode_load(fs, inode_ID, &inode);
+    if (inode.fileType != 'r'){
+        return -1;
+    }
+    memset(frag, 0, sizeof(fs_frag_t));
+    inode_frag_count(fs, &inode, frag);
+    frag_score(frag);
+    return 0;
+}
+
+/** Reports how scattered the blocks of every regular file are, and how broken up free space is
+    \param fs The FS to report on
+    \param frag Where to put the report
+    \return 0 on success, < 0 on error
+*/
+int fs_volume_frag(FS_t *fs, fs_frag_t *frag){
+    if (fs == NULL || frag == NULL || fs->FreeBlockMap == NULL){
+        return -1;
+    }
+    memset(frag, 0, sizeof(fs_frag_t));
+    for (size_t inode_ID = 0; inode_ID < number_inodes; inode_ID++){
+        if (block_store_sub_test(fs->BlockStore_inode, inode_ID)){
+            inode_t inode;
+            inode_load(fs, inode_ID, &inode);
+            inode_frag_count(fs, &inode, frag);
+        }
+    }
+    size_t run = 0;
+    for (size_t block = 1; block < BLOCK_STORE_AVAIL_BLOCKS; block++){
+        if (bitmap_test(fs->FreeBlockMap, block)){
+            run = 0;
+            continue;
+        }
+        frag->freeBlocks++;
+        if (++run > frag->largestFree){
+            frag->largestFree = run;
+        }
+    }
+    frag_score(frag);
+    return 0;
+}
+
+
+// blocks the FS keeps for itself ahead of any file: the inode bitmap and the inode table
+#define check_meta_blocks (1 + number_inode_blocks)
+
+// what one fs_check thread scans, and what it finds there
+typedef struct {
+    FS_t *fs;
+    size_t first_inode;             // the slice of the inode table it scans, [first_inode, last_inode)
+    size_t last_inode;
+    const bool *in_use;             // which inodes are allocated, shared and only read
+    uint8_t *bad;                   // per inode, shared: it holds a pointer to no block a file can have (each thread writes its own slice)
+    uint16_t *refs;                 // per block, pointers to it from the slice
+    uint16_t names[number_inodes];  // per inode, directory entries in the slice naming it
+    size_t dangling;                // directory entries in the slice naming an inode that is not allocated
+} check_scan_t;
+
+// everything the threads found, added up
+typedef struct {
+    bool in_use[number_inodes];
+    uint8_t bad[number_inodes];
+    uint16_t names[number_inodes];
+    uint16_t *refs;                 // per block, pointers to it from the whole inode table
+    size_t dangling;
+} check_t;
+
+// counts one pointer held by inode_ID, false for a hole or a pointer outside the blocks a file can have (flagged as bad)
+bool check_ref(check_scan_t *scan, size_t inode_ID, uint16_t block_id){
+    if (block_id == 0){
+        return false;
+    }
+    if (block_id < check_meta_blocks || block_id >= scan->fs->StoreReserved){
+        scan->bad[inode_ID] = 1;
+        return false;
+    }
+    scan->refs[block_id]++;
+    return true;
+}
+
+// counts an indirect block and every block it points to, level 2 for a double indirect block
+void check_pointer_block(check_scan_t *scan, size_t inode_ID, uint16_t table_id, int level){
+    if (!check_ref(scan, inode_ID, table_id)){
+        return;
+    }
+    uint16_t ptr_buff[pointers_per_block];
+    fs_block_read(scan->fs, table_id, ptr_buff);
+    for (size_t i = 0; i < pointers_per_block; i++){
+        if (level > 1){
+            check_pointer_block(scan, inode_ID, ptr_buff[i], level - 1);
+        } else {
+            check_ref(scan, inode_ID, ptr_buff[i]);
+        }
+    }
+}
+
+// counts every block inode_ID holds, and for a directory the inodes its entries name
+void check_inode(check_scan_t *scan, size_t inode_ID){
+    inode_t inode;
+    inode_load(scan->fs, inode_ID, &inode);
+    if (inode.fileType == 'd'){
+        if (inode_ID == 0 && inode.extents[0].blockCount == number_ref_blocks){ // root keeps the reference count table in its first extent
+            for (size_t i = 0; i < number_ref_blocks; i++){
+                check_ref(scan, inode_ID, inode.extents[0].startBlock + i);
+            }
+        }
+        if (inode_ID == 0 && (inode.flags & FS_INODE_DEDUP) && inode.extents[1].blockCount == number_dedup_blocks){ // and the fingerprint index in its second
+            for (size_t i = 0; i < number_dedup_blocks; i++){
+                check_ref(scan, inode_ID, inode.extents[1].startBlock + i);
+            }
+        }
+        if (!check_ref(scan, inode_ID, inode.directPointer[0]) || inode.vacantFile == 0){ // an emptied directory keeps its block
+            return;
+        }
+        directoryFile_t directory[folder_number_entries];
+        uint8_t block_buff[BLOCK_SIZE_BYTES];
+        fs_block_read(scan->fs, inode.directPointer[0], block_buff);
+        memcpy(directory, block_buff, sizeof(directory));
+        for (size_t i = 0; i < folder_number_entries; i++){
+            if (((inode.vacantFile >> i) & 1) == 1){
+                if (scan->in_use[directory[i].inodeNumber]){
+                    scan->names[directory[i].inodeNumber]++;
+                } else {
+                    scan->dangling++;
+                }
+            }
+        }
+        return;
+    }
+    if (inode.flags & FS_INODE_INLINE){
+        return;
+    }
+    for (size_t i = 0; i < number_direct_pointers; i++){
+        check_ref(scan, inode_ID, inode.directPointer[i]);
+    }
+    check_pointer_block(scan, inode_ID, inode.indirectPointer[0], 1);
+    check_pointer_block(scan, inode_ID, inode.doubleIndirectPointer, 2);
+    for (size_t i = 0; i < FS_INODE_EXTENTS; i++){ // blocks fs_fallocate set aside
+        for (size_t j = 0; j < inode.extents[i].blockCount; j++){
+            check_ref(scan, inode_ID, inode.extents[i].startBlock + j);
+        }
+    }
+}
+
+void *check_scan_thread(void *arg){
+    check_scan_t *scan = (check_scan_t*)arg;
+    for (size_t inode_ID = scan->first_inode; inode_ID < scan->last_inode; inode_ID++){
+        if (scan->in_use[inode_ID]){
+            check_inode(scan, inode_ID);
+        }
+    }
+    return NULL;
+}
+
+/** Scans the inode table, split into one slice per thread, and adds up what the threads find
+      The scan only reads, nothing may change the FS while it runs
+    \param fs The FS to scan
+    \param threads Number of threads to split the inode table between
+    \param check Where to put the totals, check->refs must hold BLOCK_STORE_NUM_BLOCKS counts
+    \return 0 on success, < 0 if memory ran out
+*/
+int check_scan(FS_t *fs, size_t threads, check_t *check){
+    memset(check->bad, 0, sizeof(check->bad));
+    memset(check->names, 0, sizeof(check->names));
+    memset(check->refs, 0, BLOCK_STORE_NUM_BLOCKS * sizeof(uint16_t));
+    check->dangling = 0;
+    for (size_t inode_ID = 0; inode_ID < number_inodes; inode_ID++){
+        check->in_use[inode_ID] = block_store_sub_test(fs->BlockStore_inode, inode_ID);
+    }
+
+    check_scan_t *scans = (check_scan_t*)calloc(threads, sizeof(check_scan_t));
+    pthread_t *ids = (pthread_t*)calloc(threads, sizeof(pthread_t));
+    bool *started = (bool*)calloc(threads, sizeof(bool));
+    int result = scans != NULL && ids != NULL && started != NULL ? 0 : -1;
+    for (size_t t = 0; t < threads && result == 0; t++){
+        scans[t].fs = fs;
+        scans[t].first_inode = number_inodes * t / threads;
+        scans[t].last_inode = number_inodes * (t + 1) / threads;
+        scans[t].in_use = check->in_use;
+        scans[t].bad = check->bad;
+        scans[t].refs = (uint16_t*)calloc(BLOCK_STORE_NUM_BLOCKS, sizeof(uint16_t));
+        if (scans[t].refs == NULL){
+            result = -1;
+            break;
+        }
+        started[t] = pthread_create(&ids[t], NULL, check_scan_thread, &scans[t]) == 0;
+        if (!started[t]){ // no thread to spare, scan the slice right here
+            check_scan_thread(&scans[t]);
+        }
+    }
+    for (size_t t = 0; t < threads && scans != NULL; t++){
+        if (started != NULL && started[t]){
+            pthread_join(ids[t], NULL);
+        }
+        if (scans[t].refs == NULL){
+            continue;
+        }
+        for (size_t block = 0; block < BLOCK_STORE_NUM_BLOCKS; block++){
+            check->refs[block] += scans[t].refs[block];
+        }
+        for (size_t inode_ID = 0; inode_ID < number_inodes; inode_ID++){
+            check->names[inode_ID] += scans[t].names[inode_ID];
+        }
+        check->dangling += scans[t].dangling;
+        free(scans[t].refs);
+    }
+    free(scans);
+    free(ids);
+    free(started);
+    return result;
+}
+
+// clears every pointer inode_ID holds to a block no file can have, what was behind a bad indirect block is lost
+void check_clear_bad(FS_t *fs, size_t inode_ID){
+    inode_t inode;
+    inode_load(fs, inode_ID, &inode);
+    uint16_t *pointers[number_direct_pointers + 2];
+    size_t pointer_count = 0;
+    for (size_t i = 0; i < number_direct_pointers; i++){
+        pointers[pointer_count++] = &inode.directPointer[i];
+    }
+    if (inode.fileType == 'r'){
+        pointers[pointer_count++] = &inode.indirectPointer[0];
+        pointers[pointer_count++] = &inode.doubleIndirectPointer;
+    }
+    for (size_t i = 0; i < pointer_count; i++){
+        if (*pointers[i] != 0 && (*pointers[i] < check_meta_blocks || *pointers[i] >= fs->StoreReserved)){
+            *pointers[i] = 0;
+        }
+    }
+    if (inode.fileType == 'd'){
+        if (inode.directPointer[0] == 0){ // its entries went with the block
+            inode.vacantFile = 0;
+        }
+        if (inode_ID == 0){ // the reference count table is checked with the other blocks, never cleared
+            inode_store(fs, inode_ID, &inode);
+            return;
+        }
+    }
+    for (size_t i = 0; i < FS_INODE_EXTENTS; i++){
+        size_t end = (size_t)inode.extents[i].startBlock + inode.extents[i].blockCount;
+        if (inode.extents[i].blockCount != 0 && (inode.extents[i].startBlock < check_meta_blocks || end > fs->StoreReserved)){
+            memset(&inode.extents[i], 0, sizeof(extent_t));
+        }
+    }
+    // the double indirect block's tables first, then every table's entries
+    uint16_t tables[1 + pointers_per_block];
+    size_t table_count = 0;
+    if (inode.indirectPointer[0] != 0){
+        tables[table_count++] = inode.indirectPointer[0];
+    }
+    if (inode.doubleIndirectPointer != 0){
+        uint16_t ptr_buff[pointers_per_block];
+        fs_block_read(fs, inode.doubleIndirectPointer, ptr_buff);
+        for (size_t i = 0; i < pointers_per_block; i++){
+            if (ptr_buff[i] != 0 && (ptr_buff[i] < check_meta_blocks || ptr_buff[i] >= fs->StoreReserved)){
+                ptr_buff[i] = 0;
+            } else if (ptr_buff[i] != 0 && table_count < 1 + pointers_per_block){
+                tables[table_count++] = ptr_buff[i];
+            }
+        }
+        fs_block_write(fs, inode.doubleIndirectPointer, ptr_buff);
+    }
+    for (size_t t = 0; t < table_count; t++){
+        uint16_t ptr_buff[pointers_per_block];
+        fs_block_read(fs, tables[t], ptr_buff);
+        for (size_t i = 0; i < pointers_per_block; i++){
+            if (ptr_buff[i] != 0 && (ptr_buff[i] < check_meta_blocks || ptr_buff[i] >= fs->StoreReserved)){
+                ptr_buff[i] = 0;
+            }
+        }
+        fs_block_write(fs, tables[t], ptr_buff);
+    }
+    inode_store(fs, inode_ID, &inode);
+}
+
+// drops every entry of directory dir_ID naming an inode that is not allocated
+void check_drop_dangling(FS_t *fs, size_t dir_ID, const bool *in_use){
+    inode_t dir;
+    inode_load(fs, dir_ID, &dir);
+    if (dir.fileType != 'd' || dir.vacantFile == 0){
+        return;
+    }
+    directoryFile_t directory[folder_number_entries];
+    uint8_t block_buff[BLOCK_SIZE_BYTES];
+    fs_block_read(fs, dir.directPointer[0], block_buff);
+    memcpy(directory, block_buff, sizeof(directory));
+    for (size_t i = 0; i < folder_number_entries; i++){
+        if (((dir.vacantFile >> i) & 1) == 1 && !in_use[directory[i].inodeNumber]){
+            dir_entry_remove(fs, dir_ID, i);
+        }
+    }
+}
+
+/** Checks the FS for consistency, and repairs what it finds if asked to
+      The inode table is scanned by several threads at once, each one counting the pointers to every block
+      and the directory entries naming every inode in its slice
+      The counts give a reference bitmap of the blocks in use, which is diffed against the free block map a byte at a time
+      Repairs, in order: pointers to blocks no file can have are cleared, directory entries naming free inodes dropped,
+      inodes no directory names released (the scan is repeated until there are none), link counts set to the entries
+      naming each inode, then the free block map and the reference count table set to what the files point at
+    \param fs The FS to check, nothing else may use it meanwhile
+    \param repair Repair what is found, otherwise only report it
+    \param threads Number of threads to scan with, 0 for fs_check_threads
+    \param report Where to put the counts of what was found, may be NULL
+    \return number of problems found (0 for a clean FS), < 0 on error
+*/
+int fs_check(FS_t *fs, bool repair, size_t threads, fs_check_t *report){
+    if (fs == NULL || fs->FreeBlockMap == NULL){
+        return -1;
+    }
+    if (threads == 0){
+        threads = fs_check_threads;
+    }
+    if (threads > number_inodes){
+        threads = number_inodes;
+    }
+    fs_check_t found;
+    memset(&found, 0, sizeof(found));
+    check_t *check = (check_t*)calloc(1, sizeof(check_t));
+    if (check == NULL){
+        return -1;
+    }
+    check->refs = (uint16_t*)calloc(BLOCK_STORE_NUM_BLOCKS, sizeof(uint16_t));
+    if (check->refs == NULL || check_scan(fs, threads, check) < 0){
+        free(check->refs);
+        free(check);
+        return -1;
+    }
+
+    // files and directories, repaired until the namespace holds together, every round rescans what the last one changed
+    for (size_t round = 0; round <= number_inodes; round++){
+        size_t fixes = 0;
+        for (size_t inode_ID = 0; inode_ID < number_inodes; inode_ID++){
+            if (check->bad[inode_ID]){
+                found.badPointers++;
+                if (repair){
+                    check_clear_bad(fs, inode_ID);
+                    fixes++;
+                }
+            }
+        }
+        found.danglingEntries += check->dangling;
+        if (repair && check->dangling != 0){
+            for (size_t dir_ID = 0; dir_ID < number_inodes; dir_ID++){
+                if (check->in_use[dir_ID]){
+                    check_drop_dangling(fs, dir_ID, check->in_use);
+                }
+            }
+            fixes++;
+        }
+        for (size_t inode_ID = 1; inode_ID < number_inodes; inode_ID++){ // nothing names root
+            if (check->in_use[inode_ID] && check->names[inode_ID] == 0){
+                found.orphanInodes++;
+                if (repair){
+                    inode_t inode;
+                    inode_load(fs, inode_ID, &inode);
+                    inode_release(fs, inode_ID, &inode);
+                    fixes++;
+                }
+            }
+        }
+        if (fixes == 0 || check_scan(fs, threads, check) < 0){
+            break;
+        }
+    }
+    for (size_t inode_ID = 1; inode_ID < number_inodes; inode_ID++){
+        if (!check->in_use[inode_ID] || check->names[inode_ID] == 0){
+            continue;
+        }
+        inode_t inode;
+        inode_load(fs, inode_ID, &inode);
+        size_t link_count = inode.linkCount != 0 ? inode.linkCount : 1; // images from before link counts
+        if (link_count != check->names[inode_ID]){
+            found.linkCounts++;
+            if (repair){
+                inode.linkCount = check->names[inode_ID];
+                inode_store(fs, inode_ID, &inode);
+            }
+        }
+    }
+
+    // blocks: the reference bitmap against the free block map
+    bool shared = false;
+    for (size_t block = check_meta_blocks; block < BLOCK_STORE_AVAIL_BLOCKS && !shared; block++){
+        shared = check->refs[block] > 1;
+    }
+    if (repair && shared && fs->BlockRefs == NULL && fs_block_refs(fs) != NULL){ // blocks are shared with no count of it, start one
+        inode_t root_inode;
+        inode_load(fs, 0, &root_inode);
+        for (size_t i = 0; i < number_ref_blocks; i++){
+            check->refs[root_inode.extents[0].startBlock + i] = 1;
+        }
+    }
+    bitmap_t *referenced = bitmap_create(BLOCK_STORE_NUM_BLOCKS);
+    if (referenced == NULL){
+        free(check->refs);
+        free(check);
+        return -1;
+    }
+    for (size_t block = 0; block < BLOCK_STORE_NUM_BLOCKS; block++){
+        if (block < check_meta_blocks || block >= fs->StoreReserved || check->refs[block] != 0){
+            bitmap_set(referenced, block);
+        }
+    }
+    const uint8_t *want = bitmap_export(referenced);
+    const uint8_t *have = bitmap_export(fs->FreeBlockMap);
+    for (size_t byte = 0; byte < (BLOCK_STORE_AVAIL_BLOCKS + 7) / 8; byte++){
+        if (want[byte] == have[byte]){ // all 8 blocks agree
+            continue;
+        }
+        for (size_t block = byte * 8; block < byte * 8 + 8 && block < fs->StoreReserved; block++){
+            bool in_use = bitmap_test(fs->FreeBlockMap, block);
+            if (block < check_meta_blocks || in_use == bitmap_test(referenced, block)){
+                continue;
+            }
+            if (in_use){
+                found.blocksLeaked++;
+                if (repair){
+                    block_store_release(fs->BlockStore_whole, block);
+                    bitmap_set(fs->Released, block);
+                }
+            } else {
+                found.blocksMissing++;
+                if (repair){
+                    block_store_request(fs->BlockStore_whole, block);
+                }
+            }
+        }
+    }
+    for (size_t block = check_meta_blocks; block < BLOCK_STORE_AVAIL_BLOCKS; block++){
+        size_t extra = check->refs[block] > 1 ? check->refs[block] - 1u : 0;
+        size_t counted = fs->BlockRefs != NULL ? fs->BlockRefs[block] : 0;
+        if (extra == counted){
+            continue;
+        }
+        found.refCounts++;
+        if (repair && fs->BlockRefs != NULL){
+            fs->BlockRefs[block] = extra > UINT8_MAX ? UINT8_MAX : extra;
+        }
+    }
+    bitmap_destroy(referenced);
+    free(check->refs);
+    free(check);
+
+    if (repair){
+        fs_count_free(fs);
+    }
+    if (report != NULL){
+        *report = found;
+    }
+    return found.blocksLeaked + found.blocksMissing + found.refCounts + found.linkCounts + found.orphanInodes + found.danglingEntries + found.badPointers;
+}
+
+/** Gives the pages behind a run of free blocks back to the host, the image file gets a hole there
+      Only pages wholly inside the run are given back, in case pages are larger than blocks
+    \param fs The FS containing the blocks
+    \param start_block First block of the run
+    \param block_count Number of blocks in the run
+    \return number of blocks given back, 0 if the host does not support it
+*/
+size_t trim_range(FS_t *fs, size_t start_block, size_t block_count){
+#ifdef MADV_REMOVE
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    size_t start = (start_block * BLOCK_SIZE_BYTES + page_size - 1) / page_size * page_size;
+    size_t end = (start_block + block_count) * BLOCK_SIZE_BYTES / page_size * page_size;
+    if (start >= end){
+        return 0;
+    }
+    // the store maps the image file shared, removing the pages punches a hole in the file (as fallocate(FALLOC_FL_PUNCH_HOLE) would)
+    uint8_t *data = block_store_Data_location(fs->BlockStore_whole);
+    if (madvise(data + start, end - start, MADV_REMOVE) < 0){
+        return 0;
+    }
+    return (end - start) / BLOCK_SIZE_BYTES;
+#else
+    UNUSED(fs);
+    UNUSED(start_block);
+    UNUSED(block_count);
+    return 0;
+#endif
+}
+
+/** Punches holes in the image file where blocks have been released, so it only takes up space for blocks in use
+      Released blocks are collected as they are freed and handed back in runs, here
+    \param fs The FS to trim
+    \param all Trim every free block, not only the ones released since the last trim (for images that were never trimmed)
+    \return number of blocks trimmed, < 0 on error
+*/
+int fs_trim(FS_t *fs, bool all){
+    if (fs == NULL || fs->FreeBlockMap == NULL || fs->Released == NULL){
+        return -1;
+    }
+    const uint8_t *released = bitmap_export(fs->Released);
+    size_t trimmed = 0;
+    size_t run_start = 0, run_count = 0;
+    for (size_t block = 1 + number_inode_blocks; block <= BLOCK_STORE_AVAIL_BLOCKS; block++){
+        bool skip = !all && block % 8 == 0 && released[block / 8] == 0 && block + 8 <= BLOCK_STORE_AVAIL_BLOCKS; // 8 blocks nobody released
+        if (!skip && block < BLOCK_STORE_AVAIL_BLOCKS && !bitmap_test(fs->FreeBlockMap, block) && (all || bitmap_test(fs->Released, block))){
+            if (run_count++ == 0){
+                run_start = block;
+            }
+            continue;
+        }
+        if (run_count != 0){ // blocks taken again since they were released end the run too
+            trimmed += trim_range(fs, run_start, run_count);
+            run_count = 0;
+        }
+        if (skip){
+            block += 7;
+        }
+    }
+    bitmap_format(fs->Released, 0);
+    return trimmed;
+}
+
+
+struct fs_map {
+    FS_t *fs;
+    size_t size;            // file size when the view was made
+    size_t block_count;     // blocks covered by the view
+    const uint8_t *base;    // start of the bytes handed out, either inside the image or the window
+    uint8_t *window;        // private copy for files that are not contiguous, NULL for zero-copy views
+    uint16_t *blocks;       // block id behind each block of the window, 0 for a hole
+    bitmap_t *faulted;      // which blocks of the window have been read in so far
+    inode_t *compressed;    // the inode of a compressed file, whose window is faulted in a cluster at a time; NULL otherwise
+};
+
+/** Maps the file linked to the given descriptor as a read-only view
+    \param fs The FS containing the file
+    \param fd The file to map
+    \return The new view, NULL on error
+*/
+fs_map_t *fs_mmap(FS_t *fs, int fd){
+    if (fs == NULL || fd < 0 || fd >= number_fd || !block_store_sub_test(fs->BlockStore_fd, fd)){
+        return NULL;
+    }
+    fileDescriptor_t map_fd;
+    block_store_fd_read(fs->BlockStore_fd, fd, &map_fd);
+    inode_t map_inode;
+    inode_load(fs, map_fd.inodeNum, &map_inode);
+
+    fs_map_t *map = (fs_map_t*)calloc(1, sizeof(fs_map_t));
+    if (map == NULL){
+        return NULL;
+    }
+    map->fs = fs;
+    map->size = map_inode.fileSize;
+    map->block_count = (map->size + BLOCK_SIZE_BYTES - 1) / BLOCK_SIZE_BYTES;
+    if (map->block_count == 0){ // nothing to view, every fs_map_at will fail
+        return map;
+    }
+
+    if (map_inode.flags & FS_INODE_INLINE){ // the bytes came along with the inode, copy them into the window right away
+        map->window = (uint8_t*)calloc(map->block_count, BLOCK_SIZE_BYTES);
+        map->faulted = bitmap_create(map->block_count);
+        if (map->window == NULL || map->faulted == NULL){
+            fs_munmap(map);
+            return NULL;
+        }
+        memcpy(map->window, map_inode.inlineData, map->size);
+        bitmap_format(map->faulted, 0xFF);
+        map->base = map->window;
+        return map;
+    }
+
+    if (map_inode.flags & FS_INODE_COMPRESSED){ // its blocks are not its bytes, decompress into the window as it is touched
+        map->window = (uint8_t*)calloc(map->block_count, BLOCK_SIZE_BYTES);
+        map->faulted = bitmap_create(map->block_count);
+        map->compressed = (inode_t*)malloc(sizeof(inode_t));
+        if (map->window == NULL || map->faulted == NULL || map->compressed == NULL){
+            fs_munmap(map);
+            return NULL;
+        }
+        *map->compressed = map_inode;
+        map->base = map->window;
+        return map;
+    }
+
+    // resolve every block id up front, this only touches the pointer blocks and not the data
+    map->blocks = (uint16_t*)calloc(map->block_count, sizeof(uint16_t));
+    if (map->blocks == NULL){
+        free(map);
+        return NULL;
+    }
+    bool contiguous = true;
+    for (size_t i = 0; i < map->block_count; i++){
+        map->blocks[i] = inode_block_lookup(fs, &map_inode, i);
+        if (map->blocks[i] == 0 || (i > 0 && map->blocks[i] != map->blocks[i - 1] + 1)){
+            contiguous = false;
+        }
+    }
+
+    if (contiguous){ // the bytes are already laid out in order inside the image, hand them out as is
+        map->base = block_store_Data_location(fs->BlockStore_whole) + (size_t)map->blocks[0] * BLOCK_SIZE_BYTES;
+        free(map->blocks);
+        map->blocks = NULL;
+        return map;
+    }
+
+    // otherwise reserve the window now and fill it in lazily from fs_map_at
+    map->window = (uint8_t*)calloc(map->block_count, BLOCK_SIZE_BYTES);
+    map->faulted = bitmap_create(map->block_count);
+    if (map->window == NULL || map->faulted == NULL){
+        fs_munmap(map);
+        return NULL;
+    }
+    map->base = map->window;
+    return map;
+}
+
+/** Returns a pointer to nbyte bytes of the mapped file starting at offset
+    \param map The view to index into
+    \param offset Offset from BOF of the first byte
+    \param nbyte Number of bytes the caller is going to look at
+    \return Pointer to the bytes, NULL on error or if the range passes EOF
+*/
+const void *fs_map_at(fs_map_t *map, size_t offset, size_t nbyte){
+    if (map == NULL || nbyte == 0 || offset >= map->size || nbyte > map->size - offset){
+        return NULL;
+    }
+    if (map->window != NULL){ // fault in every block of the range that has not been read yet
+        size_t last = (offset + nbyte - 1) / BLOCK_SIZE_BYTES;
+        for (size_t i = offset / BLOCK_SIZE_BYTES; i <= last; i++){
+            if (!bitmap_test(map->faulted, i) && map->compressed != NULL){ // the whole cluster comes in at once
+                uint8_t cluster_buff[fs_cluster_size];
+                size_t first = i / fs_cluster_blocks * fs_cluster_blocks;
+                if (inode_cluster_load(map->fs, map->compressed, first / fs_cluster_blocks, cluster_buff) < 0){
+                    return NULL;
+                }
+                for (size_t j = first; j < first + fs_cluster_blocks && j < map->block_count; j++){
+                    memcpy(map->window + j * BLOCK_SIZE_BYTES, cluster_buff + (j - first) * BLOCK_SIZE_BYTES, BLOCK_SIZE_BYTES);
+                    bitmap_set(map->faulted, j);
+                }
+            } else if (!bitmap_test(map->faulted, i)){
+                if (map->blocks[i] != 0){ // holes stay zeroed from the calloc
+                    fs_block_read(map->fs, map->blocks[i], map->window + i * BLOCK_SIZE_BYTES);
+                }
+                bitmap_set(map->faulted, i);
+            }
+        }
+    }
+    return map->base + offset;
+}
+
+/** Returns the size in bytes of the mapped file
+    \param map The view
+    \return Size of the view, 0 on error
+*/
+size_t fs_map_size(const fs_map_t *map){
+    if (map == NULL){
+        return 0;
+    }
+    return map->size;
+}
+
+/** Reports whether the view points straight into the image
+    \param map The view
+    \return true if the view is zero-copy, false if it is assembled or on error
+*/
+bool fs_map_is_direct(const fs_map_t *map){
+    return map != NULL && map->base != NULL && map->window == NULL;
+}
+
+/** Releases a view returned by fs_mmap
+    \param map The view to release
+    \return 0 on success, < 0 on error
+*/
+int fs_munmap(fs_map_t *map){
+    if (map == NULL){
+        return -1;
+    }
+    if (map->faulted != NULL){
+        bitmap_destroy(map->faulted);
+    }
+    free(map->window);
+    free(map->blocks);
+    free(map->compressed);
+    free(map);
+    return 0;
+}
@@ -1,7 +1,9 @@
+#include <algorithm>
 #include <cstdlib>
 #include <iostream>
 #include <new>
 #include <vector>
+#include <sys/stat.h>
 using std::vector;
 using std::string;
 #include <gtest/gtest.h>
@@ -58,6 +60,7 @@ bool find_in_directory(const dyn_array_t *const record_arr, const char *fname)
    1   Normal
    2   NULL
    3   Empty string
+   4   No such file
    int fs_unmount(FS *fs);
    1   Normal
    2   NULL
@@ -93,6 +96,9 @@ TEST(a_tests, format_mount_unmount)
 
     // MOUNT 3
     ASSERT_EQ(fs_mount(""), nullptr);
+
+    // MOUNT 4
+    ASSERT_EQ(fs_mount("a_tests_missing.FS"), nullptr);
 }
 
 /*
@@ -1318,6 +1324,1644 @@ TEST(j_tests, link) {
 }
 
 
+/*
+   fs_map_t *fs_mmap(FS *fs, int fd);
+   const void *fs_map_at(fs_map_t *map, size_t offset, size_t nbyte);
+   1. Normal, contiguous file is viewed in place
+   2. Normal, scattered file is assembled, reads match what was written
+   3. Normal, empty file maps but has nothing to index
+   4. Error, range passes EOF
+   5. Error, FS NULL
+   6. Error, bad fd
+ */
+TEST(k_tests, mmap)
+{
+	const char *test_fname = "k_tests.FS";
+	FS *fs = fs_format(test_fname);
+	ASSERT_NE(fs, nullptr);
+
+	uint8_t block[BLOCK_SIZE_BYTES];
+	ASSERT_EQ(fs_create(fs, "/contiguous", FS_REGULAR), 0);
+	ASSERT_EQ(fs_create(fs, "/scattered", FS_REGULAR), 0);
+	ASSERT_EQ(fs_create(fs, "/filler", FS_REGULAR), 0);
+	ASSERT_EQ(fs_create(fs, "/empty", FS_REGULAR), 0);
+	int fd_a = fs_open(fs, "/contiguous");
+	int fd_b = fs_open(fs, "/scattered");
+	int fd_c = fs_open(fs, "/filler");
+	ASSERT_GE(fd_a, 0);
+	ASSERT_GE(fd_b, 0);
+	ASSERT_GE(fd_c, 0);
+	for (int i = 0; i < 3; ++i) {
+		memset(block, 0x20 + i, BLOCK_SIZE_BYTES);
+		ASSERT_EQ(fs_write(fs, fd_a, block, BLOCK_SIZE_BYTES), BLOCK_SIZE_BYTES);
+	}
+	// interleaving with "/filler" scatters the blocks of "/scattered" across the image
+	for (int i = 0; i < 3; ++i) {
+		memset(block, 0x10 + i, BLOCK_SIZE_BYTES);
+		ASSERT_EQ(fs_write(fs, fd_b, block, BLOCK_SIZE_BYTES), BLOCK_SIZE_BYTES);
+		ASSERT_EQ(fs_write(fs, fd_c, block, BLOCK_SIZE_BYTES), BLOCK_SIZE_BYTES);
+	}
+
+	// 1. Normal, blocks were allocated in order, view is zero-copy
+	fs_map_t *map = fs_mmap(fs, fd_a);
+	ASSERT_NE(map, nullptr);
+	ASSERT_EQ(fs_map_size(map), (size_t) BLOCK_SIZE_BYTES * 3);
+	ASSERT_TRUE(fs_map_is_direct(map));
+	const uint8_t *bytes = (const uint8_t *) fs_map_at(map, BLOCK_SIZE_BYTES + 7, 64);
+	ASSERT_NE(bytes, nullptr);
+	ASSERT_EQ(bytes[0], 0x21);
+	ASSERT_EQ(fs_munmap(map), 0);
+
+	// 2. Normal, assembled view, a lookup that straddles two blocks
+	map = fs_mmap(fs, fd_b);
+	ASSERT_NE(map, nullptr);
+	ASSERT_FALSE(fs_map_is_direct(map));
+	bytes = (const uint8_t *) fs_map_at(map, BLOCK_SIZE_BYTES * 2 - 32, 64);
+	ASSERT_NE(bytes, nullptr);
+	ASSERT_EQ(bytes[0], 0x11);
+	ASSERT_EQ(bytes[63], 0x12);
+
+	// 4. Error, range passes EOF
+	ASSERT_EQ(fs_map_at(map, BLOCK_SIZE_BYTES * 3 - 32, 64), nullptr);
+	ASSERT_EQ(fs_munmap(map), 0);
+
+	// 3. Normal, empty file
+	int fd_d = fs_open(fs, "/empty");
+	ASSERT_GE(fd_d, 0);
+	map = fs_mmap(fs, fd_d);
+	ASSERT_NE(map, nullptr);
+	ASSERT_EQ(fs_map_size(map), (size_t) 0);
+	ASSERT_EQ(fs_map_at(map, 0, 1), nullptr);
+	ASSERT_EQ(fs_munmap(map), 0);
+
+	// 5. Error, FS NULL
+	ASSERT_EQ(fs_mmap(NULL, fd_a), nullptr);
+
+	// 6. Error, bad fd
+	ASSERT_EQ(fs_mmap(fs, 200), nullptr);
+	ASSERT_EQ(fs_mmap(fs, -1), nullptr);
+
+	fs_unmount(fs);
+}
+
+
+/*
+   Inline data for small files
+   1. Normal, small write stays in the inode, no block is allocated
+   2. Normal, read back from the inode
+   3. Normal, growing past FS_INLINE_DATA_MAX moves the data to a block, nothing is lost
+ */
+TEST(l_tests, inline_data)
+{
+	const char *test_fname = "l_tests.FS";
+	FS *fs = fs_format(test_fname);
+	ASSERT_NE(fs, nullptr);
+	ASSERT_EQ(fs_create(fs, "/tiny", FS_REGULAR), 0);
+	int fd = fs_open(fs, "/tiny");
+	ASSERT_GE(fd, 0);
+
+	// 1. Normal, small write
+	size_t used_blocks = block_store_get_used_blocks(fs->BlockStore_whole);
+	const char greeting[] = "hello, inode";
+	ASSERT_EQ(fs_write(fs, fd, greeting, sizeof(greeting)), (ssize_t) sizeof(greeting));
+	ASSERT_EQ(block_store_get_used_blocks(fs->BlockStore_whole), used_blocks);
+
+	// 2. Normal, read back
+	char buffer[BLOCK_SIZE_BYTES] = {0};
+	ASSERT_EQ(fs_seek(fs, fd, 0, FS_SEEK_SET), 0);
+	ASSERT_EQ(fs_read(fs, fd, buffer, sizeof(buffer)), (ssize_t) sizeof(greeting));
+	ASSERT_STREQ(buffer, greeting);
+
+	// 3. Normal, promotion
+	uint8_t tail[FS_INLINE_DATA_MAX];
+	memset(tail, 0x44, sizeof(tail));
+	ASSERT_EQ(fs_write(fs, fd, tail, sizeof(tail)), (ssize_t) sizeof(tail));
+	ASSERT_EQ(block_store_get_used_blocks(fs->BlockStore_whole), used_blocks + 1);
+	ASSERT_EQ(fs_seek(fs, fd, 0, FS_SEEK_SET), 0);
+	memset(buffer, 0, sizeof(buffer));
+	ASSERT_EQ(fs_read(fs, fd, buffer, sizeof(buffer)), (ssize_t) (sizeof(greeting) + sizeof(tail)));
+	ASSERT_STREQ(buffer, greeting);
+	ASSERT_EQ(memcmp(buffer + sizeof(greeting), tail, sizeof(tail)), 0);
+
+	ASSERT_EQ(fs_close(fs, fd), 0);
+	fs_unmount(fs);
+}
+
+
+/*
+   On-disk inode layout
+   1. Normal, inode fields survive an unmount/mount round trip
+   2. Normal, fields sit at their fixed little-endian offsets in the image
+   3. Error, image with another inode version is not mounted
+ */
+TEST(m_tests, disk_inode_layout)
+{
+	const char *test_fname = "m_tests.FS";
+	FS *fs = fs_format(test_fname);
+	ASSERT_NE(fs, nullptr);
+	ASSERT_EQ(fs_create(fs, "/file", FS_REGULAR), 0);
+	int fd = fs_open(fs, "/file");
+	ASSERT_GE(fd, 0);
+	uint8_t data[BLOCK_SIZE_BYTES + 10];
+	memset(data, 0x5A, sizeof(data));
+	ASSERT_EQ(fs_write(fs, fd, data, BLOCK_SIZE_BYTES), BLOCK_SIZE_BYTES);
+	ASSERT_EQ(fs_write(fs, fd, data, 10), 10);
+	ASSERT_EQ(fs_close(fs, fd), 0);
+	ASSERT_EQ(fs_unmount(fs), 0);
+
+	// 1. Normal, round trip
+	fs = fs_mount(test_fname);
+	ASSERT_NE(fs, nullptr);
+	inode_t root;
+	ASSERT_EQ(inode_load(fs, 0, &root), sizeof(inode_t));
+	ASSERT_EQ(root.fileType, 'd');
+	ASSERT_EQ(root.version, FS_INODE_VERSION);
+	ASSERT_EQ(root.vacantFile, (uint32_t) 1);
+	ASSERT_NE(root.ctime, 0);
+	fd = fs_open(fs, "/file");
+	ASSERT_GE(fd, 0);
+	fileDescriptor_t descriptor;
+	block_store_fd_read(fs->BlockStore_fd, fd, &descriptor);
+	inode_t file;
+	ASSERT_EQ(inode_load(fs, descriptor.inodeNum, &file), sizeof(inode_t));
+	ASSERT_EQ(file.fileType, 'r');
+	ASSERT_EQ(file.fileSize, (size_t) BLOCK_SIZE_BYTES + 10);
+	ASSERT_NE(file.directPointer[0], 0);
+
+	// 2. Normal, raw bytes of the file inode in the inode table
+	const uint8_t *raw = block_store_Data_location(fs->BlockStore_whole) + BLOCK_SIZE_BYTES + descriptor.inodeNum * inode_size;
+	ASSERT_EQ(raw[4], 'r');
+	ASSERT_EQ(raw[6] | (raw[7] << 8), FS_INODE_VERSION);
+	ASSERT_EQ(raw[8] | (raw[9] << 8) | (raw[10] << 16) | (raw[11] << 24), BLOCK_SIZE_BYTES + 10);
+	ASSERT_EQ(raw[24] | (raw[25] << 8), file.directPointer[0]);
+	ASSERT_EQ(fs_close(fs, fd), 0);
+
+	// 3. Error, bump the root inode version behind FS's back
+	uint8_t *root_raw = block_store_Data_location(fs->BlockStore_whole) + BLOCK_SIZE_BYTES;
+	root_raw[6] = FS_INODE_VERSION + 1;
+	ASSERT_EQ(fs_unmount(fs), 0);
+	ASSERT_EQ(fs_mount(test_fname), nullptr);
+}
+
+
+/*
+   Sparse files
+   int fs_punch_hole(FS *fs, int fd, off_t offset, off_t len);
+   1. Normal, seek past EOF and write, only the written block (and its indirect block) is allocated
+   2. Normal, the gap reads back as zeros
+   3. Normal, punch a whole block, it is released and reads back as zeros
+   4. Normal, punch part of a block, only those bytes are zeroed
+   5. Normal, FS_SEEK_END
+   6. Error, FS NULL / bad fd / negative range
+ */
+TEST(n_tests, sparse_files)
+{
+	const char *test_fname = "n_tests.FS";
+	FS *fs = fs_format(test_fname);
+	ASSERT_NE(fs, nullptr);
+	ASSERT_EQ(fs_create(fs, "/sparse", FS_REGULAR), 0);
+	int fd = fs_open(fs, "/sparse");
+	ASSERT_GE(fd, 0);
+	size_t used_blocks = block_store_get_used_blocks(fs->BlockStore_whole);
+
+	// 1. Normal, block 20 lives behind the indirect pointer
+	const off_t far = 20 * BLOCK_SIZE_BYTES + 100;
+	uint8_t data[BLOCK_SIZE_BYTES * 3];
+	memset(data, 0x7C, sizeof(data));
+	ASSERT_EQ(fs_seek(fs, fd, far, FS_SEEK_SET), far);
+	ASSERT_EQ(fs_write(fs, fd, data, 10), 10);
+	ASSERT_EQ(block_store_get_used_blocks(fs->BlockStore_whole), used_blocks + 2);
+
+	// 2. Normal, gap reads back as zeros
+	uint8_t buffer[BLOCK_SIZE_BYTES * 3];
+	memset(buffer, 0xFF, sizeof(buffer));
+	ASSERT_EQ(fs_seek(fs, fd, far - BLOCK_SIZE_BYTES, FS_SEEK_SET), far - BLOCK_SIZE_BYTES);
+	ASSERT_EQ(fs_read(fs, fd, buffer, sizeof(buffer)), BLOCK_SIZE_BYTES + 10);
+	for (size_t i = 0; i < BLOCK_SIZE_BYTES; ++i) {
+		ASSERT_EQ(buffer[i], 0);
+	}
+	ASSERT_EQ(memcmp(buffer + BLOCK_SIZE_BYTES, data, 10), 0);
+
+	// 3. Normal, punch a whole block out of three
+	ASSERT_EQ(fs_seek(fs, fd, 0, FS_SEEK_SET), 0);
+	ASSERT_EQ(fs_write(fs, fd, data, sizeof(data)), (ssize_t) sizeof(data));
+	used_blocks = block_store_get_used_blocks(fs->BlockStore_whole);
+	ASSERT_EQ(fs_punch_hole(fs, fd, BLOCK_SIZE_BYTES, BLOCK_SIZE_BYTES), 0);
+	ASSERT_EQ(block_store_get_used_blocks(fs->BlockStore_whole), used_blocks - 1);
+	ASSERT_EQ(fs_seek(fs, fd, 0, FS_SEEK_SET), 0);
+	ASSERT_EQ(fs_read(fs, fd, buffer, sizeof(buffer)), (ssize_t) sizeof(buffer));
+	ASSERT_EQ(memcmp(buffer, data, BLOCK_SIZE_BYTES), 0);
+	for (size_t i = BLOCK_SIZE_BYTES; i < 2 * BLOCK_SIZE_BYTES; ++i) {
+		ASSERT_EQ(buffer[i], 0);
+	}
+	ASSERT_EQ(memcmp(buffer + 2 * BLOCK_SIZE_BYTES, data, BLOCK_SIZE_BYTES), 0);
+
+	// 4. Normal, punch the middle of the last block
+	ASSERT_EQ(fs_punch_hole(fs, fd, 2 * BLOCK_SIZE_BYTES + 10, 20), 0);
+	ASSERT_EQ(block_store_get_used_blocks(fs->BlockStore_whole), used_blocks - 1);
+	ASSERT_EQ(fs_seek(fs, fd, 2 * BLOCK_SIZE_BYTES, FS_SEEK_SET), 2 * BLOCK_SIZE_BYTES);
+	ASSERT_EQ(fs_read(fs, fd, buffer, 40), 40);
+	ASSERT_EQ(buffer[9], 0x7C);
+	ASSERT_EQ(buffer[10], 0);
+	ASSERT_EQ(buffer[29], 0);
+	ASSERT_EQ(buffer[30], 0x7C);
+
+	// 5. Normal, end of file is still where the far write left it
+	ASSERT_EQ(fs_seek(fs, fd, -10, FS_SEEK_END), far);
+
+	// 6. Error
+	ASSERT_LT(fs_punch_hole(NULL, fd, 0, 10), 0);
+	ASSERT_LT(fs_punch_hole(fs, 200, 0, 10), 0);
+	ASSERT_LT(fs_punch_hole(fs, fd, -1, 10), 0);
+
+	ASSERT_EQ(fs_close(fs, fd), 0);
+	fs_unmount(fs);
+}
+
+
+/*
+   Preallocation
+   int fs_fallocate(FS *fs, int fd, off_t offset, off_t len);
+   1. Normal, the range is reserved as one unwritten extent and the file grows to cover it
+   2. Normal, unwritten blocks read back as zeros
+   3. Normal, writes land in the reserved blocks without allocating data blocks
+   4. Normal, a write inside an extent splits it, punching releases what is left unwritten
+   5. Normal, a range that fits in the inode keeps the file inline
+   6. Error, FS NULL / bad fd / bad range
+ */
+TEST(o_tests, fallocate)
+{
+	const char *test_fname = "o_tests.FS";
+	FS *fs = fs_format(test_fname);
+	ASSERT_NE(fs, nullptr);
+	ASSERT_EQ(fs_create(fs, "/ingest", FS_REGULAR), 0);
+	int fd = fs_open(fs, "/ingest");
+	ASSERT_GE(fd, 0);
+	size_t used_blocks = block_store_get_used_blocks(fs->BlockStore_whole);
+
+	// 1. Normal, 12 blocks are reserved up front as one contiguous extent
+	const off_t size = 12 * BLOCK_SIZE_BYTES;
+	ASSERT_EQ(fs_fallocate(fs, fd, 0, size), 0);
+	ASSERT_EQ(block_store_get_used_blocks(fs->BlockStore_whole), used_blocks + 12);
+	ASSERT_EQ(fs_seek(fs, fd, 0, FS_SEEK_END), size);
+	inode_t inode;
+	ASSERT_NE(inode_load(fs, 1, &inode), 0u);
+	ASSERT_EQ(inode.extents[0].logicalBlock, 0u);
+	ASSERT_EQ(inode.extents[0].blockCount, 12);
+	ASSERT_EQ(inode.directPointer[0], 0);
+
+	// 2. Normal, unwritten blocks read back as zeros
+	uint8_t buffer[BLOCK_SIZE_BYTES];
+	memset(buffer, 0xFF, sizeof(buffer));
+	ASSERT_EQ(fs_seek(fs, fd, 5 * BLOCK_SIZE_BYTES, FS_SEEK_SET), 5 * BLOCK_SIZE_BYTES);
+	ASSERT_EQ(fs_read(fs, fd, buffer, sizeof(buffer)), (ssize_t) sizeof(buffer));
+	for (size_t i = 0; i < sizeof(buffer); ++i) {
+		ASSERT_EQ(buffer[i], 0);
+	}
+
+	// 3. Normal, filling the file takes no further blocks (bar the indirect block) and lands in the reserved run
+	uint8_t data[BLOCK_SIZE_BYTES];
+	memset(data, 0x3D, sizeof(data));
+	uint16_t start_block = inode.extents[0].startBlock;
+	ASSERT_EQ(fs_seek(fs, fd, 0, FS_SEEK_SET), 0);
+	for (int i = 0; i < 12; ++i) {
+		ASSERT_EQ(fs_write(fs, fd, data, sizeof(data)), (ssize_t) sizeof(data));
+	}
+	ASSERT_EQ(block_store_get_used_blocks(fs->BlockStore_whole), used_blocks + 13);
+	ASSERT_EQ(fs_seek(fs, fd, 0, FS_SEEK_END), size);
+	ASSERT_NE(inode_load(fs, 1, &inode), 0u);
+	for (int i = 0; i < number_direct_pointers; ++i) {
+		ASSERT_EQ(inode.directPointer[i], start_block + i);
+	}
+	for (size_t i = 0; i < FS_INODE_EXTENTS; ++i) {
+		ASSERT_EQ(inode.extents[i].blockCount, 0);
+	}
+	ASSERT_EQ(fs_seek(fs, fd, 11 * BLOCK_SIZE_BYTES, FS_SEEK_SET), 11 * BLOCK_SIZE_BYTES);
+	ASSERT_EQ(fs_read(fs, fd, buffer, sizeof(buffer)), (ssize_t) sizeof(buffer));
+	ASSERT_EQ(memcmp(buffer, data, sizeof(data)), 0);
+
+	// 4. Normal, writing into the middle of a reservation splits it, punching drops the unwritten part
+	ASSERT_EQ(fs_fallocate(fs, fd, size, 4 * BLOCK_SIZE_BYTES), 0);
+	used_blocks = block_store_get_used_blocks(fs->BlockStore_whole);
+	ASSERT_EQ(fs_seek(fs, fd, size + BLOCK_SIZE_BYTES, FS_SEEK_SET), size + BLOCK_SIZE_BYTES);
+	ASSERT_EQ(fs_write(fs, fd, data, 10), 10);
+	ASSERT_EQ(block_store_get_used_blocks(fs->BlockStore_whole), used_blocks);
+	ASSERT_EQ(fs_punch_hole(fs, fd, size, 4 * BLOCK_SIZE_BYTES), 0);
+	ASSERT_EQ(block_store_get_used_blocks(fs->BlockStore_whole), used_blocks - 4);
+	ASSERT_EQ(fs_seek(fs, fd, 0, FS_SEEK_END), size + 4 * BLOCK_SIZE_BYTES);
+
+	// 5. Normal, a small range on an empty file stays inline
+	ASSERT_EQ(fs_create(fs, "/small", FS_REGULAR), 0);
+	int small_fd = fs_open(fs, "/small");
+	ASSERT_GE(small_fd, 0);
+	ASSERT_EQ(fs_fallocate(fs, small_fd, 0, 16), 0);
+	ASSERT_EQ(fs_seek(fs, small_fd, 0, FS_SEEK_END), 16);
+	ASSERT_NE(inode_load(fs, 2, &inode), 0u);
+	ASSERT_TRUE(inode.flags & FS_INODE_INLINE);
+	ASSERT_EQ(fs_close(fs, small_fd), 0);
+
+	// 6. Error
+	ASSERT_LT(fs_fallocate(NULL, fd, 0, 10), 0);
+	ASSERT_LT(fs_fallocate(fs, 200, 0, 10), 0);
+	ASSERT_LT(fs_fallocate(fs, fd, -1, 10), 0);
+	ASSERT_LT(fs_fallocate(fs, fd, 0, 0), 0);
+	ASSERT_LT(fs_fallocate(fs, fd, 0, FS_MAX_FILE_SIZE + 1), 0);
+
+	ASSERT_EQ(fs_close(fs, fd), 0);
+	fs_unmount(fs);
+}
+
+
+
+/*
+   Hard link counts
+   1. Normal, each link bumps the link count, blocks are shared not copied
+   2. Normal, removing a link keeps the blocks while another link is left
+   3. Normal, removing the last link frees the blocks and closes its descriptors
+   4. Normal, an empty directory linked twice outlives its first name
+ */
+TEST(p_tests, link_count)
+{
+	const char *test_fname = "p_tests.FS";
+	FS *fs = fs_format(test_fname);
+	ASSERT_NE(fs, nullptr);
+
+	// 1. Normal
+	ASSERT_EQ(fs_create(fs, "/data", FS_REGULAR), 0);
+	ASSERT_EQ(fs_create(fs, "/copies", FS_DIRECTORY), 0);
+	size_t used_blocks = block_store_get_used_blocks(fs->BlockStore_whole); // root has its block now
+	int fd = fs_open(fs, "/data");
+	ASSERT_GE(fd, 0);
+	uint8_t data[BLOCK_SIZE_BYTES * 3];
+	memset(data, 0x5A, sizeof(data));
+	ASSERT_EQ(fs_write(fs, fd, data, sizeof(data)), (ssize_t) sizeof(data));
+	ASSERT_EQ(fs_close(fs, fd), 0);
+	size_t data_blocks = block_store_get_used_blocks(fs->BlockStore_whole) + 1; // and the block /copies gets for its entries
+	ASSERT_EQ(fs_link(fs, "/data", "/copies/one"), 0);
+	ASSERT_EQ(fs_link(fs, "/data", "/copies/two"), 0);
+	ASSERT_EQ(block_store_get_used_blocks(fs->BlockStore_whole), data_blocks);
+	inode_t inode;
+	ASSERT_NE(inode_load(fs, fs_path_lookup(fs, "/data"), &inode), 0u);
+	ASSERT_EQ(inode.linkCount, 3u);
+	ASSERT_EQ(fs_path_lookup(fs, "/copies/two"), fs_path_lookup(fs, "/data"));
+
+	// 2. Normal
+	ASSERT_EQ(fs_remove(fs, "/data"), 0);
+	ASSERT_EQ(fs_remove(fs, "/copies/one"), 0);
+	ASSERT_EQ(block_store_get_used_blocks(fs->BlockStore_whole), data_blocks);
+	fd = fs_open(fs, "/copies/two");
+	ASSERT_GE(fd, 0);
+	uint8_t buffer[BLOCK_SIZE_BYTES * 3];
+	ASSERT_EQ(fs_read(fs, fd, buffer, sizeof(buffer)), (ssize_t) sizeof(buffer));
+	ASSERT_EQ(memcmp(buffer, data, sizeof(data)), 0);
+
+	// 3. Normal
+	ASSERT_EQ(fs_remove(fs, "/copies/two"), 0);
+	ASSERT_LT(fs_read(fs, fd, buffer, 1), 0);
+	ASSERT_EQ(fs_remove(fs, "/copies"), 0);
+	ASSERT_EQ(block_store_get_used_blocks(fs->BlockStore_whole), used_blocks);
+
+	// 4. Normal
+	ASSERT_EQ(fs_create(fs, "/empty", FS_DIRECTORY), 0);
+	ASSERT_EQ(fs_link(fs, "/empty", "/alias"), 0);
+	ASSERT_EQ(fs_remove(fs, "/empty"), 0);
+	ASSERT_EQ(fs_create(fs, "/alias/child", FS_REGULAR), 0);
+	ASSERT_EQ(fs_remove(fs, "/alias/child"), 0);
+	ASSERT_EQ(fs_remove(fs, "/alias"), 0);
+
+	fs_unmount(fs);
+}
+
+
+
+/*
+   Copy-on-write clones
+   int fs_clone(FS *fs, const char *src, const char *dst);
+   int fs_snapshot(FS *fs, const char *src, const char *dst);
+   1. Normal, a clone reads the same as its source without taking data blocks
+   2. Normal, writing to the clone copies just the block written, the source is unchanged
+   3. Normal, removing the source keeps the blocks the clone still shares
+   4. Normal, snapshot of the whole volume, taken into the volume itself
+   5. Normal, the reference counts survive an unmount/mount round trip
+   6. Error, dst exists / src missing / directory to fs_clone / file to fs_snapshot / NULL
+ */
+TEST(q_tests, clone_snapshot)
+{
+	const char *test_fname = "q_tests.FS";
+	FS *fs = fs_format(test_fname);
+	ASSERT_NE(fs, nullptr);
+
+	// 1. Normal, 20 blocks, reaching into the indirect range
+	ASSERT_EQ(fs_create(fs, "/fixture", FS_REGULAR), 0);
+	int fd = fs_open(fs, "/fixture");
+	ASSERT_GE(fd, 0);
+	uint8_t data[BLOCK_SIZE_BYTES * 20];
+	for (size_t i = 0; i < sizeof(data); ++i) {
+		data[i] = (uint8_t)(i / BLOCK_SIZE_BYTES + 1);
+	}
+	ASSERT_EQ(fs_write(fs, fd, data, sizeof(data)), (ssize_t) sizeof(data));
+	ASSERT_EQ(fs_close(fs, fd), 0);
+	size_t used_blocks = block_store_get_used_blocks(fs->BlockStore_whole);
+	ASSERT_EQ(fs_clone(fs, "/fixture", "/copy"), 0);
+	// the reference counts and the clone's own indirect block
+	ASSERT_EQ(block_store_get_used_blocks(fs->BlockStore_whole), used_blocks + number_ref_blocks + 1);
+	used_blocks = block_store_get_used_blocks(fs->BlockStore_whole);
+	uint8_t buffer[BLOCK_SIZE_BYTES * 20];
+	fd = fs_open(fs, "/copy");
+	ASSERT_GE(fd, 0);
+	ASSERT_EQ(fs_read(fs, fd, buffer, sizeof(buffer)), (ssize_t) sizeof(buffer));
+	ASSERT_EQ(memcmp(buffer, data, sizeof(data)), 0);
+
+	// 2. Normal
+	uint8_t patch[10];
+	memset(patch, 0xEE, sizeof(patch));
+	ASSERT_EQ(fs_seek(fs, fd, 8 * BLOCK_SIZE_BYTES + 5, FS_SEEK_SET), 8 * BLOCK_SIZE_BYTES + 5);
+	ASSERT_EQ(fs_write(fs, fd, patch, sizeof(patch)), (ssize_t) sizeof(patch));
+	ASSERT_EQ(block_store_get_used_blocks(fs->BlockStore_whole), used_blocks + 1);
+	ASSERT_EQ(fs_seek(fs, fd, 8 * BLOCK_SIZE_BYTES, FS_SEEK_SET), 8 * BLOCK_SIZE_BYTES);
+	ASSERT_EQ(fs_read(fs, fd, buffer, BLOCK_SIZE_BYTES), BLOCK_SIZE_BYTES);
+	ASSERT_EQ(buffer[4], 9);
+	ASSERT_EQ(memcmp(buffer + 5, patch, sizeof(patch)), 0);
+	ASSERT_EQ(buffer[15], 9);
+	ASSERT_EQ(fs_close(fs, fd), 0);
+	fd = fs_open(fs, "/fixture");
+	ASSERT_GE(fd, 0);
+	ASSERT_EQ(fs_read(fs, fd, buffer, sizeof(buffer)), (ssize_t) sizeof(buffer));
+	ASSERT_EQ(memcmp(buffer, data, sizeof(data)), 0);
+	ASSERT_EQ(fs_close(fs, fd), 0);
+
+	// 3. Normal, only the block the clone has its own copy of and the source's indirect block go
+	ASSERT_EQ(fs_remove(fs, "/fixture"), 0);
+	ASSERT_EQ(block_store_get_used_blocks(fs->BlockStore_whole), used_blocks - 1);
+
+	// 4. Normal
+	ASSERT_EQ(fs_create(fs, "/dir", FS_DIRECTORY), 0);
+	ASSERT_EQ(fs_link(fs, "/copy", "/dir/also_copy"), 0);
+	ASSERT_EQ(fs_snapshot(fs, "/", "/dir/snap"), 0);
+	dyn_array_t *record_results = fs_get_dir(fs, "/dir/snap");
+	ASSERT_NE(record_results, nullptr);
+	ASSERT_EQ(dyn_array_size(record_results), 2u);
+	dyn_array_destroy(record_results);
+	record_results = fs_get_dir(fs, "/dir/snap/dir");
+	ASSERT_NE(record_results, nullptr);
+	ASSERT_EQ(dyn_array_size(record_results), 1u); // not snap itself
+	dyn_array_destroy(record_results);
+	size_t snap_copy = fs_path_lookup(fs, "/dir/snap/copy");
+	ASSERT_NE(snap_copy, fs_path_lookup(fs, "/copy"));
+	ASSERT_EQ(snap_copy, fs_path_lookup(fs, "/dir/snap/dir/also_copy"));
+	inode_t inode;
+	ASSERT_NE(inode_load(fs, snap_copy, &inode), 0u);
+	ASSERT_EQ(inode.linkCount, 2u);
+	fd = fs_open(fs, "/dir/snap/copy");
+	ASSERT_GE(fd, 0);
+	ASSERT_EQ(fs_read(fs, fd, buffer, sizeof(buffer)), (ssize_t) sizeof(buffer));
+	ASSERT_EQ(buffer[0], 1);
+	ASSERT_EQ(buffer[8 * BLOCK_SIZE_BYTES + 5], 0xEE);
+	ASSERT_EQ(fs_close(fs, fd), 0);
+
+	// 5. Normal, a write after remounting still copies the shared block
+	fs_unmount(fs);
+	fs = fs_mount(test_fname);
+	ASSERT_NE(fs, nullptr);
+	used_blocks = block_store_get_used_blocks(fs->BlockStore_whole);
+	fd = fs_open(fs, "/copy");
+	ASSERT_GE(fd, 0);
+	ASSERT_EQ(fs_write(fs, fd, patch, sizeof(patch)), (ssize_t) sizeof(patch));
+	ASSERT_EQ(fs_close(fs, fd), 0);
+	ASSERT_EQ(block_store_get_used_blocks(fs->BlockStore_whole), used_blocks + 1);
+	fd = fs_open(fs, "/dir/snap/copy");
+	ASSERT_GE(fd, 0);
+	ASSERT_EQ(fs_read(fs, fd, buffer, 1), 1);
+	ASSERT_EQ(buffer[0], 1);
+	ASSERT_EQ(fs_close(fs, fd), 0);
+
+	// 6. Error
+	ASSERT_LT(fs_clone(fs, "/copy", "/dir/also_copy"), 0);
+	ASSERT_LT(fs_clone(fs, "/fixture", "/copy2"), 0);
+	ASSERT_LT(fs_clone(fs, "/dir", "/dir2"), 0);
+	ASSERT_LT(fs_clone(NULL, "/copy", "/copy2"), 0);
+	ASSERT_LT(fs_snapshot(fs, "/copy", "/snap2"), 0);
+	ASSERT_LT(fs_snapshot(fs, "/", "/dir/snap"), 0);
+	ASSERT_LT(fs_snapshot(fs, "/", "/"), 0);
+	ASSERT_LT(fs_snapshot(fs, nullptr, "/snap2"), 0);
+
+	fs_unmount(fs);
+}
+
+
+
+/*
+   Directory iterator
+   fs_dir_t *fs_opendir(FS *fs, const char *path);
+   int fs_readdir(fs_dir_t *dir, file_record_t *record);
+   ssize_t fs_readdir_batch(fs_dir_t *dir, file_record_t *records, size_t count);
+   1. Normal, every entry comes back once, with its type
+   2. Normal, batches smaller than the directory, then rewind
+   3. Normal, empty directory
+   4. Normal, entries made after opening are not seen
+   5. Error, file / missing path / NULL
+ */
+TEST(r_tests, readdir)
+{
+	const char *test_fname = "r_tests.FS";
+	FS *fs = fs_format(test_fname);
+	ASSERT_NE(fs, nullptr);
+	ASSERT_EQ(fs_create(fs, "/dir", FS_DIRECTORY), 0);
+	ASSERT_EQ(fs_create(fs, "/empty", FS_DIRECTORY), 0);
+	char path[32];
+	for (int i = 0; i < 10; ++i) {
+		sprintf(path, "/dir/%d", i);
+		ASSERT_EQ(fs_create(fs, path, i % 2 ? FS_DIRECTORY : FS_REGULAR), 0);
+	}
+	ASSERT_EQ(fs_remove(fs, "/dir/4"), 0);
+
+	// 1. Normal
+	fs_dir_t *dir = fs_opendir(fs, "/dir");
+	ASSERT_NE(dir, nullptr);
+	file_record_t record;
+	int seen = 0;
+	while (fs_readdir(dir, &record) == 1) {
+		int n = atoi(record.name);
+		ASSERT_NE(n, 4);
+		ASSERT_EQ(seen & (1 << n), 0);
+		seen |= 1 << n;
+		ASSERT_EQ(record.type, n % 2 ? FS_DIRECTORY : FS_REGULAR);
+	}
+	ASSERT_EQ(seen, 0x3FF & ~(1 << 4));
+	ASSERT_EQ(fs_readdir(dir, &record), 0);
+
+	// 2. Normal
+	ASSERT_EQ(fs_rewinddir(dir), 0);
+	file_record_t records[4];
+	ASSERT_EQ(fs_readdir_batch(dir, records, 4), 4);
+	ASSERT_EQ(fs_readdir_batch(dir, records, 4), 4);
+	ASSERT_EQ(fs_readdir_batch(dir, records, 4), 1);
+	ASSERT_EQ(fs_readdir_batch(dir, records, 4), 0);
+
+	// 4. Normal
+	ASSERT_EQ(fs_rewinddir(dir), 0);
+	ASSERT_EQ(fs_create(fs, "/dir/late", FS_REGULAR), 0);
+	ASSERT_EQ(fs_readdir_batch(dir, records, 4) + fs_readdir_batch(dir, records, 4) + fs_readdir_batch(dir, records, 4), 9);
+	ASSERT_EQ(fs_closedir(dir), 0);
+
+	// 3. Normal
+	dir = fs_opendir(fs, "/empty");
+	ASSERT_NE(dir, nullptr);
+	ASSERT_EQ(fs_readdir(dir, &record), 0);
+	ASSERT_EQ(fs_closedir(dir), 0);
+
+	// 5. Error
+	ASSERT_EQ(fs_opendir(fs, "/dir/0"), nullptr);
+	ASSERT_EQ(fs_opendir(fs, "/missing"), nullptr);
+	ASSERT_EQ(fs_opendir(fs, "dir"), nullptr);
+	ASSERT_EQ(fs_opendir(NULL, "/dir"), nullptr);
+	ASSERT_LT(fs_readdir(NULL, &record), 0);
+	ASSERT_LT(fs_readdir_batch(NULL, records, 4), 0);
+	ASSERT_LT(fs_closedir(NULL), 0);
+
+	fs_unmount(fs);
+}
+
+
+
+/*
+   Batched metadata operations
+   int fs_batch(FS *fs, fs_batch_entry_t *ops, size_t count);
+   1. Normal, bulk create in one directory, including into a directory made earlier in the batch
+   2. Normal, remove and move (rename and to another directory) in one batch
+   3. Normal, failed operations are reported and do not stop the rest
+   4. Normal, everything is on disk after a remount
+   5. Error, FS NULL
+ */
+TEST(s_tests, batch)
+{
+	const char *test_fname = "s_tests.FS";
+	FS *fs = fs_format(test_fname);
+	ASSERT_NE(fs, nullptr);
+
+	// 1. Normal
+	char paths[31][32];
+	vector<fs_batch_entry_t> ops;
+	ops.push_back({FS_BATCH_CREATE, "/bulk", nullptr, FS_DIRECTORY, 1});
+	for (int i = 0; i < 30; ++i) {
+		sprintf(paths[i], "/bulk/%02d", i);
+		ops.push_back({FS_BATCH_CREATE, paths[i], nullptr, FS_REGULAR, 1});
+	}
+	ops.push_back({FS_BATCH_CREATE, "/other", nullptr, FS_DIRECTORY, 1});
+	ASSERT_EQ(fs_batch(fs, ops.data(), ops.size()), 0);
+	for (const fs_batch_entry_t &op : ops) {
+		ASSERT_EQ(op.result, 0);
+	}
+	dyn_array_t *record_results = fs_get_dir(fs, "/bulk");
+	ASSERT_NE(record_results, nullptr);
+	ASSERT_EQ(dyn_array_size(record_results), 30u);
+	dyn_array_destroy(record_results);
+	int fd = fs_open(fs, "/bulk/07");
+	ASSERT_GE(fd, 0);
+	ASSERT_EQ(fs_write(fs, fd, "seven", 5), 5);
+	ASSERT_EQ(fs_close(fs, fd), 0);
+
+	// 2. Normal, 3. Normal
+	ops = {
+		{FS_BATCH_REMOVE, "/bulk/00", nullptr, FS_REGULAR, 1},
+		{FS_BATCH_REMOVE, "/bulk/00", nullptr, FS_REGULAR, 1},              // already gone
+		{FS_BATCH_MOVE, "/bulk/07", "/bulk/seven", FS_REGULAR, 1},
+		{FS_BATCH_MOVE, "/bulk/08", "/other/eight", FS_REGULAR, 1},
+		{FS_BATCH_CREATE, "/bulk/01", nullptr, FS_REGULAR, 1},              // exists
+		{FS_BATCH_CREATE, "/missing/file", nullptr, FS_REGULAR, 1},         // no parent
+		{FS_BATCH_MOVE, "/other", "/other/inside", FS_DIRECTORY, 1},        // into itself
+		{FS_BATCH_CREATE, "/bulk/30", nullptr, FS_REGULAR, 1},
+		{FS_BATCH_CREATE, "/bulk/", nullptr, FS_REGULAR, 1},                // no name
+		{FS_BATCH_REMOVE, "/other", nullptr, FS_REGULAR, 1},                // not empty
+		{FS_BATCH_REMOVE, nullptr, nullptr, FS_REGULAR, 1},
+	};
+	ASSERT_EQ(fs_batch(fs, ops.data(), ops.size()), 7);
+	const int expected[] = {0, -1, 0, 0, -1, -1, -1, 0, -1, -1, -1};
+	for (size_t i = 0; i < ops.size(); ++i) {
+		ASSERT_EQ(ops[i].result < 0 ? -1 : 0, expected[i]);
+	}
+
+	// 4. Normal
+	fs_unmount(fs);
+	fs = fs_mount(test_fname);
+	ASSERT_NE(fs, nullptr);
+	ASSERT_EQ(fs_path_lookup(fs, "/bulk/00"), SIZE_MAX);
+	ASSERT_EQ(fs_path_lookup(fs, "/bulk/07"), SIZE_MAX);
+	ASSERT_NE(fs_path_lookup(fs, "/bulk/30"), SIZE_MAX);
+	ASSERT_NE(fs_path_lookup(fs, "/other/eight"), SIZE_MAX);
+	fd = fs_open(fs, "/bulk/seven");
+	ASSERT_GE(fd, 0);
+	char buffer[8] = {0};
+	ASSERT_EQ(fs_read(fs, fd, buffer, sizeof(buffer)), 5);
+	ASSERT_STREQ(buffer, "seven");
+	ASSERT_EQ(fs_close(fs, fd), 0);
+	record_results = fs_get_dir(fs, "/bulk");
+	ASSERT_NE(record_results, nullptr);
+	ASSERT_EQ(dyn_array_size(record_results), 29u);
+	dyn_array_destroy(record_results);
+
+	// 5. Error
+	ASSERT_LT(fs_batch(NULL, ops.data(), ops.size()), 0);
+	ASSERT_LT(fs_batch(fs, NULL, 1), 0);
+
+	fs_unmount(fs);
+}
+
+
+
+/*
+   Directory handles
+   fs_dir_t *fs_opendirat(fs_dir_t *dir, const char *path);
+   int fs_openat(fs_dir_t *dir, const char *path);
+   int fs_createat(fs_dir_t *dir, const char *path, file_t type);
+   int fs_removeat(fs_dir_t *dir, const char *path);
+   1. Normal, create and open by name and by relative path
+   2. Normal, a handle on a subdirectory, an absolute path still starts from root
+   3. Normal, remove by name
+   4. Error, name taken / file opened as directory and the other way round / missing / NULL
+ */
+TEST(t_tests, at_calls)
+{
+	const char *test_fname = "t_tests.FS";
+	FS *fs = fs_format(test_fname);
+	ASSERT_NE(fs, nullptr);
+	ASSERT_EQ(fs_create(fs, "/work", FS_DIRECTORY), 0);
+	fs_dir_t *work = fs_opendir(fs, "/work");
+	ASSERT_NE(work, nullptr);
+
+	// 1. Normal
+	ASSERT_EQ(fs_createat(work, "job", FS_REGULAR), 0);
+	ASSERT_EQ(fs_createat(work, "sub", FS_DIRECTORY), 0);
+	ASSERT_EQ(fs_createat(work, "sub/part", FS_REGULAR), 0);
+	ASSERT_NE(fs_path_lookup(fs, "/work/sub/part"), SIZE_MAX);
+	int fd = fs_openat(work, "sub/part");
+	ASSERT_GE(fd, 0);
+	ASSERT_EQ(fs_write(fs, fd, "part", 4), 4);
+	ASSERT_EQ(fs_close(fs, fd), 0);
+	fd = fs_open(fs, "/work/sub/part");
+	ASSERT_GE(fd, 0);
+	char buffer[8] = {0};
+	ASSERT_EQ(fs_read(fs, fd, buffer, sizeof(buffer)), 4);
+	ASSERT_STREQ(buffer, "part");
+	ASSERT_EQ(fs_close(fs, fd), 0);
+
+	// 2. Normal
+	fs_dir_t *sub = fs_opendirat(work, "sub");
+	ASSERT_NE(sub, nullptr);
+	fd = fs_openat(sub, "part");
+	ASSERT_GE(fd, 0);
+	ASSERT_EQ(fs_close(fs, fd), 0);
+	fd = fs_openat(sub, "/work/job");
+	ASSERT_GE(fd, 0);
+	ASSERT_EQ(fs_close(fs, fd), 0);
+
+	// 3. Normal
+	ASSERT_EQ(fs_removeat(sub, "part"), 0);
+	ASSERT_EQ(fs_path_lookup(fs, "/work/sub/part"), SIZE_MAX);
+	ASSERT_EQ(fs_closedir(sub), 0);
+	ASSERT_EQ(fs_removeat(work, "sub"), 0);
+
+	// 4. Error
+	ASSERT_LT(fs_createat(work, "job", FS_REGULAR), 0);
+	ASSERT_LT(fs_createat(work, "", FS_REGULAR), 0);
+	ASSERT_LT(fs_createat(work, "missing/file", FS_REGULAR), 0);
+	ASSERT_LT(fs_openat(work, "missing"), 0);
+	ASSERT_LT(fs_openat(work, ""), 0);
+	ASSERT_EQ(fs_opendirat(work, "job"), nullptr);
+	ASSERT_LT(fs_removeat(work, "missing"), 0);
+	ASSERT_LT(fs_createat(NULL, "job", FS_REGULAR), 0);
+	ASSERT_LT(fs_openat(NULL, "job"), 0);
+	ASSERT_LT(fs_removeat(work, NULL), 0);
+
+	ASSERT_EQ(fs_closedir(work), 0);
+	fs_unmount(fs);
+}
+
+
+
+/*
+   File and volume status
+   int fs_stat(FS_t *fs, const char *path, fs_stat_t *st);
+   int fs_fstat(FS_t *fs, int fd, fs_stat_t *st);
+   int fs_statfs(FS_t *fs, fs_statfs_t *st);
+   1. Normal, a file and a directory, by path and by descriptor
+   2. Normal, free counts follow create / write / clone / remove and survive a remount
+   3. Error, missing file / closed descriptor / NULL
+ */
+// free blocks and inodes counted the slow way, what the counters must match
+static void u_count_free(FS *fs, size_t *blocks, size_t *inodes)
+{
+	*blocks = block_store_get_free_blocks(fs->BlockStore_whole);
+	*inodes = 0;
+	for (size_t i = 0; i < number_inodes; i++)
+		if (!block_store_sub_test(fs->BlockStore_inode, i))
+			(*inodes)++;
+}
+
+TEST(u_tests, stat)
+{
+	const char *test_fname = "u_tests.FS";
+	FS *fs = fs_format(test_fname);
+	ASSERT_NE(fs, nullptr);
+	fs_statfs_t vol;
+	size_t blocks, inodes;
+
+	// 1. Normal
+	ASSERT_EQ(fs_create(fs, "/dir", FS_DIRECTORY), 0);
+	ASSERT_EQ(fs_create(fs, "/dir/file", FS_REGULAR), 0);
+	int fd = fs_open(fs, "/dir/file");
+	ASSERT_GE(fd, 0);
+	uint8_t data[3 * BLOCK_SIZE_BYTES + 10];
+	memset(data, 0x5A, sizeof(data));
+	ASSERT_EQ(fs_write(fs, fd, data, sizeof(data)), (ssize_t)sizeof(data));
+	fs_stat_t st;
+	ASSERT_EQ(fs_stat(fs, "/dir/file", &st), 0);
+	ASSERT_EQ(st.type, FS_REGULAR);
+	ASSERT_EQ(st.fileSize, sizeof(data));
+	ASSERT_EQ(st.linkCount, 1u);
+	ASSERT_EQ(st.inodeNumber, fs_path_lookup(fs, "/dir/file"));
+	fs_stat_t fst;
+	ASSERT_EQ(fs_fstat(fs, fd, &fst), 0);
+	ASSERT_EQ(memcmp(&st, &fst, sizeof(st)), 0);
+	ASSERT_EQ(fs_stat(fs, "/dir", &st), 0);
+	ASSERT_EQ(st.type, FS_DIRECTORY);
+	ASSERT_EQ(fs_stat(fs, "/", &st), 0);
+	ASSERT_EQ(st.inodeNumber, 0u);
+	ASSERT_EQ(fs_close(fs, fd), 0);
+
+	// 2. Normal
+	ASSERT_EQ(fs_statfs(fs, &vol), 0);
+	ASSERT_EQ(vol.blockSize, (size_t)BLOCK_SIZE_BYTES);
+	ASSERT_EQ(vol.totalInodes, (size_t)number_inodes);
+	u_count_free(fs, &blocks, &inodes);
+	ASSERT_EQ(vol.freeBlocks, blocks);
+	ASSERT_EQ(vol.freeInodes, inodes);
+	ASSERT_EQ(vol.freeInodes, (size_t)number_inodes - 3);
+	size_t before = vol.freeBlocks;
+	ASSERT_EQ(fs_clone(fs, "/dir/file", "/dir/copy"), 0);
+	ASSERT_EQ(fs_statfs(fs, &vol), 0);
+	u_count_free(fs, &blocks, &inodes);
+	ASSERT_EQ(vol.freeBlocks, blocks);
+	ASSERT_EQ(vol.freeInodes, inodes);
+	ASSERT_GT(before, vol.freeBlocks);	// the reference count table
+	fd = fs_open(fs, "/dir/copy");
+	ASSERT_GE(fd, 0);
+	ASSERT_EQ(fs_write(fs, fd, data, 10), 10);	// copies the first shared block
+	ASSERT_EQ(fs_close(fs, fd), 0);
+	ASSERT_EQ(fs_remove(fs, "/dir/file"), 0);
+	ASSERT_EQ(fs_statfs(fs, &vol), 0);
+	u_count_free(fs, &blocks, &inodes);
+	ASSERT_EQ(vol.freeBlocks, blocks);
+	ASSERT_EQ(vol.freeInodes, inodes);
+	fs_unmount(fs);
+	fs = fs_mount(test_fname);
+	ASSERT_NE(fs, nullptr);
+	fs_statfs_t mounted;
+	ASSERT_EQ(fs_statfs(fs, &mounted), 0);
+	ASSERT_EQ(memcmp(&vol, &mounted, sizeof(vol)), 0);
+
+	// 3. Error
+	ASSERT_LT(fs_stat(fs, "/dir/file", &st), 0);
+	ASSERT_LT(fs_stat(fs, "dir", &st), 0);
+	ASSERT_LT(fs_stat(fs, "/dir", NULL), 0);
+	ASSERT_LT(fs_stat(NULL, "/dir", &st), 0);
+	ASSERT_LT(fs_fstat(fs, 0, &st), 0);
+	ASSERT_LT(fs_fstat(fs, -1, &st), 0);
+	ASSERT_LT(fs_statfs(fs, NULL), 0);
+	ASSERT_LT(fs_statfs(NULL, &vol), 0);
+	fs_unmount(fs);
+}
+
+
+
+/*
+   Defragmentation
+   int fs_defrag(FS_t *fs, const char *path);
+   int fs_defrag_volume(FS_t *fs);
+   int fs_file_frag(FS_t *fs, const char *path, fs_frag_t *frag);
+   int fs_volume_frag(FS_t *fs, fs_frag_t *frag);
+   1. Normal, two files written a block at a time in turn are fully scattered
+   2. Normal, defragmenting one puts it in a single run, contents and open descriptors intact
+   3. Normal, the volume pass packs the files left toward the start and joins up free space
+   4. Normal, a file sharing blocks with a clone is left alone
+   5. Error, missing file / directory / NULL
+ */
+TEST(v_tests, defrag)
+{
+	const char *test_fname = "v_tests.FS";
+	FS *fs = fs_format(test_fname);
+	ASSERT_NE(fs, nullptr);
+	const size_t count = 10;	// past the direct pointers, so an indirect block is moved too
+	uint8_t block[BLOCK_SIZE_BYTES];
+	fs_frag_t frag;
+	size_t blocks, inodes;
+
+	// 1. Normal
+	ASSERT_EQ(fs_create(fs, "/a", FS_REGULAR), 0);
+	ASSERT_EQ(fs_create(fs, "/b", FS_REGULAR), 0);
+	int fd_a = fs_open(fs, "/a");
+	int fd_b = fs_open(fs, "/b");
+	ASSERT_GE(fd_a, 0);
+	ASSERT_GE(fd_b, 0);
+	for (size_t i = 0; i < count; i++) {
+		memset(block, 'a' + (int)i, sizeof(block));
+		ASSERT_EQ(fs_write(fs, fd_a, block, sizeof(block)), (ssize_t)sizeof(block));
+		memset(block, 'A' + (int)i, sizeof(block));
+		ASSERT_EQ(fs_write(fs, fd_b, block, sizeof(block)), (ssize_t)sizeof(block));
+	}
+	ASSERT_EQ(fs_file_frag(fs, "/a", &frag), 0);
+	ASSERT_EQ(frag.files, 1u);
+	ASSERT_EQ(frag.blocks, count);
+	ASSERT_GT(frag.score, 0.5);
+	fs_frag_t before;
+	ASSERT_EQ(fs_volume_frag(fs, &before), 0);
+	ASSERT_EQ(before.files, 2u);
+	ASSERT_EQ(before.blocks, 2 * count);
+	ASSERT_GT(before.score, 0.5);
+
+	// 2. Normal
+	ASSERT_EQ(fs_defrag(fs, "/a"), 0);
+	ASSERT_EQ(fs_file_frag(fs, "/a", &frag), 0);
+	ASSERT_EQ(frag.breaks, 0u);
+	ASSERT_EQ(frag.score, 0.0);
+	ASSERT_EQ(fs_volume_frag(fs, &frag), 0);
+	ASSERT_LT(frag.score, before.score);
+	ASSERT_EQ(fs_seek(fs, fd_a, 0, FS_SEEK_SET), 0);
+	for (size_t i = 0; i < count; i++) {
+		ASSERT_EQ(fs_read(fs, fd_a, block, sizeof(block)), (ssize_t)sizeof(block));
+		ASSERT_EQ(block[0], 'a' + (int)i);
+		ASSERT_EQ(block[BLOCK_SIZE_BYTES - 1], 'a' + (int)i);
+	}
+	ASSERT_EQ(fs_defrag(fs, "/a"), 0);	// already contiguous
+	u_count_free(fs, &blocks, &inodes);
+	fs_statfs_t vol;
+	ASSERT_EQ(fs_statfs(fs, &vol), 0);
+	ASSERT_EQ(vol.freeBlocks, blocks);
+
+	// 3. Normal
+	ASSERT_EQ(fs_close(fs, fd_b), 0);
+	ASSERT_EQ(fs_remove(fs, "/b"), 0);
+	ASSERT_EQ(fs_volume_frag(fs, &before), 0);
+	ASSERT_GT(before.freeScore, 0.0);
+	ASSERT_EQ(fs_defrag_volume(fs), 1);
+	ASSERT_EQ(fs_volume_frag(fs, &frag), 0);
+	ASSERT_EQ(frag.score, 0.0);
+	ASSERT_LT(frag.freeScore, before.freeScore);
+	ASSERT_GT(frag.largestFree, before.largestFree);
+	ASSERT_EQ(fs_defrag_volume(fs), 0);	// nothing left to pack
+	ASSERT_EQ(fs_seek(fs, fd_a, 0, FS_SEEK_SET), 0);
+	for (size_t i = 0; i < count; i++) {
+		ASSERT_EQ(fs_read(fs, fd_a, block, sizeof(block)), (ssize_t)sizeof(block));
+		ASSERT_EQ(block[BLOCK_SIZE_BYTES / 2], 'a' + (int)i);
+	}
+	ASSERT_EQ(fs_close(fs, fd_a), 0);
+	u_count_free(fs, &blocks, &inodes);
+	ASSERT_EQ(fs_statfs(fs, &vol), 0);
+	ASSERT_EQ(vol.freeBlocks, blocks);
+
+	// 4. Normal
+	ASSERT_EQ(fs_create(fs, "/c", FS_REGULAR), 0);
+	ASSERT_EQ(fs_create(fs, "/d", FS_REGULAR), 0);
+	int fd_c = fs_open(fs, "/c");
+	int fd_d = fs_open(fs, "/d");
+	for (size_t i = 0; i < 3; i++) {
+		ASSERT_EQ(fs_write(fs, fd_c, block, sizeof(block)), (ssize_t)sizeof(block));
+		ASSERT_EQ(fs_write(fs, fd_d, block, sizeof(block)), (ssize_t)sizeof(block));
+	}
+	ASSERT_EQ(fs_close(fs, fd_c), 0);
+	ASSERT_EQ(fs_close(fs, fd_d), 0);
+	ASSERT_EQ(fs_clone(fs, "/c", "/e"), 0);
+	ASSERT_EQ(fs_file_frag(fs, "/c", &before), 0);
+	ASSERT_GT(before.breaks, 0u);
+	ASSERT_EQ(fs_defrag(fs, "/c"), 0);
+	ASSERT_EQ(fs_file_frag(fs, "/c", &frag), 0);
+	ASSERT_EQ(frag.breaks, before.breaks);
+	ASSERT_EQ(fs_defrag(fs, "/d"), 0);
+	ASSERT_EQ(fs_file_frag(fs, "/d", &frag), 0);
+	ASSERT_EQ(frag.breaks, 0u);
+
+	// 5. Error
+	ASSERT_LT(fs_defrag(fs, "/missing"), 0);
+	ASSERT_LT(fs_defrag(fs, "/"), 0);
+	ASSERT_LT(fs_defrag(fs, NULL), 0);
+	ASSERT_LT(fs_defrag(NULL, "/a"), 0);
+	ASSERT_LT(fs_defrag_volume(NULL), 0);
+	ASSERT_LT(fs_file_frag(fs, "/missing", &frag), 0);
+	ASSERT_LT(fs_file_frag(fs, "/", &frag), 0);
+	ASSERT_LT(fs_file_frag(fs, "/a", NULL), 0);
+	ASSERT_LT(fs_volume_frag(fs, NULL), 0);
+	ASSERT_LT(fs_volume_frag(NULL, &frag), 0);
+	fs_unmount(fs);
+}
+
+
+
+/*
+   Consistency check
+   int fs_check(FS_t *fs, bool repair, size_t threads, fs_check_t *report);
+   1. Normal, a clean FS with every kind of file (inline, linked, cloned, reserved, emptied directory) has no problems
+   2. Normal, one problem of each kind put in behind FS's back is found, and gone once repaired
+   3. Normal, mounting an image that was never unmounted repairs it
+   4. Normal, an FS_MOUNT_INSPECT mount of it repairs nothing and leaves it marked as never unmounted
+   5. Error, NULL
+ */
+TEST(w_tests, check)
+{
+	const char *test_fname = "w_tests.FS";
+	FS *fs = fs_format(test_fname);
+	ASSERT_NE(fs, nullptr);
+	fs_check_t report;
+	size_t blocks, inodes;
+	uint8_t block[BLOCK_SIZE_BYTES];
+	memset(block, 0x3C, sizeof(block));
+
+	// 1. Normal
+	ASSERT_EQ(fs_create(fs, "/dir", FS_DIRECTORY), 0);
+	ASSERT_EQ(fs_create(fs, "/empty", FS_DIRECTORY), 0);
+	ASSERT_EQ(fs_create(fs, "/empty/gone", FS_REGULAR), 0);
+	ASSERT_EQ(fs_remove(fs, "/empty/gone"), 0);
+	ASSERT_EQ(fs_create(fs, "/dir/small", FS_REGULAR), 0);
+	ASSERT_EQ(fs_create(fs, "/dir/data", FS_REGULAR), 0);
+	ASSERT_EQ(fs_create(fs, "/dir/big", FS_REGULAR), 0);
+	int fd = fs_open(fs, "/dir/small");
+	ASSERT_EQ(fs_write(fs, fd, "tiny", 4), 4);
+	ASSERT_EQ(fs_close(fs, fd), 0);
+	fd = fs_open(fs, "/dir/data");
+	for (size_t i = 0; i < 3; i++)
+		ASSERT_EQ(fs_write(fs, fd, block, sizeof(block)), (ssize_t)sizeof(block));
+	ASSERT_EQ(fs_close(fs, fd), 0);
+	fd = fs_open(fs, "/dir/big");
+	for (size_t i = 0; i < number_direct_pointers + 2; i++)
+		ASSERT_EQ(fs_write(fs, fd, block, sizeof(block)), (ssize_t)sizeof(block));
+	ASSERT_EQ(fs_fallocate(fs, fd, 20 * BLOCK_SIZE_BYTES, 4 * BLOCK_SIZE_BYTES), 0);
+	ASSERT_EQ(fs_close(fs, fd), 0);
+	ASSERT_EQ(fs_link(fs, "/dir/data", "/linked"), 0);
+	ASSERT_EQ(fs_clone(fs, "/dir/big", "/copy"), 0);
+	ASSERT_EQ(fs_check(fs, false, 1, &report), 0);
+	ASSERT_EQ(fs_check(fs, false, 4, NULL), 0);
+	ASSERT_EQ(fs_check(fs, true, 0, &report), 0);
+
+	// 2. Normal
+	size_t leaked = fs_block_alloc(fs);	// in use, held by nobody
+	ASSERT_NE(leaked, 0u);
+	inode_t data;
+	size_t data_ID = fs_path_lookup(fs, "/dir/data");
+	inode_load(fs, data_ID, &data);
+	block_store_release(fs->BlockStore_whole, data.directPointer[1]);	// held, but free
+	data.linkCount = 5;	// /dir/data and /linked are all there is
+	inode_store(fs, data_ID, &data);
+	inode_t big;
+	size_t big_ID = fs_path_lookup(fs, "/dir/big");
+	inode_load(fs, big_ID, &big);
+	big.directPointer[2] = 2;	// a block of the inode table, /copy is now the only one sharing the block that was there
+	inode_store(fs, big_ID, &big);
+	inode_t orphan;
+	size_t orphan_ID = fs_inode_alloc(fs);
+	memset(&orphan, 0, sizeof(orphan));
+	orphan.fileType = 'r';
+	orphan.flags = FS_INODE_INLINE;
+	orphan.inodeNumber = orphan_ID;
+	orphan.linkCount = 1;
+	inode_store(fs, orphan_ID, &orphan);
+	ASSERT_EQ(dir_entry_add(fs, fs_path_lookup(fs, "/dir"), "ghost", orphan_ID + 1), 0);
+	ASSERT_EQ(fs_check(fs, false, 4, &report), 7);
+	ASSERT_EQ(report.blocksLeaked, 1u);
+	ASSERT_EQ(report.blocksMissing, 1u);
+	ASSERT_EQ(report.linkCounts, 1u);
+	ASSERT_EQ(report.orphanInodes, 1u);
+	ASSERT_EQ(report.danglingEntries, 1u);
+	ASSERT_EQ(report.badPointers, 1u);
+	ASSERT_EQ(report.refCounts, 1u);
+	ASSERT_EQ(fs_check(fs, false, 1, NULL), 7);	// same answer with one thread
+	ASSERT_EQ(fs_check(fs, true, 4, &report), 7);
+	ASSERT_EQ(fs_check(fs, false, 4, &report), 0);
+	inode_load(fs, data_ID, &data);
+	ASSERT_EQ(data.linkCount, 2);
+	ASSERT_FALSE(block_store_sub_test(fs->BlockStore_inode, orphan_ID));
+	ASSERT_EQ(fs_path_lookup(fs, "/dir/ghost"), SIZE_MAX);
+	inode_load(fs, big_ID, &big);
+	ASSERT_EQ(big.directPointer[2], 0);
+	fs_statfs_t vol;
+	ASSERT_EQ(fs_statfs(fs, &vol), 0);
+	u_count_free(fs, &blocks, &inodes);
+	ASSERT_EQ(vol.freeBlocks, blocks);
+	ASSERT_EQ(vol.freeInodes, inodes);
+
+	// 3. Normal
+	ASSERT_EQ(fs_unmount(fs), 0);
+	FS *crashed = fs_mount(test_fname);
+	ASSERT_NE(crashed, nullptr);
+	leaked = fs_block_alloc(crashed);
+	ASSERT_NE(leaked, 0u);
+	fs = fs_mount(test_fname);	// the first one never got unmounted
+	ASSERT_NE(fs, nullptr);
+	ASSERT_FALSE(bitmap_test(fs->FreeBlockMap, leaked));
+	ASSERT_EQ(fs_check(fs, false, 4, &report), 0);
+	ASSERT_EQ(fs_unmount(fs), 0);
+	fs = crashed;
+
+	// 4. Normal
+	FS *dirty = fs_mount(test_fname);
+	ASSERT_NE(dirty, nullptr);
+	leaked = fs_block_alloc(dirty);
+	ASSERT_NE(leaked, 0u);
+	FS *look = fs_mount_flags(test_fname, FS_MOUNT_INSPECT);
+	ASSERT_NE(look, nullptr);
+	ASSERT_TRUE(bitmap_test(look->FreeBlockMap, leaked));
+	ASSERT_EQ(fs_check(look, false, 4, &report), 1);
+	ASSERT_EQ(report.blocksLeaked, 1u);
+	ASSERT_EQ(fs_unmount(look), 0);
+	inode_t root;
+	inode_load(dirty, 0, &root);
+	ASSERT_TRUE(root.flags & FS_INODE_DIRTY);
+	ASSERT_TRUE(bitmap_test(dirty->FreeBlockMap, leaked));
+	ASSERT_EQ(fs_check(dirty, true, 4, &report), 1);
+	ASSERT_EQ(fs_unmount(dirty), 0);
+
+	// 5. Error
+	ASSERT_LT(fs_check(NULL, true, 4, &report), 0);
+	ASSERT_EQ(fs_mount_flags("w_tests_missing.FS", FS_MOUNT_INSPECT), nullptr);
+	fs_unmount(fs);
+}
+
+
+
+/*
+   Trim
+   int fs_trim(FS_t *fs, bool all);
+   int fs_flush(FS_t *fs);
+   1. Normal, the pages of a removed file are punched out of the image file
+   2. Normal, blocks taken again before the trim are left alone, trimmed blocks work when used again
+   3. Normal, fs_flush writes the image back, unmount trims what is left
+   4. Error, NULL
+ */
+// space the image file takes up on the host, in 512 byte units
+static blkcnt_t x_image_blocks(const char *fname)
+{
+	struct stat st;
+	return stat(fname, &st) == 0 ? st.st_blocks : -1;
+}
+
+TEST(x_tests, trim)
+{
+	const char *test_fname = "x_tests.FS";
+	FS *fs = fs_format(test_fname);
+	ASSERT_NE(fs, nullptr);
+	const size_t count = 64;
+	uint8_t block[BLOCK_SIZE_BYTES];
+	memset(block, 0x77, sizeof(block));
+
+	// 1. Normal
+	ASSERT_EQ(fs_create(fs, "/keep", FS_REGULAR), 0);
+	ASSERT_EQ(fs_create(fs, "/big", FS_REGULAR), 0);
+	int keep = fs_open(fs, "/keep");
+	ASSERT_EQ(fs_write(fs, keep, block, sizeof(block)), (ssize_t)sizeof(block));
+	int fd = fs_open(fs, "/big");
+	for (size_t i = 0; i < count; i++)
+		ASSERT_EQ(fs_write(fs, fd, block, sizeof(block)), (ssize_t)sizeof(block));
+	ASSERT_EQ(fs_close(fs, fd), 0);
+	blkcnt_t full = x_image_blocks(test_fname);
+	ASSERT_EQ(fs_remove(fs, "/big"), 0);
+	ASSERT_GE(fs_trim(fs, false), (int)count);
+	ASSERT_LE(x_image_blocks(test_fname), full - (blkcnt_t)(count * BLOCK_SIZE_BYTES / 512));
+	ASSERT_EQ(fs_trim(fs, false), 0);	// nothing released since
+	ASSERT_EQ(fs_seek(fs, keep, 0, FS_SEEK_SET), 0);
+	uint8_t buffer[BLOCK_SIZE_BYTES];
+	ASSERT_EQ(fs_read(fs, keep, buffer, sizeof(buffer)), (ssize_t)sizeof(buffer));
+	ASSERT_EQ(memcmp(buffer, block, sizeof(block)), 0);
+
+	// 2. Normal
+	ASSERT_EQ(fs_create(fs, "/big", FS_REGULAR), 0);
+	fd = fs_open(fs, "/big");
+	for (size_t i = 0; i < count; i++)
+		ASSERT_EQ(fs_write(fs, fd, block, sizeof(block)), (ssize_t)sizeof(block));
+	ASSERT_EQ(fs_punch_hole(fs, fd, 0, count * BLOCK_SIZE_BYTES), 0);
+	memset(block, 0x11, sizeof(block));
+	ASSERT_EQ(fs_seek(fs, fd, 0, FS_SEEK_SET), 0);
+	ASSERT_EQ(fs_write(fs, fd, block, sizeof(block)), (ssize_t)sizeof(block));	// takes a released block back
+	ASSERT_EQ(fs_trim(fs, false), (int)count);	// count - 1 data blocks and the indirect block
+	ASSERT_EQ(fs_seek(fs, fd, 0, FS_SEEK_SET), 0);
+	ASSERT_EQ(fs_read(fs, fd, buffer, sizeof(buffer)), (ssize_t)sizeof(buffer));
+	ASSERT_EQ(memcmp(buffer, block, sizeof(block)), 0);
+	for (size_t i = 1; i < count; i++)
+		ASSERT_EQ(fs_write(fs, fd, block, sizeof(block)), (ssize_t)sizeof(block));	// into trimmed blocks
+	ASSERT_EQ(fs_seek(fs, fd, (count - 1) * BLOCK_SIZE_BYTES, FS_SEEK_SET), (off_t)((count - 1) * BLOCK_SIZE_BYTES));
+	ASSERT_EQ(fs_read(fs, fd, buffer, sizeof(buffer)), (ssize_t)sizeof(buffer));
+	ASSERT_EQ(memcmp(buffer, block, sizeof(block)), 0);
+	ASSERT_EQ(fs_close(fs, fd), 0);
+	ASSERT_EQ(fs_close(fs, keep), 0);
+
+	// 3. Normal
+	full = x_image_blocks(test_fname);
+	ASSERT_EQ(fs_remove(fs, "/big"), 0);
+	ASSERT_EQ(fs_flush(fs), 0);
+	ASSERT_EQ(fs_unmount(fs), 0);
+	ASSERT_LE(x_image_blocks(test_fname), full - (blkcnt_t)(count * BLOCK_SIZE_BYTES / 512));
+	fs = fs_mount(test_fname);
+	ASSERT_NE(fs, nullptr);
+	ASSERT_GE(fs_trim(fs, true), 0);
+	ASSERT_EQ(fs_check(fs, false, 0, NULL), 0);
+
+	// 4. Error
+	ASSERT_LT(fs_trim(NULL, false), 0);
+	ASSERT_LT(fs_flush(NULL), 0);
+	fs_unmount(fs);
+}
+
+
+
+/*
+   Compression
+   int fs_set_compressed(FS_t *fs, const char *path, bool compressed);
+   1. Normal, text written to a compressed file takes a fraction of the blocks and reads back whole
+   2. Normal, random reads after fs_seek, repeated reads come out of the cluster cache
+   3. Normal, overwrites across clusters, incompressible clusters and zero clusters
+   4. Normal, the data survives a remount, a clone and an fs_mmap view; fs_check finds nothing wrong
+   5. Error, non-empty file / directory / missing file / punch and fallocate / NULL
+ */
+TEST(y_tests, compress)
+{
+	const char *test_fname = "y_tests.FS";
+	FS *fs = fs_format(test_fname);
+	ASSERT_NE(fs, nullptr);
+	const size_t size = 20 * BLOCK_SIZE_BYTES + 123;	// five whole clusters and a bit
+	uint8_t *text = (uint8_t *)malloc(size);
+	uint8_t *buffer = (uint8_t *)malloc(size);
+	ASSERT_NE(text, nullptr);
+	ASSERT_NE(buffer, nullptr);
+	const char *words[] = {"block ", "store ", "inode ", "cluster ", "the ", "of ", "file ", "\n"};
+	for (size_t i = 0, w = 7; i < size; w = (w * 31 + 17) % 8)
+		for (const char *c = words[w]; *c != '\0' && i < size; c++)
+			text[i++] = *c;
+
+	// 1. Normal
+	fs_statfs_t before, after;
+	ASSERT_EQ(fs_create(fs, "/text", FS_REGULAR), 0);
+	ASSERT_EQ(fs_set_compressed(fs, "/text", true), 0);
+	ASSERT_EQ(fs_statfs(fs, &before), 0);
+	int fd = fs_open(fs, "/text");
+	ASSERT_GE(fd, 0);
+	ASSERT_EQ(fs_write(fs, fd, text, size), (ssize_t)size);
+	ASSERT_EQ(fs_statfs(fs, &after), 0);
+	ASSERT_LE(before.freeBlocks - after.freeBlocks, (size_t)10);	// 21 blocks uncompressed, plus the indirect block
+	fs_stat_t st;
+	ASSERT_EQ(fs_stat(fs, "/text", &st), 0);
+	ASSERT_EQ(st.fileSize, size);
+	ASSERT_EQ(fs_seek(fs, fd, 0, FS_SEEK_SET), 0);
+	ASSERT_EQ(fs_read(fs, fd, buffer, size + 100), (ssize_t)size);
+	ASSERT_EQ(memcmp(buffer, text, size), 0);
+
+	// 2. Normal
+	const size_t offsets[] = {0, 5, BLOCK_SIZE_BYTES - 3, fs_cluster_size - 1, 3 * fs_cluster_size + 77, size - 10};
+	for (size_t offset : offsets) {
+		ASSERT_EQ(fs_seek(fs, fd, offset, FS_SEEK_SET), (off_t)offset);
+		size_t want = offset + 5000 <= size ? 5000 : size - offset;
+		ASSERT_EQ(fs_read(fs, fd, buffer, 5000), (ssize_t)want);
+		ASSERT_EQ(memcmp(buffer, text + offset, want), 0);
+	}
+	size_t misses = fs->ClusterMisses;
+	ASSERT_EQ(fs_seek(fs, fd, fs_cluster_size + 10, FS_SEEK_SET), (off_t)(fs_cluster_size + 10));
+	ASSERT_EQ(fs_read(fs, fd, buffer, 100), 100);
+	ASSERT_EQ(fs_seek(fs, fd, fs_cluster_size + 900, FS_SEEK_SET), (off_t)(fs_cluster_size + 900));
+	ASSERT_EQ(fs_read(fs, fd, buffer, 100), 100);
+	ASSERT_EQ(fs->ClusterMisses, misses);
+	ASSERT_GT(fs->ClusterHits, (size_t)0);
+
+	// 3. Normal
+	for (size_t i = fs_cluster_size - 500; i < 2 * fs_cluster_size + 500; i++)
+		text[i] = (uint8_t)((i * 2654435761u) >> 13);	// cluster 1 no longer compresses
+	ASSERT_EQ(fs_seek(fs, fd, fs_cluster_size - 500, FS_SEEK_SET), (off_t)(fs_cluster_size - 500));
+	ASSERT_EQ(fs_write(fs, fd, text + fs_cluster_size - 500, fs_cluster_size + 1000), (ssize_t)(fs_cluster_size + 1000));
+	memset(text + 3 * fs_cluster_size, 0, fs_cluster_size);
+	ASSERT_EQ(fs_seek(fs, fd, 3 * fs_cluster_size, FS_SEEK_SET), (off_t)(3 * fs_cluster_size));
+	ASSERT_EQ(fs_write(fs, fd, text + 3 * fs_cluster_size, fs_cluster_size), (ssize_t)fs_cluster_size);
+	ASSERT_EQ(fs_seek(fs, fd, 0, FS_SEEK_SET), 0);
+	ASSERT_EQ(fs_read(fs, fd, buffer, size), (ssize_t)size);
+	ASSERT_EQ(memcmp(buffer, text, size), 0);
+	ASSERT_EQ(fs_close(fs, fd), 0);
+
+	// 4. Normal
+	ASSERT_EQ(fs_unmount(fs), 0);
+	fs = fs_mount(test_fname);
+	ASSERT_NE(fs, nullptr);
+	ASSERT_EQ(fs_clone(fs, "/text", "/copy"), 0);
+	fd = fs_open(fs, "/copy");
+	ASSERT_GE(fd, 0);
+	ASSERT_EQ(fs_write(fs, fd, "changed", 7), 7);
+	ASSERT_EQ(fs_close(fs, fd), 0);
+	fd = fs_open(fs, "/text");
+	ASSERT_GE(fd, 0);
+	ASSERT_EQ(fs_read(fs, fd, buffer, size), (ssize_t)size);
+	ASSERT_EQ(memcmp(buffer, text, size), 0);
+	fs_map_t *map = fs_mmap(fs, fd);
+	ASSERT_NE(map, nullptr);
+	ASSERT_FALSE(fs_map_is_direct(map));
+	const uint8_t *bytes = (const uint8_t *)fs_map_at(map, 2 * fs_cluster_size - 50, 100);
+	ASSERT_NE(bytes, nullptr);
+	ASSERT_EQ(memcmp(bytes, text + 2 * fs_cluster_size - 50, 100), 0);
+	ASSERT_EQ(fs_munmap(map), 0);
+	ASSERT_EQ(fs_check(fs, false, 0, NULL), 0);
+
+	// 5. Error
+	ASSERT_LT(fs_set_compressed(fs, "/text", false), 0);
+	ASSERT_LT(fs_set_compressed(fs, "/", true), 0);
+	ASSERT_LT(fs_set_compressed(fs, "/missing", true), 0);
+	ASSERT_LT(fs_set_compressed(fs, NULL, true), 0);
+	ASSERT_LT(fs_set_compressed(NULL, "/text", true), 0);
+	ASSERT_LT(fs_punch_hole(fs, fd, 0, BLOCK_SIZE_BYTES), 0);
+	ASSERT_LT(fs_fallocate(fs, fd, 0, size + fs_cluster_size), 0);
+	ASSERT_EQ(fs_close(fs, fd), 0);
+	free(text);
+	free(buffer);
+	fs_unmount(fs);
+}
+
+
+
+/*
+   Deduplication
+   int fs_set_dedup(FS_t *fs, bool enable);
+   int fs_dedup_stats(FS_t *fs, fs_dedup_t *stats);
+   1. Normal, repeated blocks within a file and a second copy of the file take no blocks of their own
+   2. Normal, writing to a shared block copies it first, the other files keep their data
+   3. Normal, the index survives a remount; fs_check finds nothing wrong
+   4. Normal, removing the files gives every block back, turning dedup off frees the index
+   5. Error, NULL
+ */
+TEST(z_tests, dedup)
+{
+	const char *test_fname = "z_tests.FS";
+	FS *fs = fs_format(test_fname);
+	ASSERT_NE(fs, nullptr);
+	uint8_t blocks[3][BLOCK_SIZE_BYTES];
+	for (size_t b = 0; b < 3; b++)
+		for (size_t i = 0; i < BLOCK_SIZE_BYTES; i++)
+			blocks[b][i] = (uint8_t)(i * (b + 3) + b);
+	const size_t pattern[number_direct_pointers] = {0, 1, 0, 1, 2, 0};	// 6 blocks, 3 different
+	uint8_t file[number_direct_pointers * BLOCK_SIZE_BYTES];
+	for (size_t i = 0; i < number_direct_pointers; i++)
+		memcpy(file + i * BLOCK_SIZE_BYTES, blocks[pattern[i]], BLOCK_SIZE_BYTES);
+	fs_statfs_t empty, vol;
+	fs_dedup_t stats;
+
+	// 1. Normal
+	ASSERT_EQ(fs_set_dedup(fs, true), 0);
+	ASSERT_EQ(fs_set_dedup(fs, true), 0);
+	ASSERT_EQ(fs_create(fs, "/a", FS_REGULAR), 0);
+	ASSERT_EQ(fs_create(fs, "/b", FS_REGULAR), 0);
+	ASSERT_EQ(fs_statfs(fs, &empty), 0);
+	int fd = fs_open(fs, "/a");
+	ASSERT_EQ(fs_write(fs, fd, file, sizeof(file)), (ssize_t)sizeof(file));
+	ASSERT_EQ(fs_close(fs, fd), 0);
+	ASSERT_EQ(fs_statfs(fs, &vol), 0);
+	ASSERT_EQ(empty.freeBlocks - vol.freeBlocks, (size_t)3);
+	fd = fs_open(fs, "/b");
+	ASSERT_EQ(fs_write(fs, fd, file, sizeof(file)), (ssize_t)sizeof(file));
+	ASSERT_EQ(fs_statfs(fs, &vol), 0);
+	ASSERT_EQ(empty.freeBlocks - vol.freeBlocks, (size_t)3);
+	ASSERT_EQ(fs_dedup_stats(fs, &stats), 0);
+	ASSERT_EQ(stats.blocksHashed, (size_t)12);
+	ASSERT_EQ(stats.blocksShared, (size_t)9);
+	ASSERT_DOUBLE_EQ(stats.ratio, 4.0);
+	ASSERT_GT(stats.hashNanos, 0.0);
+	ASSERT_EQ(stats.sharedBlocks, (size_t)3);
+
+	// 2. Normal
+	uint8_t buffer[sizeof(file)];
+	ASSERT_EQ(fs_seek(fs, fd, 0, FS_SEEK_SET), 0);
+	ASSERT_EQ(fs_write(fs, fd, "x", 1), 1);
+	ASSERT_EQ(fs_statfs(fs, &vol), 0);
+	ASSERT_EQ(empty.freeBlocks - vol.freeBlocks, (size_t)4);
+	ASSERT_EQ(fs_seek(fs, fd, 0, FS_SEEK_SET), 0);
+	ASSERT_EQ(fs_read(fs, fd, buffer, sizeof(buffer)), (ssize_t)sizeof(buffer));
+	ASSERT_EQ(buffer[0], 'x');
+	ASSERT_EQ(memcmp(buffer + 1, file + 1, sizeof(file) - 1), 0);
+	ASSERT_EQ(fs_close(fs, fd), 0);
+	fd = fs_open(fs, "/a");
+	ASSERT_EQ(fs_read(fs, fd, buffer, sizeof(buffer)), (ssize_t)sizeof(buffer));
+	ASSERT_EQ(memcmp(buffer, file, sizeof(file)), 0);
+	ASSERT_EQ(fs_close(fs, fd), 0);
+
+	// 3. Normal
+	ASSERT_EQ(fs_unmount(fs), 0);
+	fs = fs_mount(test_fname);
+	ASSERT_NE(fs, nullptr);
+	ASSERT_EQ(fs_create(fs, "/c", FS_REGULAR), 0);
+	fd = fs_open(fs, "/c");
+	ASSERT_EQ(fs_write(fs, fd, blocks[2], BLOCK_SIZE_BYTES), BLOCK_SIZE_BYTES);
+	ASSERT_EQ(fs_close(fs, fd), 0);
+	ASSERT_EQ(fs_dedup_stats(fs, &stats), 0);
+	ASSERT_EQ(stats.blocksShared, (size_t)1);
+	ASSERT_EQ(fs_statfs(fs, &vol), 0);
+	ASSERT_EQ(empty.freeBlocks - vol.freeBlocks, (size_t)4);
+	ASSERT_EQ(fs_check(fs, false, 0, NULL), 0);
+
+	// 4. Normal
+	ASSERT_EQ(fs_remove(fs, "/a"), 0);
+	ASSERT_EQ(fs_remove(fs, "/b"), 0);
+	ASSERT_EQ(fs_remove(fs, "/c"), 0);
+	ASSERT_EQ(fs_statfs(fs, &vol), 0);
+	ASSERT_EQ(vol.freeBlocks, empty.freeBlocks);
+	ASSERT_EQ(fs_set_dedup(fs, false), 0);
+	ASSERT_EQ(fs_statfs(fs, &vol), 0);
+	ASSERT_EQ(vol.freeBlocks, empty.freeBlocks + number_dedup_blocks);
+	ASSERT_EQ(fs_check(fs, false, 0, NULL), 0);
+
+	// 5. Error
+	ASSERT_LT(fs_set_dedup(NULL, true), 0);
+	ASSERT_LT(fs_dedup_stats(fs, NULL), 0);
+	ASSERT_LT(fs_dedup_stats(NULL, &stats), 0);
+	fs_unmount(fs);
+}
+
+
+
+
+/*
+   Statistics
+   int fs_get_stats(FS_t *fs, fs_stats_t *stats);
+   uint64_t fs_stats_percentile(const fs_op_stats_t *op, double percentile);
+   int fs_stats_json(const fs_stats_t *stats, FILE *out);
+   1. Normal, every call is counted with the bytes it moved, the histogram holds each call once
+   2. Normal, failed calls count as errors
+   3. Normal, percentiles fall between the fastest and the slowest call
+   4. Normal, the JSON dump carries the counts; a remount starts from zero
+   5. Error, NULL
+ */
+TEST(za_tests, stats)
+{
+	const char *test_fname = "za_tests.FS";
+	FS *fs = fs_format(test_fname);
+	ASSERT_NE(fs, nullptr);
+	uint8_t data[3 * BLOCK_SIZE_BYTES];
+	memset(data, 'a', sizeof(data));
+	fs_stats_t *stats = new fs_stats_t;
+
+	// 1. Normal
+	ASSERT_EQ(fs_get_stats(fs, stats), 0);
+	ASSERT_EQ(stats->enabled, (bool)fs_stats);
+	ASSERT_EQ(fs_create(fs, "/a", FS_REGULAR), 0);
+	int fd = fs_open(fs, "/a");
+	ASSERT_GE(fd, 0);
+	ASSERT_EQ(fs_write(fs, fd, data, sizeof(data)), (ssize_t)sizeof(data));
+	ASSERT_EQ(fs_seek(fs, fd, 0, FS_SEEK_SET), 0);
+	ASSERT_EQ(fs_read(fs, fd, data, sizeof(data)), (ssize_t)sizeof(data));
+	ASSERT_EQ(fs_close(fs, fd), 0);
+	ASSERT_EQ(fs_get_stats(fs, stats), 0);
+#if fs_stats
+	ASSERT_EQ(stats->ops[FS_OP_CREATE].calls, 1u);
+	ASSERT_EQ(stats->ops[FS_OP_OPEN].calls, 1u);
+	ASSERT_EQ(stats->ops[FS_OP_SEEK].calls, 1u);
+	ASSERT_EQ(stats->ops[FS_OP_CLOSE].calls, 1u);
+	ASSERT_EQ(stats->ops[FS_OP_WRITE].calls, 1u);
+	ASSERT_EQ(stats->ops[FS_OP_WRITE].bytes, (uint64_t)sizeof(data));
+	ASSERT_EQ(stats->ops[FS_OP_READ].bytes, (uint64_t)sizeof(data));
+	ASSERT_GE(stats->ops[FS_OP_BLOCK_WRITE].calls, 3u);
+	ASSERT_GE(stats->ops[FS_OP_BLOCK_READ].bytes, (uint64_t)sizeof(data));
+	ASSERT_GT(stats->ops[FS_OP_WRITE].totalNanos, 0u);
+	for (size_t op = 0; op < FS_OP_COUNT; op++) {
+		uint64_t calls = 0;
+		for (size_t bucket = 0; bucket < fs_stats_buckets; bucket++)
+			calls += stats->ops[op].histogram[bucket];
+		ASSERT_EQ(calls, stats->ops[op].calls);
+		ASSERT_EQ(stats->ops[op].errors, 0u);
+		ASSERT_LE(stats->ops[op].minNanos, stats->ops[op].maxNanos);
+	}
+#else
+	ASSERT_EQ(stats->ops[FS_OP_WRITE].calls, 0u);
+#endif
+
+	// 2. Normal
+	ASSERT_LT(fs_open(fs, "/missing"), 0);
+	ASSERT_LT(fs_read(fs, 200, data, 1), 0);
+	ASSERT_EQ(fs_get_stats(fs, stats), 0);
+#if fs_stats
+	ASSERT_EQ(stats->ops[FS_OP_OPEN].calls, 2u);
+	ASSERT_EQ(stats->ops[FS_OP_OPEN].errors, 1u);
+	ASSERT_EQ(stats->ops[FS_OP_READ].errors, 1u);
+	ASSERT_EQ(stats->ops[FS_OP_READ].bytes, (uint64_t)sizeof(data));
+#endif
+
+	// 3. Normal
+	fd = fs_open(fs, "/a");
+	for (int i = 0; i < 50; i++) {
+		ASSERT_EQ(fs_seek(fs, fd, (i * 997) % sizeof(data), FS_SEEK_SET), (off_t)((i * 997) % sizeof(data)));
+		ASSERT_EQ(fs_read(fs, fd, data, 16), 16);
+	}
+	ASSERT_EQ(fs_close(fs, fd), 0);
+	ASSERT_EQ(fs_get_stats(fs, stats), 0);
+#if fs_stats
+	const fs_op_stats_t *reads = &stats->ops[FS_OP_READ];
+	ASSERT_EQ(reads->calls, 52u);
+	uint64_t p50 = fs_stats_percentile(reads, 50), p99 = fs_stats_percentile(reads, 99);
+	ASSERT_GE(p50, reads->minNanos);
+	ASSERT_LE(p50, p99);
+	ASSERT_LE(p99, reads->maxNanos);
+	ASSERT_EQ(fs_stats_percentile(reads, 100), reads->maxNanos);
+#endif
+	ASSERT_EQ(fs_stats_percentile(&stats->ops[FS_OP_REMOVE], 50), 0u);
+
+	// 4. Normal
+	FILE *out = tmpfile();
+	ASSERT_NE(out, nullptr);
+	ASSERT_EQ(fs_stats_json(stats, out), 0);
+	char json[1 << 16] = {0};
+	rewind(out);
+	ASSERT_GT(fread(json, 1, sizeof(json) - 1, out), 0u);
+	fclose(out);
+	ASSERT_NE(strstr(json, "\"cluster_cache\": {\"hits\": 0, \"misses\": 0"), nullptr);
+#if fs_stats
+	ASSERT_NE(strstr(json, "\"enabled\": true"), nullptr);
+	ASSERT_NE(strstr(json, "\"write\": {\"calls\": 1, \"errors\": 0, \"bytes\": 12288"), nullptr);
+	ASSERT_NE(strstr(json, "\"read\": {\"calls\": 52, \"errors\": 1"), nullptr);
+#endif
+	ASSERT_EQ(fs_unmount(fs), 0);
+	fs = fs_mount(test_fname);
+	ASSERT_NE(fs, nullptr);
+	ASSERT_EQ(fs_get_stats(fs, stats), 0);
+	ASSERT_EQ(stats->ops[FS_OP_WRITE].calls, 0u);
+	ASSERT_EQ(stats->ops[FS_OP_CREATE].calls, 0u);
+
+	// 5. Error
+	ASSERT_LT(fs_get_stats(NULL, stats), 0);
+	ASSERT_LT(fs_get_stats(fs, NULL), 0);
+	ASSERT_LT(fs_stats_json(NULL, stdout), 0);
+	ASSERT_LT(fs_stats_json(stats, NULL), 0);
+	ASSERT_EQ(fs_stats_percentile(NULL, 50), 0u);
+	delete stats;
+	fs_unmount(fs);
+}
+
+
+
+
+// one call out of a trace made by fs_trace
+struct trace_call {
+	uint8_t op;
+	bool ok;
+	uint64_t args[2];	// the block id, for open the block size and block count
+};
+
+static bool trace_varint(FILE *in, uint64_t *value)
+{
+	*value = 0;
+	for (unsigned shift = 0; shift < 64; shift += 7) {
+		int c = getc(in);
+		if (c == EOF)
+			return false;
+		*value |= (uint64_t)(c & 0x7F) << shift;
+		if (!(c & 0x80))
+			return true;
+	}
+	return false;
+}
+
+// reads a whole trace back, false if it is not one or is cut short
+static bool read_trace(FILE *in, vector<trace_call> *calls)
+{
+	char magic[4];
+	rewind(in);
+	if (fread(magic, 1, 4, in) != 4 || memcmp(magic, "BST1", 4) != 0)
+		return false;
+	int c;
+	while ((c = getc(in)) != EOF) {
+		trace_call call = {(uint8_t)(c & 0x7F), (c & 0x80) != 0, {0, 0}};
+		uint64_t since, took;
+		size_t args = call.op == 1 ? 2 : call.op == 7 ? 0 : 1;
+		if (call.op < 1 || call.op > 7 || !trace_varint(in, &since) || !trace_varint(in, &took))
+			return false;
+		for (size_t i = 0; i < args; i++)
+			if (!trace_varint(in, &call.args[i]))
+				return false;
+		calls->push_back(call);
+	}
+	return true;
+}
+
+static size_t count_calls(const vector<trace_call> &calls, uint8_t op)
+{
+	size_t count = 0;
+	for (const trace_call &call : calls)
+		count += call.op == op;
+	return count;
+}
+
+/*
+   Block tracing
+   int fs_trace(FS_t *fs, FILE *out);
+   1. Normal, the trace opens with the store's geometry, logs the blocks a write takes and fills, and closes
+   2. Normal, removing the file logs its blocks released; stopping a stopped trace does nothing
+   3. Normal, fs_unmount closes a trace still running
+   4. Error, NULL
+ */
+TEST(zb_tests, trace)
+{
+	const char *test_fname = "zb_tests.FS";
+	FS *fs = fs_format(test_fname);
+	ASSERT_NE(fs, nullptr);
+	uint8_t data[3 * BLOCK_SIZE_BYTES];
+	memset(data, 'a', sizeof(data));
+
+	// 1. Normal
+	FILE *out = tmpfile();
+	ASSERT_NE(out, nullptr);
+	ASSERT_EQ(fs_trace(fs, out), 0);
+	ASSERT_EQ(fs_create(fs, "/a", FS_REGULAR), 0);
+	int fd = fs_open(fs, "/a");
+	ASSERT_GE(fd, 0);
+	ASSERT_EQ(fs_write(fs, fd, data, sizeof(data)), (ssize_t)sizeof(data));
+	ASSERT_EQ(fs_close(fs, fd), 0);
+	ASSERT_EQ(fs_trace(fs, NULL), 0);
+	vector<trace_call> calls;
+	ASSERT_TRUE(read_trace(out, &calls));
+	ASSERT_GE(calls.size(), 2u);
+	ASSERT_EQ(calls.front().op, 1);
+	ASSERT_EQ(calls.front().args[0], (uint64_t)BLOCK_SIZE_BYTES);
+	ASSERT_EQ(calls.front().args[1], 65536u);
+	ASSERT_EQ(calls.back().op, 7);
+	ASSERT_EQ(count_calls(calls, 7), 1u);
+	ASSERT_GE(count_calls(calls, 4), 3u);
+	ASSERT_GE(count_calls(calls, 3), 3u);
+	vector<uint64_t> allocated;
+	for (const trace_call &call : calls) {
+		ASSERT_TRUE(call.ok);
+		if (call.op == 4)
+			allocated.push_back(call.args[0]);
+		if (call.op == 3) {
+			ASSERT_NE(std::find(allocated.begin(), allocated.end(), call.args[0]), allocated.end());
+		}
+	}
+	fclose(out);
+
+	// 2. Normal
+	out = tmpfile();
+	ASSERT_EQ(fs_trace(fs, out), 0);
+	ASSERT_EQ(fs_remove(fs, "/a"), 0);
+	ASSERT_EQ(fs_trace(fs, NULL), 0);
+	ASSERT_EQ(fs_trace(fs, NULL), 0);
+	calls.clear();
+	ASSERT_TRUE(read_trace(out, &calls));
+	ASSERT_GE(count_calls(calls, 5), 3u);
+	for (const trace_call &call : calls) {
+		if (call.op == 5) {
+			ASSERT_NE(std::find(allocated.begin(), allocated.end(), call.args[0]), allocated.end());
+		}
+	}
+	ASSERT_EQ(count_calls(calls, 7), 1u);
+	fclose(out);
+
+	// 3. Normal
+	out = tmpfile();
+	ASSERT_EQ(fs_trace(fs, out), 0);
+	ASSERT_EQ(fs_unmount(fs), 0);
+	calls.clear();
+	ASSERT_TRUE(read_trace(out, &calls));
+	ASSERT_EQ(calls.back().op, 7);
+
+	// 4. Error
+	ASSERT_LT(fs_trace(NULL, out), 0);
+	fclose(out);
+}
 
 int main(int argc, char **argv) {
     ::testing::InitGoogleTest(&argc, argv);
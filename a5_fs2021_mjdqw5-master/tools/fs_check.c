@@ -0,0 +1,79 @@
+// Checks an FS image for consistency and repairs it, see fs_check.
+//  usage: fs_check [-n] [-j threads] image
+//    -n          only report, change nothing
+//    -j threads  threads to scan the inode table with (default fs_check_threads)
+//  exit status: 0 clean, 1 problems found (and repaired unless -n), 2 error
+//  An image that was not unmounted is already repaired by fs_mount, before the check proper runs; with -n it is
+//  mounted with FS_MOUNT_INSPECT instead, so it is reported as found and nothing is written back.
+#include <time.h>
+#include <unistd.h>
+#include "FS.h"
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-n] [-j threads] image\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+    bool repair = true;
+    size_t threads = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "nj:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            repair = false;
+            break;
+        case 'j':
+            threads = strtoul(optarg, NULL, 10);
+            break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (optind != argc - 1)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    FS_t *fs = fs_mount_flags(argv[optind], repair ? 0 : FS_MOUNT_INSPECT);
+    if (fs == NULL)
+    {
+        fprintf(stderr, "could not mount %s\n", argv[optind]);
+        return 2;
+    }
+    fs_check_t report;
+    double start = now_ms();
+    int problems = fs_check(fs, repair, threads, &report);
+    double took = now_ms() - start;
+    if (problems < 0)
+    {
+        fprintf(stderr, "could not check %s\n", argv[optind]);
+        fs_unmount(fs);
+        return 2;
+    }
+
+    printf("%-18s %zu\n", "leaked blocks", report.blocksLeaked);
+    printf("%-18s %zu\n", "missing blocks", report.blocksMissing);
+    printf("%-18s %zu\n", "reference counts", report.refCounts);
+    printf("%-18s %zu\n", "link counts", report.linkCounts);
+    printf("%-18s %zu\n", "orphan inodes", report.orphanInodes);
+    printf("%-18s %zu\n", "dangling entries", report.danglingEntries);
+    printf("%-18s %zu\n", "bad pointers", report.badPointers);
+    printf("%s: %d problem%s %s in %.1f ms\n", argv[optind], problems, problems == 1 ? "" : "s",
+           problems == 0 ? "found" : repair ? "repaired" : "found", took);
+
+    fs_unmount(fs);
+    return problems == 0 ? 0 : 1;
+}
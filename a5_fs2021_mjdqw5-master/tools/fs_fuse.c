@@ -0,0 +1,476 @@
+// Mounts an FS image as a Linux filesystem through FUSE (libfuse3).
+//  usage: fs_fuse image mountpoint [FUSE options]
+//    the image is formatted first if it does not exist; -f stays in the foreground, -s serves one request at a time
+//    unmount with fusermount3 -u mountpoint, the image is unmounted cleanly then
+//  Requests are dispatched on several threads (unless -s), with writeback caching and reads and writes of up to
+//  fs_fuse_max_io bytes. The FS does no locking of its own, so every call into it is made under one lock; what runs
+//  in parallel is the kernel side and the copying in and out of the requests.
+//  Shrinking a file is not supported by the FS, truncate only grows files (or leaves them as they are). Modes, owners
+//  and times are not kept: files are 0644 and directories 0755, owned by whoever mounted the image.
+#define FUSE_USE_VERSION 31
+
+#include <errno.h>
+#include <fcntl.h>
+#include <fuse.h>
+#include <linux/falloc.h>	// for FALLOC_FL_PUNCH_HOLE, not in fcntl.h without _GNU_SOURCE
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <unistd.h>
+#include "FS.h"
+
+// the largest read or write request the kernel is asked to send
+#define fs_fuse_max_io (1 << 20)
+
+typedef struct {
+    FS_t *fs;
+    pthread_mutex_t lock; // held around every call into fs
+    uid_t uid;
+    gid_t gid;
+} fuse_fs_t;
+
+static fuse_fs_t *mounted(void)
+{
+    return (fuse_fs_t *)fuse_get_context()->private_data;
+}
+
+// the errno for a path that could not be made: it is already there, or the directory it goes in is not, or the FS is full
+static int create_errno(FS_t *fs, const char *path)
+{
+    fs_stat_t st;
+    if (fs_stat(fs, path, &st) == 0)
+    {
+        return -EEXIST;
+    }
+    char name[FS_FNAME_MAX];
+    size_t name_length = strlen(strrchr(path, '/') + 1);
+    if (name_length == 0 || name_length >= FS_FNAME_MAX)
+    {
+        return name_length == 0 ? -EINVAL : -ENAMETOOLONG;
+    }
+    return fs_path_parent(fs, path, name) == SIZE_MAX ? -ENOENT : -ENOSPC;
+}
+
+// the errno for a path that could not be removed
+static int remove_errno(FS_t *fs, const char *path, bool directory)
+{
+    fs_stat_t st;
+    if (fs_stat(fs, path, &st) < 0)
+    {
+        return -ENOENT;
+    }
+    if ((st.type == FS_DIRECTORY) != directory)
+    {
+        return directory ? -ENOTDIR : -EISDIR;
+    }
+    return directory ? -ENOTEMPTY : -EIO;
+}
+
+static void fill_stat(const fuse_fs_t *m, const fs_stat_t *st, struct stat *stbuf)
+{
+    memset(stbuf, 0, sizeof(struct stat));
+    stbuf->st_ino = st->inodeNumber + 1; // FUSE keeps inode 0 for itself
+    stbuf->st_mode = st->type == FS_DIRECTORY ? S_IFDIR | 0755 : S_IFREG | 0644;
+    stbuf->st_nlink = st->linkCount;
+    stbuf->st_uid = m->uid;
+    stbuf->st_gid = m->gid;
+    stbuf->st_size = (off_t)st->fileSize;
+    stbuf->st_blksize = BLOCK_SIZE_BYTES;
+    stbuf->st_blocks = (blkcnt_t)((st->fileSize + 511) / 512);
+    stbuf->st_mtime = st->mtime;
+    stbuf->st_ctime = st->ctime;
+    stbuf->st_atime = st->mtime;
+}
+
+static void *fuse_fs_init(struct fuse_conn_info *conn, struct fuse_config *cfg)
+{
+    cfg->use_ino = 1;
+    cfg->nullpath_ok = 1;   // reads and writes go by descriptor
+    cfg->entry_timeout = 1.0;
+    cfg->attr_timeout = 1.0;
+    conn->max_write = fs_fuse_max_io;
+    conn->max_read = fs_fuse_max_io;
+    conn->max_readahead = fs_fuse_max_io;
+    if (conn->capable & FUSE_CAP_WRITEBACK_CACHE)
+    {
+        conn->want |= FUSE_CAP_WRITEBACK_CACHE;
+    }
+    return fuse_get_context()->private_data;
+}
+
+static void fuse_fs_destroy(void *private_data)
+{
+    fuse_fs_t *m = (fuse_fs_t *)private_data;
+    fs_unmount(m->fs);
+    m->fs = NULL;
+}
+
+static int fuse_fs_getattr(const char *path, struct stat *stbuf, struct fuse_file_info *fi)
+{
+    fuse_fs_t *m = mounted();
+    fs_stat_t st;
+    pthread_mutex_lock(&m->lock);
+    int result = fi != NULL ? fs_fstat(m->fs, (int)fi->fh, &st) : fs_stat(m->fs, path, &st);
+    pthread_mutex_unlock(&m->lock);
+    if (result < 0)
+    {
+        return -ENOENT;
+    }
+    fill_stat(m, &st, stbuf);
+    return 0;
+}
+
+static int fuse_fs_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi,
+                           enum fuse_readdir_flags flags)
+{
+    (void)offset;
+    (void)fi;
+    (void)flags;
+    fuse_fs_t *m = mounted();
+    pthread_mutex_lock(&m->lock);
+    fs_dir_t *dir = fs_opendir(m->fs, path);
+    if (dir == NULL)
+    {
+        pthread_mutex_unlock(&m->lock);
+        return -ENOENT;
+    }
+    filler(buf, ".", NULL, 0, 0);
+    filler(buf, "..", NULL, 0, 0);
+    file_record_t record;
+    while (fs_readdir(dir, &record) == 1)
+    {
+        if (filler(buf, record.name, NULL, 0, 0) != 0)
+        {
+            break;
+        }
+    }
+    fs_closedir(dir);
+    pthread_mutex_unlock(&m->lock);
+    return 0;
+}
+
+static int fuse_fs_mkdir(const char *path, mode_t mode)
+{
+    (void)mode;
+    fuse_fs_t *m = mounted();
+    pthread_mutex_lock(&m->lock);
+    int result = fs_create(m->fs, path, FS_DIRECTORY) < 0 ? create_errno(m->fs, path) : 0;
+    pthread_mutex_unlock(&m->lock);
+    return result;
+}
+
+static int fuse_fs_create(const char *path, mode_t mode, struct fuse_file_info *fi)
+{
+    (void)mode;
+    fuse_fs_t *m = mounted();
+    pthread_mutex_lock(&m->lock);
+    int result = fs_create(m->fs, path, FS_REGULAR) < 0 ? create_errno(m->fs, path) : fs_open(m->fs, path);
+    pthread_mutex_unlock(&m->lock);
+    if (result < 0)
+    {
+        return result == -1 ? -EMFILE : result;
+    }
+    fi->fh = (uint64_t)result;
+    return 0;
+}
+
+static int fuse_fs_unlink(const char *path)
+{
+    fuse_fs_t *m = mounted();
+    pthread_mutex_lock(&m->lock);
+    int result = fs_remove(m->fs, path) < 0 ? remove_errno(m->fs, path, false) : 0;
+    pthread_mutex_unlock(&m->lock);
+    return result;
+}
+
+static int fuse_fs_rmdir(const char *path)
+{
+    fuse_fs_t *m = mounted();
+    pthread_mutex_lock(&m->lock);
+    int result = fs_remove(m->fs, path) < 0 ? remove_errno(m->fs, path, true) : 0;
+    pthread_mutex_unlock(&m->lock);
+    return result;
+}
+
+// the errno fs_move would refuse from -> to with, 0 if it would go ahead
+//  checked before rename removes anything at to; replacing says to is there and its entry is freed first
+static int move_errno(FS_t *fs, const char *from, const char *to, bool replacing)
+{
+    size_t from_length = strlen(from);
+    if (strncmp(from, to, from_length) == 0 && to[from_length] == '/')
+    {
+        return -EINVAL; // a directory does not go inside itself
+    }
+    char name[FS_FNAME_MAX];
+    size_t from_parent = fs_path_parent(fs, from, name);
+    size_t to_parent = fs_path_parent(fs, to, name);
+    if (to_parent == SIZE_MAX)
+    {
+        return create_errno(fs, to);
+    }
+    inode_t parent;
+    uint32_t full = ((uint32_t)1 << folder_number_entries) - 1;
+    if (!replacing && to_parent != from_parent && inode_load(fs, to_parent, &parent) != 0 &&
+        (parent.vacantFile & full) == full)
+    {
+        return -ENOSPC;
+    }
+    return 0;
+}
+
+// fs_move will not overwrite, a file (or empty directory) already at to is removed first as rename(2) does
+static int fuse_fs_rename(const char *from, const char *to, unsigned int flags)
+{
+    if (flags != 0)
+    {
+        return -EINVAL;
+    }
+    fuse_fs_t *m = mounted();
+    fs_stat_t src, dst;
+    int result = 0;
+    pthread_mutex_lock(&m->lock);
+    bool replacing = fs_stat(m->fs, to, &dst) == 0;
+    if (fs_stat(m->fs, from, &src) < 0)
+    {
+        result = -ENOENT;
+    }
+    else if (replacing && dst.inodeNumber == src.inodeNumber)
+    {
+        pthread_mutex_unlock(&m->lock);
+        return 0;
+    }
+    else if ((result = move_errno(m->fs, from, to, replacing)) == 0 && replacing)
+    {
+        if ((dst.type == FS_DIRECTORY) != (src.type == FS_DIRECTORY))
+        {
+            result = dst.type == FS_DIRECTORY ? -EISDIR : -ENOTDIR;
+        }
+        else if (fs_remove(m->fs, to) < 0)
+        {
+            result = remove_errno(m->fs, to, dst.type == FS_DIRECTORY);
+        }
+    }
+    if (result == 0 && fs_move(m->fs, from, to) < 0)
+    {
+        result = create_errno(m->fs, to);
+        result = result == -EEXIST ? -EIO : result;
+    }
+    pthread_mutex_unlock(&m->lock);
+    return result;
+}
+
+static int fuse_fs_link(const char *from, const char *to)
+{
+    fuse_fs_t *m = mounted();
+    pthread_mutex_lock(&m->lock);
+    int result = fs_link(m->fs, from, to) < 0 ? create_errno(m->fs, to) : 0;
+    pthread_mutex_unlock(&m->lock);
+    return result;
+}
+
+static int fuse_fs_open(const char *path, struct fuse_file_info *fi)
+{
+    fuse_fs_t *m = mounted();
+    fs_stat_t st;
+    pthread_mutex_lock(&m->lock);
+    int fd = fs_open(m->fs, path);
+    int result = fd >= 0 ? 0 : fs_stat(m->fs, path, &st) < 0 ? -ENOENT : st.type == FS_DIRECTORY ? -EISDIR : -EMFILE;
+    pthread_mutex_unlock(&m->lock);
+    fi->fh = (uint64_t)fd;
+    return result;
+}
+
+static int fuse_fs_read(const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *fi)
+{
+    (void)path;
+    fuse_fs_t *m = mounted();
+    pthread_mutex_lock(&m->lock);
+    ssize_t read = fs_seek(m->fs, (int)fi->fh, offset, FS_SEEK_SET) == offset ? fs_read(m->fs, (int)fi->fh, buf, size) : -1;
+    pthread_mutex_unlock(&m->lock);
+    return read < 0 ? (offset > FS_MAX_SEEK ? 0 : -EIO) : (int)read;
+}
+
+static int fuse_fs_write(const char *path, const char *buf, size_t size, off_t offset, struct fuse_file_info *fi)
+{
+    (void)path;
+    fuse_fs_t *m = mounted();
+    if (offset + (off_t)size > FS_MAX_FILE_SIZE)
+    {
+        return -EFBIG;
+    }
+    pthread_mutex_lock(&m->lock);
+    ssize_t written = fs_seek(m->fs, (int)fi->fh, offset, FS_SEEK_SET) == offset ? fs_write(m->fs, (int)fi->fh, buf, size) : -1;
+    pthread_mutex_unlock(&m->lock);
+    return written < 0 ? -EIO : written == 0 && size > 0 ? -ENOSPC : (int)written;
+}
+
+// grows a file with a hole (a zero byte written at the new end); the FS can not make one shorter
+static int fuse_fs_truncate(const char *path, off_t size, struct fuse_file_info *fi)
+{
+    fuse_fs_t *m = mounted();
+    fs_stat_t st;
+    if (size > FS_MAX_FILE_SIZE)
+    {
+        return -EFBIG;
+    }
+    pthread_mutex_lock(&m->lock);
+    int fd = fi != NULL ? (int)fi->fh : fs_open(m->fs, path);
+    int result = fd < 0 ? -ENOENT : fs_fstat(m->fs, fd, &st) < 0 ? -EIO : 0;
+    if (result == 0 && size < (off_t)st.fileSize)
+    {
+        result = -EOPNOTSUPP;
+    }
+    else if (result == 0 && size > (off_t)st.fileSize)
+    {
+        const char zero = 0;
+        result = fs_seek(m->fs, fd, size - 1, FS_SEEK_SET) == size - 1 && fs_write(m->fs, fd, &zero, 1) == 1 ? 0 : -ENOSPC;
+    }
+    if (fi == NULL && fd >= 0)
+    {
+        fs_close(m->fs, fd);
+    }
+    pthread_mutex_unlock(&m->lock);
+    return result;
+}
+
+static int fuse_fs_fallocate(const char *path, int mode, off_t offset, off_t length, struct fuse_file_info *fi)
+{
+    (void)path;
+    fuse_fs_t *m = mounted();
+    int result;
+    pthread_mutex_lock(&m->lock);
+    if (mode == 0)
+    {
+        result = fs_fallocate(m->fs, (int)fi->fh, offset, length) < 0 ? -ENOSPC : 0;
+    }
+    else if (mode == (FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE))
+    {
+        result = fs_punch_hole(m->fs, (int)fi->fh, offset, length) < 0 ? -EOPNOTSUPP : 0;
+    }
+    else
+    {
+        result = -EOPNOTSUPP;
+    }
+    pthread_mutex_unlock(&m->lock);
+    return result;
+}
+
+static int fuse_fs_release(const char *path, struct fuse_file_info *fi)
+{
+    (void)path;
+    fuse_fs_t *m = mounted();
+    pthread_mutex_lock(&m->lock);
+    fs_close(m->fs, (int)fi->fh);
+    pthread_mutex_unlock(&m->lock);
+    return 0;
+}
+
+// the FS cannot flush one file on its own, the whole image is written back (its metadata along with the data)
+static int fuse_fs_fsync(const char *path, int datasync, struct fuse_file_info *fi)
+{
+    (void)path;
+    (void)datasync;
+    (void)fi;
+    fuse_fs_t *m = mounted();
+    pthread_mutex_lock(&m->lock);
+    int result = fs_flush(m->fs) < 0 ? -EIO : 0;
+    pthread_mutex_unlock(&m->lock);
+    return result;
+}
+
+// the FS keeps its own times, what is asked for is accepted so touch works
+static int fuse_fs_utimens(const char *path, const struct timespec tv[2], struct fuse_file_info *fi)
+{
+    (void)tv;
+    struct stat stbuf;
+    return fuse_fs_getattr(path, &stbuf, fi);
+}
+
+static int fuse_fs_statfs(const char *path, struct statvfs *st)
+{
+    (void)path;
+    fuse_fs_t *m = mounted();
+    fs_statfs_t vol;
+    pthread_mutex_lock(&m->lock);
+    int result = fs_statfs(m->fs, &vol);
+    pthread_mutex_unlock(&m->lock);
+    if (result < 0)
+    {
+        return -EIO;
+    }
+    memset(st, 0, sizeof(struct statvfs));
+    st->f_bsize = st->f_frsize = vol.blockSize;
+    st->f_blocks = vol.totalBlocks;
+    st->f_bfree = st->f_bavail = vol.freeBlocks;
+    st->f_files = vol.totalInodes;
+    st->f_ffree = st->f_favail = vol.freeInodes;
+    st->f_namemax = FS_FNAME_MAX - 1;
+    return 0;
+}
+
+static const struct fuse_operations fuse_fs_ops = {
+    .init = fuse_fs_init,
+    .destroy = fuse_fs_destroy,
+    .getattr = fuse_fs_getattr,
+    .readdir = fuse_fs_readdir,
+    .mkdir = fuse_fs_mkdir,
+    .create = fuse_fs_create,
+    .unlink = fuse_fs_unlink,
+    .rmdir = fuse_fs_rmdir,
+    .rename = fuse_fs_rename,
+    .link = fuse_fs_link,
+    .open = fuse_fs_open,
+    .read = fuse_fs_read,
+    .write = fuse_fs_write,
+    .truncate = fuse_fs_truncate,
+    .fallocate = fuse_fs_fallocate,
+    .release = fuse_fs_release,
+    .fsync = fuse_fs_fsync,
+    .utimens = fuse_fs_utimens,
+    .statfs = fuse_fs_statfs,
+};
+
+int main(int argc, char **argv)
+{
+    if (argc < 3 || argv[1][0] == '-')
+    {
+        fprintf(stderr, "usage: %s image mountpoint [FUSE options]\n", argv[0]);
+        return 2;
+    }
+    fuse_fs_t m;
+    m.fs = access(argv[1], F_OK) == 0 ? fs_mount(argv[1]) : fs_format(argv[1]);
+    if (m.fs == NULL)
+    {
+        fprintf(stderr, "could not mount %s\n", argv[1]);
+        return 2;
+    }
+    pthread_mutex_init(&m.lock, NULL);
+    m.uid = getuid();
+    m.gid = getgid();
+
+    // FUSE gets everything but the image, and the read size the kernel needs to know at mount time
+    struct fuse_args args = FUSE_ARGS_INIT(0, NULL);
+    char max_read[32];
+    snprintf(max_read, sizeof(max_read), "-omax_read=%d", fs_fuse_max_io);
+    if (fuse_opt_add_arg(&args, argv[0]) != 0 || fuse_opt_add_arg(&args, max_read) != 0)
+    {
+        fs_unmount(m.fs);
+        return 2;
+    }
+    for (int i = 2; i < argc; i++)
+    {
+        if (fuse_opt_add_arg(&args, argv[i]) != 0)
+        {
+            fs_unmount(m.fs);
+            return 2;
+        }
+    }
+    int result = fuse_main(args.argc, args.argv, &fuse_fs_ops, &m);
+    fuse_opt_free_args(&args);
+    if (m.fs != NULL) // FUSE never got as far as mounting it
+    {
+        fs_unmount(m.fs);
+    }
+    pthread_mutex_destroy(&m.lock);
+    return result;
+}